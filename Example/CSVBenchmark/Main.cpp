@@ -0,0 +1,451 @@
+#include "SyntheticDB.h"
+#include "../CSVProcessor/CSVProcessor.h"
+#include "../CSVProcessor/CodeGenCpp.h"
+
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+
+// The timed phases of processing a DB
+enum class Phase
+{
+  ReadDB,
+  ResolveForeignLinkTypes,
+  SortTable,
+  ValidateTables,
+  SaveToString,
+  CodeGenCpp,
+  Count
+};
+
+static const char* s_phaseNames[] = { "ReadDB", "ResolveForeignLinkTypes", "SortTable", "ValidateTables", "SaveToString", "CodeGenCpp" };
+static_assert(std::size(s_phaseNames) == static_cast<size_t>(Phase::Count));
+
+struct PhaseResult
+{
+  std::string m_dbName;     // Name of the DB directory
+  std::string m_phase;      // Phase name
+  double m_seconds = 0.0;   // Fastest time of all iterations
+  double m_meanSeconds = 0.0; // Mean time of all iterations
+  uint64_t m_rows = 0;      // Total rows in all tables
+  uint64_t m_bytes = 0;     // Total bytes of all CSV files
+};
+
+struct BenchmarkOptions
+{
+  uint32_t m_iterations = 5;      // Times to run each phase
+  const char* m_jsonPath = nullptr;     // Output JSON results path (if any)
+  const char* m_baselinePath = nullptr; // Baseline JSON results to compare against (if any)
+  double m_threshold = 10.0;      // Percent slower than the baseline that is a regression
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double Seconds(Clock::time_point start, Clock::time_point end)
+{
+  return std::chrono::duration<double>(end - start).count();
+}
+
+// Run each processing phase over a DB directory and append the timings to the results
+static bool RunBenchmark(const std::filesystem::path& dbPath, const BenchmarkOptions& options, std::vector<PhaseResult>& outResults)
+{
+  std::string dbName = dbPath.filename().string();
+  if (dbName.empty())
+  {
+    dbName = dbPath.parent_path().filename().string();
+  }
+
+  // Code gen output goes to a temporary directory that is cleared each iteration
+  std::error_code error;
+  std::filesystem::path genPath = std::filesystem::temp_directory_path(error) / ("CSVBenchmarkGen_" + dbName);
+
+  double times[static_cast<size_t>(Phase::Count)][2] = {}; // Min and total
+  uint64_t rows = 0;
+  uint64_t bytes = 0;
+  std::vector<std::string> existingFiles;
+  for (uint32_t iter = 0; iter < options.m_iterations; iter++)
+  {
+    double phaseSeconds[static_cast<size_t>(Phase::Count)] = {};
+    Clock::time_point start = Clock::now();
+    auto endPhase = [&](Phase phase)
+    {
+      Clock::time_point now = Clock::now();
+      phaseSeconds[static_cast<size_t>(phase)] = Seconds(start, now);
+      start = now;
+    };
+
+    DBTables db;
+    if (!ReadDB(dbPath.string().c_str(), db))
+    {
+      return false;
+    }
+    endPhase(Phase::ReadDB);
+
+    if (!ResolveForeignLinkTypes(db))
+    {
+      return false;
+    }
+    endPhase(Phase::ResolveForeignLinkTypes);
+
+    for (auto& [tableName, table] : db.m_tables)
+    {
+      if (!SortTable(table))
+      {
+        OutputMessage("Error: Table {} failed to sort", tableName);
+        return false;
+      }
+    }
+    endPhase(Phase::SortTable);
+
+    if (!ValidateTables(db.m_tables))
+    {
+      return false;
+    }
+    endPhase(Phase::ValidateTables);
+
+    // Get the existing file contents and the DB size (not timed)
+    if (iter == 0)
+    {
+      existingFiles.resize(db.m_csvFilePaths.size());
+      for (size_t i = 0; i < db.m_csvFilePaths.size(); i++)
+      {
+        if (!ReadToString(db.m_csvFilePaths[i], existingFiles[i]))
+        {
+          return false;
+        }
+      }
+      for (const auto& path : db.m_csvEnumFilePaths)
+      {
+        bytes += std::filesystem::file_size(path, error);
+      }
+      for (const auto& path : db.m_csvFilePaths)
+      {
+        bytes += std::filesystem::file_size(path, error);
+      }
+      for (const auto& [tableName, table] : db.m_tables)
+      {
+        rows += table.m_rowData.size();
+      }
+    }
+    start = Clock::now();
+
+    std::string outFile;
+    for (size_t i = 0; i < db.m_csvFilePaths.size(); i++)
+    {
+      outFile.clear();
+      SaveToString(db.m_tables[GetTableName(db.m_csvFilePaths[i])], db.m_tables, existingFiles[i], outFile, db.m_csvFileShards[i]);
+    }
+    endPhase(Phase::SaveToString);
+
+    std::filesystem::remove_all(genPath, error);
+    std::filesystem::create_directories(genPath, error);
+    start = Clock::now();
+    if (!CodeGenCpp(genPath.string().c_str(), db.m_tables, db.m_tablesEnumRaw))
+    {
+      return false;
+    }
+    endPhase(Phase::CodeGenCpp);
+
+    for (size_t p = 0; p < static_cast<size_t>(Phase::Count); p++)
+    {
+      times[p][0] = (iter == 0) ? phaseSeconds[p] : std::min(times[p][0], phaseSeconds[p]);
+      times[p][1] += phaseSeconds[p];
+    }
+  }
+  std::filesystem::remove_all(genPath, error);
+
+  for (size_t p = 0; p < static_cast<size_t>(Phase::Count); p++)
+  {
+    PhaseResult& result = outResults.emplace_back();
+    result.m_dbName = dbName;
+    result.m_phase = s_phaseNames[p];
+    result.m_seconds = times[p][0];
+    result.m_meanSeconds = times[p][1] / std::max(options.m_iterations, 1u);
+    result.m_rows = rows;
+    result.m_bytes = bytes;
+  }
+  return true;
+}
+
+static double PerSecond(double value, double seconds)
+{
+  return seconds > 0.0 ? value / seconds : 0.0;
+}
+
+// Write the results as JSON with one result object per line
+static bool WriteJson(const char* path, const std::vector<PhaseResult>& results)
+{
+  std::string json = "{\n  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const PhaseResult& result = results[i];
+    json += std::format("    {{\"db\": \"{}\", \"phase\": \"{}\", \"seconds\": {:.6f}, \"meanSeconds\": {:.6f}, \"rows\": {}, \"bytes\": {}, \"rowsPerSec\": {:.1f}, \"mbPerSec\": {:.3f}}}{}\n",
+      result.m_dbName, result.m_phase, result.m_seconds, result.m_meanSeconds, result.m_rows, result.m_bytes,
+      PerSecond(static_cast<double>(result.m_rows), result.m_seconds), PerSecond(result.m_bytes / (1024.0 * 1024.0), result.m_seconds),
+      (i + 1 < results.size()) ? "," : "");
+  }
+  json += "  ]\n}\n";
+
+  std::ofstream file(path, std::ios::binary);
+  if (!file.is_open() ||
+      !file.write(json.data(), json.size()))
+  {
+    OutputMessage("Error: Unable to write file {}", path);
+    return false;
+  }
+  return true;
+}
+
+// Get a value from a single line JSON object written by WriteJson()
+static bool GetJsonValue(std::string_view line, std::string_view key, std::string_view& outValue)
+{
+  std::string search = "\"" + std::string(key) + "\": ";
+  size_t start = line.find(search);
+  if (start == std::string_view::npos)
+  {
+    return false;
+  }
+  line.remove_prefix(start + search.size());
+  if (line.starts_with('"'))
+  {
+    outValue = line.substr(1, line.find('"', 1) - 1);
+  }
+  else
+  {
+    outValue = line.substr(0, line.find_first_of(",}"));
+  }
+  return true;
+}
+
+// Compare the results against a baseline JSON file. Returns false if the baseline could not be read.
+static bool CompareBaseline(const char* path, const std::vector<PhaseResult>& results, double threshold, uint32_t& outRegressions)
+{
+  outRegressions = 0;
+  std::string baselineData;
+  if (!ReadToString(path, baselineData))
+  {
+    return false;
+  }
+
+  std::string_view baseline(baselineData);
+  while (baseline.size() > 0)
+  {
+    std::string_view line = baseline.substr(0, baseline.find('\n'));
+    baseline.remove_prefix(std::min(baseline.size(), line.size() + 1));
+
+    std::string_view dbName;
+    std::string_view phase;
+    std::string_view secondsStr;
+    if (!GetJsonValue(line, "db", dbName) ||
+        !GetJsonValue(line, "phase", phase) ||
+        !GetJsonValue(line, "seconds", secondsStr))
+    {
+      continue;
+    }
+    double baseSeconds = std::strtod(std::string(secondsStr).c_str(), nullptr);
+
+    auto findResult = std::find_if(results.begin(), results.end(), [&](const PhaseResult& result) { return result.m_dbName == dbName && result.m_phase == phase; });
+    if (findResult == results.end() || baseSeconds <= 0.0)
+    {
+      continue;
+    }
+
+    double change = (findResult->m_seconds / baseSeconds - 1.0) * 100.0;
+    if (change > threshold)
+    {
+      OutputMessage("Regression: {} {} {:.3f}ms -> {:.3f}ms (+{:.1f}%)", dbName, phase, baseSeconds * 1000.0, findResult->m_seconds * 1000.0, change);
+      outRegressions++;
+    }
+    else if (change < -threshold)
+    {
+      OutputMessage("Improvement: {} {} {:.3f}ms -> {:.3f}ms ({:.1f}%)", dbName, phase, baseSeconds * 1000.0, findResult->m_seconds * 1000.0, change);
+    }
+  }
+  return true;
+}
+
+// Parse a synthetic DB option, returns false if not a generator option
+static bool ParseGenerateOption(std::string_view arg, const char* value, SyntheticDBOptions& options, bool& outError)
+{
+  auto toUInt = [value]() { return static_cast<uint32_t>(std::strtoul(value, nullptr, 10)); };
+  outError = false;
+  const char* names[] = { "--tables", "--rows", "--columns", "--keys", "--links", "--enums", "--enum-size", "--enum-columns", "--seed", "--quoted", "--types" };
+  if (std::find(std::begin(names), std::end(names), arg) == std::end(names))
+  {
+    return false;
+  }
+  if (!value)
+  {
+    OutputMessage("Error: Missing value for option {}", arg);
+    outError = true;
+    return true;
+  }
+
+  if (arg == "--tables")            { options.m_tableCount = toUInt(); }
+  else if (arg == "--rows")         { options.m_rowCount = toUInt(); }
+  else if (arg == "--columns")      { options.m_columnCount = toUInt(); }
+  else if (arg == "--keys")         { options.m_keyCount = toUInt(); }
+  else if (arg == "--links")        { options.m_linkCount = toUInt(); }
+  else if (arg == "--enums")        { options.m_enumCount = toUInt(); }
+  else if (arg == "--enum-size")    { options.m_enumSize = toUInt(); }
+  else if (arg == "--enum-columns") { options.m_enumColumnCount = toUInt(); }
+  else if (arg == "--seed")         { options.m_seed = toUInt(); }
+  else if (arg == "--quoted")       { options.m_quotedRatio = std::strtof(value, nullptr); }
+  else if (arg == "--types")        { outError = !ParseTypeWeights(value, options.m_typeWeights); }
+  return true;
+}
+
+// Parse a benchmark run option, returns false if not a run option
+static bool ParseRunOption(std::string_view arg, const char* value, BenchmarkOptions& options, bool& outError)
+{
+  outError = false;
+  if (arg != "--iterations" && arg != "--json" && arg != "--baseline" && arg != "--threshold")
+  {
+    return false;
+  }
+  if (!value)
+  {
+    OutputMessage("Error: Missing value for option {}", arg);
+    outError = true;
+    return true;
+  }
+
+  if (arg == "--iterations")     { options.m_iterations = std::max(1u, static_cast<uint32_t>(std::strtoul(value, nullptr, 10))); }
+  else if (arg == "--json")      { options.m_jsonPath = value; }
+  else if (arg == "--baseline")  { options.m_baselinePath = value; }
+  else if (arg == "--threshold") { options.m_threshold = std::strtod(value, nullptr); }
+  return true;
+}
+
+static void PrintUsage()
+{
+  OutputMessage("Usage:");
+  OutputMessage("  CSVBenchmark generate <output_directory> [generator options]");
+  OutputMessage("  CSVBenchmark run <db_directory>... [run options]");
+  OutputMessage("  CSVBenchmark suite <work_directory> [run options]   Generate the standard DB set and run over each");
+  OutputMessage("Generator options:");
+  OutputMessage("  --tables N --rows N --columns N --keys N --links N --enums N --enum-size N --enum-columns N");
+  OutputMessage("  --quoted <ratio> --types <type:weight,...> --seed N --sorted");
+  OutputMessage("Run options:");
+  OutputMessage("  --iterations N  --json <results.json>  --baseline <baseline.json>  --threshold <percent>");
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3)
+  {
+    PrintUsage();
+    return 1;
+  }
+
+  std::string_view mode = argv[1];
+  SyntheticDBOptions generateOptions;
+  BenchmarkOptions runOptions;
+  std::vector<std::filesystem::path> dirPaths;
+  for (int i = 2; i < argc; i++)
+  {
+    std::string_view arg = argv[i];
+    const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    bool isError = false;
+    if (arg == "--sorted" && mode == "generate")
+    {
+      generateOptions.m_sortedRows = true;
+    }
+    else if ((mode == "generate" && ParseGenerateOption(arg, value, generateOptions, isError)) ||
+             (mode != "generate" && ParseRunOption(arg, value, runOptions, isError)))
+    {
+      if (isError)
+      {
+        return 1;
+      }
+      i++;
+    }
+    else if (arg.starts_with("--"))
+    {
+      OutputMessage("Error: Unknown option {}", arg);
+      return 1;
+    }
+    else
+    {
+      dirPaths.push_back(argv[i]);
+    }
+  }
+
+  if (dirPaths.size() == 0)
+  {
+    PrintUsage();
+    return 1;
+  }
+
+  if (mode == "generate")
+  {
+    return WriteSyntheticDB(dirPaths[0], generateOptions) ? 0 : 1;
+  }
+
+  if (mode == "suite")
+  {
+    // The standard set of DBs to measure different processing costs
+    std::vector<std::pair<std::string, SyntheticDBOptions>> suite;
+    suite.emplace_back("Small", SyntheticDBOptions{ .m_tableCount = 4, .m_rowCount = 1000 });
+    suite.emplace_back("Large", SyntheticDBOptions{ .m_tableCount = 8, .m_rowCount = 50000 });
+    suite.emplace_back("Wide", SyntheticDBOptions{ .m_tableCount = 4, .m_rowCount = 10000, .m_columnCount = 64 });
+    suite.emplace_back("Composite", SyntheticDBOptions{ .m_tableCount = 8, .m_rowCount = 20000, .m_keyCount = 3, .m_linkCount = 3 });
+    suite.emplace_back("Linked", SyntheticDBOptions{ .m_tableCount = 16, .m_rowCount = 10000, .m_linkCount = 6, .m_enumCount = 8, .m_enumSize = 200, .m_enumColumnCount = 4 });
+    suite.emplace_back("Quoted", SyntheticDBOptions{ .m_tableCount = 4, .m_rowCount = 20000, .m_quotedRatio = 0.5f, .m_typeWeights = { {"", 1} } });
+
+    std::filesystem::path workPath = dirPaths[0];
+    dirPaths.clear();
+    for (const auto& [name, options] : suite)
+    {
+      dirPaths.push_back(workPath / name);
+      if (!WriteSyntheticDB(dirPaths.back(), options))
+      {
+        return 1;
+      }
+    }
+  }
+  else if (mode != "run")
+  {
+    OutputMessage("Error: Unknown mode {}", mode);
+    PrintUsage();
+    return 1;
+  }
+
+  std::vector<PhaseResult> results;
+  for (const std::filesystem::path& dirPath : dirPaths)
+  {
+    if (!RunBenchmark(dirPath, runOptions, results))
+    {
+      OutputMessage("Error: Benchmark failed on {}", dirPath.string());
+      return 1;
+    }
+  }
+
+  for (const PhaseResult& result : results)
+  {
+    OutputMessage("{} {} {:.3f}ms  {:.0f} rows/s  {:.2f} MB/s", result.m_dbName, result.m_phase, result.m_seconds * 1000.0,
+      PerSecond(static_cast<double>(result.m_rows), result.m_seconds), PerSecond(result.m_bytes / (1024.0 * 1024.0), result.m_seconds));
+  }
+
+  if (runOptions.m_jsonPath && !WriteJson(runOptions.m_jsonPath, results))
+  {
+    return 1;
+  }
+
+  // Return a different error code for regressions so scripts can tell them apart from failures
+  if (runOptions.m_baselinePath)
+  {
+    uint32_t regressions = 0;
+    if (!CompareBaseline(runOptions.m_baselinePath, results, runOptions.m_threshold, regressions))
+    {
+      return 1;
+    }
+    if (regressions > 0)
+    {
+      OutputMessage("{} regressions over {}% against the baseline", regressions, runOptions.m_threshold);
+      return 2;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,340 @@
+#include "SyntheticDB.h"
+#include "../CSVProcessor/CSVProcessor.h"
+
+#include <fstream>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+bool ParseTypeWeights(std::string_view typeMix, std::vector<std::pair<std::string, uint32_t>>& outWeights)
+{
+  outWeights.clear();
+  while (typeMix.size() > 0)
+  {
+    std::string_view entry = typeMix.substr(0, typeMix.find(','));
+    typeMix.remove_prefix(std::min(typeMix.size(), entry.size() + 1));
+
+    size_t split = entry.find(':');
+    std::string type(entry.substr(0, split));
+    uint32_t weight = 1;
+    if (split != std::string_view::npos)
+    {
+      weight = static_cast<uint32_t>(std::strtoul(std::string(entry.substr(split + 1)).c_str(), nullptr, 10));
+    }
+
+    // Check the type is a valid column type tag
+    FieldType checkType;
+    if (type == "string")
+    {
+      type.clear();
+    }
+    else if (!GetColumnType(type, checkType))
+    {
+      OutputMessage("Error: Unknown column type {} in type mix", type);
+      return false;
+    }
+    if (weight > 0)
+    {
+      outWeights.emplace_back(type, weight);
+    }
+  }
+
+  if (outWeights.size() == 0)
+  {
+    OutputMessage("Error: Empty column type mix");
+    return false;
+  }
+  return true;
+}
+
+// Write a random value of a column type tag
+static void AppendRandomValue(const std::string& type, float quotedRatio, std::mt19937& rng, std::string& out)
+{
+  if (type.empty())
+  {
+    static const char* s_words[] = { "Alpha", "Bravo", "Charlie", "Delta", "Echo", "Foxtrot", "Golf", "Hotel", "India", "Juliet" };
+    std::string_view word1 = s_words[rng() % std::size(s_words)];
+    std::string_view word2 = s_words[rng() % std::size(s_words)];
+    uint32_t number = rng() % 10000;
+    if (static_cast<float>(rng() % 10000) < quotedRatio * 10000.0f)
+    {
+      // Comma and escaped quotes so the field needs quoting
+      out += "\"";
+      out += word1;
+      out += ", \"\"";
+      out += word2;
+      out += "\"\" ";
+      out += std::to_string(number);
+      out += "\"";
+    }
+    else
+    {
+      out += word1;
+      out += " ";
+      out += word2;
+      out += " ";
+      out += std::to_string(number);
+    }
+  }
+  else if (type == "bool")
+  {
+    out += (rng() & 1) ? "1" : "0";
+  }
+  else if (type == "int8")
+  {
+    out += std::to_string(static_cast<int32_t>(rng() % 256) - 128);
+  }
+  else if (type == "uint8")
+  {
+    out += std::to_string(rng() % 256);
+  }
+  else if (type == "int16")
+  {
+    out += std::to_string(static_cast<int32_t>(rng() % 65536) - 32768);
+  }
+  else if (type == "uint16")
+  {
+    out += std::to_string(rng() % 65536);
+  }
+  else if (type == "int32" || type == "int64")
+  {
+    out += std::to_string(static_cast<int32_t>(rng()));
+  }
+  else if (type == "uint32")
+  {
+    out += std::to_string(static_cast<uint32_t>(rng()));
+  }
+  else if (type == "uint64")
+  {
+    // Draw the halves in order, the order of the calls in a single expression is unspecified
+    const uint64_t high = rng();
+    const uint64_t low = rng();
+    out += std::to_string((high << 32) | low);
+  }
+  else
+  {
+    // Float values with a single decimal place
+    out += std::to_string(static_cast<int32_t>(rng() % 200000) - 100000);
+    out += ".";
+    out += std::to_string(rng() % 10);
+  }
+}
+
+// Write the key values of a row index
+static void AppendKeyValues(uint32_t rowIndex, uint32_t keyCount, uint32_t keyBase, std::string& out)
+{
+  // Each key column is a digit of the row index, with the first key column as the most significant
+  std::vector<uint32_t> digits(keyCount);
+  for (uint32_t k = keyCount; k > 0; k--)
+  {
+    digits[k - 1] = rowIndex % keyBase;
+    rowIndex /= keyBase;
+  }
+
+  // The first key is a zero padded string so the string order is the same as the row order
+  std::string digit = std::to_string(digits[0]);
+  out += "Row";
+  out.append(std::to_string(keyBase - 1).size() - digit.size(), '0');
+  out += digit;
+  for (uint32_t k = 1; k < keyCount; k++)
+  {
+    out += ",";
+    out += std::to_string(digits[k]);
+  }
+}
+
+// File marking a directory as written by the generator, that can be written over
+static constexpr char c_markerFileName[] = "SyntheticDB.marker";
+
+static bool WriteFile(const std::filesystem::path& path, const std::string& contents)
+{
+  std::ofstream file(path, std::ios::binary);
+  if (!file.is_open() ||
+      !file.write(contents.data(), contents.size()))
+  {
+    OutputMessage("Error: Unable to write file {}", path.string());
+    return false;
+  }
+  return true;
+}
+
+bool WriteSyntheticDB(const std::filesystem::path& dirPath, const SyntheticDBOptions& options)
+{
+  if (options.m_keyCount == 0 ||
+      options.m_rowCount == 0 ||
+      options.m_typeWeights.size() == 0 ||
+      (options.m_enumColumnCount > 0 && options.m_enumCount == 0))
+  {
+    OutputMessage("Error: Invalid synthetic DB options");
+    return false;
+  }
+
+  // Create the directory, or only reuse a directory written by the generator, so the tables of a DB are never removed
+  std::error_code error;
+  const std::filesystem::path markerPath = dirPath / c_markerFileName;
+  if (std::filesystem::exists(dirPath, error) &&
+      !std::filesystem::is_empty(dirPath, error) &&
+      !std::filesystem::is_regular_file(markerPath, error))
+  {
+    OutputMessage("Error: {} is not empty and was not written by the generator", dirPath.string());
+    return false;
+  }
+  std::filesystem::create_directories(dirPath, error);
+  if (!std::filesystem::is_directory(dirPath, error))
+  {
+    OutputMessage("Error: Unable to create directory {}", dirPath.string());
+    return false;
+  }
+  if (!WriteFile(markerPath, "Synthetic DB written by CSVBenchmark generate\n"))
+  {
+    return false;
+  }
+
+  // Remove the tables of the previous run
+  for (const auto& entry : std::filesystem::directory_iterator(dirPath))
+  {
+    if (entry.is_regular_file() && entry.path().extension() == ".csv")
+    {
+      std::filesystem::remove(entry.path(), error);
+    }
+  }
+
+  std::mt19937 rng(options.m_seed);
+  std::string fileData;
+
+  // Write the enum tables
+  const uint32_t enumSize = std::max(options.m_enumSize, 1u);
+  for (uint32_t e = 0; e < options.m_enumCount; e++)
+  {
+    fileData = enumSize <= 256 ? "Name key,Value uint8,Comment\n" : "Name key,Value uint16,Comment\n";
+    fileData += "None,0,No value\n";
+    for (uint32_t v = 1; v < enumSize; v++)
+    {
+      fileData += "Value" + std::to_string(v) + "," + std::to_string(v) + ",Enum value " + std::to_string(v) + "\n";
+    }
+    if (!WriteFile(dirPath / ("EnumSynth" + std::to_string(e) + ".csv"), fileData))
+    {
+      return false;
+    }
+  }
+
+  // Get the number base of the key columns so that each row has unique keys
+  uint32_t keyBase = std::max(2u, static_cast<uint32_t>(std::ceil(std::pow(static_cast<double>(std::max(options.m_rowCount, 1u)), 1.0 / options.m_keyCount))));
+  while (std::pow(static_cast<double>(keyBase), options.m_keyCount) < options.m_rowCount)
+  {
+    keyBase++;
+  }
+
+  uint32_t totalTypeWeight = 0;
+  for (const auto& [type, weight] : options.m_typeWeights)
+  {
+    totalTypeWeight += weight;
+  }
+
+  std::vector<uint32_t> rowOrder(options.m_rowCount);
+  for (uint32_t t = 0; t < options.m_tableCount; t++)
+  {
+    // Links only go to earlier tables so there are no table cycles
+    std::vector<uint32_t> linkTables;
+    for (uint32_t l = 0; t > 0 && l < options.m_linkCount; l++)
+    {
+      linkTables.push_back(rng() % t);
+    }
+    std::vector<uint32_t> enumTables;
+    for (uint32_t e = 0; e < options.m_enumColumnCount; e++)
+    {
+      enumTables.push_back(rng() % options.m_enumCount);
+    }
+    std::vector<std::string> valueTypes;
+    for (uint32_t c = 0; c < options.m_columnCount; c++)
+    {
+      uint32_t pick = rng() % totalTypeWeight;
+      for (const auto& [type, weight] : options.m_typeWeights)
+      {
+        if (pick < weight)
+        {
+          valueTypes.push_back(type);
+          break;
+        }
+        pick -= weight;
+      }
+    }
+
+    // Write the header
+    fileData = "Name key";
+    for (uint32_t k = 1; k < options.m_keyCount; k++)
+    {
+      fileData += ",Key" + std::to_string(k) + " key uint32";
+    }
+    for (uint32_t l = 0; l < linkTables.size(); l++)
+    {
+      std::string linkTable = "Table" + std::to_string(linkTables[l]);
+      if (options.m_keyCount == 1)
+      {
+        fileData += ",Link" + std::to_string(l) + " +" + linkTable;
+      }
+      else
+      {
+        fileData += ",Link" + std::to_string(l) + ":Name +" + linkTable;
+        for (uint32_t k = 1; k < options.m_keyCount; k++)
+        {
+          fileData += ",Link" + std::to_string(l) + ":Key" + std::to_string(k) + " +" + linkTable;
+        }
+      }
+    }
+    for (uint32_t e = 0; e < enumTables.size(); e++)
+    {
+      fileData += ",Enum" + std::to_string(e) + " +EnumSynth" + std::to_string(enumTables[e]);
+    }
+    for (uint32_t c = 0; c < valueTypes.size(); c++)
+    {
+      fileData += ",Value" + std::to_string(c);
+      if (valueTypes[c].size() > 0)
+      {
+        fileData += " " + valueTypes[c];
+      }
+    }
+    fileData += "\n";
+
+    // Write the rows
+    for (uint32_t r = 0; r < options.m_rowCount; r++)
+    {
+      rowOrder[r] = r;
+    }
+    if (!options.m_sortedRows)
+    {
+      // Fisher-Yates with the raw generator output, as std::shuffle is implemented differently by each standard library
+      for (uint32_t r = options.m_rowCount - 1; r > 0; r--)
+      {
+        std::swap(rowOrder[r], rowOrder[rng() % (r + 1)]);
+      }
+    }
+    for (uint32_t r : rowOrder)
+    {
+      AppendKeyValues(r, options.m_keyCount, keyBase, fileData);
+      for (uint32_t l = 0; l < linkTables.size(); l++)
+      {
+        fileData += ",";
+        AppendKeyValues(rng() % options.m_rowCount, options.m_keyCount, keyBase, fileData);
+      }
+      for (uint32_t e = 0; e < enumTables.size(); e++)
+      {
+        uint32_t value = rng() % enumSize;
+        fileData += value == 0 ? ",None" : ",Value" + std::to_string(value);
+      }
+      for (const std::string& type : valueTypes)
+      {
+        fileData += ",";
+        AppendRandomValue(type, options.m_quotedRatio, rng, fileData);
+      }
+      fileData += "\n";
+    }
+
+    if (!WriteFile(dirPath / ("Table" + std::to_string(t) + ".csv"), fileData))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+struct SyntheticDBOptions
+{
+  uint32_t m_tableCount = 8;      // Number of regular tables
+  uint32_t m_rowCount = 10000;    // Rows per table
+  uint32_t m_columnCount = 8;     // Value columns per table (not including keys and links)
+  uint32_t m_keyCount = 1;        // Key columns per table (composite keys if > 1)
+  uint32_t m_linkCount = 1;       // Links from each table to earlier tables (link fan-out)
+  uint32_t m_enumCount = 2;       // Number of enum tables
+  uint32_t m_enumSize = 16;       // Values per enum table
+  uint32_t m_enumColumnCount = 1; // Enum columns per table
+  float m_quotedRatio = 0.1f;     // Ratio of string values that contain characters that need quoting
+  bool m_sortedRows = false;      // Write rows in key order (otherwise shuffled so sorting has work to do)
+  uint32_t m_seed = 1;            // Random seed, the same options and seed always generate the same files
+
+  // Weights of each column type tag for value columns ("" is a string column)
+  std::vector<std::pair<std::string, uint32_t>> m_typeWeights = { {"", 3}, {"bool", 1}, {"uint8", 1}, {"int16", 1}, {"int32", 2}, {"uint64", 1}, {"float32", 2}, {"float64", 1} };
+};
+
+// Parse a type mix string in the format "type:weight,type:weight" (eg "string:3,int32:2,float32:1")
+bool ParseTypeWeights(std::string_view typeMix, std::vector<std::pair<std::string, uint32_t>>& outWeights);
+
+// Write a directory of synthetic CSV tables. The directory needs to be empty or written by the generator before
+// (it has the marker file), then any existing CSV files in it are removed first.
+bool WriteSyntheticDB(const std::filesystem::path& dirPath, const SyntheticDBOptions& options);
@@ -0,0 +1,218 @@
+#include "CSVTableModel.h"
+
+#include <algorithm>
+
+// Rows added to the view each fetch
+static constexpr int s_fetchPageRows = 4096;
+
+CSVTableModel::CSVTableModel(CSVTableState& state, QObject *parent)
+    : QAbstractTableModel(parent)
+    , m_state(state)
+{
+    buildRows();
+}
+
+int CSVTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_fetchedCount;
+}
+
+int CSVTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(m_state.m_table->m_headerData.size());
+}
+
+size_t CSVTableModel::tableRow(int row) const
+{
+    if (m_isPermuted)
+    {
+        return m_rows[row];
+    }
+    return m_isReversed ? m_totalCount - 1 - size_t(row) : size_t(row);
+}
+
+QVariant CSVTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || (role != Qt::DisplayRole && role != Qt::EditRole))
+    {
+        return QVariant();
+    }
+
+    const FieldType& field = m_state.m_table->m_rowData[tableRow(index.row())][index.column()];
+    if (const FieldString* string = std::get_if<FieldString>(&field))
+    {
+        return QString::fromUtf8(string->data(), qsizetype(string->size()));
+    }
+    std::string text;
+    AppendToString(field, text);
+    return QString::fromStdString(text);
+}
+
+QVariant CSVTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Vertical)
+    {
+        return role == Qt::DisplayRole ? QVariant(section + 1) : QVariant();
+    }
+
+    const CSVHeader& header = m_state.m_table->m_headerData[section];
+    if (role == Qt::DisplayRole)
+    {
+        return QString::fromStdString(header.m_name);
+    }
+    if (role == Qt::ToolTipRole)
+    {
+        return QString::fromStdString(header.m_rawField);
+    }
+    return QVariant();
+}
+
+Qt::ItemFlags CSVTableModel::flags(const QModelIndex &index) const
+{
+    Qt::ItemFlags itemFlags = QAbstractTableModel::flags(index);
+
+    // Keys set the row order, so are edited with SQL where duplicates are checked
+    if (index.isValid() && !m_state.m_table->m_headerData[index.column()].m_isKey)
+    {
+        itemFlags |= Qt::ItemIsEditable;
+    }
+    return itemFlags;
+}
+
+bool CSVTableModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid() || role != Qt::EditRole || m_state.m_table->m_headerData[index.column()].m_isKey)
+    {
+        return false;
+    }
+
+    CSVTable& table = *m_state.m_table;
+    std::string text = value.toString().toStdString();
+    FieldType field;
+    if (!ParseField(table.m_headerData[index.column()].m_type, text, field, table.GetArena()))
+    {
+        return false;
+    }
+
+    table.m_rowData[tableRow(index.row())][index.column()] = std::move(field);
+    emit dataChanged(index, index, {Qt::DisplayRole, Qt::EditRole});
+    return true;
+}
+
+bool CSVTableModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && size_t(m_fetchedCount) < m_totalCount;
+}
+
+void CSVTableModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid())
+    {
+        return;
+    }
+    const int fetchCount = int(std::min<size_t>(s_fetchPageRows, m_totalCount - m_fetchedCount));
+    if (fetchCount <= 0)
+    {
+        return;
+    }
+    beginInsertRows(QModelIndex(), m_fetchedCount, m_fetchedCount + fetchCount - 1);
+    m_fetchedCount += fetchCount;
+    endInsertRows();
+}
+
+void CSVTableModel::sort(int column, Qt::SortOrder order)
+{
+    beginResetModel();
+    m_sortColumn = column;
+    m_sortOrder = order;
+    buildRows();
+    endResetModel();
+}
+
+void CSVTableModel::setFilter(const QString &filter)
+{
+    beginResetModel();
+    m_filter = filter.toStdString();
+    buildRows();
+    endResetModel();
+}
+
+void CSVTableModel::refresh()
+{
+    beginResetModel();
+    buildRows();
+    endResetModel();
+}
+
+void CSVTableModel::buildRows()
+{
+    // Rows edited with SQL are only in key order once the table is compacted, until then the rows are permuted
+    const CSVTable& table = *m_state.m_table;
+    const CSVRows& rows = table.m_rowData;
+    const bool isKeyOrder = m_state.m_deletedCount == 0 && m_state.m_sortedCount == rows.size();
+    const bool isFirstKeySort = m_sortColumn < 0 || (table.m_keyColumns.size() > 0 && m_sortColumn == int(table.m_keyColumns[0]));
+
+    m_rows.clear();
+    m_rows.shrink_to_fit();
+    m_isReversed = isFirstKeySort && m_sortColumn >= 0 && m_sortOrder == Qt::DescendingOrder;
+    m_isPermuted = !isKeyOrder || !isFirstKeySort || !m_filter.empty();
+
+    if (!m_isPermuted)
+    {
+        m_totalCount = rows.size();
+    }
+    else
+    {
+        // Keep the rows that are not deleted and have a key column that contains the filter
+        std::string keyText;
+        m_rows.reserve(m_filter.empty() ? rows.size() : 0);
+        for (size_t r = 0; r < rows.size(); r++)
+        {
+            if (m_state.m_isDeleted[r])
+            {
+                continue;
+            }
+            bool isMatch = m_filter.empty();
+            for (size_t k = 0; k < table.m_keyColumns.size() && !isMatch; k++)
+            {
+                const FieldType& field = rows[r][table.m_keyColumns[k]];
+                if (const FieldString* string = std::get_if<FieldString>(&field))
+                {
+                    isMatch = string->find(m_filter) != std::string::npos;
+                }
+                else
+                {
+                    keyText.clear();
+                    AppendToString(field, keyText);
+                    isMatch = keyText.find(m_filter) != std::string::npos;
+                }
+            }
+            if (isMatch)
+            {
+                m_rows.push_back(uint32_t(r));
+            }
+        }
+
+        // Rows are in key order, so a stable sort keeps equal values in key order
+        const bool isSorted = m_state.m_sortedCount == rows.size();
+        if (m_sortColumn >= 0 && !(isFirstKeySort && isSorted))
+        {
+            const uint32_t column = uint32_t(m_sortColumn);
+            if (m_sortOrder == Qt::AscendingOrder)
+            {
+                std::stable_sort(m_rows.begin(), m_rows.end(), [&rows, column](uint32_t a, uint32_t b) { return rows[a][column] < rows[b][column]; });
+            }
+            else
+            {
+                std::stable_sort(m_rows.begin(), m_rows.end(), [&rows, column](uint32_t a, uint32_t b) { return rows[b][column] < rows[a][column]; });
+            }
+        }
+        else if (m_isReversed)
+        {
+            std::reverse(m_rows.begin(), m_rows.end());
+        }
+        m_totalCount = m_rows.size();
+    }
+
+    m_fetchedCount = int(std::min<size_t>(s_fetchPageRows, m_totalCount));
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "CSVVirtualTable.h"
+
+#include <QAbstractTableModel>
+
+// Table model directly over the rows of a loaded CSV table.
+// Cells are only converted to strings when the view asks for them (the visible rows), and rows are fetched in pages.
+// Sorting and filtering build an index permutation of the table rows, the rows themselves are not copied or moved.
+// Without a sort or filter (or sorted by the first key) the rows are shown in table order and no permutation is kept.
+class CSVTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    CSVTableModel(CSVTableState& state, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
+
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+    // Only show the rows with a key column containing the text
+    void setFilter(const QString &filter);
+
+    // Rebuild the shown rows after the table was changed outside of the model (eg. by SQL)
+    void refresh();
+
+private:
+    size_t tableRow(int row) const;
+    void buildRows();
+
+    CSVTableState& m_state;
+    std::vector<uint32_t> m_rows;   // Table row of each shown row, when sorted or filtered
+    bool m_isPermuted = false;      // If the rows are shown through m_rows, instead of in table order
+    bool m_isReversed = false;      // If the table order is shown reversed (sorted by the first key descending)
+    size_t m_totalCount = 0;        // Number of rows that can be shown
+    int m_fetchedCount = 0;         // Number of rows fetched into the view
+
+    int m_sortColumn = -1;
+    Qt::SortOrder m_sortOrder = Qt::AscendingOrder;
+    std::string m_filter;
+};
@@ -0,0 +1,683 @@
+#include "CSVVirtualTable.h"
+
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Flags of the plan in idxNum. The low byte is the number of leading key columns with an equality constraint.
+static constexpr int s_idxEqualMask = 0xff;
+static constexpr int s_idxLower = 0x100;
+static constexpr int s_idxLowerInclusive = 0x200;
+static constexpr int s_idxUpper = 0x400;
+static constexpr int s_idxUpperInclusive = 0x800;
+
+struct CSVVTab : sqlite3_vtab
+{
+    CSVTableState* m_state = nullptr;
+};
+
+struct CSVCursor : sqlite3_vtab_cursor
+{
+    size_t m_row = 0;       // Current row
+    size_t m_sortedEnd = 0; // End of the key range in the sorted rows, the inserted rows are scanned after
+};
+
+static CSVTableState& GetState(sqlite3_vtab* vtab)
+{
+    return *static_cast<CSVVTab*>(vtab)->m_state;
+}
+
+static void SetError(sqlite3_vtab* vtab, const std::string& message)
+{
+    sqlite3_free(vtab->zErrMsg);
+    vtab->zErrMsg = sqlite3_mprintf("%s", message.c_str());
+}
+
+// Compare the leading key columns of the row to the values
+static int CompareKeys(const CSVTable& table, const CSVRow& row, const std::vector<FieldType>& values)
+{
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        const FieldType& field = row[table.m_keyColumns[i]];
+        if (field < values[i])
+        {
+            return -1;
+        }
+        if (field != values[i])
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static bool KeysEqual(const CSVTable& table, const CSVRow& a, const CSVRow& b)
+{
+    for (uint32_t index : table.m_keyColumns)
+    {
+        if (a[index] != b[index])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool KeysLess(const CSVTable& table, const CSVRow& a, const CSVRow& b)
+{
+    for (uint32_t index : table.m_keyColumns)
+    {
+        if (a[index] < b[index])
+        {
+            return true;
+        }
+        if (a[index] != b[index])
+        {
+            break;
+        }
+    }
+    return false;
+}
+
+// Get a constraint value as the exact column type, fails if the value would not compare the same way as in SQLite
+static bool ToKeyField(sqlite3_value* value, const FieldType& type, FieldType& outField)
+{
+    const int valueType = sqlite3_value_type(value);
+    return std::visit([&]<typename T>(const T&)
+    {
+        if constexpr (std::is_same_v<T, FieldString>)
+        {
+            if (valueType != SQLITE_TEXT)
+            {
+                return false;
+            }
+            outField.emplace<FieldString>(reinterpret_cast<const char*>(sqlite3_value_text(value)), size_t(sqlite3_value_bytes(value)));
+            return true;
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            if (valueType != SQLITE_INTEGER && valueType != SQLITE_FLOAT)
+            {
+                return false;
+            }
+            double number = sqlite3_value_double(value);
+            if (double(T(number)) != number)
+            {
+                return false;
+            }
+            outField = T(number);
+            return true;
+        }
+        else
+        {
+            // Values above the int64 range are seen by SQLite as negative, so would not be in the same order
+            if (valueType != SQLITE_INTEGER || std::is_same_v<T, uint64_t>)
+            {
+                return false;
+            }
+            sqlite3_int64 number = sqlite3_value_int64(value);
+            if (number < sqlite3_int64(std::numeric_limits<T>::min()) ||
+                uint64_t(number) > uint64_t(std::numeric_limits<T>::max()))
+            {
+                return false;
+            }
+            outField = T(number);
+            return true;
+        }
+    }, type);
+}
+
+// Get a written value as the column type. NULL is the default value of the type.
+static bool ToWriteField(sqlite3_value* value, const FieldType& type, FieldType& outField, std::pmr::memory_resource* resource)
+{
+    const int valueType = sqlite3_value_type(value);
+    if (valueType == SQLITE_NULL)
+    {
+        if (std::holds_alternative<FieldString>(type))
+        {
+            outField.emplace<FieldString>(resource);
+        }
+        else
+        {
+            outField = type;
+        }
+        return true;
+    }
+
+    if (!std::holds_alternative<FieldString>(type))
+    {
+        if (valueType == SQLITE_INTEGER && ToKeyField(value, type, outField))
+        {
+            return true;
+        }
+        if (valueType == SQLITE_FLOAT && (type.index() == 10 || type.index() == 11))
+        {
+            double number = sqlite3_value_double(value);
+            outField = type.index() == 10 ? FieldType(float(number)) : FieldType(number);
+            return true;
+        }
+    }
+
+    // Parse the text of the value, as done for the CSV files
+    const char* text = reinterpret_cast<const char*>(sqlite3_value_text(value));
+    return ParseField(type, std::string_view(text, size_t(sqlite3_value_bytes(value))), outField, resource);
+}
+
+// Find the live row with the keys of the row, or -1
+static int64_t FindKeyRow(const CSVTableState& state, const CSVRow& row)
+{
+    const CSVTable& table = *state.m_table;
+    const CSVRows& rows = table.m_rowData;
+
+    auto sortedEnd = rows.begin() + state.m_sortedCount;
+    auto findRow = std::lower_bound(rows.begin(), sortedEnd, row,
+        [&table](const CSVRow& a, const CSVRow& b) { return KeysLess(table, a, b); });
+    if (findRow != sortedEnd && KeysEqual(table, *findRow, row) && !state.m_isDeleted[findRow - rows.begin()])
+    {
+        return findRow - rows.begin();
+    }
+
+    for (size_t r = state.m_sortedCount; r < rows.size(); r++)
+    {
+        if (!state.m_isDeleted[r] && KeysEqual(table, rows[r], row))
+        {
+            return int64_t(r);
+        }
+    }
+    return -1;
+}
+
+static void Compact(CSVTableState& state)
+{
+    CSVTable& table = *state.m_table;
+    CSVRows& rows = table.m_rowData;
+
+    // Remove deleted rows, keeping the count of the sorted rows before the inserted rows
+    size_t sortedCount = state.m_sortedCount;
+    size_t writeIndex = 0;
+    for (size_t r = 0; r < rows.size(); r++)
+    {
+        if (state.m_isDeleted[r])
+        {
+            if (r < state.m_sortedCount)
+            {
+                sortedCount--;
+            }
+            continue;
+        }
+        if (writeIndex != r)
+        {
+            rows[writeIndex] = std::move(rows[r]);
+        }
+        writeIndex++;
+    }
+    rows.resize(writeIndex);
+
+    // Sort the inserted rows and merge them in (keys are unique as they are checked on write)
+    if (table.m_keyColumns.size() > 0 && sortedCount < rows.size())
+    {
+        auto keyLess = [&table](const CSVRow& a, const CSVRow& b) { return KeysLess(table, a, b); };
+        auto sortedEnd = rows.begin() + sortedCount;
+        std::sort(sortedEnd, rows.end(), keyLess);
+        std::inplace_merge(rows.begin(), sortedEnd, rows.end(), keyLess);
+    }
+
+    state.m_isDeleted.assign(rows.size(), false);
+    state.m_deletedCount = 0;
+    state.m_sortedCount = rows.size();
+}
+
+static bool NeedsCompact(const CSVTableState& state)
+{
+    return state.m_sortedCount != state.m_table->m_rowData.size() || state.m_deletedCount > 0;
+}
+
+static const char* GetSqlType(const FieldType& type)
+{
+    switch (type.index())
+    {
+    case 0: return "TEXT";
+    case 10:
+    case 11: return "REAL";
+    default: return "INTEGER";
+    }
+}
+
+static std::string QuoteName(std::string_view name)
+{
+    std::string ret = "\"";
+    for (char c : name)
+    {
+        ret += c;
+        if (c == '"')
+        {
+            ret += c;
+        }
+    }
+    ret += "\"";
+    return ret;
+}
+
+// Create and connect are the same, as the table data is owned by the module
+static int CSVConnect(sqlite3* handle, void* aux, int argc, const char* const* argv, sqlite3_vtab** outVTab, char** outError)
+{
+    CSVModule& module = *static_cast<CSVModule*>(aux);
+    auto findTable = argc >= 3 ? module.m_tables.find(argv[2]) : module.m_tables.end();
+    if (findTable == module.m_tables.end())
+    {
+        *outError = sqlite3_mprintf("Unknown CSV table %s", argc >= 3 ? argv[2] : "");
+        return SQLITE_ERROR;
+    }
+
+    std::string sql = "CREATE TABLE x(";
+    const std::vector<CSVHeader>& headers = findTable->second.m_table->m_headerData;
+    for (size_t h = 0; h < headers.size(); h++)
+    {
+        sql += h > 0 ? ", " : "";
+        sql += QuoteName(headers[h].m_name);
+        sql += " ";
+        sql += GetSqlType(headers[h].m_type);
+    }
+    sql += ")";
+
+    int result = sqlite3_declare_vtab(handle, sql.c_str());
+    if (result != SQLITE_OK)
+    {
+        return result;
+    }
+
+    CSVVTab* vtab = new CSVVTab();
+    vtab->m_state = &findTable->second;
+    *outVTab = vtab;
+    return SQLITE_OK;
+}
+
+static int CSVDisconnect(sqlite3_vtab* vtab)
+{
+    sqlite3_free(vtab->zErrMsg);
+    delete static_cast<CSVVTab*>(vtab);
+    return SQLITE_OK;
+}
+
+// Use the equality constraints on the leading key columns, then a range on the next key column
+static int CSVBestIndex(sqlite3_vtab* vtab, sqlite3_index_info* info)
+{
+    const CSVTable& table = *GetState(vtab).m_table;
+
+    int argvIndex = 0;
+    int equalCount = 0;
+    int flags = 0;
+    for (uint32_t keyColumn : table.m_keyColumns)
+    {
+        int equal = -1;
+        int lower = -1;
+        int upper = -1;
+        for (int c = 0; c < info->nConstraint; c++)
+        {
+            const auto& constraint = info->aConstraint[c];
+            if (!constraint.usable ||
+                constraint.iColumn != int(keyColumn) ||
+                sqlite3_stricmp(sqlite3_vtab_collation(info, c), "BINARY") != 0)
+            {
+                continue;
+            }
+            switch (constraint.op)
+            {
+            case SQLITE_INDEX_CONSTRAINT_EQ: equal = c; break;
+            case SQLITE_INDEX_CONSTRAINT_GT:
+            case SQLITE_INDEX_CONSTRAINT_GE: lower = c; break;
+            case SQLITE_INDEX_CONSTRAINT_LT:
+            case SQLITE_INDEX_CONSTRAINT_LE: upper = c; break;
+            }
+        }
+
+        // SQLite still checks the constraints (omit is not set), so a key range only has to hold the matching rows
+        if (equal >= 0)
+        {
+            info->aConstraintUsage[equal].argvIndex = ++argvIndex;
+            equalCount++;
+            continue;
+        }
+        if (lower >= 0)
+        {
+            info->aConstraintUsage[lower].argvIndex = ++argvIndex;
+            flags |= s_idxLower | (info->aConstraint[lower].op == SQLITE_INDEX_CONSTRAINT_GE ? s_idxLowerInclusive : 0);
+        }
+        if (upper >= 0)
+        {
+            info->aConstraintUsage[upper].argvIndex = ++argvIndex;
+            flags |= s_idxUpper | (info->aConstraint[upper].op == SQLITE_INDEX_CONSTRAINT_LE ? s_idxUpperInclusive : 0);
+        }
+        break;
+    }
+    info->idxNum = equalCount | flags;
+
+    const double rowCount = double(std::max<size_t>(table.m_rowData.size(), 1));
+    const double searchCost = std::log2(rowCount) + 1.0;
+    if (equalCount > 0 && equalCount == int(table.m_keyColumns.size()))
+    {
+        info->estimatedCost = searchCost;
+        info->estimatedRows = 1;
+        info->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+    }
+    else if (argvIndex > 0)
+    {
+        double rows = rowCount / std::pow(10.0, equalCount) / ((flags & (s_idxLower | s_idxUpper)) ? 4.0 : 1.0);
+        info->estimatedCost = searchCost + rows;
+        info->estimatedRows = sqlite3_int64(rows) + 1;
+    }
+    else
+    {
+        info->estimatedCost = rowCount;
+        info->estimatedRows = sqlite3_int64(rowCount);
+    }
+    return SQLITE_OK;
+}
+
+static int CSVOpen(sqlite3_vtab* vtab, sqlite3_vtab_cursor** outCursor)
+{
+    GetState(vtab).m_openCursors++;
+    *outCursor = new CSVCursor();
+    return SQLITE_OK;
+}
+
+static int CSVClose(sqlite3_vtab_cursor* cursor)
+{
+    GetState(cursor->pVtab).m_openCursors--;
+    delete static_cast<CSVCursor*>(cursor);
+    return SQLITE_OK;
+}
+
+// Move past deleted rows, and from the end of the key range to the inserted rows
+static void SkipRows(CSVCursor& cursor, const CSVTableState& state)
+{
+    const size_t rowCount = state.m_table->m_rowData.size();
+    while (true)
+    {
+        if (cursor.m_row >= cursor.m_sortedEnd && cursor.m_row < state.m_sortedCount)
+        {
+            cursor.m_row = state.m_sortedCount;
+        }
+        if (cursor.m_row >= rowCount || !state.m_isDeleted[cursor.m_row])
+        {
+            return;
+        }
+        cursor.m_row++;
+    }
+}
+
+static int CSVFilter(sqlite3_vtab_cursor* vtabCursor, int idxNum, const char*, int argc, sqlite3_value** argv)
+{
+    CSVCursor& cursor = *static_cast<CSVCursor*>(vtabCursor);
+    CSVTableState& state = GetState(cursor.pVtab);
+    const CSVTable& table = *state.m_table;
+
+    // Compact the edits of earlier statements when this is the only cursor, so the key range covers all rows
+    if (state.m_openCursors == 1 && NeedsCompact(state))
+    {
+        Compact(state);
+    }
+
+    cursor.m_row = 0;
+    cursor.m_sortedEnd = state.m_sortedCount;
+
+    // Get the key values, any value that can not be compared as the column type scans all of the rows
+    const int equalCount = idxNum & s_idxEqualMask;
+    std::vector<FieldType> lowerKey(equalCount);
+    int arg = 0;
+    for (int i = 0; i < equalCount && arg < argc; i++, arg++)
+    {
+        if (!ToKeyField(argv[arg], table.m_headerData[table.m_keyColumns[i]].m_type, lowerKey[i]))
+        {
+            SkipRows(cursor, state);
+            return SQLITE_OK;
+        }
+    }
+    std::vector<FieldType> upperKey = lowerKey;
+    const FieldType& rangeType = equalCount < int(table.m_keyColumns.size()) ? table.m_headerData[table.m_keyColumns[equalCount]].m_type : FieldType();
+    if ((idxNum & s_idxLower) && arg < argc)
+    {
+        if (!ToKeyField(argv[arg++], rangeType, lowerKey.emplace_back()))
+        {
+            SkipRows(cursor, state);
+            return SQLITE_OK;
+        }
+    }
+    if ((idxNum & s_idxUpper) && arg < argc)
+    {
+        if (!ToKeyField(argv[arg++], rangeType, upperKey.emplace_back()))
+        {
+            SkipRows(cursor, state);
+            return SQLITE_OK;
+        }
+    }
+
+    // Binary search the sorted rows for the key range
+    const CSVRows& rows = table.m_rowData;
+    auto sortedEnd = rows.begin() + state.m_sortedCount;
+    if (lowerKey.size() > 0)
+    {
+        const bool inclusive = (idxNum & s_idxLower) == 0 || (idxNum & s_idxLowerInclusive) != 0;
+        auto lower = std::partition_point(rows.begin(), sortedEnd, [&](const CSVRow& row)
+        {
+            int compare = CompareKeys(table, row, lowerKey);
+            return inclusive ? compare < 0 : compare <= 0;
+        });
+        cursor.m_row = lower - rows.begin();
+    }
+    if (upperKey.size() > 0)
+    {
+        const bool inclusive = (idxNum & s_idxUpper) == 0 || (idxNum & s_idxUpperInclusive) != 0;
+        auto upper = std::partition_point(rows.begin() + cursor.m_row, sortedEnd, [&](const CSVRow& row)
+        {
+            int compare = CompareKeys(table, row, upperKey);
+            return inclusive ? compare <= 0 : compare < 0;
+        });
+        cursor.m_sortedEnd = upper - rows.begin();
+    }
+
+    SkipRows(cursor, state);
+    return SQLITE_OK;
+}
+
+static int CSVNext(sqlite3_vtab_cursor* vtabCursor)
+{
+    CSVCursor& cursor = *static_cast<CSVCursor*>(vtabCursor);
+    cursor.m_row++;
+    SkipRows(cursor, GetState(cursor.pVtab));
+    return SQLITE_OK;
+}
+
+static int CSVEof(sqlite3_vtab_cursor* vtabCursor)
+{
+    CSVCursor& cursor = *static_cast<CSVCursor*>(vtabCursor);
+    return cursor.m_row >= GetState(cursor.pVtab).m_table->m_rowData.size();
+}
+
+static int CSVColumn(sqlite3_vtab_cursor* vtabCursor, sqlite3_context* context, int column)
+{
+    CSVCursor& cursor = *static_cast<CSVCursor*>(vtabCursor);
+    const FieldType& field = GetState(cursor.pVtab).m_table->m_rowData[cursor.m_row][column];
+    std::visit([context]<typename T>(const T& value)
+    {
+        if constexpr (std::is_same_v<T, FieldString>)
+        {
+            sqlite3_result_text(context, value.data(), int(value.size()), SQLITE_TRANSIENT);
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            sqlite3_result_double(context, value);
+        }
+        else if constexpr (std::is_same_v<T, uint64_t>)
+        {
+            // Values above the int64 range are returned as text, so they are not changed by an edit of the row
+            if (value > uint64_t(std::numeric_limits<sqlite3_int64>::max()))
+            {
+                std::string text = std::to_string(value);
+                sqlite3_result_text(context, text.data(), int(text.size()), SQLITE_TRANSIENT);
+            }
+            else
+            {
+                sqlite3_result_int64(context, sqlite3_int64(value));
+            }
+        }
+        else
+        {
+            sqlite3_result_int64(context, sqlite3_int64(value));
+        }
+    }, field);
+    return SQLITE_OK;
+}
+
+static int CSVRowid(sqlite3_vtab_cursor* vtabCursor, sqlite3_int64* outRowid)
+{
+    *outRowid = sqlite3_int64(static_cast<CSVCursor*>(vtabCursor)->m_row);
+    return SQLITE_OK;
+}
+
+// Deletes mark the row, inserts and key changes append a row that is sorted in when the table is compacted
+static int CSVUpdate(sqlite3_vtab* vtab, int argc, sqlite3_value** argv, sqlite3_int64*)
+{
+    CSVTableState& state = GetState(vtab);
+    CSVTable& table = *state.m_table;
+    CSVRows& rows = table.m_rowData;
+
+    size_t rowIndex = rows.size();
+    if (sqlite3_value_type(argv[0]) != SQLITE_NULL)
+    {
+        rowIndex = size_t(sqlite3_value_int64(argv[0]));
+        if (rowIndex >= rows.size() || state.m_isDeleted[rowIndex])
+        {
+            SetError(vtab, "Row was removed");
+            return SQLITE_ERROR;
+        }
+    }
+
+    if (argc == 1)
+    {
+        state.m_isDeleted[rowIndex] = true;
+        state.m_deletedCount++;
+        return SQLITE_OK;
+    }
+
+    // Get the new row values in the table arena
+    CSVRow newRow(table.m_headerData.size(), table.GetArena());
+    for (size_t c = 0; c < table.m_headerData.size(); c++)
+    {
+        if (!ToWriteField(argv[c + 2], table.m_headerData[c].m_type, newRow[c], table.GetArena()))
+        {
+            SetError(vtab, std::format("Invalid value for column {}", table.m_headerData[c].m_name));
+            return SQLITE_MISMATCH;
+        }
+    }
+
+    const bool isInsert = rowIndex == rows.size();
+    const bool keysChanged = isInsert || !KeysEqual(table, rows[rowIndex], newRow);
+    if (!keysChanged || table.m_keyColumns.size() == 0)
+    {
+        if (isInsert)
+        {
+            rows.push_back(std::move(newRow));
+            state.m_isDeleted.push_back(false);
+        }
+        else
+        {
+            rows[rowIndex] = std::move(newRow);
+        }
+        return SQLITE_OK;
+    }
+
+    if (FindKeyRow(state, newRow) >= 0)
+    {
+        SetError(vtab, "Duplicate key in table");
+        return SQLITE_CONSTRAINT;
+    }
+    if (!isInsert)
+    {
+        state.m_isDeleted[rowIndex] = true;
+        state.m_deletedCount++;
+    }
+    rows.push_back(std::move(newRow));
+    state.m_isDeleted.push_back(false);
+    return SQLITE_OK;
+}
+
+static const sqlite3_module s_csvModule =
+{
+    1,              // iVersion
+    CSVConnect,     // xCreate
+    CSVConnect,     // xConnect
+    CSVBestIndex,
+    CSVDisconnect,
+    CSVDisconnect,  // xDestroy
+    CSVOpen,
+    CSVClose,
+    CSVFilter,
+    CSVNext,
+    CSVEof,
+    CSVColumn,
+    CSVRowid,
+    CSVUpdate,
+};
+
+bool LoadCSVModule(const char* dirPath, CSVModule& o_module)
+{
+    DBTables& db = o_module.m_db;
+    if (!ReadDB(dirPath, db))
+    {
+        return false;
+    }
+
+    // Enums are exposed as the tables sorted by name, the link columns hold the names
+    auto addTable = [&o_module](const std::string& tableName, CSVTable& table)
+    {
+        if (!SortTable(table))
+        {
+            OutputMessage("Error: Table {} failed to sort", tableName);
+            return false;
+        }
+        CSVTableState& state = o_module.m_tables[tableName];
+        state.m_table = &table;
+        state.m_isDeleted.assign(table.m_rowData.size(), false);
+        state.m_sortedCount = table.m_rowData.size();
+        return true;
+    };
+
+    for (auto& [tableName, table] : db.m_tablesEnumNameSort)
+    {
+        if (!addTable(tableName, table))
+        {
+            return false;
+        }
+    }
+    for (auto& [tableName, table] : db.m_tables)
+    {
+        if (!IsEnumTable(tableName) && !addTable(tableName, table))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AttachCSVModule(sqlite3* handle, CSVModule& module, std::string& o_error)
+{
+    if (sqlite3_create_module_v2(handle, "csvtable", &s_csvModule, &module, nullptr) != SQLITE_OK)
+    {
+        o_error = sqlite3_errmsg(handle);
+        return false;
+    }
+
+    for (const auto& [tableName, state] : module.m_tables)
+    {
+        std::string sql = "CREATE VIRTUAL TABLE " + QuoteName(tableName) + " USING csvtable";
+        if (sqlite3_exec(handle, sql.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK)
+        {
+            o_error = std::format("Error: Creating table {}: {}", tableName, sqlite3_errmsg(handle));
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "../CSVProcessor/CSVProcessor.h"
+
+struct sqlite3;
+
+// Edit state of a CSV table exposed as an SQLite virtual table
+struct CSVTableState
+{
+    CSVTable* m_table = nullptr;
+    std::vector<bool> m_isDeleted;  // Deleted rows, removed from the table when it is compacted
+    size_t m_deletedCount = 0;      // Number of deleted rows
+    size_t m_sortedCount = 0;       // Rows before this are in key order, rows after were inserted since the last compact
+    uint32_t m_openCursors = 0;     // The table is only compacted with no open cursors, as it changes the row ids
+};
+
+// The tables of a DB exposed through the "csvtable" virtual table module. Must outlive the SQLite connection.
+struct CSVModule
+{
+    DBTables m_db;
+    std::unordered_map<std::string, CSVTableState> m_tables;
+};
+
+// Read and sort the tables of the directory into the module.
+// Link columns are kept as their CSV text, enum tables are the name keyed tables.
+bool LoadCSVModule(const char* dirPath, CSVModule& o_module);
+
+// Register the module with the connection and create a virtual table for each loaded table.
+// The tables are queried and edited in place without an import:
+// - Equality and range constraints on the leading key columns are found with a binary search of the sorted rows.
+// - Inserts and updates check for duplicate keys and write into the table arena. Rows are only removed or re-sorted
+//   when the table is compacted on a scan with no other open cursor, so row ids are stable within a statement
+//   (use the key columns to identify rows). The edits are not saved back to the CSV files.
+// - Foreign keys are not enforced and writes are not rolled back with a transaction.
+bool AttachCSVModule(sqlite3* handle, CSVModule& module, std::string& o_error);
@@ -0,0 +1,395 @@
+#include "DBRead.h"
+
+#include <QSqlQuery>
+#include <QSqlDriver>
+#include <QSqlError>
+#include <QVariant>
+
+#include <sqlite3.h>
+
+#include <algorithm>
+
+// Most bound parameters in a statement supported by all SQLite versions (SQLITE_MAX_VARIABLE_NUMBER)
+static constexpr int s_maxSqlVariables = 999;
+
+// Redirect the CSV processor output to a log for the lifetime of the object
+class ScopedOutputLog
+{
+public:
+    explicit ScopedOutputLog(QString& log) : m_oldFunc(std::move(OutputMessageFunc))
+    {
+        OutputMessageFunc = [&log](const char* message)
+        {
+            log += QString::fromUtf8(message);
+            log += "\n";
+        };
+    }
+    ~ScopedOutputLog() { OutputMessageFunc = std::move(m_oldFunc); }
+
+private:
+    std::function<void (const char*)> m_oldFunc;
+};
+
+static QString QuoteName(std::string_view name)
+{
+    QString ret = QString::fromUtf8(name.data(), qsizetype(name.size()));
+    ret.replace("\"", "\"\"");
+    return "\"" + ret + "\"";
+}
+
+static const char* GetSqlType(const FieldType& type)
+{
+    switch (type.index())
+    {
+    case 0: return "TEXT";
+    case 10:
+    case 11: return "REAL";
+    default: return "INTEGER";
+    }
+}
+
+static QVariant ToVariant(const FieldType& field)
+{
+    return std::visit([](const auto& value) -> QVariant
+    {
+        using T = std::decay_t<decltype(value)>;
+        if constexpr (std::is_same_v<T, FieldString>)
+        {
+            return QString::fromUtf8(value.data(), qsizetype(value.size()));
+        }
+        else if constexpr (std::is_same_v<T, bool>)
+        {
+            return int(value);
+        }
+        else if constexpr (std::is_same_v<T, uint64_t>)
+        {
+            return qulonglong(value);
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            return double(value);
+        }
+        else
+        {
+            return qlonglong(value);
+        }
+    }, field);
+}
+
+static bool Exec(QSqlQuery& query, const QString& sql, QString& o_log)
+{
+    if (!query.exec(sql))
+    {
+        o_log += "Error: " + query.lastError().text() + "\n" + sql + "\n";
+        return false;
+    }
+    return true;
+}
+
+// Find the table a link column references, enums are linked by name
+static const CSVTable* FindLinkTable(const DBTables& db, const std::string& tableName)
+{
+    const auto& tables = IsEnumTable(tableName) ? db.m_tablesEnumRaw : db.m_tables;
+    auto findTable = tables.find(tableName);
+    return findTable != tables.end() ? &findTable->second : nullptr;
+}
+
+// Create the SQLite table with the key columns as the primary key and foreign keys for the links
+static bool CreateTable(QSqlDatabase& db, const DBTables& dbTables, const std::string& tableName, const CSVTable& table, QString& o_log)
+{
+    const std::vector<CSVHeader>& headers = table.m_headerData;
+
+    // Get the foreign table and the link columns of each column (if any)
+    std::vector<const CSVTable*> linkTables(headers.size());
+    std::vector<std::vector<uint32_t>> linkColumns;
+    std::vector<const CSVTable*> linkColumnTables;
+    std::vector<bool> processed(headers.size());
+    std::vector<uint32_t> matchIndices;
+    for (uint32_t h = 0; h < headers.size(); h++)
+    {
+        const CSVHeader& header = headers[h];
+        if (processed[h] || header.m_foreignTable.size() == 0)
+        {
+            continue;
+        }
+
+        const CSVTable* foreignTable = FindLinkTable(dbTables, header.m_foreignTable);
+        if (foreignTable == nullptr || foreignTable->m_keyColumns.size() == 0)
+        {
+            OutputMessage("Error: Table {} has link to unknown table or table with no keys {}", tableName, header.m_foreignTable);
+            return false;
+        }
+        if (!GetLinkColumns(tableName, table, h, matchIndices))
+        {
+            return false;
+        }
+        for (uint32_t index : matchIndices)
+        {
+            processed[index] = true;
+            linkTables[index] = foreignTable;
+        }
+        linkColumns.push_back(matchIndices);
+        linkColumnTables.push_back(foreignTable);
+    }
+
+    QString sql = "CREATE TABLE " + QuoteName(tableName) + " (";
+    for (uint32_t h = 0; h < headers.size(); h++)
+    {
+        // Link columns take the type of the foreign key they hold
+        const FieldType* type = &headers[h].m_type;
+        if (linkTables[h] != nullptr)
+        {
+            for (size_t l = 0; l < linkColumns.size(); l++)
+            {
+                const std::vector<uint32_t>& columns = linkColumns[l];
+                auto findColumn = std::find(columns.begin(), columns.end(), h);
+                if (findColumn != columns.end())
+                {
+                    const CSVTable& foreignTable = *linkColumnTables[l];
+                    type = &foreignTable.m_headerData[foreignTable.m_keyColumns[findColumn - columns.begin()]].m_type;
+                    break;
+                }
+            }
+        }
+
+        if (h > 0)
+        {
+            sql += ", ";
+        }
+        sql += QuoteName(headers[h].m_name);
+        sql += " ";
+        sql += GetSqlType(*type);
+    }
+
+    if (table.m_keyColumns.size() > 0)
+    {
+        sql += ", PRIMARY KEY (";
+        for (size_t k = 0; k < table.m_keyColumns.size(); k++)
+        {
+            sql += (k > 0 ? ", " : "") + QuoteName(headers[table.m_keyColumns[k]].m_name);
+        }
+        sql += ")";
+    }
+
+    for (size_t l = 0; l < linkColumns.size(); l++)
+    {
+        const CSVTable& foreignTable = *linkColumnTables[l];
+        QString keys;
+        QString foreignKeys;
+        for (size_t k = 0; k < linkColumns[l].size(); k++)
+        {
+            keys += (k > 0 ? ", " : "") + QuoteName(headers[linkColumns[l][k]].m_name);
+            foreignKeys += (k > 0 ? ", " : "") + QuoteName(foreignTable.m_headerData[foreignTable.m_keyColumns[k]].m_name);
+        }
+        sql += ", FOREIGN KEY (" + keys + ") REFERENCES " + QuoteName(headers[linkColumns[l][0]].m_foreignTable) + " (" + foreignKeys + ")";
+    }
+    sql += ")";
+
+    QSqlQuery query(db);
+    return Exec(query, sql, o_log);
+}
+
+// Insert all the rows of the table in a single transaction.
+// Rows are inserted several at a time with a prepared statement that is reused for each batch.
+static bool InsertRows(QSqlDatabase& db, const std::string& tableName, const CSVTable& table, QString& o_log)
+{
+    const int columnCount = int(table.m_headerData.size());
+    const int rowCount = int(table.m_rowData.size());
+    if (columnCount == 0 || rowCount == 0)
+    {
+        return true;
+    }
+
+    const int batchRows = std::max(1, s_maxSqlVariables / columnCount);
+    QString rowValues = "(?";
+    for (int c = 1; c < columnCount; c++)
+    {
+        rowValues += ",?";
+    }
+    rowValues += ")";
+
+    auto prepare = [&](QSqlQuery& query, int rows)
+    {
+        QString sql = "INSERT INTO " + QuoteName(tableName) + " VALUES " + rowValues;
+        for (int r = 1; r < rows; r++)
+        {
+            sql += "," + rowValues;
+        }
+        if (!query.prepare(sql))
+        {
+            o_log += "Error: " + query.lastError().text() + "\n";
+            return false;
+        }
+        return true;
+    };
+
+    if (!db.transaction())
+    {
+        o_log += "Error: " + db.lastError().text() + "\n";
+        return false;
+    }
+
+    QSqlQuery query(db);
+    int preparedRows = 0;
+    for (int start = 0; start < rowCount; start += batchRows)
+    {
+        // The last partial batch needs its own statement
+        const int rows = std::min(batchRows, rowCount - start);
+        if (rows != preparedRows)
+        {
+            if (!prepare(query, rows))
+            {
+                db.rollback();
+                return false;
+            }
+            preparedRows = rows;
+        }
+
+        int param = 0;
+        for (int r = start; r < start + rows; r++)
+        {
+            const CSVRow& row = table.m_rowData[r];
+            for (int c = 0; c < columnCount; c++)
+            {
+                query.bindValue(param++, ToVariant(row[c]));
+            }
+        }
+
+        if (!query.exec())
+        {
+            o_log += QString("Error: Table %1 insert at row %2: %3\n").arg(QString::fromStdString(tableName)).arg(start + 1).arg(query.lastError().text());
+            db.rollback();
+            return false;
+        }
+    }
+
+    if (!db.commit())
+    {
+        o_log += "Error: " + db.lastError().text() + "\n";
+        return false;
+    }
+    return true;
+}
+
+bool DBReadCSV(const QString& dbPath, QSqlDatabase& db, std::vector<TableData>& o_tableData, QString& o_log)
+{
+    ScopedOutputLog outputLog(o_log);
+
+    DBTables dbTables;
+    if (!ReadDB(dbPath.toStdString().c_str(), dbTables))
+    {
+        return false;
+    }
+
+    // Tune for a bulk load, there is nothing to recover if the load fails.
+    // The page size has to be set before any table is created.
+    QSqlQuery pragma(db);
+    if (!Exec(pragma, "PRAGMA page_size = 65536", o_log) ||
+        !Exec(pragma, "PRAGMA journal_mode = OFF", o_log) ||
+        !Exec(pragma, "PRAGMA synchronous = OFF", o_log) ||
+        !Exec(pragma, "PRAGMA cache_size = -262144", o_log) ||
+        !Exec(pragma, "PRAGMA temp_store = MEMORY", o_log) ||
+        !Exec(pragma, "PRAGMA foreign_keys = OFF", o_log))
+    {
+        return false;
+    }
+
+    // Enums are loaded as the raw tables, keyed by name
+    auto addTable = [&](const std::filesystem::path& path, const CSVTable& table)
+    {
+        std::string tableName = GetTableName(path);
+        if (!CreateTable(db, dbTables, tableName, table, o_log) ||
+            !InsertRows(db, tableName, table, o_log))
+        {
+            OutputMessage("Error: Loading table {} into SQLite", tableName);
+            return false;
+        }
+
+        TableData& data = o_tableData.emplace_back();
+        data.m_name = QString::fromStdString(tableName);
+        data.m_filePath = path;
+        data.m_headerData = table.m_headerData;
+        data.m_keyColumns = table.m_keyColumns;
+        return true;
+    };
+
+    o_tableData.reserve(dbTables.m_csvEnumFilePaths.size() + dbTables.m_csvFilePaths.size());
+    for (const std::filesystem::path& path : dbTables.m_csvEnumFilePaths)
+    {
+        if (!addTable(path, dbTables.m_tablesEnumRaw[path.stem().string()]))
+        {
+            return false;
+        }
+    }
+    for (size_t fileIndex = 0; fileIndex < dbTables.m_csvFilePaths.size(); fileIndex++)
+    {
+        // A sharded table is added once, from its first shard
+        const std::filesystem::path& path = dbTables.m_csvFilePaths[fileIndex];
+        if (dbTables.m_csvFileShards[fileIndex] == 0 &&
+            !addTable(path, dbTables.m_tables[GetTableName(path)]))
+        {
+            return false;
+        }
+    }
+
+    // Restore a rollback journal for the edits
+    return Exec(pragma, "PRAGMA journal_mode = MEMORY", o_log);
+}
+
+bool DBAttachCSV(const QString& dbPath, QSqlDatabase& db, CSVModule& o_module, std::vector<TableData>& o_tableData, QString& o_log)
+{
+    ScopedOutputLog outputLog(o_log);
+
+    if (!LoadCSVModule(dbPath.toStdString().c_str(), o_module))
+    {
+        return false;
+    }
+
+    // The module is registered on the handle of the connection, so the Qt SQLite driver has to use the same SQLite library
+    QVariant handle = db.driver()->handle();
+    if (!handle.isValid() || qstrcmp(handle.typeName(), "sqlite3*") != 0)
+    {
+        o_log += "Error: The DB is not an SQLite DB\n";
+        return false;
+    }
+    sqlite3* sqlHandle = *static_cast<sqlite3**>(handle.data());
+    if (sqlHandle == nullptr)
+    {
+        o_log += "Error: The DB is not open\n";
+        return false;
+    }
+
+    std::string error;
+    if (!AttachCSVModule(sqlHandle, o_module, error))
+    {
+        o_log += QString::fromStdString(error) + "\n";
+        return false;
+    }
+
+    const DBTables& dbTables = o_module.m_db;
+    o_tableData.reserve(dbTables.m_csvEnumFilePaths.size() + dbTables.m_csvFilePaths.size());
+    auto addTable = [&](const std::filesystem::path& path)
+    {
+        const std::string tableName = GetTableName(path);
+        const CSVTable& table = *o_module.m_tables.at(tableName).m_table;
+
+        TableData& data = o_tableData.emplace_back();
+        data.m_name = QString::fromStdString(tableName);
+        data.m_filePath = path;
+        data.m_headerData = table.m_headerData;
+        data.m_keyColumns = table.m_keyColumns;
+    };
+    for (const std::filesystem::path& path : dbTables.m_csvEnumFilePaths)
+    {
+        addTable(path);
+    }
+    for (size_t fileIndex = 0; fileIndex < dbTables.m_csvFilePaths.size(); fileIndex++)
+    {
+        // A sharded table is added once, from its first shard
+        if (dbTables.m_csvFileShards[fileIndex] == 0)
+        {
+            addTable(dbTables.m_csvFilePaths[fileIndex]);
+        }
+    }
+    return true;
+}
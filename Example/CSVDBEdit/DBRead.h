@@ -0,0 +1,24 @@
+#pragma once
+
+#include "CSVVirtualTable.h"
+
+#include <QSqlDatabase>
+#include <QString>
+
+// Info of a CSV table loaded into the SQLite DB
+struct TableData
+{
+    QString m_name;                     // Table name (also the SQLite table name)
+    std::filesystem::path m_filePath;   // Path of the CSV file (the first shard of a sharded table)
+    std::vector<CSVHeader> m_headerData;// Header info of each column
+    std::vector<uint32_t> m_keyColumns; // Index of the key columns
+};
+
+// Read the CSV tables of the directory into the SQLite DB.
+// Tables are created with the key columns as the primary key and foreign keys for the links. Foreign keys are not checked during the load.
+// Errors and warnings are appended to o_log.
+bool DBReadCSV(const QString& dbPath, QSqlDatabase& db, std::vector<TableData>& o_tableData, QString& o_log);
+
+// Expose the CSV tables of the directory as virtual tables of the SQLite DB, so they are queried and edited in place without an import.
+// The module holds the table data and must outlive the DB connection.
+bool DBAttachCSV(const QString& dbPath, QSqlDatabase& db, CSVModule& o_module, std::vector<TableData>& o_tableData, QString& o_log);
@@ -1,13 +1,87 @@
 #include "MainWindow.h"
 #include "./ui_MainWindow.h"
+#include "CSVTableModel.h"
 
-MainWindow::MainWindow(QWidget *parent)
+#include <QHeaderView>
+#include <QLineEdit>
+#include <QMdiSubWindow>
+#include <QSqlTableModel>
+#include <QStringListModel>
+#include <QTableView>
+#include <QVBoxLayout>
+
+MainWindow::MainWindow(CSVModule &module, const std::vector<TableData> &tableData, QWidget *parent)
     : QMainWindow(parent)
+    , m_module(module)
 {
     ui = std::make_unique<Ui::MainWindow>();
     ui->setupUi(this);
+
+    QStringList tableNames;
+    for (const TableData &data : tableData)
+    {
+        tableNames << data.m_name;
+    }
+    tableNames.sort();
+    ui->listView->setModel(new QStringListModel(tableNames, this));
+    ui->listView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    connect(ui->listView, &QListView::activated, this, &MainWindow::openTable);
 }
 
 MainWindow::~MainWindow()
 {
 }
+
+void MainWindow::openTable(const QModelIndex &index)
+{
+    const QString tableName = index.data().toString();
+    for (QMdiSubWindow *subWindow : ui->mdiArea->subWindowList())
+    {
+        if (subWindow->windowTitle() == tableName)
+        {
+            ui->mdiArea->setActiveSubWindow(subWindow);
+            return;
+        }
+    }
+
+    QWidget *tableWidget = new QWidget();
+    QVBoxLayout *layout = new QVBoxLayout(tableWidget);
+    QTableView *tableView = new QTableView(tableWidget);
+
+    auto findTable = m_module.m_tables.find(tableName.toStdString());
+    if (findTable != m_module.m_tables.end())
+    {
+        CSVTableModel *model = new CSVTableModel(findTable->second, tableWidget);
+        tableView->setModel(model);
+
+        QLineEdit *filterEdit = new QLineEdit(tableWidget);
+        filterEdit->setPlaceholderText("Filter keys");
+        filterEdit->setClearButtonEnabled(true);
+        connect(filterEdit, &QLineEdit::textChanged, model, &CSVTableModel::setFilter);
+        layout->addWidget(filterEdit);
+    }
+    else
+    {
+        QSqlTableModel *model = new QSqlTableModel(tableWidget, QSqlDatabase::database());
+        model->setTable(tableName);
+        model->setEditStrategy(QSqlTableModel::OnFieldChange);
+        model->select();
+        tableView->setModel(model);
+    }
+
+    // Fixed row heights and column widths, so the view never measures the contents of rows that are not visible
+    tableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    tableView->verticalHeader()->setDefaultSectionSize(tableView->fontMetrics().height() + 4);
+    tableView->horizontalHeader()->setSectionResizeMode(QHeaderView::Interactive);
+    tableView->setWordWrap(false);
+
+    // Start in table order, clicking a column header sorts by it
+    tableView->horizontalHeader()->setSortIndicator(-1, Qt::AscendingOrder);
+    tableView->setSortingEnabled(true);
+    layout->addWidget(tableView);
+
+    QMdiSubWindow *subWindow = ui->mdiArea->addSubWindow(tableWidget);
+    subWindow->setWindowTitle(tableName);
+    subWindow->setAttribute(Qt::WA_DeleteOnClose);
+    subWindow->show();
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "DBRead.h"
+
 #include <QMainWindow>
 
 QT_BEGIN_NAMESPACE
@@ -13,10 +15,13 @@ class MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
-    MainWindow(QWidget *parent = nullptr);
+    // The tables in the module are shown directly from the table data, other tables are shown from the SQLite DB
+    MainWindow(CSVModule &module, const std::vector<TableData> &tableData, QWidget *parent = nullptr);
     ~MainWindow();
 
 private:
+    void openTable(const QModelIndex &index);
+
     std::unique_ptr<Ui::MainWindow> ui;
+    CSVModule &m_module;
 };
-
@@ -1,6 +1,8 @@
 #include "MainWindow.h"
+#include "DBRead.h"
 #include <QCommandLineParser>
 #include <QSqlDatabase>
+#include <QSqlQuery>
 #include <QMessageBox>
 #include <QFileDialog>
 #include <QApplication>
@@ -13,6 +15,8 @@ int main(int argc, char *argv[])
     parser.setApplicationDescription("CSV DB editor");
     parser.addHelpOption();
     parser.addPositionalArgument("dbPath", "Database to open");
+    QCommandLineOption inPlaceOption("in-place", "Edit the tables in place as virtual tables, without an import into SQLite");
+    parser.addOption(inPlaceOption);
 
     // If a path is not provided, get a path from the user on startup
     parser.process(app);
@@ -32,6 +36,9 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    // Table data when edited in place
+    CSVModule csvModule;
+
     // Setup global database
     QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
     db.setDatabaseName(":memory:");
@@ -40,10 +47,11 @@ int main(int argc, char *argv[])
         QMessageBox::critical(nullptr, "Cannot open database", "Unable to open SQLite DB.");
         return 1;
     }
-/*
+
     std::vector<TableData> tableData;
     QString readLog;
-    if(!DBReadCSV(dbPath, db, tableData, readLog))
+    const bool inPlace = parser.isSet(inPlaceOption);
+    if(inPlace ? !DBAttachCSV(dbPath, db, csvModule, tableData, readLog) : !DBReadCSV(dbPath, db, tableData, readLog))
     {
         QMessageBox::critical(0, "DB read failure", readLog + "\nClick Cancel to exit.", QMessageBox::Cancel);
         return 1;
@@ -53,31 +61,34 @@ int main(int argc, char *argv[])
         QMessageBox::information(0, "DB read errors", readLog, QMessageBox::Ok);
     }
 
-    // Turn database foreign key checking on
-    db.exec("PRAGMA foreign_keys = ON");
-    QSqlQuery fkOn = db.exec("PRAGMA foreign_key_check");
-    QString errorStr;
-    while(fkOn.next())
+    // Virtual tables do not have foreign keys, the links are checked on import
+    if(!inPlace)
     {
-        int i = 0;
-        QVariant value = fkOn.value(i);
-        while(value.isValid())
+        // Turn database foreign key checking on
+        db.exec("PRAGMA foreign_keys = ON");
+        QSqlQuery fkOn = db.exec("PRAGMA foreign_key_check");
+        QString errorStr;
+        while(fkOn.next())
         {
-            errorStr += value.toString();
-            errorStr += ",";
-            i++;
-            value = fkOn.value(i);
+            int i = 0;
+            QVariant value = fkOn.value(i);
+            while(value.isValid())
+            {
+                errorStr += value.toString();
+                errorStr += ",";
+                i++;
+                value = fkOn.value(i);
+            }
+            errorStr += "\n";
+        }
+        if(errorStr.length() > 0)
+        {
+            QMessageBox::critical(0, "DB read failure", "Foreign key constrains failed:\n" + errorStr + "\nClick Cancel to exit.", QMessageBox::Cancel);
+            return 1;
         }
-        errorStr += "\n";
-    }
-    if(errorStr.length() > 0)
-    {
-        o_log += "Foreign key constrains failed:\n" + errorStr;
-        return 1;
     }
-*/
 
-    MainWindow w;
+    MainWindow w(csvModule, tableData);
     w.show();
     return app.exec();
 }
@@ -1,4 +1,5 @@
 #include "CSVProcessor.h"
+#include "Profile.h"
 
 #include <iostream>
 #include <fstream>
@@ -7,7 +8,9 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <charconv>
+#include <cstring>
 #include <algorithm>
+#include <numeric>
 
 // TODO: Add test where the key is a foreign key - part of a multi key also
 //       Test when key is int type and what to do when referenced by a foreign key
@@ -28,12 +31,12 @@ bool GetColumnType(std::string_view name, FieldType& retType)
 
   if (name == "int8")  { retType = FieldType(int8_t(0));  return true; }
   if (name == "int16") { retType = FieldType(int16_t(0)); return true; }
-  if (name == "int23") { retType = FieldType(int32_t(0)); return true; }
+  if (name == "int32") { retType = FieldType(int32_t(0)); return true; }
   if (name == "int64") { retType = FieldType(int64_t(0)); return true; }
 
   if (name == "uint8") { retType = FieldType(uint8_t(0));   return true; }
   if (name == "uint16") { retType = FieldType(uint16_t(0)); return true; }
-  if (name == "uint23") { retType = FieldType(uint32_t(0)); return true; }
+  if (name == "uint32") { retType = FieldType(uint32_t(0)); return true; }
   if (name == "uint64") { retType = FieldType(uint64_t(0)); return true; }
 
   if (name == "float32") { retType = FieldType(float(0)); return true;  }
@@ -46,7 +49,7 @@ void AppendToString(const FieldType& var, std::string& appendStr)
 {
   std::visit([&appendStr]<typename T>(const T & e)
   {
-    if constexpr (std::is_same_v<T, std::string>)
+    if constexpr (std::is_same_v<T, FieldString>)
     {
       appendStr += e;
     }
@@ -88,7 +91,7 @@ bool IsEqual(const FieldType& var, size_t val)
 {
   return std::visit([val]<typename T>(const T & e)
   {
-    if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, bool>)
+    if constexpr (std::is_same_v<T, FieldString> || std::is_same_v<T, bool>)
     {
       return false;
     }
@@ -107,11 +110,11 @@ T ReadNumberValue(const char* start, const char* end, std::from_chars_result& st
   return val;
 }
 
-bool ParseField(const FieldType& type, std::string_view string, FieldType& retField)
+bool ParseField(const FieldType& type, std::string_view string, FieldType& retField, std::pmr::memory_resource* resource)
 {
-  if (std::holds_alternative<std::string>(type))
+  if (std::holds_alternative<FieldString>(type))
   {
-    retField = std::string(string);
+    retField.emplace<FieldString>(string, resource);
     return true;
   }
 
@@ -121,7 +124,7 @@ bool ParseField(const FieldType& type, std::string_view string, FieldType& retFi
 
   std::visit([start, end, &strRes, &retField]<typename T>(const T & e)
   {
-    if constexpr (std::is_same_v<T, std::string>)
+    if constexpr (std::is_same_v<T, FieldString>)
     {
       // String is handled earlier
     }
@@ -164,29 +167,126 @@ bool ParseField(const FieldType& type, std::string_view string, FieldType& retFi
   return true;
 }
 
-bool ParseFieldMove(const FieldType& type, std::string&& string, FieldType& retField)
+bool ParseFieldMove(const FieldType& type, FieldString&& string, FieldType& retField, std::pmr::memory_resource* resource)
 {
-  if (std::holds_alternative<std::string>(type))
+  if (std::holds_alternative<FieldString>(type))
   {
-    retField = std::move(string);
+    // Only moves the string memory if it is from the same resource
+    retField.emplace<FieldString>(std::move(string), resource);
     return true;
   }
 
-  return ParseField(type, string, retField);
+  return ParseField(type, string, retField, resource);
 }
 
-std::vector<std::vector<std::string>> ReadCSV(const char* srcData) 
+void CopyField(const FieldType& field, FieldType& retField, std::pmr::memory_resource* resource)
 {
-  std::vector<std::vector<std::string>> csvTable;
-  std::vector<std::string> row;
-  std::string field;
+  if (const FieldString* accessField = std::get_if<FieldString>(&field))
+  {
+    retField.emplace<FieldString>(*accessField, resource);
+  }
+  else
+  {
+    retField = field;
+  }
+}
+
+CSVTable::CSVTable(size_t arenaInitialSize)
+  : m_arena(arenaInitialSize > 0 ? std::make_shared<std::pmr::monotonic_buffer_resource>(arenaInitialSize) : std::make_shared<std::pmr::monotonic_buffer_resource>())
+  , m_rowData(m_arena.get())
+{
+}
+
+CSVTable::CSVTable(const CSVTable& other)
+  : m_headerData(other.m_headerData)
+  , m_keyColumns(other.m_keyColumns)
+  , m_wasSorted(other.m_wasSorted)
+  , m_schema(other.m_schema)
+  , m_linkRows(other.m_linkRows)
+  , m_rowShards(other.m_rowShards)
+  , m_arena(std::make_shared<std::pmr::monotonic_buffer_resource>())
+  , m_rowData(m_arena.get())
+{
+  // Copy the rows into the arena of this table
+  m_rowData.resize(other.m_rowData.size());
+  for (size_t r = 0; r < other.m_rowData.size(); r++)
+  {
+    const CSVRow& srcRow = other.m_rowData[r];
+    CSVRow& row = m_rowData[r];
+    row.resize(srcRow.size());
+    for (size_t i = 0; i < srcRow.size(); i++)
+    {
+      CopyField(srcRow[i], row[i], m_arena.get());
+    }
+  }
+}
+
+CSVTable& CSVTable::operator=(const CSVTable& other)
+{
+  if (this != &other)
+  {
+    *this = CSVTable(other);
+  }
+  return *this;
+}
+
+CSVTable& CSVTable::operator=(CSVTable&& other) noexcept
+{
+  m_headerData = std::move(other.m_headerData);
+  m_keyColumns = std::move(other.m_keyColumns);
+  m_wasSorted = other.m_wasSorted;
+  m_schema = std::move(other.m_schema);
+  m_linkRows = std::move(other.m_linkRows);
+  m_rowShards = std::move(other.m_rowShards);
+
+  // Release the old rows before the old arena
+  m_rowData = std::move(other.m_rowData);
+  m_arena = std::move(other.m_arena);
+  return *this;
+}
+
+std::pmr::vector<std::pmr::vector<std::string_view>> ReadCSV(const char* srcData, std::pmr::memory_resource* resource)
+{
+  std::pmr::vector<std::pmr::vector<std::string_view>> csvTable(resource);
+  std::pmr::vector<std::string_view> row(resource);
   bool inQuotes = false;
 
+  // Fields are views of the source data. Only fields where quotes were removed are built in a buffer and copied to the resource.
+  const char* fieldStart = srcData;
+  bool fieldCopied = false;
+  std::string field;
+
   if (!srcData)
   {
     return csvTable;
   }
 
+  // Start copying the field to the buffer (characters in the source from the start of the field are no longer contiguous)
+  auto beginFieldCopy = [&]()
+  {
+    if (!fieldCopied)
+    {
+      field.assign(fieldStart, srcData);
+      fieldCopied = true;
+    }
+  };
+
+  auto addField = [&]()
+  {
+    if (fieldCopied)
+    {
+      char* fieldData = static_cast<char*>(resource->allocate(field.size(), 1));
+      std::memcpy(fieldData, field.data(), field.size());
+      row.emplace_back(fieldData, field.size());
+      field.clear();
+      fieldCopied = false;
+    }
+    else
+    {
+      row.emplace_back(fieldStart, srcData - fieldStart);
+    }
+  };
+
   char c = *srcData;
 
   while (c)
@@ -210,39 +310,59 @@ std::vector<std::vector<std::string>> ReadCSV(const char* srcData)
       }
       else
       {
-        field += c; // Add character to field, including newlines
+        // Add the characters up to the next quote to the field in one go, including newlines
+        const char* runEnd = srcData + 1;
+        while (*runEnd && *runEnd != '"')
+        {
+          runEnd++;
+        }
+        field.append(srcData, runEnd);
+        srcData = runEnd - 1;
       }
     }
     else
     {
       if (c == '"')
       {
+        beginFieldCopy();
         inQuotes = true; // Start of quoted field
       }
       else if (c == ',')
       {
-        row.push_back(field);
-        field.clear();
+        addField();
+        fieldStart = srcData + 1;
       }
       else if (c == '\n' || c == '\r')
       {
+        // Add the last field of the row // DT_TODO: Should this be discarding empty rows? What if a single column? Verify against other parser
+        addField();
+
         // Handle newlines (including \r\n for Windows)
         if (c == '\r' && srcData[1] == '\n')
         {
           srcData++; // Consume \n in \r\n
         }
+        fieldStart = srcData + 1;
 
-        // Add the last field of the row // DT_TODO: Should this be discarding empty rows? What if a single column? Verify against other parser
-        row.push_back(field);
-        field.clear();
-
-        // Add row to data
-        csvTable.push_back(row);
+        // Add row to data, the next row likely has the same field count
+        size_t fieldCount = row.size();
+        csvTable.push_back(std::move(row));
         row.clear();
+        row.reserve(fieldCount);
       }
       else
       {
-        field += c;
+        // Skip over the characters up to the next separator, newline or quote in one go
+        const char* runEnd = srcData + 1;
+        while (*runEnd && *runEnd != ',' && *runEnd != '"' && *runEnd != '\n' && *runEnd != '\r')
+        {
+          runEnd++;
+        }
+        if (fieldCopied)
+        {
+          field.append(srcData, runEnd);
+        }
+        srcData = runEnd - 1;
       }
     }
 
@@ -252,10 +372,11 @@ std::vector<std::vector<std::string>> ReadCSV(const char* srcData)
   }
 
   // Handle the last field and row
-  if (!field.empty() || !row.empty())
+  bool hasField = fieldCopied ? !field.empty() : srcData != fieldStart;
+  if (hasField || !row.empty())
   {
-    row.push_back(field);
-    csvTable.push_back(row);
+    addField();
+    csvTable.push_back(std::move(row));
   }
 
   // How to handle if still in quotes at end? inQuotes
@@ -311,6 +432,10 @@ bool ReadHeader(std::string_view field, CSVHeader& out)
       {
         out.m_isIgnored = true;
       }
+      else if (tag == "cold")
+      {
+        out.m_isCold = true;
+      }
       else if (tag.starts_with("min="))
       {
         out.m_minValue = tag.substr(4);
@@ -345,6 +470,7 @@ bool ReadHeader(std::string_view field, CSVHeader& out)
   if (out.m_isIgnored)
   {
     out.m_isKey = false;
+    out.m_isCold = false;
     out.m_type = FieldType("");
     out.m_foreignTable.clear();
     out.m_comment.clear();
@@ -365,13 +491,19 @@ bool ReadHeader(std::string_view field, CSVHeader& out)
     return false;
   }
 
+  // Keys are needed for searches, so cannot be moved to cold storage
+  if (out.m_isKey && out.m_isCold)
+  {
+    OutputMessage("Error: Key column cannot be cold in ""{}""", field);
+    return false;
+  }
+
   return true;
 }
 
-bool ReadTable(const char* fileString, CSVTable& newTable)
+bool ReadTableHeader(const std::pmr::vector<std::pmr::vector<std::string_view>>& csvData, CSVTable& newTable)
 {
   // Check that there is at least one row in addition to the header
-  std::vector<std::vector<std::string>> csvData = ReadCSV(fileString);
   if (csvData.size() < 2)
   {
     OutputMessage("Error: Table does not have at least 2 rows"); // DT_TODO: Relax this - only check when reading data into DB?
@@ -393,7 +525,7 @@ bool ReadTable(const char* fileString, CSVTable& newTable)
   newTable.m_headerData.reserve(columnCount);
   for (uint32_t i = 0; i < columnCount; i++)
   {
-    const std::string& header = csvData[0][i];
+    std::string_view header = csvData[0][i];
 
     CSVHeader newHeader;
     if (!ReadHeader(header, newHeader))
@@ -423,70 +555,100 @@ bool ReadTable(const char* fileString, CSVTable& newTable)
       uniqueCheck.insert(header.m_name); // DT_TODO: This will not catch multiple columns with the same name if multiple foreign tables with the same base name
     }
   }
+  return true;
+}
 
-  // Copy all row data over
-  newTable.m_rowData.resize(csvData.size() - 1);
-  for (std::vector<FieldType>& row : newTable.m_rowData)
+bool ReadColumnRange(const CSVHeader& header, FieldType& outMin, FieldType& outMax)
+{
+  if (header.m_minValue.size() > 0)
   {
-    row.resize(columnCount);
+    if (!ParseField(header.m_type, header.m_minValue, outMin))
+    {
+      OutputMessage("Error: Table has bad min value in column {} entry \"{}\"", header.m_name, header.m_minValue);
+      return false;
+    }
+  }
+  if (header.m_maxValue.size() > 0)
+  {
+    if (!ParseField(header.m_type, header.m_maxValue, outMax))
+    {
+      OutputMessage("Error: Table has bad max value in column {} entry \"{}\"", header.m_name, header.m_maxValue);
+      return false;
+    }
   }
+  return true;
+}
 
-  for (size_t h = 0; h < columnCount; h++)
+bool ParseColumnField(const CSVHeader& header, const FieldType& minValue, const FieldType& maxValue, std::string_view string, FieldType& retField, std::pmr::memory_resource* resource)
+{
+  // Attempt conversion
+  if (!ParseField(header.m_type, string, retField, resource))
   {
-    const CSVHeader& header = newTable.m_headerData[h];
+    OutputMessage("Error: Table has bad data in column {}", header.m_name);
+    return false;
+  }
 
-    // If there is a min/max range get it
-    FieldType minNumber;
+  if (!std::holds_alternative<FieldString>(header.m_type))
+  {
+    // Check min / max ranges
     if (header.m_minValue.size() > 0)
     {
-      if (!ParseField(header.m_type, header.m_minValue, minNumber))
+      if (retField < minValue)
       {
-        OutputMessage("Error: Table has bad min value in column {} entry \"{}\"", header.m_name, header.m_minValue);
+        OutputMessage("Error: Table has bad data in column {} entry \"{}\" is less than min {}", header.m_name, to_string(retField), header.m_minValue);
         return false;
       }
     }
-    FieldType maxNumber;
     if (header.m_maxValue.size() > 0)
     {
-      if (!ParseField(header.m_type, header.m_maxValue, maxNumber))
+      if (retField > maxValue)
       {
-        OutputMessage("Error: Table has bad max value in column {} entry \"{}\"", header.m_name, header.m_maxValue);
+        OutputMessage("Error: Table has bad data in column {} entry \"{}\" is greater than max {} ", header.m_name, to_string(retField), header.m_maxValue);
         return false;
       }
     }
+  }
+  return true;
+}
+
+bool ReadTable(const char* fileString, CSVTable& newTable)
+{
+  // The parse temporaries are allocated from an arena that is released in one go at the end of the read
+  std::pmr::monotonic_buffer_resource parseArena(std::max<size_t>(std::strlen(fileString) * 4, 4096));
+
+  std::pmr::vector<std::pmr::vector<std::string_view>> csvData = ReadCSV(fileString, &parseArena);
+  if (!ReadTableHeader(csvData, newTable))
+  {
+    return false;
+  }
+
+  // Copy all row data over
+  const size_t columnCount = csvData[0].size();
+  newTable.m_rowData.resize(csvData.size() - 1);
+  for (CSVRow& row : newTable.m_rowData)
+  {
+    row.resize(columnCount);
+  }
+
+  for (size_t h = 0; h < columnCount; h++)
+  {
+    const CSVHeader& header = newTable.m_headerData[h];
+
+    // If there is a min/max range get it
+    FieldType minNumber;
+    FieldType maxNumber;
+    if (!ReadColumnRange(header, minNumber, maxNumber))
+    {
+      return false;
+    }
 
     // Check all table data
     for (size_t i = 1; i < csvData.size(); i++)
     {
-      FieldType& columnField = newTable.m_rowData[i - 1][h];
-
-      // Attempt conversion
-      if (!ParseFieldMove(header.m_type, std::move(csvData[i][h]), columnField))
+      if (!ParseColumnField(header, minNumber, maxNumber, csvData[i][h], newTable.m_rowData[i - 1][h], newTable.GetArena()))
       {
-        OutputMessage("Error: Table has bad data in column {}", header.m_name);
         return false;
       }
-
-      if (!std::holds_alternative<std::string>(header.m_type))
-      {
-        // Check min / max ranges
-        if (header.m_minValue.size() > 0)
-        {
-          if (columnField < minNumber)
-          {
-            OutputMessage("Error: Table has bad data in column {} entry \"{}\" is less than min {}", header.m_name, to_string(columnField), header.m_minValue);
-            return false;
-          }
-        }
-        if (header.m_maxValue.size() > 0)
-        {
-          if (columnField > maxNumber)
-          {
-            OutputMessage("Error: Table has bad data in column {} entry \"{}\" is greater than max {} ", header.m_name, to_string(columnField), header.m_maxValue);
-            return false;
-          }
-        }
-      }
     }
   }
   return true;
@@ -496,12 +658,12 @@ bool SortTable(CSVTable & newTable)
 {
   if (newTable.m_keyColumns.size() == 0 || newTable.m_rowData.size() <= 1)
   {
+    newTable.m_wasSorted = true;
     return true;
   }
 
   // Sort by the keys, check if duplicate rows
-  std::sort(newTable.m_rowData.begin(), newTable.m_rowData.end(),
-    [&newTable](const std::vector<FieldType>& a, const std::vector<FieldType>& b)
+  auto keyCompare = [&newTable](const CSVRow& a, const CSVRow& b)
     {
       for (uint32_t index : newTable.m_keyColumns)
       {
@@ -515,13 +677,41 @@ bool SortTable(CSVTable & newTable)
         }
       }
       return false;
-    });
+    };
+
+  // Most tables are saved sorted, so only sort when the rows are out of order
+  newTable.m_wasSorted = std::is_sorted(newTable.m_rowData.begin(), newTable.m_rowData.end(), keyCompare);
+  if (!newTable.m_wasSorted && newTable.m_rowShards.size() == 0)
+  {
+    std::sort(newTable.m_rowData.begin(), newTable.m_rowData.end(), keyCompare);
+    newTable.m_linkRows.clear();
+  }
+  else if (!newTable.m_wasSorted)
+  {
+    // Sort the shard of each row with the rows
+    std::vector<uint32_t> order(newTable.m_rowData.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&newTable, &keyCompare](uint32_t a, uint32_t b) { return keyCompare(newTable.m_rowData[a], newTable.m_rowData[b]); });
+
+    CSVRows sortedRows(newTable.m_rowData.get_allocator());
+    std::vector<uint16_t> sortedShards;
+    sortedRows.reserve(order.size());
+    sortedShards.reserve(order.size());
+    for (uint32_t r : order)
+    {
+      sortedRows.push_back(std::move(newTable.m_rowData[r]));
+      sortedShards.push_back(newTable.m_rowShards[r]);
+    }
+    newTable.m_rowData = std::move(sortedRows);
+    newTable.m_rowShards = std::move(sortedShards);
+    newTable.m_linkRows.clear();
+  }
 
   // Loop and check for duplicate rows
   for (size_t r = 1; r < newTable.m_rowData.size(); r++)
   {
-    const std::vector<FieldType>& prev = newTable.m_rowData[r - 1];
-    const std::vector<FieldType>& curr = newTable.m_rowData[r];
+    const CSVRow& prev = newTable.m_rowData[r - 1];
+    const CSVRow& curr = newTable.m_rowData[r];
 
     bool duplicate = true;
     for (uint32_t index : newTable.m_keyColumns)
@@ -548,13 +738,9 @@ bool SortTable(CSVTable & newTable)
   return true;
 }
 
-bool FindSourceHeaderColumn(const std::string& columnName, const std::string& foreignTableName, const std::unordered_map<std::string, CSVTable>& tables, std::string& outTableName, FieldType& outField)
+// Find the key column of the foreign table that a link column holds
+static bool FindForeignKeyColumn(const std::string& columnName, const std::string& foreignTableName, const std::unordered_map<std::string, CSVTable>& tables, const CSVTable*& outForeignTable, uint32_t& outColumn)
 {
-  if (foreignTableName.size() == 0)
-  {
-    return false;
-  }
-
   // Check foreign table exists
   auto findTable = tables.find(foreignTableName);
   if (findTable == tables.end())
@@ -569,93 +755,125 @@ bool FindSourceHeaderColumn(const std::string& columnName, const std::string& fo
     OutputMessage("Error: Column {} has link to table {} with no keys", columnName, foreignTableName);
     return false;
   }
+  outForeignTable = &foreignTable;
 
   // Get the base name end position
   size_t headerSplitIndex = columnName.find_first_of(':');
 
   // If only one foreign key, check for optional foreign table column name
-  int32_t foundIndex = -1;
   if (foreignTable.m_keyColumns.size() == 1 && headerSplitIndex == std::string::npos)
   {
     // If only the base name, 
-    foundIndex = foreignTable.m_keyColumns[0];
+    outColumn = foreignTable.m_keyColumns[0];
+    return true;
   }
-  else
+
+  // Find each base name+ foreign key name
+  std::string_view findName(columnName);
+  findName = findName.substr(headerSplitIndex + 1);
+  for (uint32_t foreignKeyColumn : foreignTable.m_keyColumns)
   {
-    // Find each base name+ foreign key name
-    std::string_view findName(columnName);
-    findName = findName.substr(headerSplitIndex + 1);
-    for (uint32_t foreignKeyColumn : foreignTable.m_keyColumns)
+    if (foreignTable.m_headerData[foreignKeyColumn].m_name == findName)
     {
-      if (foreignTable.m_headerData[foreignKeyColumn].m_name == findName)
-      {
-        foundIndex = foreignKeyColumn;
-        break;
-      }
+      outColumn = foreignKeyColumn;
+      return true;
     }
   }
-  if (foundIndex < 0)
+  OutputMessage("Error: Column {} has link to table {} without key", columnName, foreignTableName);
+  return false;
+}
+
+// Resolve the source of a link column, following links through linked key columns.
+// The state of each column is 0 unresolved, 1 resolving and 2 resolved, so a column found again while resolving is a link cycle.
+static bool ResolveColumnLink(const std::string& tableName, CSVTable& table, uint32_t column, std::unordered_map<std::string, CSVTable>& tables,
+                              std::unordered_map<const CSVTable*, std::vector<uint8_t>>& columnStates)
+{
+  uint8_t& state = columnStates.at(&table)[column];
+  if (state == 2)
+  {
+    return true;
+  }
+  const CSVHeader& header = table.m_headerData[column];
+  if (state == 1)
   {
-    OutputMessage("Error: Column {} has link to table {} without key", columnName, foreignTableName);
+    OutputMessage("Error: Table {} column {} has a link cycle", tableName, header.m_name);
     return false;
   }
-  if (foreignTable.m_headerData[foundIndex].m_foreignTable.size() > 0)
+  state = 1;
+
+  const CSVTable* foreignTable = nullptr;
+  uint32_t foreignColumn = 0;
+  if (!FindForeignKeyColumn(header.m_name, header.m_foreignTable, tables, foreignTable, foreignColumn))
   {
-    return FindSourceHeaderColumn(foreignTable.m_headerData[foundIndex].m_name, foreignTable.m_headerData[foundIndex].m_foreignTable, tables, outTableName, outField);
+    return false;
   }
 
-  outTableName = foreignTableName;
-  outField = foreignTable.m_headerData[foundIndex].m_type;
+  CSVColumnLink& link = table.m_schema.m_columnLinks[column];
+  if (foreignTable->m_headerData[foreignColumn].m_foreignTable.size() > 0)
+  {
+    CSVTable& linkedTable = tables.at(header.m_foreignTable);
+    if (!ResolveColumnLink(header.m_foreignTable, linkedTable, foreignColumn, tables, columnStates))
+    {
+      return false;
+    }
+    link.m_sourceTable = linkedTable.m_schema.m_columnLinks[foreignColumn].m_sourceTable;
+    link.m_sourceColumn = linkedTable.m_schema.m_columnLinks[foreignColumn].m_sourceColumn;
+  }
+  else
+  {
+    link.m_sourceTable = header.m_foreignTable;
+    link.m_sourceColumn = foreignColumn;
+  }
 
+  state = 2;
   return true;
 }
 
-bool ValidateTables(const std::unordered_map<std::string, CSVTable>& tables)
+bool BuildSchema(std::unordered_map<std::string, CSVTable>& tables)
 {
-  // Check that the table references match up
-  std::vector<bool> processed;
-  std::vector<uint32_t> matchIndices;
-  std::string searchName;
-  for (const auto& [tableName, table] : tables)
+  // Column names first, as the links are found by the names of the columns in the tables
+  std::unordered_map<const CSVTable*, std::vector<uint8_t>> columnStates;
+  for (auto& [tableName, table] : tables)
   {
-    // Reset the processed array
-    processed.resize(0);
-    processed.resize(table.m_headerData.size());
+    CSVSchema& schema = table.m_schema;
+    schema.m_columnIndices.clear();
+    schema.m_columnIndices.reserve(table.m_headerData.size());
+    for (uint32_t h = 0; h < table.m_headerData.size(); h++)
+    {
+      schema.m_columnIndices.try_emplace(table.m_headerData[h].m_name, h);
+    }
+    schema.m_columnLinks.clear();
+    schema.m_columnLinks.resize(table.m_headerData.size());
+    columnStates[&table].resize(table.m_headerData.size());
+  }
 
-    // Check the table for foreign links
+  std::string searchName;
+  for (auto& [tableName, table] : tables)
+  {
+    CSVSchema& schema = table.m_schema;
     for (uint32_t h = 0; h < table.m_headerData.size(); h++)
     {
-      // Check if this column is already processed or does not have a foreign table link
       const CSVHeader& header = table.m_headerData[h];
-      if (processed[h] || header.m_foreignTable.size() == 0)
+      if (header.m_foreignTable.size() == 0)
       {
         continue;
       }
-
-      // Check foreign table exists
-      auto findTable = tables.find(header.m_foreignTable);
-      if (findTable == tables.end())
+      if (!ResolveColumnLink(tableName, table, h, tables, columnStates))
       {
-        OutputMessage("Error: Table {} has link to unknown table {}", tableName, header.m_foreignTable);
         return false;
       }
 
-      const CSVTable& foreignTable = findTable->second;
-      if (foreignTable.m_keyColumns.size() == 0)
+      // The columns of the link, set for each column of a multi key link when the first is found
+      if (schema.m_columnLinks[h].m_linkColumns.size() > 0)
       {
-        OutputMessage("Error: Table {} has link to table {} with no keys", tableName, header.m_foreignTable);
-        return false;
+        continue;
       }
-
-      // Get the base name end position
+      const CSVTable& foreignTable = tables.at(header.m_foreignTable);
       size_t headerSplitIndex = header.m_name.find_first_of(':');
-
-      // If only one foreign key, check for optional foreign table column name
-      matchIndices.resize(0);
+      std::vector<uint32_t> linkColumns;
       if (foreignTable.m_keyColumns.size() == 1 && headerSplitIndex == std::string::npos)
       {
-        // If only the base name, 
-        matchIndices.push_back(h);
+        linkColumns.push_back(h);
       }
       else
       {
@@ -666,230 +884,449 @@ bool ValidateTables(const std::unordered_map<std::string, CSVTable>& tables)
           searchName += ":";
           searchName += foreignTable.m_headerData[foreignKeyColumn].m_name;
 
-          int32_t foundIndex = -1;
-          for (uint32_t i = 0; i < table.m_headerData.size(); i++)
-          {
-            if (table.m_headerData[i].m_name == searchName &&
-                table.m_headerData[i].m_foreignTable == header.m_foreignTable)
-            {
-              foundIndex = i;
-              break;
-            }
-          }
-          if (foundIndex < 0)
+          auto findColumn = schema.m_columnIndices.find(searchName);
+          if (findColumn == schema.m_columnIndices.end() ||
+              table.m_headerData[findColumn->second].m_foreignTable != header.m_foreignTable)
           {
             OutputMessage("Error: Table {} has link to table {} without key {}", tableName, header.m_foreignTable, searchName);
             return false;
           }
-          matchIndices.push_back(foundIndex);
-        }
-      }
-
-      // Search in the foreign table for each of the keys in the main table
-      for (const std::vector<FieldType>& row : table.m_rowData)
-      {
-        auto findInfo = std::lower_bound(foreignTable.m_rowData.begin(), foreignTable.m_rowData.end(), row,
-          [&foreignTable, &matchIndices](const std::vector<FieldType>& a, const std::vector<FieldType>& b)
-          {
-            for (uint32_t i = 0; i < foreignTable.m_keyColumns.size(); i++)
-            {
-              const FieldType& aVal = a[foreignTable.m_keyColumns[i]]; // Enum sort issue?
-              const FieldType& bVal = b[matchIndices[i]];
-              if (aVal < bVal)
-              {
-                return true;
-              }
-              if (aVal != bVal)
-              {
-                break;
-              }
-            }
-            return false;
-          });
-
-        auto IsEqual = [&foreignTable, &matchIndices](const std::vector<FieldType>& a, const std::vector<FieldType>& b)
-          {
-            for (uint32_t i = 0; i < foreignTable.m_keyColumns.size(); i++)
-            {
-              const FieldType& aVal = a[foreignTable.m_keyColumns[i]];
-              const FieldType& bVal = b[matchIndices[i]];
-              if (aVal != bVal)
-              {
-                return false;
-              }
-            }
-            return true;
-          };
-
-        if (findInfo == foreignTable.m_rowData.end() ||
-            !IsEqual(*findInfo, row))
-        {
-          std::string errorKeys;
-          for (uint32_t index : matchIndices)
-          {
-            AppendToString(row[index], errorKeys);
-            errorKeys += " ";
-          }
-          OutputMessage("Error: Table {} has link to table {} with a missing lookup column key {}", tableName, header.m_foreignTable, errorKeys);
-          return false;
+          linkColumns.push_back(findColumn->second);
         }
       }
-
-      // Flag all columns as processed
-      for (uint32_t index : matchIndices)
+      for (uint32_t column : linkColumns)
       {
-        processed[index] = true;
+        schema.m_columnLinks[column].m_linkColumns = linkColumns;
       }
     }
   }
-
   return true;
 }
 
-void SaveToString(const CSVTable& table, const std::unordered_map<std::string, CSVTable>& tables, std::string_view existingFile, std::string& outFile)
+bool FindSourceHeaderColumn(const std::string& columnName, const std::string& foreignTableName, const std::unordered_map<std::string, CSVTable>& tables, std::string& outTableName, FieldType& outField)
 {
-  std::string fieldStr;
-  outFile.reserve(existingFile.size());
-
-  // Find the first type of newline in the file
-  std::string newLine = "\n";
-  size_t newLineoffset = existingFile.find_first_of("\n\r", 0, 2);
-  if (newLineoffset != std::string::npos)
+  if (foreignTableName.size() == 0)
   {
-    newLine = existingFile[newLineoffset];
+    return false;
+  }
 
-    // Check for windows style \r\n
-    if (existingFile[newLineoffset] == '\r' &&
-      (newLineoffset + 1) < existingFile.size() &&
-      existingFile[newLineoffset + 1] == '\n')
-    {
-      newLine += '\n';
-    }
+  const CSVTable* foreignTable = nullptr;
+  uint32_t foreignColumn = 0;
+  if (!FindForeignKeyColumn(columnName, foreignTableName, tables, foreignTable, foreignColumn))
+  {
+    return false;
   }
 
-  // Write header data
-  std::vector<std::string> enumTableHeaders;
+  // A linked key column has its source in the schema of the foreign table
+  if (foreignTable->m_headerData[foreignColumn].m_foreignTable.size() > 0)
   {
-    bool firstWrite = true;
-    for (const CSVHeader& header : table.m_headerData)
+    if (foreignColumn >= foreignTable->m_schema.m_columnLinks.size())
     {
-      if (!firstWrite)
-      {
-        outFile += ",";
-      }
-      firstWrite = false;
-      outFile += header.m_rawField;
-
-      // Get what tables need an enum replacement with the text version
-      std::string lookupTable;
-      FieldType dummyField;
-      if (header.m_foreignTable.size() > 0 &&
-          FindSourceHeaderColumn(header.m_name, header.m_foreignTable, tables, lookupTable, dummyField) &&
-          IsEnumTable(lookupTable))
-      {
-        enumTableHeaders.push_back(lookupTable);
-      }
-      else
-      {
-        enumTableHeaders.push_back(std::string());
-      }
+      OutputMessage("Error: Table {} has no schema", foreignTableName);
+      return false;
     }
+    const CSVColumnLink& link = foreignTable->m_schema.m_columnLinks[foreignColumn];
+    outTableName = link.m_sourceTable;
+    outField = tables.at(link.m_sourceTable).m_headerData[link.m_sourceColumn].m_type;
+    return true;
   }
-  outFile += newLine;
 
-  // Write each row
-  for (const std::vector<FieldType>& row : table.m_rowData)
-  {
-    // Loop and write the fields
-    bool firstWrite = true;
-    for(uint32_t i = 0; i < row.size(); i++)
-    {
-      const FieldType* field = &row[i];
+  outTableName = foreignTableName;
+  outField = foreignTable->m_headerData[foreignColumn].m_type;
 
-      if (!firstWrite)
-      {
-        outFile += ",";
-      }
-      firstWrite = false;
+  return true;
+}
 
-      // If an enum type, lookup the string version
-      if (enumTableHeaders[i].size() > 0)
-      {
-        auto findTable = tables.find(enumTableHeaders[i]);
-        if (findTable == tables.end())
-        {
-          OutputMessage("Error: Unknown table {}", enumTableHeaders[i]);
-          return;
-        }
-        const CSVTable& enumTable = findTable->second;
+bool GetLinkColumns(std::string_view tableName, const CSVTable& table, uint32_t column, std::vector<uint32_t>& outColumns)
+{
+  if (column >= table.m_schema.m_columnLinks.size() ||
+      table.m_schema.m_columnLinks[column].m_linkColumns.size() == 0)
+  {
+    OutputMessage("Error: Table {} column {} has no link in the schema", tableName, table.m_headerData[column].m_name);
+    return false;
+  }
+  outColumns = table.m_schema.m_columnLinks[column].m_linkColumns;
+  return true;
+}
 
-        // Find the enum - access name column
-        auto findInfo = std::lower_bound(enumTable.m_rowData.begin(), enumTable.m_rowData.end(), row,
-          [i](const std::vector<FieldType>& a, const std::vector<FieldType>& b)
-          {
-            return a[1] < b[i];
-          });
+bool ValidateTable(const std::string& tableName, CSVTable& table, const std::unordered_map<std::string, CSVTable>& tables)
+{
+  std::vector<bool> processed(table.m_headerData.size());
+  std::vector<uint32_t> matchIndices;
+  table.m_linkRows.clear();
+  table.m_linkRows.resize(table.m_headerData.size());
+
+  // Check the table for foreign links
+  for (uint32_t h = 0; h < table.m_headerData.size(); h++)
+  {
+    // Check if this column is already processed or does not have a foreign table link
+    const CSVHeader& header = table.m_headerData[h];
+    if (processed[h] || header.m_foreignTable.size() == 0)
+    {
+      continue;
+    }
 
-        auto IsEqual = [i](const std::vector<FieldType>& a, const std::vector<FieldType>& b)
+    // Check foreign table exists
+    auto findTable = tables.find(header.m_foreignTable);
+    if (findTable == tables.end())
+    {
+      OutputMessage("Error: Table {} has link to unknown table {}", tableName, header.m_foreignTable);
+      return false;
+    }
+
+    const CSVTable& foreignTable = findTable->second;
+    if (foreignTable.m_keyColumns.size() == 0)
+    {
+      OutputMessage("Error: Table {} has link to table {} with no keys", tableName, header.m_foreignTable);
+      return false;
+    }
+
+    if (!GetLinkColumns(tableName, table, h, matchIndices))
+    {
+      return false;
+    }
+
+    // Search in the foreign table for each of the keys in the main table, keeping the row found
+    ProfileScope linkScope("ValidateLink", tableName, header.m_name);
+    linkScope.SetRows(table.m_rowData.size());
+    std::vector<uint32_t>& linkRows = table.m_linkRows[h];
+    linkRows.resize(table.m_rowData.size());
+    for (size_t r = 0; r < table.m_rowData.size(); r++)
+    {
+      const CSVRow& row = table.m_rowData[r];
+      auto findInfo = std::lower_bound(foreignTable.m_rowData.begin(), foreignTable.m_rowData.end(), row,
+        [&foreignTable, &matchIndices](const CSVRow& a, const CSVRow& b)
+        {
+          for (uint32_t i = 0; i < foreignTable.m_keyColumns.size(); i++)
           {
-            return a[1] == b[i];
-          };
+            const FieldType& aVal = a[foreignTable.m_keyColumns[i]]; // Enum sort issue?
+            const FieldType& bVal = b[matchIndices[i]];
+            if (aVal < bVal)
+            {
+              return true;
+            }
+            if (aVal != bVal)
+            {
+              break;
+            }
+          }
+          return false;
+        });
 
-        if (findInfo == enumTable.m_rowData.end() ||
-            !IsEqual(*findInfo, row))
+      auto IsEqual = [&foreignTable, &matchIndices](const CSVRow& a, const CSVRow& b)
         {
-          OutputMessage("Error: Table has link to table {} with a missing lookup column key {}", enumTableHeaders[i], to_string(row[i]));
-          return;
-        }
-        else
+          for (uint32_t i = 0; i < foreignTable.m_keyColumns.size(); i++)
+          {
+            const FieldType& aVal = a[foreignTable.m_keyColumns[i]];
+            const FieldType& bVal = b[matchIndices[i]];
+            if (aVal != bVal)
+            {
+              return false;
+            }
+          }
+          return true;
+        };
+
+      if (findInfo == foreignTable.m_rowData.end() ||
+          !IsEqual(*findInfo, row))
+      {
+        std::string errorKeys;
+        for (uint32_t index : matchIndices)
         {
-          field = &(*findInfo)[0];
+          AppendToString(row[index], errorKeys);
+          errorKeys += " ";
         }
+        OutputMessage("Error: Table {} has link to table {} with a missing lookup column key {}", tableName, header.m_foreignTable, errorKeys);
+        return false;
       }
+      linkRows[r] = static_cast<uint32_t>(std::distance(foreignTable.m_rowData.begin(), findInfo));
+    }
+
+    // Flag all columns as processed
+    for (uint32_t index : matchIndices)
+    {
+      processed[index] = true;
+    }
+  }
+
+  return true;
+}
+
+bool ValidateTables(std::unordered_map<std::string, CSVTable>& tables)
+{
+  // Check that the table references match up
+  for (auto& [tableName, table] : tables)
+  {
+    if (!ValidateTable(tableName, table, tables))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string GetNewLine(std::string_view existingFile)
+{
+  // Find the first type of newline in the file
+  std::string newLine = "\n";
+  size_t newLineoffset = existingFile.find_first_of("\n\r", 0, 2);
+  if (newLineoffset != std::string::npos)
+  {
+    newLine = existingFile[newLineoffset];
+
+    // Check for windows style \r\n
+    if (existingFile[newLineoffset] == '\r' &&
+      (newLineoffset + 1) < existingFile.size() &&
+      existingFile[newLineoffset + 1] == '\n')
+    {
+      newLine += '\n';
+    }
+  }
+  return newLine;
+}
+
+void AppendSavedString(std::string_view str, std::string& appendStr)
+{
+  // If the fields contain a comma or quotes, put in quotes
+  size_t quoteOffset = str.find_first_of('"');
+  if (quoteOffset == std::string::npos &&
+      str.find_first_of(',') == std::string::npos)
+  {
+    // Add raw unmodified string
+    appendStr += str;
+    return;
+  }
+
+  // Replace all single quotes with double quotes // DT_TODO: Test this!
+  appendStr += '"';
+  while (quoteOffset != std::string::npos)
+  {
+    appendStr += str.substr(0, quoteOffset + 1);
+    appendStr += '"';
+    str = str.substr(quoteOffset + 1);
+    quoteOffset = str.find_first_of('"');
+  }
+  appendStr += str;
+  appendStr += '"';
+}
+
+void AppendSavedField(const FieldType& field, std::string& appendStr)
+{
+  if (const FieldString* accessField = std::get_if<FieldString>(&field))
+  {
+    AppendSavedString(*accessField, appendStr);
+  }
+  else
+  {
+    // Add number type
+    AppendToString(field, appendStr);
+  }
+}
+
+// Appends the saved table text to a string
+class StringTableWriter
+{
+public:
+  explicit StringTableWriter(std::string& outFile) : m_outFile(outFile) {}
 
-      // Get the field in string form
-      if (const std::string* accessField = std::get_if<std::string>(field))
+  bool Append(std::string_view str)
+  {
+    m_outFile += str;
+    return true;
+  }
+
+private:
+  std::string& m_outFile;
+};
+
+// Compares the saved table text against an existing file as it is written, stopping at the first difference
+class CompareTableWriter
+{
+public:
+  explicit CompareTableWriter(std::string_view existingFile) : m_existingFile(existingFile) {}
+
+  bool Append(std::string_view str)
+  {
+    if (!m_existingFile.substr(m_offset).starts_with(str))
+    {
+      return false;
+    }
+    m_offset += str.size();
+    return true;
+  }
+
+  bool IsMatch() const { return m_offset == m_existingFile.size(); }
+
+private:
+  std::string_view m_existingFile;
+  size_t m_offset = 0;
+};
+
+// Write the table in the saved text form. Returns false on an error or if the writer stops the write.
+template<typename Writer>
+static bool WriteTableText(const CSVTable& table, const std::unordered_map<std::string, CSVTable>& tables, std::string_view existingFile, uint16_t shard, Writer& out)
+{
+  std::string fieldStr;
+  const std::string newLine = GetNewLine(existingFile);
+
+  // Write header data
+  std::vector<std::string> enumTableHeaders;
+  std::vector<const std::vector<uint32_t>*> enumLinkRows;
+  {
+    bool firstWrite = true;
+    for (uint32_t h = 0; h < table.m_headerData.size(); h++)
+    {
+      const CSVHeader& header = table.m_headerData[h];
+      if ((!firstWrite && !out.Append(",")) ||
+          !out.Append(header.m_rawField))
+      {
+        return false;
+      }
+      firstWrite = false;
+
+      // Get what tables need an enum replacement with the text version, from the schema of the table if it has one
+      std::string lookupTable;
+      FieldType dummyField;
+      if (h < table.m_schema.m_columnLinks.size())
+      {
+        lookupTable = table.m_schema.m_columnLinks[h].m_sourceTable;
+      }
+      else if (header.m_foreignTable.size() > 0)
+      {
+        FindSourceHeaderColumn(header.m_name, header.m_foreignTable, tables, lookupTable, dummyField);
+      }
+      if (IsEnumTable(lookupTable))
+      {
+        // A direct link to the enum table has the rows found on validation
+        bool hasLinkRows = lookupTable == header.m_foreignTable && h < table.m_linkRows.size() && table.m_linkRows[h].size() == table.m_rowData.size();
+        enumTableHeaders.push_back(lookupTable);
+        enumLinkRows.push_back(hasLinkRows ? &table.m_linkRows[h] : nullptr);
+      }
+      else
+      {
+        enumTableHeaders.push_back(std::string());
+        enumLinkRows.push_back(nullptr);
+      }
+    }
+  }
+
+  // Write each row, starting with the newline of the previous line. Rows added after the read are in the first shard.
+  for (size_t r = 0; r < table.m_rowData.size(); r++)
+  {
+    if (table.m_rowShards.size() > 0 && (r < table.m_rowShards.size() ? table.m_rowShards[r] : 0) != shard)
+    {
+      continue;
+    }
+    const CSVRow& row = table.m_rowData[r];
+    if (!out.Append(newLine))
+    {
+      return false;
+    }
+
+    // Loop and write the fields
+    bool firstWrite = true;
+    for(uint32_t i = 0; i < row.size(); i++)
+    {
+      const FieldType* field = &row[i];
+
+      if (!firstWrite && !out.Append(","))
+      {
+        return false;
+      }
+      firstWrite = false;
+
+      // If an enum type, lookup the string version
+      if (enumTableHeaders[i].size() > 0)
       {
-        // If the fields contain a comma or quotes, put in quotes
-        size_t quoteOffset = accessField->find_first_of('"');
-        if (quoteOffset != std::string::npos ||
-            accessField->find_first_of(',') != std::string::npos)
+        auto findTable = tables.find(enumTableHeaders[i]);
+        if (findTable == tables.end())
         {
-          fieldStr = *accessField;
-          outFile += "\"";
+          OutputMessage("Error: Unknown table {}", enumTableHeaders[i]);
+          return false;
+        }
+        const CSVTable& enumTable = findTable->second;
+        if (enumLinkRows[i])
+        {
+          field = &enumTable.m_rowData[(*enumLinkRows[i])[r]][0];
+        }
+        else
+        {
+          // Find the enum - access name column
+          auto findInfo = std::lower_bound(enumTable.m_rowData.begin(), enumTable.m_rowData.end(), row,
+            [i](const CSVRow& a, const CSVRow& b)
+            {
+              return a[1] < b[i];
+            });
+
+          auto IsEqual = [i](const CSVRow& a, const CSVRow& b)
+            {
+              return a[1] == b[i];
+            };
 
-          // Replace all single quotes with double quotes // DT_TODO: Test this!
-          while (quoteOffset != std::string::npos)
+          if (findInfo == enumTable.m_rowData.end() ||
+              !IsEqual(*findInfo, row))
           {
-            fieldStr.replace(quoteOffset, 1, 2, '"');
-            quoteOffset = fieldStr.find_first_of('"', quoteOffset + 2);
+            OutputMessage("Error: Table has link to table {} with a missing lookup column key {}", enumTableHeaders[i], to_string(row[i]));
+            return false;
+          }
+          else
+          {
+            field = &(*findInfo)[0];
           }
-
-          outFile += fieldStr;
-          outFile += "\"";
         }
-        else
+      }
+
+      // Get the field in string form, adding a string without quotes or commas unmodified
+      const FieldString* accessField = std::get_if<FieldString>(field);
+      if (accessField &&
+          accessField->find_first_of("\",", 0, 2) == std::string::npos)
+      {
+        if (!out.Append(*accessField))
         {
-          // Add raw unmodified string
-          outFile += *accessField;
+          return false;
         }
       }
       else
       {
-        // Add number type
-        AppendToString(*field, outFile);
+        fieldStr.clear();
+        AppendSavedField(*field, fieldStr);
+        if (!out.Append(fieldStr))
+        {
+          return false;
+        }
       }
     }
-    outFile += newLine;
   }
 
-  // Remove the newline if the existing file does not have it
-  if (!existingFile.ends_with(newLine))
+  // Only end with a newline if the existing file does
+  if (existingFile.ends_with(newLine) &&
+      !out.Append(newLine))
   {
-    outFile.erase(outFile.size() - newLine.size());
+    return false;
+  }
+  return true;
+}
+
+void SaveToString(const CSVTable& table, const std::unordered_map<std::string, CSVTable>& tables, std::string_view existingFile, std::string& outFile, uint16_t shard)
+{
+  outFile.reserve(existingFile.size());
+  StringTableWriter writer(outFile);
+  WriteTableText(table, tables, existingFile, shard, writer);
+}
+
+bool IsSavedFormat(const CSVTable& table, const std::unordered_map<std::string, CSVTable>& tables, std::string_view existingFile, uint16_t shard)
+{
+  // Rows that were not in key order will always be re-saved
+  if (!table.m_wasSorted)
+  {
+    return false;
   }
+
+  CompareTableWriter writer(existingFile);
+  return WriteTableText(table, tables, existingFile, shard, writer) && writer.IsMatch();
 }
 
+
 bool CalculateTableDepth(const std::string& tableName, const std::unordered_map<std::string, CSVTable>& tables, std::unordered_map<std::string, uint32_t>& tableDepths, uint32_t& depth)
 {
   // Enum tables have no depth
@@ -969,98 +1406,153 @@ bool ReadToString(const std::filesystem::path& path, std::string& outStr)
   return true;
 }
 
-bool ResolveForeignLinkTypes(DBTables& db)
+bool WriteFileAtomic(const std::filesystem::path& path, std::string_view contents)
 {
-  // Follow all foreign table links and get the correct types for columns (enums go to the value type)
-  for (auto& [tableName, table] : db.m_tables)
+  // Write to a temporary file next to the destination, then rename over it.
+  // A crash or full disk part way through never leaves a truncated file behind.
+  std::filesystem::path tempPath = path;
+  tempPath += ".tmp";
   {
-    // Check the table for foreign links
-    for (uint32_t h = 0; h < table.m_headerData.size(); h++)
+    // Unbuffered, so the contents are handed to the OS in a single write
+    std::ofstream file;
+    file.rdbuf()->pubsetbuf(nullptr, 0);
+    file.open(tempPath, std::ios::binary);
+    if (!file.is_open())
     {
-      CSVHeader& header = table.m_headerData[h];
-      if (header.m_foreignTable.size() == 0)
-      {
-        continue;
-      }
+      OutputMessage("Error: Unable to open file for writing {}", tempPath.string());
+      return false;
+    }
+
+    if (!file.write(contents.data(), contents.size()) ||
+        !file.flush())
+    {
+      OutputMessage("Error: Unable to write file contents {}", tempPath.string());
+      file.close();
+      std::error_code removeError;
+      std::filesystem::remove(tempPath, removeError);
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tempPath, path, error);
+  if (error)
+  {
+    OutputMessage("Error: Unable to replace file {} ({})", path.string(), error.message());
+    std::filesystem::remove(tempPath, error);
+    return false;
+  }
+  return true;
+}
 
-      // Find the ultimate source of the column (DT_TODO check for header loops)
-      std::string finalTableName;
-      FieldType newType;
-      if (!FindSourceHeaderColumn(header.m_name, header.m_foreignTable, db.m_tables, finalTableName, newType))
+bool ResolveTableLinkTypes(const std::string& tableName, CSVTable& table, const DBTables& db)
+{
+  // Check the table for foreign links
+  for (uint32_t h = 0; h < table.m_headerData.size(); h++)
+  {
+    CSVHeader& header = table.m_headerData[h];
+    if (header.m_foreignTable.size() == 0)
+    {
+      continue;
+    }
+
+    // The ultimate source of the column, resolved by the schema
+    const CSVColumnLink& link = table.m_schema.m_columnLinks[h];
+    const std::string& finalTableName = link.m_sourceTable;
+    FieldType newType = db.m_tables.at(finalTableName).m_headerData[link.m_sourceColumn].m_type;
+
+    // If a foreign key is an enum table
+    if (IsEnumTable(finalTableName))
+    {
+      // Get the lookup table
+      auto enumTableIter = db.m_tablesEnumNameSort.find(finalTableName);
+      if (enumTableIter == db.m_tablesEnumNameSort.end())
       {
-        OutputMessage("Error: Table {} has link issues with {}", tableName, header.m_name);
+        OutputMessage("Error: Unable to find linked enum table {} for table {}", finalTableName, tableName);
         return false;
       }
+      const CSVTable& enumTable = enumTableIter->second;
 
-      // If a foreign key is an enum table
-      if (IsEnumTable(finalTableName))
+      // Loop for all rows
+      header.m_type = enumTable.m_headerData[1].m_type;
+      for (CSVRow& row : table.m_rowData)
       {
-        // Get the lookup table
-        auto enumTableIter = db.m_tablesEnumNameSort.find(finalTableName);
-        if (enumTableIter == db.m_tablesEnumNameSort.end())
-        {
-          OutputMessage("Error: Unable to find linked enum table {} for table {}", finalTableName, tableName);
-          return false;
-        }
-        const CSVTable& enumTable = enumTableIter->second;
-
-        // Loop for all rows
-        header.m_type = enumTable.m_headerData[1].m_type;
-        for (std::vector<FieldType>& row : table.m_rowData)
-        {
-          auto findInfo = std::lower_bound(enumTable.m_rowData.begin(), enumTable.m_rowData.end(), row,
-            [h](const std::vector<FieldType>& a, const std::vector<FieldType>& b)
-            {
-              return a[0] < b[h];
-            });
-
-          auto IsEqual = [h](const std::vector<FieldType>& a, const std::vector<FieldType>& b)
-            {
-              return a[0] == b[h];
-            };
+        auto findInfo = std::lower_bound(enumTable.m_rowData.begin(), enumTable.m_rowData.end(), row,
+          [h](const CSVRow& a, const CSVRow& b)
+          {
+            return a[0] < b[h];
+          });
 
-          if (findInfo == enumTable.m_rowData.end() ||
-            !IsEqual(*findInfo, row))
+        auto IsEqual = [h](const CSVRow& a, const CSVRow& b)
           {
-            OutputMessage("Error: Table {} has link to table {} with a missing lookup column key {}", tableName, header.m_foreignTable, to_string(row[h]));
-            return false;
-          }
+            return a[0] == b[h];
+          };
 
-          // Swap the name for the integer
-          row[h] = (*findInfo)[1];
+        if (findInfo == enumTable.m_rowData.end() ||
+          !IsEqual(*findInfo, row))
+        {
+          OutputMessage("Error: Table {} has link to table {} with a missing lookup column key {}", tableName, header.m_foreignTable, to_string(row[h]));
+          return false;
         }
+
+        // Swap the name for the integer
+        row[h] = (*findInfo)[1];
       }
-      // Only convert if the new type is not already a string
-      else if (!std::holds_alternative<std::string>(newType))
+    }
+    // Only convert if the new type is not already a string
+    else if (!std::holds_alternative<FieldString>(newType))
+    {
+      header.m_type = newType;
+      for (CSVRow& row : table.m_rowData)
       {
-        header.m_type = newType;
-        for (std::vector<FieldType>& row : table.m_rowData)
+        // Should always be a string here
+        if (const FieldString* accessField = std::get_if<FieldString>(&row[h]))
         {
-          // Should always be a string here
-          if (const std::string* accessField = std::get_if<std::string>(&row[h]))
+          if (!ParseField(header.m_type, *accessField, newType))
           {
-            if (!ParseField(header.m_type, *accessField, newType))
-            {
-              OutputMessage("Error: Table has bad data in column {} - {}", header.m_name, *accessField);
-              return false;
-            }
-            row[h] = newType;
+            OutputMessage("Error: Table has bad data in column {} - {}", header.m_name, *accessField);
+            return false;
           }
+          row[h] = newType;
         }
       }
     }
   }
+  return true;
 }
 
-bool ReadDB(const char* dirPath, DBTables& outTables)
+bool ResolveForeignLinkTypes(DBTables& db)
+{
+  // Follow all foreign table links and get the correct types for columns (enums go to the value type)
+  for (auto& [tableName, table] : db.m_tables)
+  {
+    if (!ResolveTableLinkTypes(tableName, table, db))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string GetTableName(const std::filesystem::path& path)
+{
+  // Only a ".part<digits>" suffix is a shard, other dotted names are kept whole so they are not taken as a shard of a table
+  std::string stem = path.stem().string();
+  const size_t shardStart = stem.rfind(".part");
+  if (shardStart != std::string::npos &&
+      shardStart + 5 < stem.size() &&
+      std::all_of(stem.begin() + shardStart + 5, stem.end(), [](char c) { return c >= '0' && c <= '9'; }))
+  {
+    stem.resize(shardStart);
+  }
+  return stem;
+}
+
+bool FindDBFiles(const char* dirPath, DBTables& outTables)
 {
   std::vector<std::filesystem::path> &csvEnumFilePaths = outTables.m_csvEnumFilePaths;
   std::vector<std::filesystem::path> &csvFilePaths = outTables.m_csvFilePaths;
 
-  std::unordered_map<std::string, CSVTable> &tables = outTables.m_tables;
-  std::unordered_map<std::string, CSVTable> &tablesEnumRaw = outTables.m_tablesEnumRaw;
-  std::unordered_map<std::string, CSVTable> &tablesEnumNameSort = outTables.m_tablesEnumNameSort;
-
   // Check if directory exists
   std::error_code error;
   std::filesystem::file_status dirPathStatus = std::filesystem::status(dirPath, error);
@@ -1083,7 +1575,12 @@ bool ReadDB(const char* dirPath, DBTables& outTables)
       std::tolower(extension[2]) == 's' &&
       std::tolower(extension[3]) == 'v')
     {
-      std::string tableName = entry.path().stem().string();
+      std::string tableName = GetTableName(entry.path());
+      if (tableName.find('.') != std::string::npos)
+      {
+        OutputMessage("Error: {} is not a table file, shard files are named <Table>.partNN.csv", entry.path().string());
+        return false;
+      }
 
       if (IsEnumTable(tableName))
       {
@@ -1096,101 +1593,349 @@ bool ReadDB(const char* dirPath, DBTables& outTables)
     }
   }
 
-  // Process enums first as they swap their key column to be based on values
-  std::string csvFileData;
+  // The directory order is unspecified, sort so the shard numbers, messages and profile are the same on each run
+  std::sort(csvEnumFilePaths.begin(), csvEnumFilePaths.end());
+  std::sort(csvFilePaths.begin(), csvFilePaths.end());
+
+  // Add an empty table for each file, so the files can be read into their tables in parallel
   for (const auto& path : csvEnumFilePaths)
   {
-    std::string tableName = path.stem().string();
-    if (!ReadToString(path, csvFileData))
+    std::string tableName = GetTableName(path);
+    if (tableName != path.stem().string())
     {
+      OutputMessage("Error: Enum table {} can not be split into shards", tableName);
       return false;
     }
+    if (outTables.m_tables.contains(tableName))
+    {
+      OutputMessage("Error: Duplicate table name {}", tableName);
+      return false;
+    }
+    outTables.m_tables[tableName];
+    outTables.m_tablesEnumRaw[tableName];
+    outTables.m_tablesEnumNameSort[tableName];
+  }
 
-    if (tables.contains(tableName))
+  // The files of a table split into shards are numbered in path order
+  std::unordered_map<std::string, uint16_t> shardCounts;
+  outTables.m_csvFileShards.resize(csvFilePaths.size());
+  for (size_t fileIndex = 0; fileIndex < csvFilePaths.size(); fileIndex++)
+  {
+    std::string tableName = GetTableName(csvFilePaths[fileIndex]);
+    uint16_t& shardCount = shardCounts[tableName];
+    if (shardCount == std::numeric_limits<uint16_t>::max())
+    {
+      OutputMessage("Error: Table {} has too many shards", tableName);
+      return false;
+    }
+    outTables.m_csvFileShards[fileIndex] = shardCount++;
+    if (shardCount > 1 && IsGlobalTable(tableName))
+    {
+      OutputMessage("Error: Global table {} can not be split into shards", tableName);
+      return false;
+    }
+  }
+  for (const auto& [tableName, shardCount] : shardCounts)
+  {
+    if (outTables.m_tables.contains(tableName))
     {
       OutputMessage("Error: Duplicate table name {}", tableName);
       return false;
     }
+    outTables.m_tables[tableName];
+    if (shardCount > 1)
+    {
+      outTables.m_tableShards[tableName].resize(shardCount);
+    }
+  }
+  outTables.m_csvEnumFileData.resize(csvEnumFilePaths.size());
+  outTables.m_csvFileData.resize(csvFilePaths.size());
+  return true;
+}
+
+bool ReadEnumTable(size_t fileIndex, DBTables& db)
+{
+  if (!ReadToString(db.m_csvEnumFilePaths[fileIndex], db.m_csvEnumFileData[fileIndex]))
+  {
+    return false;
+  }
+  return ParseEnumTable(fileIndex, db);
+}
 
-    // Read in the table data from the file
-    CSVTable newTable;
+bool ParseEnumTable(size_t fileIndex, DBTables& db)
+{
+  const std::filesystem::path& path = db.m_csvEnumFilePaths[fileIndex];
+  std::string tableName = GetTableName(path);
+  ProfileScope fileScope("LoadTable", tableName);
+
+  // The table is parsed into its own memory, so the file bytes are released at the end
+  std::string csvFileData = std::move(db.m_csvEnumFileData[fileIndex]);
+  fileScope.SetBytes(csvFileData.size());
+
+  // Read in the table data from the file
+  CSVTable newTable(csvFileData.size() * 2);
+  {
+    ProfileScope readScope("ReadTable", tableName);
     if (!ReadTable(csvFileData.data(), newTable))
     {
       OutputMessage("Error: Reading table {}", tableName);
       return false;
     }
+    readScope.SetBytes(csvFileData.size());
+    readScope.SetRows(newTable.m_rowData.size());
+  }
+
+  // Enums have a strict layout
+  if (newTable.m_headerData.size() != 3 ||
+    !newTable.m_headerData[0].m_isKey ||
+    newTable.m_headerData[1].m_isKey ||
+    newTable.m_headerData[2].m_isKey ||
+    newTable.m_headerData[0].m_foreignTable.size() != 0 ||
+    newTable.m_headerData[1].m_foreignTable.size() != 0 ||
+    newTable.m_headerData[2].m_foreignTable.size() != 0 ||
+    newTable.m_headerData[0].m_name != "Name" ||
+    newTable.m_headerData[1].m_name != "Value")
+  {
+    OutputMessage("Error: Enum table {} need three columns, single key and no foreign table links", tableName);
+    return false;
+  }
+
+  // Store a copy of the raw table before sorting
+  db.m_tablesEnumRaw.at(tableName) = newTable;
+
+  // Sort the table data by column and check for duplicates
+  if (!SortTable(newTable))
+  {
+    OutputMessage("Error: Enum table {} failed to sort", tableName);
+    return false;
+  }
+
+  db.m_tablesEnumNameSort.at(tableName) = newTable;
+
+  // Swap the key row and re-sort (needs to be sorted by number value)
+  newTable.m_headerData[0].m_isKey = false;
+  newTable.m_headerData[1].m_isKey = true;
+  newTable.m_keyColumns.resize(0);
+  newTable.m_keyColumns.push_back(1);
+  if (!SortTable(newTable))
+  {
+    OutputMessage("Error: Enum table {} failed to sort by value", tableName);
+    return false;
+  }
+
+  // Add to a map of all the csv files
+  db.m_tables.at(tableName) = std::move(newTable);
+  return true;
+}
+
+bool ReadDBTable(size_t fileIndex, DBTables& db)
+{
+  if (!ReadToString(db.m_csvFilePaths[fileIndex], db.m_csvFileData[fileIndex]))
+  {
+    return false;
+  }
+  return ParseDBTable(fileIndex, db);
+}
+
+bool ParseDBTable(size_t fileIndex, DBTables& db)
+{
+  // Keep the loaded bytes of the regular tables so a resave can compare against them without reading the files again
+  const std::filesystem::path& path = db.m_csvFilePaths[fileIndex];
+  const std::string& fileData = db.m_csvFileData[fileIndex];
+
+  std::string tableName = GetTableName(path);
+  ProfileScope fileScope("LoadTable", tableName);
+  fileScope.SetBytes(fileData.size());
 
-    // Enums have a strict layout
-    if (newTable.m_headerData.size() != 3 ||
-      !newTable.m_headerData[0].m_isKey ||
-      newTable.m_headerData[1].m_isKey ||
-      newTable.m_headerData[2].m_isKey ||
-      newTable.m_headerData[0].m_foreignTable.size() != 0 ||
-      newTable.m_headerData[1].m_foreignTable.size() != 0 ||
-      newTable.m_headerData[2].m_foreignTable.size() != 0 ||
-      newTable.m_headerData[0].m_name != "Name" ||
-      newTable.m_headerData[1].m_name != "Value")
+  // Read in the table data from the file
+  CSVTable newTable(fileData.size() * 2);
+  {
+    ProfileScope readScope("ReadTable", tableName);
+    if (!ReadTable(fileData.data(), newTable))
     {
-      OutputMessage("Error: Enum table {} need three columns, single key and no foreign table links", tableName);
+      OutputMessage("Error: Reading table {}", tableName);
       return false;
     }
+    readScope.SetBytes(fileData.size());
+    readScope.SetRows(newTable.m_rowData.size());
+  }
 
-    // Store a copy of the raw table before sorting
-    tablesEnumRaw[tableName] = newTable;
+  // Check that Global and Enum tables have the correct format
+  if (IsGlobalTable(tableName) && newTable.m_rowData.size() != 1)
+  {
+    OutputMessage("Error: Global table {} can only have one row - has {}", tableName, newTable.m_rowData.size());
+    return false;
+  }
 
-    // Sort the table data by column and check for duplicates
+  // Shards are sorted as they are read, to be merged once all the shards of the table are read
+  auto findShards = db.m_tableShards.find(tableName);
+  if (findShards != db.m_tableShards.end())
+  {
+    ProfileScope sortScope("SortShard", tableName, path.filename().string());
+    sortScope.SetRows(newTable.m_rowData.size());
     if (!SortTable(newTable))
     {
-      OutputMessage("Error: Enum table {} failed to sort", tableName);
+      OutputMessage("Error: Table {} shard {} failed to sort", tableName, path.filename().string());
       return false;
     }
+    findShards->second[db.m_csvFileShards[fileIndex]] = std::move(newTable);
+    return true;
+  }
 
-    tablesEnumNameSort[tableName] = newTable;
+  // Add to a map of all the csv files
+  db.m_tables.at(tableName) = std::move(newTable);
+  return true;
+}
 
-    // Swap the key row and re-sort (needs to be sorted by number value)
-    newTable.m_headerData[0].m_isKey = false;
-    newTable.m_headerData[1].m_isKey = true;
-    newTable.m_keyColumns.resize(0);
-    newTable.m_keyColumns.push_back(1);
-    if (!SortTable(newTable))
+bool MergeTableShards(const std::string& tableName, DBTables& db)
+{
+  std::vector<CSVTable>& shards = db.m_tableShards.at(tableName);
+  ProfileScope scope("MergeShards", tableName);
+
+  const CSVTable& firstShard = shards[0];
+  size_t rowCount = 0;
+  size_t arenaSize = 0;
+  for (size_t s = 0; s < shards.size(); s++)
+  {
+    const std::vector<CSVHeader>& headers = shards[s].m_headerData;
+    bool isSame = headers.size() == firstShard.m_headerData.size();
+    for (size_t h = 0; isSame && h < headers.size(); h++)
+    {
+      isSame = headers[h].m_rawField == firstShard.m_headerData[h].m_rawField;
+    }
+    if (!isSame)
     {
-      OutputMessage("Error: Enum table {} failed to sort by value", tableName);
+      OutputMessage("Error: Table {} shards have different headers", tableName);
       return false;
     }
-
-    // Add to a map of all the csv files
-    tables[tableName] = std::move(newTable);
+    rowCount += shards[s].m_rowData.size();
+  }
+  for (size_t fileIndex = 0; fileIndex < db.m_csvFilePaths.size(); fileIndex++)
+  {
+    if (GetTableName(db.m_csvFilePaths[fileIndex]) == tableName)
+    {
+      arenaSize += db.m_csvFileData[fileIndex].size() * 2;
+    }
   }
+  scope.SetRows(rowCount);
+
+  CSVTable newTable(arenaSize);
+  newTable.m_headerData = firstShard.m_headerData;
+  newTable.m_keyColumns = firstShard.m_keyColumns;
+  newTable.m_wasSorted = true;
+  newTable.m_rowData.reserve(rowCount);
+  newTable.m_rowShards.reserve(rowCount);
 
-  for (const auto& path : csvFilePaths)
+  auto keyCompare = [&newTable](const CSVRow& a, const CSVRow& b)
+    {
+      for (uint32_t index : newTable.m_keyColumns)
+      {
+        if (a[index] < b[index])
+        {
+          return -1;
+        }
+        if (a[index] != b[index])
+        {
+          return 1;
+        }
+      }
+      return 0;
+    };
+
+  // K-way merge of the sorted shards, with a heap of the shards ordered by their next row.
+  // A table without keys keeps the rows in shard order.
+  std::vector<size_t> nextRows(shards.size());
+  std::vector<uint16_t> heap;
+  auto heapCompare = [&](uint16_t a, uint16_t b)
+    {
+      int compare = keyCompare(shards[a].m_rowData[nextRows[a]], shards[b].m_rowData[nextRows[b]]);
+      return compare != 0 ? compare > 0 : a > b;
+    };
+  for (uint16_t s = 0; s < shards.size(); s++)
   {
-    std::string tableName = path.stem().string();
-    if (!ReadToString(path, csvFileData))
+    newTable.m_wasSorted &= shards[s].m_wasSorted;
+    if (shards[s].m_rowData.size() > 0)
     {
-      return false;
+      heap.push_back(s);
     }
-    if (tables.contains(tableName))
+  }
+  std::make_heap(heap.begin(), heap.end(), heapCompare);
+  while (heap.size() > 0)
+  {
+    std::pop_heap(heap.begin(), heap.end(), heapCompare);
+    uint16_t s = heap.back();
+    const CSVRow& srcRow = shards[s].m_rowData[nextRows[s]];
+
+    // Keys are unique within a shard, so equal keys of consecutive rows are in different shards
+    if (newTable.m_keyColumns.size() > 0 && newTable.m_rowData.size() > 0 &&
+        keyCompare(newTable.m_rowData.back(), srcRow) == 0)
     {
-      OutputMessage("Error: Duplicate table name {}", tableName);
+      std::string errorKeys;
+      for (uint32_t index : newTable.m_keyColumns)
+      {
+        AppendToString(srcRow[index], errorKeys);
+        errorKeys += " ";
+      }
+      OutputMessage("Error: Table {} has duplicate keys in different shards {}", tableName, errorKeys);
       return false;
     }
 
-    // Read in the table data from the file
-    CSVTable newTable;
-    if (!ReadTable(csvFileData.data(), newTable))
+    // Copy the row into the arena of the table
+    CSVRow& row = newTable.m_rowData.emplace_back();
+    row.resize(srcRow.size());
+    for (size_t i = 0; i < srcRow.size(); i++)
     {
-      OutputMessage("Error: Reading table {}", tableName);
-      return false;
+      CopyField(srcRow[i], row[i], newTable.GetArena());
     }
+    newTable.m_rowShards.push_back(s);
 
-    // Check that Global and Enum tables have the correct format
-    if (IsGlobalTable(tableName) && newTable.m_rowData.size() != 1)
+    if (++nextRows[s] < shards[s].m_rowData.size())
     {
-      OutputMessage("Error: Global table {} can only have one row - has {}", tableName, newTable.m_rowData.size());
-      return false;
+      std::push_heap(heap.begin(), heap.end(), heapCompare);
+    }
+    else
+    {
+      heap.pop_back();
     }
+  }
 
-    // Add to a map of all the csv files
-    tables[tableName] = std::move(newTable);
+  // Release the shards, the rows are now in the table
+  shards.clear();
+  db.m_tables.at(tableName) = std::move(newTable);
+  return true;
+}
+
+bool ReadDB(const char* dirPath, DBTables& outTables)
+{
+  if (!FindDBFiles(dirPath, outTables))
+  {
+    return false;
   }
+
+  // Process enums first as they swap their key column to be based on values
+  for (size_t fileIndex = 0; fileIndex < outTables.m_csvEnumFilePaths.size(); fileIndex++)
+  {
+    if (!ReadEnumTable(fileIndex, outTables))
+    {
+      return false;
+    }
+  }
+  for (size_t fileIndex = 0; fileIndex < outTables.m_csvFilePaths.size(); fileIndex++)
+  {
+    if (!ReadDBTable(fileIndex, outTables))
+    {
+      return false;
+    }
+  }
+  for (const auto& [tableName, shards] : outTables.m_tableShards)
+  {
+    if (!MergeTableShards(tableName, outTables))
+    {
+      return false;
+    }
+  }
+
+  // Resolve the links of all the tables once
+  ProfileScope schemaScope("BuildSchema");
+  return BuildSchema(outTables.m_tables);
 }
@@ -6,8 +6,49 @@
 #include <unordered_map>
 #include <filesystem>
 #include <functional>
+#include <memory>
+#include <memory_resource>
 
-using FieldType = std::variant<std::string, bool, int8_t, uint8_t, int16_t, uint16_t, int32_t, uint32_t, int64_t, uint64_t, float, double>;
+// Strings in table data are allocated from the arena of the table
+using FieldString = std::pmr::string;
+using FieldType = std::variant<FieldString, bool, int8_t, uint8_t, int16_t, uint16_t, int32_t, uint32_t, int64_t, uint64_t, float, double>;
+
+// Allocator of the table row containers, allocating from a memory resource (eg. the arena of the table).
+// Unlike std::pmr::polymorphic_allocator it moves with the container on move assignment and swap, so rows are never re-allocated when moved.
+template<typename T>
+class ArenaAllocator
+{
+public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::false_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  ArenaAllocator() noexcept = default;
+  ArenaAllocator(std::pmr::memory_resource* resource) noexcept : m_resource(resource) {}
+  template<typename U> ArenaAllocator(const ArenaAllocator<U>& other) noexcept : m_resource(other.resource()) {}
+
+  T* allocate(size_t count) { return static_cast<T*>(m_resource->allocate(count * sizeof(T), alignof(T))); }
+  void deallocate(T* ptr, size_t count) noexcept { m_resource->deallocate(ptr, count * sizeof(T), alignof(T)); }
+
+  // Pass the allocator on to nested containers (rows of a table)
+  template<typename U, typename... Args>
+  void construct(U* ptr, Args&&... args) { std::uninitialized_construct_using_allocator(ptr, *this, std::forward<Args>(args)...); }
+
+  // Copies are allocated from the default resource, as the arena of the source may be released first
+  ArenaAllocator select_on_container_copy_construction() const noexcept { return ArenaAllocator(); }
+
+  std::pmr::memory_resource* resource() const noexcept { return m_resource; }
+
+  template<typename U>
+  bool operator == (const ArenaAllocator<U>& other) const noexcept { return m_resource == other.resource() || m_resource->is_equal(*other.resource()); }
+
+private:
+  std::pmr::memory_resource* m_resource = std::pmr::get_default_resource();
+};
+
+using CSVRow = std::vector<FieldType, ArenaAllocator<FieldType>>;
+using CSVRows = std::vector<CSVRow, ArenaAllocator<CSVRow>>;
 
 // Override this method to redirect output messages
 extern std::function<void (const char*)> OutputMessageFunc;
@@ -29,6 +70,7 @@ struct CSVHeader
   FieldType m_type;          // Column type
   bool m_isKey = false;      // Is table key
   bool m_isIgnored = false;  // Is ignored
+  bool m_isCold = false;     // Is rarely accessed at runtime (stored in a separate array)
 
   std::string m_minValue;    // The min range string value (if any)
   std::string m_maxValue;    // The max range string value (if any)
@@ -38,18 +80,58 @@ struct CSVHeader
   bool m_isWeakForeignTable = false; // If a foreign table link is a weak link
 };
 
+// Link of a column to the table its values come from
+struct CSVColumnLink
+{
+  std::string m_sourceTable;           // Table of the column the values come from, following links through linked key columns (empty if not a link)
+  uint32_t m_sourceColumn = 0;         // Column in the source table
+  std::vector<uint32_t> m_linkColumns; // Columns of the table that hold the foreign table keys for the link (in foreign key column order)
+};
+
+// Schema catalog of a table, built once from the headers of all the tables by BuildSchema
+struct CSVSchema
+{
+  std::unordered_map<std::string, uint32_t> m_columnIndices; // Column index by name (the first column of a duplicate name)
+  std::vector<CSVColumnLink> m_columnLinks;                  // Link of each column
+};
+
 struct CSVTable
 {
+  explicit CSVTable(size_t arenaInitialSize = 0);
+  CSVTable(const CSVTable& other);
+  CSVTable(CSVTable&& other) noexcept = default;
+  CSVTable& operator=(const CSVTable& other);
+  CSVTable& operator=(CSVTable&& other) noexcept;
+
+  // Get the memory resource that row data should be allocated from
+  std::pmr::memory_resource* GetArena() const { return m_rowData.get_allocator().resource(); }
+
   std::vector<CSVHeader> m_headerData; // Header data that is info for each column
   std::vector<uint32_t> m_keyColumns;  // Index of the columns that are keys in the table
+  bool m_wasSorted = false;            // If the rows were already in key order when sorted (the loaded order is the saved order)
+  CSVSchema m_schema;                  // Column names and resolved links, set by ReadDB once all tables are read
 
-  std::vector<std::vector<FieldType>> m_rowData;
+  // Row index in the foreign table of each row, per link column (at the first column of a multi key link, empty for other columns).
+  // Set by ValidateTables, so links are not searched for again. Only valid until the rows of the table or the linked table change.
+  std::vector<std::vector<uint32_t>> m_linkRows;
+
+  // Shard file each row was read from and is saved to, empty if the table is a single file
+  std::vector<uint16_t> m_rowShards;
+
+  // Row data and the arena it is allocated from. All of the table memory is released at once when the table is destroyed.
+  // The arena is declared first so that it is destroyed after the rows.
+  std::shared_ptr<std::pmr::monotonic_buffer_resource> m_arena;
+  CSVRows m_rowData;
 };
 
 struct DBTables
 {
   std::vector<std::filesystem::path> m_csvEnumFilePaths;
   std::vector<std::filesystem::path> m_csvFilePaths;
+  std::vector<std::string> m_csvEnumFileData; // The loaded contents of each file in m_csvEnumFilePaths, until it is parsed
+  std::vector<std::string> m_csvFileData; // The loaded contents of each file in m_csvFilePaths
+  std::vector<uint16_t> m_csvFileShards;  // Shard index of each file in m_csvFilePaths within its table (0 if the table is a single file)
+  std::unordered_map<std::string, std::vector<CSVTable>> m_tableShards; // Each shard of the sharded tables, until they are merged into the table
 
   std::unordered_map<std::string, CSVTable> m_tables;        // All table data
   std::unordered_map<std::string, CSVTable> m_tablesEnumRaw; // Unsorted raw enum tables
@@ -59,26 +141,73 @@ struct DBTables
 constexpr bool IsGlobalTable(std::string_view tableName) { return tableName.starts_with("Global"); }
 constexpr bool IsEnumTable(std::string_view tableName) { return tableName.starts_with("Enum"); }
 
+// Get the table name of a CSV file. A large table can be split into shard files named <Table>.partNN.csv (eg. Items.part01.csv),
+// that all have the same header.
+std::string GetTableName(const std::filesystem::path& path);
+
 bool GetColumnType(std::string_view name, FieldType& retType);
 
 void AppendToString(const FieldType& var, std::string& appendStr);
 std::string to_string(const FieldType& var);
 bool IsEqual(const FieldType& var, size_t val);
 
-bool ParseField(const FieldType& type, std::string_view string, FieldType& retField);
-bool ParseFieldMove(const FieldType& type, std::string&& string, FieldType& retField);
+// Parse a field of the type. Strings are allocated from the resource (pass the arena of the table the field is stored in).
+bool ParseField(const FieldType& type, std::string_view string, FieldType& retField, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+bool ParseFieldMove(const FieldType& type, FieldString&& string, FieldType& retField, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
-std::vector<std::vector<std::string>> ReadCSV(const char* srcData);
+// Copy a field, with any string allocated from the resource
+void CopyField(const FieldType& field, FieldType& retField, std::pmr::memory_resource* resource);
+
+// Read the raw CSV fields, allocated from the resource (a temporary arena for the parse, as fields are not individually released).
+// Fields are views of srcData, except fields with quotes removed that are copied to the resource.
+std::pmr::vector<std::pmr::vector<std::string_view>> ReadCSV(const char* srcData, std::pmr::memory_resource* resource);
 bool ReadHeader(std::string_view field, CSVHeader& out);
+// Read the header row of the raw CSV fields into the table, checking every row has a field for each column
+bool ReadTableHeader(const std::pmr::vector<std::pmr::vector<std::string_view>>& csvData, CSVTable& newTable);
+// Read the min / max range values of a column (left unset if the column has no range)
+bool ReadColumnRange(const CSVHeader& header, FieldType& outMin, FieldType& outMax);
+// Parse a field of the column, checking it is in the range of the column
+bool ParseColumnField(const CSVHeader& header, const FieldType& minValue, const FieldType& maxValue, std::string_view string, FieldType& retField, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 bool ReadTable(const char* fileString, CSVTable& newTable);
 bool SortTable(CSVTable& newTable);
+// Build the schema catalog of the tables from the headers, resolving every link and checking for link cycles
+bool BuildSchema(std::unordered_map<std::string, CSVTable>& tables);
+// Find the source of a column linking to the foreign table (for columns of tables without a schema, eg. query output)
 bool FindSourceHeaderColumn(const std::string& columnName, const std::string& foreignTableName, const std::unordered_map<std::string, CSVTable>& tables, std::string& outTableName, FieldType& outField);
-bool ValidateTables(const std::unordered_map<std::string, CSVTable>& tables);
-
-void SaveToString(const CSVTable& table, const std::unordered_map<std::string, CSVTable>& tables, std::string_view existingFile, std::string& outFile);
+// Get the columns of the table that hold the foreign table keys for the link in column (in foreign key column order)
+bool GetLinkColumns(std::string_view tableName, const CSVTable& table, uint32_t column, std::vector<uint32_t>& outColumns);
+// Check that every link has a row in the foreign table, and set the link rows of the tables
+bool ValidateTables(std::unordered_map<std::string, CSVTable>& tables);
+// Validate the links of a single table. Only reads the tables it links to, which need to be sorted.
+bool ValidateTable(const std::string& tableName, CSVTable& table, const std::unordered_map<std::string, CSVTable>& tables);
+
+// Get the newline used by the file (the first one in the file, or \n)
+std::string GetNewLine(std::string_view existingFile);
+// Append a field in the saved CSV form, with strings quoted if they have quotes or commas
+void AppendSavedString(std::string_view str, std::string& appendStr);
+void AppendSavedField(const FieldType& field, std::string& appendStr);
+
+// Rows of a sharded table are saved to the shard they were read from, so only the rows of the shard are saved
+void SaveToString(const CSVTable& table, const std::unordered_map<std::string, CSVTable>& tables, std::string_view existingFile, std::string& outFile, uint16_t shard = 0);
+// Check if saving the table would give exactly the existing file, without building the saved string
+bool IsSavedFormat(const CSVTable& table, const std::unordered_map<std::string, CSVTable>& tables, std::string_view existingFile, uint16_t shard = 0);
 bool CalculateTableDepth(const std::string& tableName, const std::unordered_map<std::string, CSVTable>& tables, std::unordered_map<std::string, uint32_t>& tableDepths, uint32_t& depth);
 
 bool ReadToString(const std::filesystem::path& path, std::string& outStr);
+bool WriteFileAtomic(const std::filesystem::path& path, std::string_view contents);
 
 bool ReadDB(const char* dirPath, DBTables& outTables);
 bool ResolveForeignLinkTypes(DBTables& db);
+
+// The steps of ReadDB and ResolveForeignLinkTypes, to run the tables in parallel.
+// FindDBFiles adds an empty table for each file, then each read only writes to its own tables.
+bool FindDBFiles(const char* dirPath, DBTables& outTables);
+bool ReadEnumTable(size_t fileIndex, DBTables& db); // Index into m_csvEnumFilePaths
+bool ReadDBTable(size_t fileIndex, DBTables& db);   // Index into m_csvFilePaths, a shard is sorted and added to m_tableShards
+// Parse a table from the file contents already loaded into m_csvEnumFileData / m_csvFileData (eg. by a batched read)
+bool ParseEnumTable(size_t fileIndex, DBTables& db);
+bool ParseDBTable(size_t fileIndex, DBTables& db);
+// Merge the sorted shards of a table by key into the table, after all its shards are read
+bool MergeTableShards(const std::string& tableName, DBTables& db);
+// Resolve the link types of a single table, after the schema is built
+bool ResolveTableLinkTypes(const std::string& tableName, CSVTable& table, const DBTables& db);
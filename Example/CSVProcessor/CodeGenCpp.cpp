@@ -1,9 +1,15 @@
 
 #include "CodeGenCpp.h"
+#include "Profile.h"
+#include "TaskGraph.h"
 
 #include <iostream>
-#include <fstream>
 #include <filesystem>
+#include <span>
+#include <bit>
+#include <algorithm>
+#include <memory>
+#include <unordered_set>
 
 
 static const char s_commonHeaderStart[] = R"header(// Generated Database file - do not edit manually
@@ -14,10 +20,74 @@ static const char s_commonHeaderStart[] = R"header(// Generated Database file -
 #include <vector>
 #include <string>
 #include <string_view>
+#include <span>
+#include <algorithm>
+)header";
+
+// The includes of the options are written between the common includes and the common types
+static const char s_commonHeaderTypes[] = R"header(
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
 
 namespace DB
 {
 
+// Hint to the CPU that the memory at the address will be read soon
+inline void Prefetch(const void* address)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#elif defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(address);
+#else
+  (void)address;
+#endif
+}
+
+// Lower bound search of many keys over a sorted table.
+// Keys are searched in groups that step through the table together, with the next probe rows of each search
+// prefetched a step ahead so the cache misses of the group overlap instead of being waited on one at a time.
+//  isLess(row, keyIndex) - returns true if the row is ordered before the key
+//  onResult(keyIndex, rowIndex) - called with the lower bound row index of each key
+template<typename T, typename IsLess, typename OnResult>
+void BatchLowerBound(const std::vector<T>& values, size_t keyCount, IsLess isLess, OnResult onResult)
+{
+  constexpr size_t c_groupSize = 16;
+  uint32_t base[c_groupSize];
+
+  const T* data = values.data();
+  for (size_t groupStart = 0; groupStart < keyCount; groupStart += c_groupSize)
+  {
+    const size_t groupCount = std::min(c_groupSize, keyCount - groupStart);
+    std::fill_n(base, groupCount, 0);
+
+    // Branchless binary search, all searches in the group have the same step sizes
+    size_t count = values.size();
+    while (count > 1)
+    {
+      const size_t half = count / 2;
+      const size_t nextHalf = (count - half) / 2;
+      for (size_t i = 0; i < groupCount; i++)
+      {
+        base[i] += isLess(data[base[i] + half], groupStart + i) ? static_cast<uint32_t>(half) : 0;
+        Prefetch(&data[base[i] + nextHalf]);
+      }
+      count -= half;
+    }
+
+    for (size_t i = 0; i < groupCount; i++)
+    {
+      uint32_t index = base[i];
+      if (count > 0 && isLess(data[index], groupStart + i))
+      {
+        index++;
+      }
+      onResult(groupStart + i, index);
+    }
+  }
+}
+
 // Protected DB identifier type. The ID can only be created by the database and helper database methods.
 template<typename T>
 class IDType
@@ -31,7 +101,8 @@ public:
 
 private:
   friend class DB;
-  template<typename T> friend class IterType;
+  template<typename U> friend class IterType;
+  template<typename U> friend class IDRange;
 
   uint32_t m_dbIndex = 0;
 
@@ -82,452 +153,2104 @@ private:
   const std::vector<T>& m_dbArray;
 };
 
-)header";
-
-static const char s_commonHeaderEnd[] = R"header(
-} // namespace DB
-)header";
-
-
-static const char s_commonBodyStart[] = R"body(// Generated Database file - do not edit manually
-#include "DB.h"
-
-)body";
-
-static const char s_commonBodyEnd[] = R"body()body";
-
-
-const char* CPPTypeString(const FieldType& var)
+// Contiguous range of IDs in a table, returned from the range queries. IDs are in table key order.
+// Usage example for a "SpecialWeapons" table with the keys "Name" and "Type":
+//  DB::IDRange<DB::SpecialWeapons> range;
+//  Database.PrefixRange("Name", range);
+//  for (DB::SpecialWeapons::ID id : range)
+//  {
+//    const DB::SpecialWeapons& Item = Database.Get(id);
+//  }
+template <typename T>
+class IDRange
 {
-  return std::visit([]<typename T>(const T & e)
+public:
+  struct Iterator
   {
-    if constexpr (std::is_same_v<T, std::string>) { return "std::string"; }
-    else if constexpr (std::is_same_v<T, bool>) { return "bool"; }
+    constexpr IDType<T> operator *() const { return IDType<T>(m_pos); }
+    constexpr Iterator& operator++() { m_pos++; return *this; }
+    constexpr bool operator!=(const Iterator& val) const { return m_pos != val.m_pos; }
 
-    else if constexpr (std::is_same_v<T, int8_t>) { return "int8_t"; }
-    else if constexpr (std::is_same_v<T, int16_t>) { return "int16_t"; }
-    else if constexpr (std::is_same_v<T, int32_t>) { return "int32_t"; }
-    else if constexpr (std::is_same_v<T, int64_t>) { return "int64_t"; }
+    uint32_t m_pos;
+  };
 
-    else if constexpr (std::is_same_v<T, uint8_t>) { return "uint8_t"; }
-    else if constexpr (std::is_same_v<T, uint16_t>) { return "uint16_t"; }
-    else if constexpr (std::is_same_v<T, uint32_t>) { return "uint32_t"; }
-    else if constexpr (std::is_same_v<T, uint64_t>) { return "uint64_t"; }
+  constexpr IDRange() = default;
+  constexpr uint32_t size() const { return m_end - m_begin; }
+  constexpr bool empty() const { return m_begin == m_end; }
+  constexpr IDType<T> operator[](uint32_t index) const { return IDType<T>(m_begin + index); }
 
-    else if constexpr (std::is_same_v<T, float>) { return "float"; }
-    else if constexpr (std::is_same_v<T, double>) { return "double"; }
+  constexpr Iterator begin() const { return Iterator{ m_begin }; }
+  constexpr Iterator end() const { return Iterator{ m_end }; }
 
-  }, var);
-}
+private:
+  friend class DB;
 
-bool CodeGenCpp(const char* outputPathStr, const std::unordered_map<std::string, CSVTable>& tables, const std::unordered_map<std::string, CSVTable>& tablesEnumRaw)
-{
-  std::filesystem::path outputPath(outputPathStr);
-  std::error_code error;
-  std::filesystem::file_status dirPathStatus = std::filesystem::status(outputPath, error);
-  if (!std::filesystem::is_directory(dirPathStatus))
-  {
-    OutputMessage("Error: {} is not a valid directory", outputPathStr);
-    return false;
-  }
+  uint32_t m_begin = 0;
+  uint32_t m_end = 0;
 
-  // Add the common header
-  std::string outHeaderString = s_commonHeaderStart;
-  std::string outBodyString = s_commonBodyStart;
+  constexpr IDRange(uint32_t begin, uint32_t end) : m_begin(begin), m_end(end) {}
+};
 
-  // Write out all enum types // DT_TODO: Sort enums by table name for consistency in output?
-  for (const auto& [tableName, rawTable] : tablesEnumRaw)
+)header";
+
+static const char s_gatherMethod[] = R"header(  // Read a member from the rows of many IDs. Rows are prefetched ahead of use so the cache misses overlap.
+  // Usage example following links from "Characters" to "Weapons" to the weapon type:
+  //  Database.Gather(characterIds, &DB::Characters::LeftWeapon, weaponIds);
+  //  Database.Gather(weaponIds, &DB::Weapons::Type, weaponTypes);
+  template<typename T, typename M> void Gather(std::span<const std::type_identity_t<IDType<T>>> ids, M T::* member, std::span<std::type_identity_t<M>> out) const
   {
-    if (rawTable.m_rowData.size() > 0 && rawTable.m_headerData.size() == 3)
+    constexpr size_t c_prefetchDistance = 8;
+    const std::vector<T>& table = GetTable<T>();
+    const size_t count = std::min(ids.size(), out.size());
+    for (size_t i = 0; i < count; i++)
     {
-      std::string enumName = tableName.substr(4);
-      outHeaderString += "enum class " + enumName + " : " + CPPTypeString(rawTable.m_headerData[1].m_type) + "\n{\n";
-      size_t enumCounter = 0;
-      bool isSequential = true;
-      for (const std::vector<FieldType>& row : rawTable.m_rowData)
-      {
-        outHeaderString += "  ";
-        AppendToString(row[0], outHeaderString);
-        outHeaderString += " = ";
-        AppendToString(row[1], outHeaderString);
-        outHeaderString += ",";
-
-        // Check if a sequential enum
-        if (isSequential && !IsEqual(row[1], enumCounter))
-        {
-          isSequential = false;
-        }
-        enumCounter++;
-
-        if (const std::string* accessField = std::get_if<std::string>(&row[2]))
-        {
-          if (accessField->size() > 0)
-          {
-            outHeaderString += " // ";
-            outHeaderString += *accessField;
-          }
-        }
-        outHeaderString += "\n";
-      }
-      outHeaderString += "};\n";
-
-      // Find if the enum starts at 0 and ascends by one each time
-      if (isSequential)
-      {
-        outHeaderString += "constexpr uint32_t " + enumName + "_MAX = " + to_string(enumCounter) + "; // For using the enum in lookup arrays\n";
-      }
-
-      outHeaderString += "const char* to_string(" + enumName + " value);\n";
-      outHeaderString += "bool find_enum(std::string_view name, " + enumName + "& out);\n";
-
-      // Write out functions in cpp file
-      outBodyString += "const char* DB::to_string(" + enumName + " value)\n{\n";
-      outBodyString += "  switch (value)\n  {\n";
-
-      // Do to string lookups
-      for (const std::vector<FieldType>& row : rawTable.m_rowData)
+      if (i + c_prefetchDistance < count)
       {
-        outBodyString += "  case(" + enumName + "::";
-        AppendToString(row[0], outBodyString);
-        outBodyString += "): return \"";
-        AppendToString(row[0], outBodyString);
-        outBodyString += "\";\n";
+        Prefetch(&table[ids[i + c_prefetchDistance].m_dbIndex]);
       }
-      outBodyString += "  }\n  return \"\";\n}\n\n";
+      out[i] = table[ids[i].m_dbIndex].*member;
+    }
+  }
 
-      // Create an array sorted by name to do a lookup
-      std::vector<std::string> sortedNames;
-      for (const std::vector<FieldType>& row : rawTable.m_rowData)
-      {
-        sortedNames.emplace_back(to_string(row[0]));
-      }
-      std::sort(sortedNames.begin(), sortedNames.end());
+)header";
 
-      outBodyString += "bool DB::find_enum(std::string_view name, " + enumName + "& out)\n{\n";
-      outBodyString += "  std::string_view names[] =\n  {\n";
-      for (const auto& name : sortedNames)
-      {
-        outBodyString += "    \"";
-        outBodyString += name;
-        outBodyString += "\",\n";
-      }
-      outBodyString += "  };\n";
+static const char s_deltaIncludes[] = R"header(#include <cstring>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+)header";
 
-      outBodyString += "  " + enumName + " values[] =\n  {\n";
-      for (const auto& name : sortedNames)
-      {
-        outBodyString += "    ";
-        outBodyString += enumName;
-        outBodyString += "::";
-        outBodyString += name;
-        outBodyString += ",\n";
-      }
-      outBodyString += "  };\n";
+static const char s_deltaTypes[] = R"header(// Reader of a delta written by "CSVProcessor diff". Values are stored little endian, strings as a uint32_t size then the bytes.
+class DeltaReader
+{
+public:
+  explicit DeltaReader(std::span<const uint8_t> data) : m_data(data) {}
 
-      outBodyString += "  auto lowerBound = std::lower_bound(std::begin(names), std::end(names), name);\n";
-      outBodyString += "  if (lowerBound == std::end(names) ||\n";
-      outBodyString += "      *lowerBound != name)\n";
-      outBodyString += "  {\n";
-      outBodyString += "    out = " + enumName + "::";
-      AppendToString(rawTable.m_rowData[0][0], outBodyString);
-      outBodyString += ";\n";
-      outBodyString += "    return false;\n";
-      outBodyString += "  }\n";
-      outBodyString += "  out = values[std::distance(std::begin(names), lowerBound)];\n";
-      outBodyString += "  return true;\n";
-      outBodyString += "}\n";
+  template<typename T> bool Read(T& out)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (sizeof(T) > m_data.size() - m_pos)
+    {
+      return false;
     }
+    std::memcpy(&out, m_data.data() + m_pos, sizeof(T));
+    m_pos += sizeof(T);
+    return true;
   }
-
-  // Sort table names based on the reference order
-  std::unordered_map<std::string, uint32_t> tableDepths;
-  for (const auto& [tableName, table] : tables)
+  bool Read(bool& out)
   {
-    uint32_t depth = 0;
-    if (!CalculateTableDepth(tableName, tables, tableDepths, depth))
+    uint8_t value = 0;
+    if (!Read(value))
     {
-      OutputMessage("Error: {} Recursive table link - Use \"*TableName\" instead of +TabeName on one link", tableName);
       return false;
     }
+    out = value != 0;
+    return true;
   }
-
-  // Sort by count then by name
-  std::vector<std::tuple< uint32_t, std::string>> tableOrdering;
-  for (const auto& [tableName, order] : tableDepths)
+  bool Read(std::string_view& out)
   {
-    tableOrdering.emplace_back(order, tableName);
+    uint32_t size = 0;
+    if (!Read(size) || size > m_data.size() - m_pos)
+    {
+      return false;
+    }
+    out = std::string_view(reinterpret_cast<const char*>(m_data.data() + m_pos), size);
+    m_pos += size;
+    return true;
   }
-  std::sort(tableOrdering.begin(), tableOrdering.end());
-
-  // Write out each table
-  std::vector<std::string> writtenLinks;
-  for (const auto& [_, tableName] : tableOrdering)
+  bool Read(std::string& out)
   {
-    auto findTable = tables.find(tableName);
-    if (findTable == tables.end())
+    std::string_view value;
+    if (!Read(value))
     {
-      OutputMessage("Error: Unknown table {}", tableName);
       return false;
     }
-    const CSVTable& writeTable = findTable->second;
+    out = value;
+    return true;
+  }
+  bool IsEnd() const { return m_pos == m_data.size(); }
 
-    //DT_TODO: Write pre-declare loop reference count types (if not "this" type)
+private:
+  std::span<const uint8_t> m_data;
+  size_t m_pos = 0;
+};
 
-    outHeaderString += "\nclass " + tableName + "\n{\npublic:\n";
-    outHeaderString += "  using ID = IDType<" + tableName + ">;\n";
-    outHeaderString += "  using Iter = const IterType<" + tableName + ">::Data;\n\n";
+// Row index changes of the tables with inserted or deleted rows, output from DB::ApplyDelta.
+// Tables without inserted or deleted rows keep their indices and are not in the map.
+struct DeltaRemap
+{
+  struct Range
+  {
+    uint32_t m_oldBegin = 0;  // Old index range of rows that were kept
+    uint32_t m_oldEnd = 0;
+    uint32_t m_newBegin = 0;  // New index of the first row in the range
+  };
+  std::unordered_map<const void*, std::vector<Range>> m_tables; // Ranges in old index order, by the address of the table array
+};
 
-    writtenLinks.resize(0);
-    for (const CSVHeader& header : writeTable.m_headerData)
-    {
-      // Test if a table link
-      if (header.m_foreignTable.size() > 0)
-      {
-        if (IsEnumTable(header.m_foreignTable))
-        {
-          auto enumFindTable = tablesEnumRaw.find(header.m_foreignTable);
-          if (enumFindTable == tablesEnumRaw.end())
-          {
-            OutputMessage("Error: Unknown table {}", tableName);
-            return false;
-          }
-          const CSVTable& enumTable = enumFindTable->second;
-
-          std::string enumName = header.m_foreignTable.substr(4);
-          outHeaderString += "  ";
-          outHeaderString += enumName;
-          outHeaderString += " ";
-          outHeaderString += header.m_name;
-          outHeaderString += " = ";
-          outHeaderString += enumName;
-          outHeaderString += "::";
-          AppendToString(enumTable.m_rowData[0][0], outHeaderString);
-          outHeaderString += ";\n";
-        }
-        else
-        {
-          // Check if the link has already been processed
-          std::string newLinkName = header.m_name.substr(0, header.m_name.find_first_of(':'));
-          if (std::find(writtenLinks.begin(), writtenLinks.end(), newLinkName) == writtenLinks.end())
-          {
-            writtenLinks.push_back(newLinkName);
-
-            outHeaderString += "  ";
-            outHeaderString += header.m_foreignTable;
-            outHeaderString += "::ID ";
-            outHeaderString += newLinkName;
-            outHeaderString += ";\n";
-          }
-        }
-      }
-      else
-      {
-        outHeaderString += "  ";
-        outHeaderString += CPPTypeString(header.m_type);
-        outHeaderString += " ";
-        outHeaderString += header.m_name;
+constexpr uint32_t c_deltaMagic = 0x44565343; // "CSVD"
+constexpr uint32_t c_deltaVersion = 2;
 
-        if (const std::string* accessField = std::get_if<std::string>(&(header.m_type)))
-        {
-        }
-        else if (const bool* accessField = std::get_if<bool>(&(header.m_type)))
-        {
-          outHeaderString += " = false"; // Perhaps set a value based on min / max ?
-        }
-        else
-        {
-          outHeaderString += " = 0";
-        }
-        outHeaderString += ";\n";
-      }
-    }
-    outHeaderString += "};\n";
-  }
+enum class DeltaOp : uint8_t
+{
+  Keep = 0,   // Old rows that are unchanged
+  Delete = 1, // Old rows that are removed
+  Insert = 2, // New rows with every column value
+  Change = 3, // Old rows with the values of the changed columns
+};
 
-  // Write the main database table
-  outHeaderString += "\nclass DB\n{\npublic:\n\n";
+// Apply the row ops of a table in a delta to the table array and any parallel (cold) arrays.
+// Rows before the first insert or delete are changed in place, the rows after it are moved out once and moved back in at their new index.
+//  readCell(reader, column, rowIndex) - reads a column value into the row at the index
+template<typename ReadCell, typename T, typename... Cold>
+bool ApplyTableDelta(DeltaReader& reader, DeltaRemap* outRemap, ReadCell readCell, std::vector<T>& values, std::vector<Cold>&... coldValues)
+{
+  uint32_t oldCount = 0;
+  uint32_t newCount = 0;
+  uint32_t opCount = 0;
+  if (!reader.Read(oldCount) || !reader.Read(newCount) || !reader.Read(opCount) || oldCount != values.size())
+  {
+    return false;
+  }
 
-  outHeaderString += "  template<typename T> const std::vector<T>& GetTable() const;\n";
-  outHeaderString += "  template<typename T> IterType<T> Iter() const { return IterType<T>(GetTable<T>()); }\n";
-  outHeaderString += "  template<typename T> const T& Get(IDType<T> id) const { return GetTable<T>()[id.m_dbIndex]; }\n";
-  outHeaderString += "  template<typename T> bool ToID(uint32_t index, IDType<T>& id) const { if (index < GetTable<T>().size()) { id = IDType<T>(index); return true; } return false; }\n\n";
+  // Call a function with each array of the table and the array that its rows are moved out to
+  std::vector<T> movedValues;
+  std::tuple<std::vector<Cold>...> movedColdValues;
+  auto forEachArray = [&](auto func)
+  {
+    func(values, movedValues);
+    (func(coldValues, std::get<std::vector<Cold>>(movedColdValues)), ...);
+  };
 
-  // Add Find() methods - type string, param name string, member name string
-  std::vector<std::tuple<std::string, std::string, std::string>> params;
-  for (const auto& [_, tableName] : tableOrdering)
+  auto readCells = [&reader, &readCell](size_t index)
   {
-    if (IsGlobalTable(tableName))
+    uint16_t cellCount = 0;
+    if (!reader.Read(cellCount))
     {
-      continue;
+      return false;
     }
-    auto findTable = tables.find(tableName);
-    if (findTable == tables.end())
+    for (uint16_t i = 0; i < cellCount; i++)
+    {
+      uint16_t column = 0;
+      if (!reader.Read(column) || !readCell(reader, column, index))
+      {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  bool isMoved = false;
+  uint32_t moveStart = 0;
+  uint32_t oldIndex = 0;
+  std::vector<DeltaRemap::Range> ranges;
+  for (uint32_t op = 0; op < opCount; op++)
+  {
+    uint8_t type = 0;
+    uint32_t count = 0;
+    if (!reader.Read(type) || !reader.Read(count) ||
+        (type != static_cast<uint8_t>(DeltaOp::Insert) && count > oldCount - oldIndex))
     {
-      OutputMessage("Error: Unknown table {}", tableName);
       return false;
     }
-    const CSVTable& table = findTable->second;
 
-    writtenLinks.resize(0);
-    params.resize(0);
-    for (uint32_t columnID : table.m_keyColumns)
+    if (!isMoved && (type == static_cast<uint8_t>(DeltaOp::Delete) || type == static_cast<uint8_t>(DeltaOp::Insert)))
     {
-      const CSVHeader& header = table.m_headerData[columnID];
-      std::string writeHeaderName = header.m_name;
-      writeHeaderName[0] = std::tolower(writeHeaderName[0]);
+      isMoved = true;
+      moveStart = oldIndex;
+      forEachArray([moveStart](auto& array, auto& movedArray)
+      {
+        movedArray.assign(std::make_move_iterator(array.begin() + moveStart), std::make_move_iterator(array.end()));
+        array.resize(moveStart);
+      });
+    }
 
-      // Test if a table link
-      if (header.m_foreignTable.size() > 0)
+    switch (static_cast<DeltaOp>(type))
+    {
+    case DeltaOp::Keep:
+    case DeltaOp::Change:
+    {
+      const uint32_t newIndex = isMoved ? static_cast<uint32_t>(values.size()) : oldIndex;
+      if (isMoved)
       {
-        if (IsEnumTable(header.m_foreignTable))
-        {
-          params.emplace_back(header.m_foreignTable.substr(4), writeHeaderName, header.m_name);
-        }
-        else
+        const uint32_t movedIndex = oldIndex - moveStart;
+        forEachArray([movedIndex, count](auto& array, auto& movedArray)
         {
-          // Check if the link has already been processed
-          std::string newLinkName = header.m_name.substr(0, header.m_name.find_first_of(':'));
-          if (std::find(writtenLinks.begin(), writtenLinks.end(), newLinkName) == writtenLinks.end() && newLinkName.size() > 0)
-          {
-            writtenLinks.push_back(newLinkName);
-            writeHeaderName = newLinkName;
-            writeHeaderName[0] = std::tolower(writeHeaderName[0]);
-            params.emplace_back(header.m_foreignTable + "::ID", writeHeaderName, newLinkName);
-          }
-        }
+          array.insert(array.end(), std::make_move_iterator(movedArray.begin() + movedIndex), std::make_move_iterator(movedArray.begin() + movedIndex + count));
+        });
+      }
+      if (ranges.size() > 0 &&
+          ranges.back().m_oldEnd == oldIndex &&
+          ranges.back().m_newBegin + (oldIndex - ranges.back().m_oldBegin) == newIndex)
+      {
+        ranges.back().m_oldEnd += count;
       }
       else
       {
-        if (const std::string* accessField = std::get_if<std::string>(&(header.m_type)))
+        ranges.push_back({ oldIndex, oldIndex + count, newIndex });
+      }
+      for (uint32_t r = 0; type == static_cast<uint8_t>(DeltaOp::Change) && r < count; r++)
+      {
+        if (!readCells(newIndex + r))
         {
-          params.emplace_back("std::string_view", writeHeaderName, header.m_name);
+          return false;
         }
-        else
+      }
+      oldIndex += count;
+      break;
+    }
+    case DeltaOp::Delete:
+      oldIndex += count;
+      break;
+    case DeltaOp::Insert:
+      for (uint32_t r = 0; r < count; r++)
+      {
+        forEachArray([](auto& array, auto&) { array.emplace_back(); });
+        if (!readCells(values.size() - 1))
         {
-          params.emplace_back(CPPTypeString(header.m_type), writeHeaderName, header.m_name);
+          return false;
         }
       }
+      break;
+    default:
+      return false;
     }
+  }
 
-    outHeaderString += "  bool Find(";
-    for (auto& [type, name, _] : params)
-    {
-      outHeaderString += type;
-      outHeaderString += " ";
-      outHeaderString += name;
-      outHeaderString += ", ";
-    }
-    outHeaderString += tableName;
-    outHeaderString += "::ID& _ret) const;\n";
+  if (oldIndex != oldCount || values.size() != newCount)
+  {
+    return false;
+  }
+  if (outRemap && isMoved)
+  {
+    outRemap->m_tables[&values] = std::move(ranges);
+  }
+  return true;
+}
 
-    outBodyString += "\nbool DB::DB::Find(";
-    for (auto& [type, name, _] : params)
-    {
-      outBodyString += type;
-      outBodyString += " ";
-      outBodyString += name;
-      outBodyString += ", ";
-    }
-    outBodyString += tableName;
-    outBodyString += "::ID& _ret) const\n{\n";
+)header";
 
-    outBodyString += "  auto _searchLowerBound = std::lower_bound(" + tableName + "Values.begin(), " + tableName + "Values.end(), 0, [&](const " + tableName + "& left, int)\n  {\n";
+static const char s_deltaMethods[] = R"header(  // Apply a delta written by "CSVProcessor diff <old_path> <new_path> <delta_file>" to a DB that holds the old version.
+  // Only the tables in the delta are changed, and the links to tables with inserted or deleted rows. Links in the delta are the IDs
+  // in the new version, so IDs held outside the DB are updated with RemapID. On failure the DB is partly updated and should be reloaded.
+  bool ApplyDelta(std::span<const uint8_t> delta, DeltaRemap* outRemap = nullptr);
 
-    outBodyString += "    return ";
-    std::string equalStr;
-    for (auto& [type, name, member] : params)
+  // Update an ID held from before ApplyDelta to the index of the row after it. Returns false if the row was deleted.
+  template<typename T> bool RemapID(const DeltaRemap& remap, IDType<T>& id) const
+  {
+    auto findTable = remap.m_tables.find(&GetTable<T>());
+    if (findTable == remap.m_tables.end())
     {
-      if (equalStr.size() != 0)
-      {
-        outBodyString += " ||\n           ";
-      }
-      outBodyString += "(" + equalStr + "left." + member + " < " + name + ")";
-      equalStr += "left." + member + " == " + name + " && ";
+      return true;
     }
-    outBodyString += ";\n  });\n";
-
-    outBodyString += "  if (_searchLowerBound == " + tableName + "Values.end()";
-    for (auto& [type, name, member] : params)
+    const std::vector<DeltaRemap::Range>& ranges = findTable->second;
+    auto range = std::upper_bound(ranges.begin(), ranges.end(), id.m_dbIndex, [](uint32_t index, const DeltaRemap::Range& range) { return index < range.m_oldBegin; });
+    if (range == ranges.begin() ||
+        id.m_dbIndex >= (--range)->m_oldEnd)
     {
-      outBodyString += " ||\n      _searchLowerBound->" + member + " != " + name;
+      return false;
     }
-    outBodyString += ")\n  {\n";
-    outBodyString += "    _ret = " + tableName + "::ID(0);\n";
-    outBodyString += "    return false;\n";
-    outBodyString += "  }\n";
+    id = IDType<T>(range->m_newBegin + (id.m_dbIndex - range->m_oldBegin));
+    return true;
+  }
 
+)header";
 
-    outBodyString += "  _ret = " + tableName + "::ID((uint32_t)std::distance(" + tableName + "Values.begin(), _searchLowerBound));\n";
-    outBodyString += "  return true;\n}\n";
-  }
-  outHeaderString += "\n";
+static const char s_compactIncludes[] = R"header(#include <cassert>
+)header";
 
-  for (const auto& [_, tableName] : tableOrdering)
+static const char s_statsIncludes[] = R"header(#include <atomic>
+#include <bit>
+#include <chrono>
+)header";
+
+static const char s_statsTypes[] = R"header(// Memory use of a table, returned from DB::GetStats().
+// With DB_ENABLE_ACCESS_STATS defined the Find(), Get() and Iter() calls of each table are also counted. As this changes the
+// layout of the types, define it (or not) the same for all files that include the DB.
+struct TableStats
+{
+  std::string_view m_name;  // Table name
+  size_t m_rowCount = 0;    // Number of rows
+  size_t m_rowSize = 0;     // Size of a row (including the cold row)
+  size_t m_heapBytes = 0;   // Bytes allocated for the rows and for the strings too long to be stored in the string object
+  size_t m_indexBytes = 0;  // Bytes of search indices (0, as tables are sorted by key and searched in place)
+
+#ifdef DB_ENABLE_ACCESS_STATS
+  static constexpr size_t c_latencyBuckets = 20;
+
+  uint64_t m_findCount = 0; // Calls of Find()
+  uint64_t m_getCount = 0;  // Calls of Get()
+  uint64_t m_iterCount = 0; // Calls of Iter()
+  uint64_t m_findLatency[c_latencyBuckets] = {}; // Find() calls by time taken, bucket i counts the calls from 2^(i-1) to 2^i nanoseconds (the last bucket counts all slower calls)
+#endif
+};
+
+// Bytes allocated by a string, 0 if the string is short enough to be stored in the string object
+inline size_t StringHeapBytes(const std::string& value)
+{
+  const uintptr_t data = reinterpret_cast<uintptr_t>(value.data());
+  const uintptr_t object = reinterpret_cast<uintptr_t>(&value);
+  return (data >= object && data < object + sizeof(value)) ? 0 : value.capacity() + 1;
+}
+
+#ifdef DB_ENABLE_ACCESS_STATS
+// Access counts of a table over all DB instances. The counts use relaxed atomics, so they are cheap to update from
+// any thread but the counts of calls on other threads can be slightly behind.
+struct AccessCounters
+{
+  std::atomic<uint64_t> m_findCount;
+  std::atomic<uint64_t> m_getCount;
+  std::atomic<uint64_t> m_iterCount;
+  std::atomic<uint64_t> m_findLatency[TableStats::c_latencyBuckets];
+
+  void AddFind(std::chrono::steady_clock::duration time)
   {
-    if (IsGlobalTable(tableName))
-    {
-      outHeaderString += "  " + tableName + " " + tableName + "Values;\n";
-    }
-    else
-    {
-      outHeaderString += "  std::vector<" + tableName + "> " + tableName + "Values;\n";
-    }
+    const uint64_t nanoseconds = static_cast<uint64_t>(std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count(), 0));
+    const size_t bucket = std::min<size_t>(std::bit_width(nanoseconds), TableStats::c_latencyBuckets - 1);
+    m_findCount.fetch_add(1, std::memory_order_relaxed);
+    m_findLatency[bucket].fetch_add(1, std::memory_order_relaxed);
   }
 
-  outHeaderString += "};\n";
-
-  for (const auto& [_, tableName] : tableOrdering)
+  void Read(TableStats& outStats) const
   {
-    if (!IsGlobalTable(tableName))
+    outStats.m_findCount = m_findCount.load(std::memory_order_relaxed);
+    outStats.m_getCount = m_getCount.load(std::memory_order_relaxed);
+    outStats.m_iterCount = m_iterCount.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < TableStats::c_latencyBuckets; i++)
     {
-      outHeaderString += "template<> inline const std::vector<" + tableName + ">& DB::GetTable() const { return " + tableName + "Values; }\n";
+      outStats.m_findLatency[i] = m_findLatency[i].load(std::memory_order_relaxed);
     }
   }
+};
 
-  outHeaderString += s_commonHeaderEnd;
-  outBodyString += s_commonBodyEnd;
+template<typename T> inline AccessCounters s_tableAccess;
 
-  // DT_TODO: Read existing header, compare and only overwrite if different
-  {
-    std::filesystem::path outputPathHeader = outputPath / "DB.h";
-    std::ofstream headerFile(outputPathHeader, std::ios::binary);
-    if (!headerFile.is_open())
-    {
-      OutputMessage("Error: Unable to open file for writing {}", outputPathHeader.string());
-      return false;
-    }
+// Times a Find() call into the access counters of a table
+class FindTimer
+{
+public:
+  explicit FindTimer(AccessCounters& counters) : m_counters(counters), m_start(std::chrono::steady_clock::now()) {}
+  ~FindTimer() { m_counters.AddFind(std::chrono::steady_clock::now() - m_start); }
 
-    if (!headerFile.write(outHeaderString.data(), outHeaderString.size()))
-    {
-      OutputMessage("Error: Unable to write to file {}", outputPathHeader.string());
-      return false;
-    }
-  }
-  {
-    std::filesystem::path outputPathBody = outputPath / "DB.cpp";
-    std::ofstream bodyFile(outputPathBody, std::ios::binary);
-    if (!bodyFile.is_open())
-    {
-      OutputMessage("Error: Unable to open file for writing {}", outputPathBody.string());
-      return false;
-    }
+private:
+  AccessCounters& m_counters;
+  std::chrono::steady_clock::time_point m_start;
+};
+#endif
 
-    if (!bodyFile.write(outBodyString.data(), outBodyString.size()))
-    {
-      OutputMessage("Error: Unable to write to file {}", outputPathBody.string());
-      return false;
-    }
-  }
+)header";
+
+static const char s_commonHeaderEnd[] = R"header(
+} // namespace DB
+)header";
+
+
+static const char s_commonBodyStart[] = R"body(// Generated Database file - do not edit manually
+#include "DB.h"
 
-// Add code gen of runtime types
+#include <algorithm>
 
-// Write out common DB util header
+)body";
 
-  // OverrideIfDifferent(std::string_view newContents, std::string& workingBuffer, const std::filesystem::path& writePath);
+static const char s_commonBodyEnd[] = R"body()body";
 
+static const char s_generatedFileComment[] = "// Generated Database file - do not edit manually";
 
-   // Handle Enum tables
+static const char s_splitHeaderStart[] = R"header(// Generated Database file - do not edit manually
+#pragma once
+
+#include "DBCore.h"
+
+namespace DB
+{
+
+)header";
+
+static const char s_splitBodyStart[] = R"body(// Generated Database file - do not edit manually
+)body";
+
+
+// Append formatted text to an output string. The text is formatted straight into the string, without the temporary strings of operator+.
+template<typename... Args>
+static void AppendFormat(std::string& outString, std::format_string<Args...> format, Args&&... args)
+{
+  std::format_to(std::back_inserter(outString), format, std::forward<Args>(args)...);
+}
+
+const char* CPPTypeString(const FieldType& var)
+{
+  return std::visit([]<typename T>(const T & e)
+  {
+    if constexpr (std::is_same_v<T, FieldString>) { return "std::string"; }
+    else if constexpr (std::is_same_v<T, bool>) { return "bool"; }
+
+    else if constexpr (std::is_same_v<T, int8_t>) { return "int8_t"; }
+    else if constexpr (std::is_same_v<T, int16_t>) { return "int16_t"; }
+    else if constexpr (std::is_same_v<T, int32_t>) { return "int32_t"; }
+    else if constexpr (std::is_same_v<T, int64_t>) { return "int64_t"; }
+
+    else if constexpr (std::is_same_v<T, uint8_t>) { return "uint8_t"; }
+    else if constexpr (std::is_same_v<T, uint16_t>) { return "uint16_t"; }
+    else if constexpr (std::is_same_v<T, uint32_t>) { return "uint32_t"; }
+    else if constexpr (std::is_same_v<T, uint64_t>) { return "uint64_t"; }
+
+    else if constexpr (std::is_same_v<T, float>) { return "float"; }
+    else if constexpr (std::is_same_v<T, double>) { return "double"; }
+
+  }, var);
+}
+
+// Key search parameter - type string, param name string, member name string
+using KeyParam = std::tuple<std::string, std::string, std::string>;
+
+// Get the search parameters for the keys of a table
+static void GetKeyParams(const CSVTable& table, std::vector<KeyParam>& params)
+{
+  std::vector<std::string> writtenLinks;
+  params.resize(0);
+  for (uint32_t columnID : table.m_keyColumns)
+  {
+    const CSVHeader& header = table.m_headerData[columnID];
+    std::string writeHeaderName = header.m_name;
+    writeHeaderName[0] = std::tolower(writeHeaderName[0]);
+
+    // Test if a table link
+    if (header.m_foreignTable.size() > 0)
+    {
+      if (IsEnumTable(header.m_foreignTable))
+      {
+        params.emplace_back(header.m_foreignTable.substr(4), writeHeaderName, header.m_name);
+      }
+      else
+      {
+        // Check if the link has already been processed
+        std::string newLinkName = header.m_name.substr(0, header.m_name.find_first_of(':'));
+        if (std::find(writtenLinks.begin(), writtenLinks.end(), newLinkName) == writtenLinks.end() && newLinkName.size() > 0)
+        {
+          writtenLinks.push_back(newLinkName);
+          writeHeaderName = newLinkName;
+          writeHeaderName[0] = std::tolower(writeHeaderName[0]);
+          params.emplace_back(header.m_foreignTable + "::ID", writeHeaderName, newLinkName);
+        }
+      }
+    }
+    else
+    {
+      if (const FieldString* accessField = std::get_if<FieldString>(&(header.m_type)))
+      {
+        params.emplace_back("std::string_view", writeHeaderName, header.m_name);
+      }
+      else
+      {
+        params.emplace_back(CPPTypeString(header.m_type), writeHeaderName, header.m_name);
+      }
+    }
+  }
+}
+
+static void WriteKeyParams(std::span<const KeyParam> params, std::string& outString)
+{
+  for (auto& [type, name, _] : params)
+  {
+    outString += type;
+    outString += " ";
+    outString += name;
+    outString += ", ";
+  }
+}
+
+// Write a comparison lambda of a table row against the key params for std::lower_bound (or std::upper_bound)
+static void WriteKeyCompareLambda(const std::string& tableName, std::span<const KeyParam> params, bool isUpperBound, std::string& outString)
+{
+  if (isUpperBound)
+  {
+    AppendFormat(outString, "[&](int, const {}& right)\n  {{\n", tableName);
+  }
+  else
+  {
+    AppendFormat(outString, "[&](const {}& left, int)\n  {{\n", tableName);
+  }
+
+  outString += "    return ";
+  std::string equalStr;
+  for (auto& [type, name, member] : params)
+  {
+    if (equalStr.size() != 0)
+    {
+      outString += " ||\n           ";
+    }
+    if (isUpperBound)
+    {
+      AppendFormat(outString, "({}{} < right.{})", equalStr, name, member);
+      AppendFormat(equalStr, "{} == right.{} && ", name, member);
+    }
+    else
+    {
+      AppendFormat(outString, "({}left.{} < {})", equalStr, member, name);
+      AppendFormat(equalStr, "left.{} == {} && ", member, name);
+    }
+  }
+  outString += ";\n  })";
+}
+
+// Write a range search of the leading key params that returns an IDRange
+static void WriteRangeFunction(const char* funcName, const std::string& tableName, std::span<const KeyParam> params, std::string& outHeaderString, std::string& outBodyString)
+{
+  AppendFormat(outHeaderString, "  bool {}(", funcName);
+  WriteKeyParams(params, outHeaderString);
+  AppendFormat(outHeaderString, "IDRange<{}>& _ret) const;\n", tableName);
+
+  AppendFormat(outBodyString, "\nbool DB::DB::{}(", funcName);
+  WriteKeyParams(params, outBodyString);
+  AppendFormat(outBodyString, "IDRange<{}>& _ret) const\n{{\n", tableName);
+
+  AppendFormat(outBodyString, "  auto _searchLowerBound = std::lower_bound({0}Values.begin(), {0}Values.end(), 0, ", tableName);
+  WriteKeyCompareLambda(tableName, params, false, outBodyString);
+  outBodyString += ";\n";
+  AppendFormat(outBodyString, "  auto _searchUpperBound = std::upper_bound(_searchLowerBound, {}Values.end(), 0, ", tableName);
+  WriteKeyCompareLambda(tableName, params, true, outBodyString);
+  outBodyString += ";\n";
+
+  AppendFormat(outBodyString, "  _ret = IDRange<{0}>((uint32_t)std::distance({0}Values.begin(), _searchLowerBound), (uint32_t)std::distance({0}Values.begin(), _searchUpperBound));\n", tableName);
+  outBodyString += "  return _searchLowerBound != _searchUpperBound;\n}\n";
+}
+
+// Write the Find(), LowerBound(), EqualRange() and PrefixRange() searches of a table sorted by its keys.
+// With countAccess the Find() calls are counted and timed when the generated code is built with DB_ENABLE_ACCESS_STATS.
+static void WriteSearchFunctions(const std::string& tableName, const std::vector<KeyParam>& params, bool countAccess, std::string& outHeaderString, std::string& outBodyString)
+{
+  // Exact match
+  outHeaderString += "  bool Find(";
+  WriteKeyParams(params, outHeaderString);
+  AppendFormat(outHeaderString, "{}::ID& _ret) const;\n", tableName);
+
+  outBodyString += "\nbool DB::DB::Find(";
+  WriteKeyParams(params, outBodyString);
+  AppendFormat(outBodyString, "{}::ID& _ret) const\n{{\n", tableName);
+  if (countAccess)
+  {
+    AppendFormat(outBodyString, "#ifdef DB_ENABLE_ACCESS_STATS\n  FindTimer _findTimer(s_tableAccess<{}>);\n#endif\n", tableName);
+  }
+
+  AppendFormat(outBodyString, "  auto _searchLowerBound = std::lower_bound({0}Values.begin(), {0}Values.end(), 0, ", tableName);
+  WriteKeyCompareLambda(tableName, params, false, outBodyString);
+  outBodyString += ";\n";
+
+  AppendFormat(outBodyString, "  if (_searchLowerBound == {}Values.end()", tableName);
+  for (auto& [type, name, member] : params)
+  {
+    AppendFormat(outBodyString, " ||\n      _searchLowerBound->{} != {}", member, name);
+  }
+  outBodyString += ")\n  {\n";
+  AppendFormat(outBodyString, "    _ret = {}::ID(0);\n", tableName);
+  outBodyString += "    return false;\n";
+  outBodyString += "  }\n";
+
+  AppendFormat(outBodyString, "  _ret = {0}::ID((uint32_t)std::distance({0}Values.begin(), _searchLowerBound));\n", tableName);
+  outBodyString += "  return true;\n}\n";
+
+  // Range searches need at least one key to search on
+  if (params.size() == 0)
+  {
+    return;
+  }
+
+  // First row that is not less than the keys
+  outHeaderString += "  bool LowerBound(";
+  WriteKeyParams(params, outHeaderString);
+  AppendFormat(outHeaderString, "{}::ID& _ret) const;\n", tableName);
+
+  outBodyString += "\nbool DB::DB::LowerBound(";
+  WriteKeyParams(params, outBodyString);
+  AppendFormat(outBodyString, "{}::ID& _ret) const\n{{\n", tableName);
+
+  AppendFormat(outBodyString, "  auto _searchLowerBound = std::lower_bound({0}Values.begin(), {0}Values.end(), 0, ", tableName);
+  WriteKeyCompareLambda(tableName, params, false, outBodyString);
+  outBodyString += ";\n";
+  AppendFormat(outBodyString, "  _ret = {0}::ID((uint32_t)std::distance({0}Values.begin(), _searchLowerBound));\n", tableName);
+  AppendFormat(outBodyString, "  return _searchLowerBound != {}Values.end();\n}}\n", tableName);
+
+  // Batched exact match
+  AppendFormat(outHeaderString, "  uint32_t FindBatch(std::span<const {0}::Key> keys, std::span<{0}::ID> _ret) const;\n", tableName);
+
+  AppendFormat(outBodyString, "\nuint32_t DB::DB::FindBatch(std::span<const {0}::Key> keys, std::span<{0}::ID> _ret) const\n{{\n", tableName);
+  outBodyString += "  uint32_t _found = 0;\n";
+  AppendFormat(outBodyString, "  BatchLowerBound({0}Values, std::min(keys.size(), _ret.size()), [&](const {0}& left, size_t _keyIndex)\n  {{\n", tableName);
+  AppendFormat(outBodyString, "    const {}::Key& key = keys[_keyIndex];\n", tableName);
+  outBodyString += "    return ";
+  std::string equalStr;
+  for (auto& [type, name, member] : params)
+  {
+    if (equalStr.size() != 0)
+    {
+      outBodyString += " ||\n           ";
+    }
+    AppendFormat(outBodyString, "({0}left.{1} < key.{1})", equalStr, member);
+    AppendFormat(equalStr, "left.{0} == key.{0} && ", member);
+  }
+  outBodyString += ";\n  },\n  [&](size_t _keyIndex, uint32_t _index)\n  {\n";
+  AppendFormat(outBodyString, "    const {}::Key& key = keys[_keyIndex];\n", tableName);
+  AppendFormat(outBodyString, "    if (_index == {}Values.size()", tableName);
+  for (auto& [type, name, member] : params)
+  {
+    AppendFormat(outBodyString, " ||\n        {0}Values[_index].{1} != key.{1}", tableName, member);
+  }
+  outBodyString += ")\n    {\n";
+  AppendFormat(outBodyString, "      _ret[_keyIndex] = {}::ID(0);\n", tableName);
+  outBodyString += "      return;\n";
+  outBodyString += "    }\n";
+  AppendFormat(outBodyString, "    _ret[_keyIndex] = {}::ID(_index);\n", tableName);
+  outBodyString += "    _found++;\n";
+  outBodyString += "  });\n";
+  outBodyString += "  return _found;\n}\n";
+
+  // All rows that match the keys
+  WriteRangeFunction("EqualRange", tableName, params, outHeaderString, outBodyString);
+
+  // All rows that match a partial key (eg. every "Type" for a "Name" in a "Name, Type" keyed table)
+  std::span<const KeyParam> paramSpan(params);
+  for (size_t prefixSize = 1; prefixSize < params.size(); prefixSize++)
+  {
+    WriteRangeFunction("PrefixRange", tableName, paramSpan.first(prefixSize), outHeaderString, outBodyString);
+  }
+}
+
+// Write the enum type declaration to the header and the to_string() / find_enum() functions to the body
+static void WriteEnum(const std::string& tableName, const CSVTable& rawTable, std::string& outHeaderString, std::string& outBodyString)
+{
+  const std::string_view enumName = std::string_view(tableName).substr(4);
+
+  // The names of the enum values, in one buffer
+  std::string nameBuffer;
+  std::vector<size_t> nameEnds;
+  nameEnds.reserve(rawTable.m_rowData.size());
+  for (const CSVRow& row : rawTable.m_rowData)
+  {
+    AppendToString(row[0], nameBuffer);
+    nameEnds.push_back(nameBuffer.size());
+  }
+  std::vector<std::string_view> names;
+  names.reserve(nameEnds.size());
+  for (size_t i = 0; i < nameEnds.size(); i++)
+  {
+    const size_t nameStart = i > 0 ? nameEnds[i - 1] : 0;
+    names.push_back(std::string_view(nameBuffer).substr(nameStart, nameEnds[i] - nameStart));
+  }
+
+  AppendFormat(outHeaderString, "enum class {} : {}\n{{\n", enumName, CPPTypeString(rawTable.m_headerData[1].m_type));
+  size_t enumCounter = 0;
+  bool isSequential = true;
+  for (const CSVRow& row : rawTable.m_rowData)
+  {
+    outHeaderString += "  ";
+    outHeaderString += names[enumCounter];
+    outHeaderString += " = ";
+    AppendToString(row[1], outHeaderString);
+    outHeaderString += ",";
+
+    // Check if a sequential enum
+    if (isSequential && !IsEqual(row[1], enumCounter))
+    {
+      isSequential = false;
+    }
+    enumCounter++;
+
+    if (const FieldString* accessField = std::get_if<FieldString>(&row[2]))
+    {
+      if (accessField->size() > 0)
+      {
+        outHeaderString += " // ";
+        outHeaderString += *accessField;
+      }
+    }
+    outHeaderString += "\n";
+  }
+  outHeaderString += "};\n";
+
+  // Find if the enum starts at 0 and ascends by one each time
+  if (isSequential)
+  {
+    AppendFormat(outHeaderString, "constexpr uint32_t {}_MAX = {}; // For using the enum in lookup arrays\n", enumName, enumCounter);
+  }
+
+  AppendFormat(outHeaderString, "const char* to_string({} value);\n", enumName);
+  AppendFormat(outHeaderString, "bool find_enum(std::string_view name, {}& out);\n", enumName);
+
+  // Write out functions in cpp file
+  AppendFormat(outBodyString, "const char* DB::to_string({} value)\n{{\n", enumName);
+  outBodyString += "  switch (value)\n  {\n";
+
+  // Do to string lookups
+  for (std::string_view name : names)
+  {
+    outBodyString += "  case(";
+    outBodyString += enumName;
+    outBodyString += "::";
+    outBodyString += name;
+    outBodyString += "): return \"";
+    outBodyString += name;
+    outBodyString += "\";\n";
+  }
+  outBodyString += "  }\n  return \"\";\n}\n\n";
+
+  // Create an array sorted by name to do a lookup
+  std::vector<std::string_view> sortedNames = names;
+  std::sort(sortedNames.begin(), sortedNames.end());
+
+  AppendFormat(outBodyString, "bool DB::find_enum(std::string_view name, {}& out)\n{{\n", enumName);
+  outBodyString += "  std::string_view names[] =\n  {\n";
+  for (std::string_view name : sortedNames)
+  {
+    outBodyString += "    \"";
+    outBodyString += name;
+    outBodyString += "\",\n";
+  }
+  outBodyString += "  };\n";
+
+  AppendFormat(outBodyString, "  {} values[] =\n  {{\n", enumName);
+  for (std::string_view name : sortedNames)
+  {
+    outBodyString += "    ";
+    outBodyString += enumName;
+    outBodyString += "::";
+    outBodyString += name;
+    outBodyString += ",\n";
+  }
+  outBodyString += "  };\n";
+
+  outBodyString += "  auto lowerBound = std::lower_bound(std::begin(names), std::end(names), name);\n";
+  outBodyString += "  if (lowerBound == std::end(names) ||\n";
+  outBodyString += "      *lowerBound != name)\n";
+  outBodyString += "  {\n";
+  AppendFormat(outBodyString, "    out = {}::{};\n", enumName, names[0]);
+  outBodyString += "    return false;\n";
+  outBodyString += "  }\n";
+  outBodyString += "  out = values[std::distance(std::begin(names), lowerBound)];\n";
+  outBodyString += "  return true;\n";
+  outBodyString += "}\n";
+}
+
+// Get a integer type field as a 64 bit signed value
+static bool GetIntegerValue(const FieldType& field, int64_t& outValue)
+{
+  return std::visit([&outValue]<typename T>(const T & e)
+  {
+    if constexpr (std::is_same_v<T, FieldString> || std::is_floating_point_v<T>)
+    {
+      return false;
+    }
+    else if constexpr (std::is_same_v<T, uint64_t>)
+    {
+      outValue = static_cast<int64_t>(e);
+      return e <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+    }
+    else
+    {
+      outValue = static_cast<int64_t>(e);
+      return true;
+    }
+  }, field);
+}
+
+// Bit packed column in compact layout mode
+struct PackedField
+{
+  std::string m_name;      // Column name
+  std::string m_type;      // Type returned from the accessor
+  bool m_isBool = false;   // If the accessor type is bool
+  bool m_isEnum = false;   // If the accessor type is an enum
+  int64_t m_minValue = 0;  // The value that is stored as zero
+  uint32_t m_bits = 0;     // Number of bits used
+  uint32_t m_word = 0;     // Index of the packed word the value is stored in
+  uint32_t m_shift = 0;    // Bit offset in the packed word
+};
+
+// Get the value range that needs to be stored for a compact layout column. Returns false if the column is not worth packing.
+// The declared min/max range is used, otherwise the range of the current values in the column.
+static bool GetPackedField(const CSVTable& table, uint32_t column, const std::unordered_map<std::string, CSVTable>& tablesEnumRaw, PackedField& outField)
+{
+  const CSVHeader& header = table.m_headerData[column];
+  if (header.m_isKey || header.m_isIgnored)
+  {
+    return false;
+  }
+
+  outField.m_name = header.m_name;
+  outField.m_type = CPPTypeString(header.m_type);
+  outField.m_isBool = std::holds_alternative<bool>(header.m_type);
+  outField.m_isEnum = false;
+
+  int64_t minValue = std::numeric_limits<int64_t>::max();
+  int64_t maxValue = std::numeric_limits<int64_t>::min();
+  int64_t value = 0;
+  if (outField.m_isBool)
+  {
+    minValue = 0;
+    maxValue = 1;
+  }
+  else if (header.m_foreignTable.size() > 0)
+  {
+    // Only enums are packed, as table links are always an ID
+    auto enumFindTable = tablesEnumRaw.find(header.m_foreignTable);
+    if (!IsEnumTable(header.m_foreignTable) || enumFindTable == tablesEnumRaw.end())
+    {
+      return false;
+    }
+    outField.m_type = header.m_foreignTable.substr(4);
+    outField.m_isEnum = true;
+    for (const CSVRow& row : enumFindTable->second.m_rowData)
+    {
+      if (!GetIntegerValue(row[1], value))
+      {
+        return false;
+      }
+      minValue = std::min(minValue, value);
+      maxValue = std::max(maxValue, value);
+    }
+  }
+  else
+  {
+    FieldType rangeField;
+    if (header.m_minValue.size() > 0 && ParseField(header.m_type, header.m_minValue, rangeField) && GetIntegerValue(rangeField, value))
+    {
+      minValue = value;
+    }
+    if (header.m_maxValue.size() > 0 && ParseField(header.m_type, header.m_maxValue, rangeField) && GetIntegerValue(rangeField, value))
+    {
+      maxValue = value;
+    }
+
+    // Use the range of the values if no declared range
+    bool hasMin = header.m_minValue.size() > 0;
+    bool hasMax = header.m_maxValue.size() > 0;
+    for (const CSVRow& row : table.m_rowData)
+    {
+      if (!GetIntegerValue(row[column], value))
+      {
+        return false;
+      }
+      if (!hasMin)
+      {
+        minValue = std::min(minValue, value);
+      }
+      if (!hasMax)
+      {
+        maxValue = std::max(maxValue, value);
+      }
+    }
+  }
+  if (minValue > maxValue)
+  {
+    minValue = maxValue = 0;
+  }
+
+  // Only pack if the range is smaller than the type
+  outField.m_minValue = minValue;
+  outField.m_bits = std::max(1u, static_cast<uint32_t>(std::bit_width(static_cast<uint64_t>(maxValue) - static_cast<uint64_t>(minValue))));
+  uint32_t typeBits = std::visit([]<typename T>(const T&) { return static_cast<uint32_t>(sizeof(T) * 8); }, header.m_type);
+  return outField.m_bits <= 32 && (outField.m_isBool || outField.m_bits < typeBits);
+}
+
+// Write the accessor methods of a bit packed column
+static void WritePackedAccessors(const PackedField& field, std::string& outHeaderString)
+{
+  const std::string mask = std::format("0x{:X}u", (uint64_t(1) << field.m_bits) - 1);
+  const std::string stored = std::format("((m_packed{} >> {}) & {})", field.m_word, field.m_shift, mask);
+
+  AppendFormat(outHeaderString, "  {} {}() const {{ return ", field.m_type, field.m_name);
+  if (field.m_isBool)
+  {
+    AppendFormat(outHeaderString, "{} != 0", stored);
+  }
+  else if (field.m_minValue > 0)
+  {
+    AppendFormat(outHeaderString, "static_cast<{}>(static_cast<int64_t>{} + {})", field.m_type, stored, field.m_minValue);
+  }
+  else if (field.m_minValue < 0)
+  {
+    AppendFormat(outHeaderString, "static_cast<{}>(static_cast<int64_t>{} - {})", field.m_type, stored, -static_cast<uint64_t>(field.m_minValue));
+  }
+  else
+  {
+    AppendFormat(outHeaderString, "static_cast<{}>{}", field.m_type, stored);
+  }
+  outHeaderString += "; }\n";
+
+  // Values outside the bits of the field can not be stored, CanSet<Name>() tests a value before it is set
+  if (!field.m_isBool)
+  {
+    std::string offset;
+    if (field.m_minValue > 0)
+    {
+      offset = std::format(" - {}ull", field.m_minValue);
+    }
+    else if (field.m_minValue < 0)
+    {
+      offset = std::format(" + {}ull", -static_cast<uint64_t>(field.m_minValue));
+    }
+    AppendFormat(outHeaderString, "  static constexpr bool CanSet{}({} value) {{ return static_cast<uint64_t>(value){} <= {}; }}\n",
+                 field.m_name, field.m_type, offset, mask);
+  }
+
+  // Setter subtracts the min value
+  std::string setValue;
+  if (field.m_minValue > 0)
+  {
+    setValue = std::format("static_cast<uint32_t>(static_cast<int64_t>(value) - {})", field.m_minValue);
+  }
+  else if (field.m_minValue < 0)
+  {
+    setValue = std::format("static_cast<uint32_t>(static_cast<int64_t>(value) + {})", -static_cast<uint64_t>(field.m_minValue));
+  }
+  else
+  {
+    setValue = "static_cast<uint32_t>(value)";
+  }
+  AppendFormat(outHeaderString, "  void Set{0}({1} value) {{ {6}m_packed{2} = static_cast<decltype(m_packed{2})>((m_packed{2} & ~({3} << {4})) | (({5} & {3}) << {4})); }}\n",
+               field.m_name, field.m_type, field.m_word, mask, field.m_shift, setValue, field.m_isBool ? "" : std::format("assert(CanSet{}(value)); ", field.m_name));
+}
+
+// Dictionary encoded string column
+struct DictionaryField
+{
+  std::string m_name;                     // Column name
+  std::vector<std::string_view> m_values; // Distinct values in sorted order, the code of a value is its index
+};
+
+// Get the distinct values of a string column. Returns false if the column is not worth storing as codes into the values,
+// which is a key or link column, more distinct values than the max or no repeated values.
+static bool GetDictionaryField(const CSVTable& table, uint32_t column, uint32_t maxValues, DictionaryField& outField)
+{
+  const CSVHeader& header = table.m_headerData[column];
+  if (header.m_isKey || header.m_foreignTable.size() > 0 || !std::holds_alternative<FieldString>(header.m_type))
+  {
+    return false;
+  }
+
+  maxValues = std::min(maxValues, 65536u);
+  std::unordered_set<std::string_view> values;
+  for (const CSVRow& row : table.m_rowData)
+  {
+    values.insert(std::get<FieldString>(row[column]));
+    if (values.size() > maxValues)
+    {
+      return false;
+    }
+  }
+  if (values.size() >= table.m_rowData.size())
+  {
+    return false;
+  }
+
+  // Sorted so that the codes compare in the same order as the values
+  outField.m_name = header.m_name;
+  outField.m_values.assign(values.begin(), values.end());
+  std::sort(outField.m_values.begin(), outField.m_values.end());
+  return true;
+}
+
+// Append a string as a C++ string literal
+static void AppendStringLiteral(std::string_view value, std::string& outString)
+{
+  outString += '"';
+  for (char c : value)
+  {
+    switch (c)
+    {
+    case '"': outString += "\\\""; break;
+    case '\\': outString += "\\\\"; break;
+    case '\n': outString += "\\n"; break;
+    case '\r': outString += "\\r"; break;
+    case '\t': outString += "\\t"; break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20)
+      {
+        AppendFormat(outString, "\\{:03o}", static_cast<unsigned char>(c));
+      }
+      else
+      {
+        outString += c;
+      }
+    }
+  }
+  outString += '"';
+}
+
+// Write the dictionary of a dictionary encoded column and the accessor methods that look up the code
+static void WriteDictionaryAccessors(const DictionaryField& field, std::string& outHeaderString)
+{
+  const char* codeType = field.m_values.size() <= 256 ? "uint8_t" : "uint16_t";
+
+  AppendFormat(outHeaderString, "  static constexpr std::string_view {}Values[] =\n  {{\n", field.m_name);
+  for (std::string_view value : field.m_values)
+  {
+    outHeaderString += "    ";
+    AppendStringLiteral(value, outHeaderString);
+    outHeaderString += ",\n";
+  }
+  outHeaderString += "  };\n";
+  AppendFormat(outHeaderString, "  std::string_view {0}() const {{ return {0}Values[{0}Code]; }}\n", field.m_name);
+  AppendFormat(outHeaderString, "  bool Set{0}(std::string_view value) {{ return Find{0}Code(value, {0}Code); }}\n", field.m_name);
+
+  // Code of a value, to compare the codes of rows against instead of the strings
+  AppendFormat(outHeaderString, "  static bool Find{}Code(std::string_view value, {}& outCode)\n  {{\n", field.m_name, codeType);
+  AppendFormat(outHeaderString, "    auto lowerBound = std::lower_bound(std::begin({0}Values), std::end({0}Values), value);\n", field.m_name);
+  AppendFormat(outHeaderString, "    if (lowerBound == std::end({}Values) ||\n", field.m_name);
+  outHeaderString += "        *lowerBound != value)\n";
+  outHeaderString += "    {\n";
+  outHeaderString += "      return false;\n";
+  outHeaderString += "    }\n";
+  AppendFormat(outHeaderString, "    outCode = static_cast<{}>(std::distance(std::begin({}Values), lowerBound));\n", codeType, field.m_name);
+  outHeaderString += "    return true;\n";
+  outHeaderString += "  }\n";
+}
+
+bool CheckCodeGenValues(const std::string& tableName, const CSVTable& codeTable, const CSVTable& table, const std::unordered_map<std::string, CSVTable>& tablesEnumRaw, const CodeGenOptions& options)
+{
+  // The packed and dictionary columns are found the same way as in WriteTableClass()
+  const bool allowCold = !IsGlobalTable(tableName);
+  PackedField packedField;
+  DictionaryField dictionaryField;
+  for (uint32_t h = 0; h < codeTable.m_headerData.size(); h++)
+  {
+    if (allowCold && codeTable.m_headerData[h].m_isCold)
+    {
+      continue;
+    }
+
+    // Bools and enums always fit, integers need to be in the range of the packed bits
+    if (options.m_compactLayout && GetPackedField(codeTable, h, tablesEnumRaw, packedField))
+    {
+      const uint64_t mask = (uint64_t(1) << packedField.m_bits) - 1;
+      int64_t value = 0;
+      for (size_t r = 0; !packedField.m_isBool && !packedField.m_isEnum && r < table.m_rowData.size(); r++)
+      {
+        if (!GetIntegerValue(table.m_rowData[r][h], value) ||
+            static_cast<uint64_t>(value) - static_cast<uint64_t>(packedField.m_minValue) > mask)
+        {
+          OutputMessage("Error: Table {} column {} value {} is outside the packed range of the generated code", tableName, packedField.m_name, to_string(table.m_rowData[r][h]));
+          return false;
+        }
+      }
+    }
+    else if (options.m_dictionaryMaxValues > 0 && GetDictionaryField(codeTable, h, options.m_dictionaryMaxValues, dictionaryField))
+    {
+      for (size_t r = 0; r < table.m_rowData.size(); r++)
+      {
+        if (!std::binary_search(dictionaryField.m_values.begin(), dictionaryField.m_values.end(), std::string_view(std::get<FieldString>(table.m_rowData[r][h]))))
+        {
+          OutputMessage("Error: Table {} column {} value {} is not in the dictionary of the generated code", tableName, dictionaryField.m_name, to_string(table.m_rowData[r][h]));
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// A data member of a generated row type
+struct TableMember
+{
+  std::string m_declaration;  // Member declaration line
+  uint32_t m_alignment = 0;   // Alignment of the member type (for reordering)
+  bool m_isCold = false;      // If stored in the cold type
+  bool m_isPrivate = false;   // If only accessed by accessor methods
+};
+
+// Get the alignment of a column value type. Strings are assumed to be pointer aligned on a 64 bit target.
+static uint32_t GetTypeAlignment(const FieldType& type)
+{
+  if (std::holds_alternative<FieldString>(type))
+  {
+    return 8;
+  }
+  return std::visit([]<typename T>(const T&) { return static_cast<uint32_t>(sizeof(T)); }, type);
+}
+
+// Write the members of a row type. In reorder mode members are sorted by alignment (largest first) to minimize padding.
+static void WriteTableMembers(std::vector<TableMember>& members, bool reorder, std::string& outHeaderString)
+{
+  if (reorder)
+  {
+    std::stable_sort(members.begin(), members.end(), [](const TableMember& a, const TableMember& b) { return a.m_alignment > b.m_alignment; });
+  }
+
+  bool isPrivate = false;
+  for (const TableMember& member : members)
+  {
+    if (member.m_isPrivate != isPrivate)
+    {
+      isPrivate = member.m_isPrivate;
+      outHeaderString += isPrivate ? "\nprivate:\n" : "\npublic:\n";
+    }
+    outHeaderString += member.m_declaration;
+  }
+}
+
+// Write the row type of a table.
+// In split file mode, links to other tables are written as IDType<Table> so only a forward declaration of the table is needed.
+// Columns marked cold are written to a separate <Table>Cold type that is stored in a parallel array in the DB.
+// outDeltaCases gets the switch cases that read a delta value into each column (in delta apply mode).
+// outStatsStrings gets the lines that add the heap bytes of each string member to the table stats (in stats mode).
+static bool WriteTableClass(const std::string& tableName, const CSVTable& writeTable, const std::unordered_map<std::string, CSVTable>& tablesEnumRaw, const CodeGenOptions& options, std::string& outHeaderString, bool& outHasCold, std::string& outDeltaCases, std::string& outStatsStrings)
+{
+  const bool forwardLinks = options.m_splitFiles;
+  const bool allowCold = !IsGlobalTable(tableName);
+
+  //DT_TODO: Write pre-declare loop reference count types (if not "this" type)
+
+  // Get the columns to bit pack into words in compact mode (first fit in column order)
+  std::vector<PackedField> packedFields;
+  std::vector<uint32_t> packedWordBits;
+  std::vector<bool> isPacked(writeTable.m_headerData.size());
+  if (options.m_compactLayout)
+  {
+    PackedField packedField;
+    for (uint32_t h = 0; h < writeTable.m_headerData.size(); h++)
+    {
+      if ((allowCold && writeTable.m_headerData[h].m_isCold) ||
+          !GetPackedField(writeTable, h, tablesEnumRaw, packedField))
+      {
+        continue;
+      }
+
+      packedField.m_word = 0;
+      while (packedField.m_word < packedWordBits.size() && packedWordBits[packedField.m_word] + packedField.m_bits > 32)
+      {
+        packedField.m_word++;
+      }
+      if (packedField.m_word == packedWordBits.size())
+      {
+        packedWordBits.push_back(0);
+      }
+      packedField.m_shift = packedWordBits[packedField.m_word];
+      packedWordBits[packedField.m_word] += packedField.m_bits;
+
+      packedFields.push_back(packedField);
+      isPacked[h] = true;
+    }
+  }
+
+  // Get the low cardinality string columns to store as codes into a dictionary (not the cold columns, as the accessors are in the row type)
+  std::vector<DictionaryField> dictionaryFields;
+  std::vector<bool> isDictionary(writeTable.m_headerData.size());
+  if (options.m_dictionaryMaxValues > 0)
+  {
+    DictionaryField dictionaryField;
+    for (uint32_t h = 0; h < writeTable.m_headerData.size(); h++)
+    {
+      if (!(allowCold && writeTable.m_headerData[h].m_isCold) &&
+          GetDictionaryField(writeTable, h, options.m_dictionaryMaxValues, dictionaryField))
+      {
+        dictionaryFields.push_back(std::move(dictionaryField));
+        isDictionary[h] = true;
+      }
+    }
+  }
+
+  std::vector<TableMember> members;
+  std::vector<std::string_view> writtenLinks;
+  size_t packedIndex = 0;
+  size_t dictionaryIndex = 0;
+  for (uint32_t h = 0; h < writeTable.m_headerData.size(); h++)
+  {
+    const CSVHeader& header = writeTable.m_headerData[h];
+    if (isPacked[h])
+    {
+      if (options.m_deltaApply)
+      {
+        const PackedField& packedField = packedFields[packedIndex];
+        const std::string rangeCheck = packedField.m_isBool ? "" : std::format(" ||\n        !{}::CanSet{}(value)", tableName, packedField.m_name);
+        AppendFormat(outDeltaCases, "  case {}:\n  {{\n    {} value{{}};\n    if (!reader.Read(value){})\n    {{\n      return false;\n    }}\n    row.Set{}(value);\n    return true;\n  }}\n",
+                                     h, packedField.m_type, rangeCheck, packedField.m_name);
+      }
+      packedIndex++;
+      continue;
+    }
+
+    TableMember member;
+    member.m_isCold = allowCold && header.m_isCold;
+    const char* rowName = member.m_isCold ? "cold" : "row"; // The row the member is in, in the delta and stats code
+
+    if (isDictionary[h])
+    {
+      const bool isWide = dictionaryFields[dictionaryIndex++].m_values.size() > 256;
+      AppendFormat(member.m_declaration, "  {} {}Code = 0;\n", isWide ? "uint16_t" : "uint8_t", header.m_name);
+      member.m_alignment = isWide ? 2 : 1;
+      members.push_back(std::move(member));
+      if (options.m_deltaApply)
+      {
+        AppendFormat(outDeltaCases, "  case {}:\n  {{\n    std::string_view value;\n    return reader.Read(value) && row.Set{}(value);\n  }}\n", h, header.m_name);
+      }
+      continue;
+    }
+
+    // Test if a table link
+    if (header.m_foreignTable.size() > 0)
+    {
+      if (IsEnumTable(header.m_foreignTable))
+      {
+        auto enumFindTable = tablesEnumRaw.find(header.m_foreignTable);
+        if (enumFindTable == tablesEnumRaw.end())
+        {
+          OutputMessage("Error: Unknown table {}", tableName);
+          return false;
+        }
+        const CSVTable& enumTable = enumFindTable->second;
+
+        const std::string_view enumName = std::string_view(header.m_foreignTable).substr(4);
+        AppendFormat(member.m_declaration, "  {} {} = {}::", enumName, header.m_name, enumName);
+        AppendToString(enumTable.m_rowData[0][0], member.m_declaration);
+        member.m_declaration += ";\n";
+        member.m_alignment = GetTypeAlignment(enumTable.m_headerData[1].m_type);
+        if (options.m_deltaApply)
+        {
+          AppendFormat(outDeltaCases, "  case {}: return reader.Read({}.{});\n", h, rowName, header.m_name);
+        }
+      }
+      else
+      {
+        // Check if the link has already been processed
+        const std::string_view newLinkName = std::string_view(header.m_name).substr(0, header.m_name.find_first_of(':'));
+        if (std::find(writtenLinks.begin(), writtenLinks.end(), newLinkName) != writtenLinks.end())
+        {
+          continue;
+        }
+        writtenLinks.push_back(newLinkName);
+
+        if (forwardLinks)
+        {
+          AppendFormat(member.m_declaration, "  IDType<{}> {};\n", header.m_foreignTable, newLinkName);
+        }
+        else
+        {
+          AppendFormat(member.m_declaration, "  {}::ID {};\n", header.m_foreignTable, newLinkName);
+        }
+        member.m_alignment = sizeof(uint32_t);
+        if (options.m_deltaApply)
+        {
+          AppendFormat(outDeltaCases, "  case {}: return ReadID(reader, {}.{});\n", h, rowName, newLinkName);
+        }
+      }
+    }
+    else
+    {
+      AppendFormat(member.m_declaration, "  {} {}", CPPTypeString(header.m_type), header.m_name);
+
+      if (const FieldString* accessField = std::get_if<FieldString>(&(header.m_type)))
+      {
+        if (options.m_stats)
+        {
+          AppendFormat(outStatsStrings, "      stats.m_heapBytes += StringHeapBytes({}.{});\n", rowName, header.m_name);
+        }
+      }
+      else if (const bool* accessField = std::get_if<bool>(&(header.m_type)))
+      {
+        member.m_declaration += " = false"; // Perhaps set a value based on min / max ?
+      }
+      else
+      {
+        member.m_declaration += " = 0";
+      }
+      member.m_declaration += ";\n";
+      member.m_alignment = GetTypeAlignment(header.m_type);
+      if (options.m_deltaApply)
+      {
+        AppendFormat(outDeltaCases, "  case {}: return reader.Read({}.{});\n", h, rowName, header.m_name);
+      }
+    }
+    members.push_back(std::move(member));
+  }
+
+  // Split off the cold members
+  auto coldStart = std::stable_partition(members.begin(), members.end(), [](const TableMember& member) { return !member.m_isCold; });
+  std::vector<TableMember> coldMembers(std::make_move_iterator(coldStart), std::make_move_iterator(members.end()));
+  members.erase(coldStart, members.end());
+
+  outHasCold = coldMembers.size() > 0;
+  if (outHasCold)
+  {
+    AppendFormat(outHeaderString, "\nclass {}Cold\n{{\npublic:\n", tableName);
+    WriteTableMembers(coldMembers, options.m_reorderMembers, outHeaderString);
+    outHeaderString += "};\n";
+  }
+
+  AppendFormat(outHeaderString, "\nclass {0}\n{{\npublic:\n  using ID = IDType<{0}>;\n  using Iter = const IterType<{0}>::Data;\n", tableName);
+  if (outHasCold)
+  {
+    AppendFormat(outHeaderString, "  using Cold = {}Cold;\n", tableName);
+  }
+  outHeaderString += "\n";
+
+  // Write the key type for batched searches
+  if (!IsGlobalTable(tableName))
+  {
+    std::vector<KeyParam> params;
+    GetKeyParams(writeTable, params);
+    if (params.size() > 0)
+    {
+      outHeaderString += "  struct Key\n  {\n";
+      for (auto& [type, name, member] : params)
+      {
+        if (forwardLinks && type.ends_with("::ID"))
+        {
+          AppendFormat(outHeaderString, "    IDType<{}> {};\n", std::string_view(type).substr(0, type.size() - 4), member);
+        }
+        else
+        {
+          AppendFormat(outHeaderString, "    {} {};\n", type, member);
+        }
+      }
+      outHeaderString += "  };\n\n";
+    }
+  }
+
+  // The dictionaries and accessors of the dictionary encoded columns
+  for (const DictionaryField& dictionaryField : dictionaryFields)
+  {
+    WriteDictionaryAccessors(dictionaryField, outHeaderString);
+    outHeaderString += "\n";
+  }
+
+  // The words of the bit packed columns are private members
+  for (size_t i = 0; i < packedWordBits.size(); i++)
+  {
+    TableMember& member = members.emplace_back();
+    member.m_alignment = packedWordBits[i] <= 8 ? 1 : (packedWordBits[i] <= 16 ? 2 : 4);
+    const char* wordType = member.m_alignment == 1 ? "uint8_t" : (member.m_alignment == 2 ? "uint16_t" : "uint32_t");
+    AppendFormat(member.m_declaration, "  {} m_packed{} = 0;\n", wordType, i);
+    member.m_isPrivate = true;
+  }
+
+  // Write the accessors of the bit packed columns. In reorder mode they are written first, as the member order mixes public and private members.
+  if (options.m_reorderMembers)
+  {
+    for (const PackedField& packedField : packedFields)
+    {
+      WritePackedAccessors(packedField, outHeaderString);
+    }
+    if (packedFields.size() > 0)
+    {
+      outHeaderString += "\n";
+    }
+    WriteTableMembers(members, true, outHeaderString);
+  }
+  else
+  {
+    auto privateStart = members.end() - packedWordBits.size();
+    std::vector<TableMember> privateMembers(std::make_move_iterator(privateStart), std::make_move_iterator(members.end()));
+    members.erase(privateStart, members.end());
+
+    WriteTableMembers(members, false, outHeaderString);
+    if (packedFields.size() > 0)
+    {
+      outHeaderString += "\n";
+      for (const PackedField& packedField : packedFields)
+      {
+        WritePackedAccessors(packedField, outHeaderString);
+      }
+      WriteTableMembers(privateMembers, false, outHeaderString);
+    }
+  }
+  outHeaderString += "};\n";
+  return true;
+}
+
+// The generated code of a table. Tables are written in parallel, each into its own strings, that are joined in table order.
+struct TableCode
+{
+  std::string m_header;       // Row types of the table
+  std::string m_body;         // Search and delta read methods of the table
+  std::string m_searchHeader; // Declarations of the search methods in the DB class
+  std::string m_deltaHeader;  // Declaration of the delta read method in the DB class
+  std::string m_deltaApply;   // Remap of the links and apply of the table rows in DB::ApplyDelta()
+  std::string m_stats;        // Stats of the table in DB::GetStats()
+  bool m_hasCold = false;     // If the table has a cold row type
+};
+
+// Write the row types, the search methods and the delta and stats code of a table.
+// tableOrder is the position of each table in the table order, the order the tables of a delta are applied in.
+static bool WriteTableCode(const std::string& tableName, const CSVTable& table, const std::unordered_map<std::string, CSVTable>& tablesEnumRaw,
+                           const std::unordered_map<std::string, uint32_t>& tableOrder, const CodeGenOptions& options, TableCode& outCode)
+{
+  ProfileScope tableScope("CodeGenTable", tableName);
+  tableScope.SetRows(table.m_rowData.size());
+
+  std::string deltaCases;
+  std::string statsStrings;
+  if (!WriteTableClass(tableName, table, tablesEnumRaw, options, outCode.m_header, outCode.m_hasCold, deltaCases, statsStrings))
+  {
+    return false;
+  }
+  const bool hasCold = outCode.m_hasCold;
+
+  // Add Find() and range methods
+  if (!IsGlobalTable(tableName))
+  {
+    std::vector<KeyParam> params;
+    GetKeyParams(table, params);
+    WriteSearchFunctions(tableName, params, options.m_stats, outCode.m_searchHeader, outCode.m_body);
+  }
+
+  // Add the method that reads a delta value into a row, and the apply of the table rows in ApplyDelta()
+  if (options.m_deltaApply)
+  {
+    const std::string params = hasCold ? std::format("(DeltaReader& reader, uint32_t column, {0}& row, {0}Cold& cold)", tableName) :
+                                         std::format("(DeltaReader& reader, uint32_t column, {}& row)", tableName);
+    AppendFormat(outCode.m_deltaHeader, "  static bool ReadDeltaCell{};\n", params);
+    AppendFormat(outCode.m_body, "\nbool DB::DB::ReadDeltaCell{}\n{{\n  switch (column)\n  {{\n{}  }}\n  return false;\n}}\n", params, deltaCases);
+
+    // The rows of the tables applied before this table may have moved, so the links to them are remapped first
+    std::string& deltaApply = outCode.m_deltaApply;
+    std::string remapLinks;
+    std::vector<std::string_view> remapTables;
+    std::vector<std::string_view> remapLinkNames;
+    for (const CSVHeader& header : table.m_headerData)
+    {
+      const std::string_view linkName = std::string_view(header.m_name).substr(0, header.m_name.find_first_of(':'));
+      if (header.m_foreignTable.size() == 0 ||
+          IsEnumTable(header.m_foreignTable) ||
+          tableOrder.at(header.m_foreignTable) >= tableOrder.at(tableName) ||
+          std::find(remapLinkNames.begin(), remapLinkNames.end(), linkName) != remapLinkNames.end())
+      {
+        continue;
+      }
+      remapLinkNames.push_back(linkName);
+      if (std::find(remapTables.begin(), remapTables.end(), header.m_foreignTable) == remapTables.end())
+      {
+        remapTables.push_back(header.m_foreignTable);
+      }
+
+      if (IsGlobalTable(tableName))
+      {
+        AppendFormat(remapLinks, "    RemapID(remap, {}Values.{});\n", tableName, linkName);
+      }
+      else
+      {
+        AppendFormat(remapLinks, "      RemapID(remap, {}{}Values[i].{});\n", tableName, header.m_isCold ? "Cold" : "", linkName);
+      }
+    }
+    if (remapTables.size() > 0)
+    {
+      deltaApply += "  if (";
+      for (size_t i = 0; i < remapTables.size(); i++)
+      {
+        AppendFormat(deltaApply, "{}remap.m_tables.contains(&{}Values)", i > 0 ? " || " : "", remapTables[i]);
+      }
+      deltaApply += ")\n  {\n";
+      if (IsGlobalTable(tableName))
+      {
+        deltaApply += remapLinks;
+      }
+      else
+      {
+        AppendFormat(deltaApply, "    for (size_t i = 0; i < {}Values.size(); i++)\n    {{\n{}    }}\n", tableName, remapLinks);
+      }
+      deltaApply += "  }\n";
+    }
+
+    if (IsGlobalTable(tableName))
+    {
+      // The global row is applied as a table of one row
+      AppendFormat(deltaApply, "  if (tableName == \"{0}\")\n  {{\n    std::vector<{0}> values(1, {0}Values);\n", tableName);
+      deltaApply += "    if (!ApplyTableDelta(reader, nullptr, [&values](DeltaReader& cellReader, uint32_t column, size_t index) { return ReadDeltaCell(cellReader, column, values[index]); }, values) ||\n"
+                    "        values.size() != 1 || !readTableName())\n    {\n      return false;\n    }\n";
+      AppendFormat(deltaApply, "    {}Values = std::move(values[0]);\n  }}\n", tableName);
+    }
+    else if (hasCold)
+    {
+      AppendFormat(deltaApply, "  if (tableName == \"{0}\" &&\n      (!ApplyTableDelta(reader, &remap, [this](DeltaReader& cellReader, uint32_t column, size_t index) {{ return ReadDeltaCell(cellReader, column, "
+                               "{0}Values[index], {0}ColdValues[index]); }}, {0}Values, {0}ColdValues) || !readTableName()))\n  {{\n    return false;\n  }}\n", tableName);
+    }
+    else
+    {
+      AppendFormat(deltaApply, "  if (tableName == \"{0}\" &&\n      (!ApplyTableDelta(reader, &remap, [this](DeltaReader& cellReader, uint32_t column, size_t index) {{ return ReadDeltaCell(cellReader, column, "
+                               "{0}Values[index]); }}, {0}Values) || !readTableName()))\n  {{\n    return false;\n  }}\n", tableName);
+    }
+  }
+
+  // Add the stats of the table in GetStats(), the rows and the strings that are allocated outside of the rows
+  if (options.m_stats)
+  {
+    std::string& stats = outCode.m_stats;
+    AppendFormat(stats, "  {{\n    TableStats& stats = _ret.emplace_back();\n    stats.m_name = \"{}\";\n", tableName);
+    if (IsGlobalTable(tableName))
+    {
+      AppendFormat(stats, "    stats.m_rowCount = 1;\n    stats.m_rowSize = sizeof({});\n", tableName);
+      if (statsStrings.size() > 0)
+      {
+        AppendFormat(stats, "    {{\n      const {0}& row = {0}Values;\n{1}    }}\n", tableName, statsStrings);
+      }
+    }
+    else
+    {
+      AppendFormat(stats, "    stats.m_rowCount = {}Values.size();\n", tableName);
+      if (hasCold)
+      {
+        AppendFormat(stats, "    stats.m_rowSize = sizeof({0}) + sizeof({0}Cold);\n", tableName);
+        AppendFormat(stats, "    stats.m_heapBytes = {0}Values.capacity() * sizeof({0}) + {0}ColdValues.capacity() * sizeof({0}Cold);\n", tableName);
+      }
+      else
+      {
+        AppendFormat(stats, "    stats.m_rowSize = sizeof({});\n", tableName);
+        AppendFormat(stats, "    stats.m_heapBytes = {0}Values.capacity() * sizeof({0});\n", tableName);
+      }
+      if (statsStrings.size() > 0)
+      {
+        AppendFormat(stats, "    for (size_t i = 0; i < {}Values.size(); i++)\n    {{\n", tableName);
+        if (statsStrings.find("(row.") != std::string::npos)
+        {
+          AppendFormat(stats, "      const {0}& row = {0}Values[i];\n", tableName);
+        }
+        if (statsStrings.find("(cold.") != std::string::npos)
+        {
+          AppendFormat(stats, "      const {0}Cold& cold = {0}ColdValues[i];\n", tableName);
+        }
+        AppendFormat(stats, "{}    }}\n", statsStrings);
+      }
+      AppendFormat(stats, "#ifdef DB_ENABLE_ACCESS_STATS\n    s_tableAccess<{}>.Read(stats);\n#endif\n", tableName);
+    }
+    stats += "  }\n";
+  }
+  return true;
+}
+
+// Write the file only if the contents are different to what is already on disk, so build timestamps of unchanged files are kept
+static bool OverrideIfDifferent(std::string_view newContents, std::string& workingBuffer, const std::filesystem::path& writePath)
+{
+  std::error_code error;
+  if (std::filesystem::is_regular_file(writePath, error) &&
+      std::filesystem::file_size(writePath, error) == newContents.size() &&
+      ReadToString(writePath, workingBuffer) &&
+      workingBuffer == newContents)
+  {
+    return true;
+  }
+
+  return WriteFileAtomic(writePath, newContents);
+}
+
+// The state of a code gen shared by its tasks, freed with the tasks once the graph is done with them
+struct CodeGenState
+{
+  CodeGenState(const char* outputPathStr, const std::unordered_map<std::string, CSVTable>& tables, const std::unordered_map<std::string, CSVTable>& tablesEnumRaw, const CodeGenOptions& options)
+    : m_outputPath(outputPathStr), m_tables(tables), m_tablesEnumRaw(tablesEnumRaw), m_options(options) {}
+
+  std::filesystem::path m_outputPath;
+  const std::unordered_map<std::string, CSVTable>& m_tables;
+  const std::unordered_map<std::string, CSVTable>& m_tablesEnumRaw;
+  CodeGenOptions m_options;
+
+  std::vector<std::string> m_enumNames;
+  std::vector<std::string> m_enumHeaderStrings;
+  std::vector<std::string> m_enumBodyStrings;
+  std::vector<std::tuple<uint32_t, std::string>> m_tableOrdering;
+  std::unordered_map<std::string, uint32_t> m_tableOrder; // Position of each table in m_tableOrdering
+  std::vector<const CSVTable*> m_orderedTables;
+  std::vector<TableCode> m_tableCodes;
+};
+
+// Check the output directory and sort the tables based on the reference order
+static bool OrderCodeGenTables(CodeGenState& state)
+{
+  std::error_code error;
+  std::filesystem::file_status dirPathStatus = std::filesystem::status(state.m_outputPath, error);
+  if (!std::filesystem::is_directory(dirPathStatus))
+  {
+    OutputMessage("Error: {} is not a valid directory", state.m_outputPath.string());
+    return false;
+  }
+
+  std::unordered_map<std::string, uint32_t> tableDepths;
+  for (const auto& [tableName, table] : state.m_tables)
+  {
+    uint32_t depth = 0;
+    if (!CalculateTableDepth(tableName, state.m_tables, tableDepths, depth))
+    {
+      OutputMessage("Error: {} Recursive table link - Use \"*TableName\" instead of +TabeName on one link", tableName);
+      return false;
+    }
+  }
+
+  // Sort by count then by name
+  for (const auto& [tableName, order] : tableDepths)
+  {
+    state.m_tableOrdering.emplace_back(order, tableName);
+  }
+  std::sort(state.m_tableOrdering.begin(), state.m_tableOrdering.end());
+
+  for (const auto& [_, tableName] : state.m_tableOrdering)
+  {
+    state.m_tableOrder[tableName] = static_cast<uint32_t>(state.m_orderedTables.size());
+    auto findTable = state.m_tables.find(tableName);
+    if (findTable == state.m_tables.end())
+    {
+      OutputMessage("Error: Unknown table {}", tableName);
+      return false;
+    }
+    state.m_orderedTables.push_back(&findTable->second);
+  }
+  return true;
+}
+
+static bool WriteCodeGenFiles(const CodeGenState& state);
+
+TaskGraph::TaskID CodeGenCppAddTasks(TaskGraph& graph, std::span<const TaskGraph::TaskID> dependencies, const char* outputPathStr,
+                                     const std::unordered_map<std::string, CSVTable>& tables, const std::unordered_map<std::string, CSVTable>& tablesEnumRaw, const CodeGenOptions& options)
+{
+  std::shared_ptr<CodeGenState> state = std::make_shared<CodeGenState>(outputPathStr, tables, tablesEnumRaw, options);
+
+  // Get the enums to write, sorted by name so the output does not depend on the hash map order.
+  // Each enum is written into its own strings, in parallel with the tables.
+  for (const auto& [tableName, rawTable] : tablesEnumRaw)
+  {
+    if (rawTable.m_rowData.size() > 0 && rawTable.m_headerData.size() == 3)
+    {
+      state->m_enumNames.push_back(tableName);
+    }
+  }
+  std::sort(state->m_enumNames.begin(), state->m_enumNames.end());
+  state->m_enumHeaderStrings.resize(state->m_enumNames.size());
+  state->m_enumBodyStrings.resize(state->m_enumNames.size());
+
+  // Enum tables are written from the raw tables, not as tables
+  size_t tableCount = 0;
+  for (const auto& [tableName, table] : tables)
+  {
+    tableCount += IsEnumTable(tableName) ? 0 : 1;
+  }
+  state->m_tableCodes.resize(tableCount);
+
+  // The tables are ordered once the dependencies are done, then each enum, and each table type and the search methods
+  // of each table are written as tasks. The files are written once all the code is written.
+  TaskGraph::TaskID orderTask = graph.AddTask([state]() { return OrderCodeGenTables(*state); });
+  TaskGraph::TaskID writeTask = graph.AddTask([state]()
+  {
+    ProfileScope scope("CodeGenCpp");
+    return WriteCodeGenFiles(*state);
+  });
+  for (TaskGraph::TaskID dependency : dependencies)
+  {
+    graph.AddDependency(orderTask, dependency);
+  }
+
+  for (size_t i = 0; i < state->m_enumNames.size(); i++)
+  {
+    TaskGraph::TaskID enumTask = graph.AddTask([state, i]()
+    {
+      const CSVTable& rawTable = state->m_tablesEnumRaw.find(state->m_enumNames[i])->second;
+      ProfileScope enumScope("CodeGenEnum", state->m_enumNames[i]);
+      enumScope.SetRows(rawTable.m_rowData.size());
+      WriteEnum(state->m_enumNames[i], rawTable, state->m_enumHeaderStrings[i], state->m_enumBodyStrings[i]);
+      return true;
+    });
+    for (TaskGraph::TaskID dependency : dependencies)
+    {
+      graph.AddDependency(enumTask, dependency);
+    }
+    graph.AddDependency(writeTask, enumTask);
+  }
+  for (size_t i = 0; i < tableCount; i++)
+  {
+    TaskGraph::TaskID tableTask = graph.AddTask([state, i]()
+    {
+      return WriteTableCode(std::get<1>(state->m_tableOrdering[i]), *state->m_orderedTables[i], state->m_tablesEnumRaw, state->m_tableOrder, state->m_options, state->m_tableCodes[i]);
+    });
+    graph.AddDependency(tableTask, orderTask);
+    graph.AddDependency(writeTask, tableTask);
+  }
+  graph.AddDependency(writeTask, orderTask);
+  return writeTask;
+}
+
+bool CodeGenCpp(const char* outputPathStr, const std::unordered_map<std::string, CSVTable>& tables, const std::unordered_map<std::string, CSVTable>& tablesEnumRaw, const CodeGenOptions& options)
+{
+  TaskGraph graph;
+  CodeGenCppAddTasks(graph, {}, outputPathStr, tables, tablesEnumRaw, options);
+  return graph.Run();
+}
+
+// Join the code of the enums and tables and write the files
+static bool WriteCodeGenFiles(const CodeGenState& state)
+{
+  const std::filesystem::path& outputPath = state.m_outputPath;
+  const std::unordered_map<std::string, CSVTable>& tablesEnumRaw = state.m_tablesEnumRaw;
+  const CodeGenOptions& options = state.m_options;
+  const std::vector<std::string>& enumNames = state.m_enumNames;
+  const std::vector<std::string>& enumHeaderStrings = state.m_enumHeaderStrings;
+  const std::vector<std::string>& enumBodyStrings = state.m_enumBodyStrings;
+  const std::vector<std::tuple<uint32_t, std::string>>& tableOrdering = state.m_tableOrdering;
+  const std::vector<const CSVTable*>& orderedTables = state.m_orderedTables;
+  const std::vector<TableCode>& tableCodes = state.m_tableCodes;
+  std::error_code error;
+
+  // Join the code of the tables in table order
+  std::string dbSearchHeaderString;
+  std::string dbDeltaHeaderString;
+  std::string deltaApplyString;
+  std::string statsString;
+  std::vector<std::string_view> coldTableNames;
+  for (size_t i = 0; i < tableCodes.size(); i++)
+  {
+    const TableCode& tableCode = tableCodes[i];
+    dbSearchHeaderString += tableCode.m_searchHeader;
+    dbDeltaHeaderString += tableCode.m_deltaHeader;
+    deltaApplyString += tableCode.m_deltaApply;
+    statsString += tableCode.m_stats;
+    if (tableCode.m_hasCold)
+    {
+      coldTableNames.push_back(std::get<1>(tableOrdering[i]));
+    }
+  }
+
+  // Write the apply of a delta, the tables in the delta are in table order, so each table is applied after the tables it links to
+  if (options.m_deltaApply)
+  {
+    std::string tableApplyString = std::move(deltaApplyString);
+    deltaApplyString = R"body(
+bool DB::DB::ApplyDelta(std::span<const uint8_t> delta, DeltaRemap* outRemap)
+{
+  DeltaReader reader(delta);
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  uint32_t tableCount = 0;
+  if (!reader.Read(magic) || magic != c_deltaMagic ||
+      !reader.Read(version) || version != c_deltaVersion ||
+      !reader.Read(tableCount))
+  {
+    return false;
+  }
+
+  // Read the name of the next table in the delta, empty after the last table
+  DeltaRemap remap;
+  std::string_view tableName;
+  auto readTableName = [&reader, &tableCount, &tableName]()
+  {
+    tableName = {};
+    if (tableCount == 0)
+    {
+      return true;
+    }
+    tableCount--;
+    return reader.Read(tableName) && tableName.size() > 0;
+  };
+  if (!readTableName())
+  {
+    return false;
+  }
+
+)body";
+    deltaApplyString += tableApplyString;
+    deltaApplyString += R"body(
+  // Fail on tables that are not known or not in table order
+  if (tableName.size() > 0 || !reader.IsEnd())
+  {
+    return false;
+  }
+  if (outRemap)
+  {
+    for (auto& [table, ranges] : remap.m_tables)
+    {
+      outRemap->m_tables[table] = std::move(ranges);
+    }
+  }
+  return true;
+}
+)body";
+  }
+
+  // Write the stats of all tables
+  std::string dbBodyString = std::move(deltaApplyString);
+  if (options.m_stats)
+  {
+    dbBodyString += "\nstd::vector<DB::TableStats> DB::DB::GetStats() const\n{\n";
+    AppendFormat(dbBodyString, "  std::vector<TableStats> _ret;\n  _ret.reserve({});\n", tableOrdering.size());
+    dbBodyString += statsString;
+    dbBodyString += "  return _ret;\n}\n";
+  }
+
+  // Write the main database table
+  std::string dbHeaderString = "\nclass DB\n{\npublic:\n\n";
+
+  dbHeaderString += "  template<typename T> const std::vector<T>& GetTable() const;\n";
+  if (options.m_stats)
+  {
+    dbHeaderString += R"header(  template<typename T> IterType<T> Iter() const
+  {
+#ifdef DB_ENABLE_ACCESS_STATS
+    s_tableAccess<T>.m_iterCount.fetch_add(1, std::memory_order_relaxed);
+#endif
+    return IterType<T>(GetTable<T>());
+  }
+  template<typename T> const T& Get(IDType<T> id) const
+  {
+#ifdef DB_ENABLE_ACCESS_STATS
+    s_tableAccess<T>.m_getCount.fetch_add(1, std::memory_order_relaxed);
+#endif
+    return GetTable<T>()[id.m_dbIndex];
+  }
+)header";
+  }
+  else
+  {
+    dbHeaderString += "  template<typename T> IterType<T> Iter() const { return IterType<T>(GetTable<T>()); }\n";
+    dbHeaderString += "  template<typename T> const T& Get(IDType<T> id) const { return GetTable<T>()[id.m_dbIndex]; }\n";
+  }
+  dbHeaderString += "  template<typename T> bool ToID(uint32_t index, IDType<T>& id) const { if (index < GetTable<T>().size()) { id = IDType<T>(index); return true; } return false; }\n\n";
+
+  // Cold columns are stored in a parallel array with the same indices as the table
+  if (coldTableNames.size() > 0)
+  {
+    dbHeaderString += "  template<typename T> const std::vector<typename T::Cold>& GetColdTable() const;\n";
+    dbHeaderString += "  template<typename T> const typename T::Cold& GetCold(IDType<T> id) const { return GetColdTable<T>()[id.m_dbIndex]; }\n\n";
+  }
+
+  if (options.m_stats)
+  {
+    dbHeaderString += "  // Memory use of each table, and the access counts when built with DB_ENABLE_ACCESS_STATS\n";
+    dbHeaderString += "  std::vector<TableStats> GetStats() const;\n\n";
+  }
+
+  dbHeaderString += s_gatherMethod;
+  if (options.m_deltaApply)
+  {
+    dbHeaderString += s_deltaMethods;
+  }
+  dbHeaderString += dbSearchHeaderString;
+  dbHeaderString += "\n";
+
+  for (const auto& [_, tableName] : tableOrdering)
+  {
+    if (IsGlobalTable(tableName))
+    {
+      AppendFormat(dbHeaderString, "  {0} {0}Values;\n", tableName);
+    }
+    else
+    {
+      AppendFormat(dbHeaderString, "  std::vector<{0}> {0}Values;\n", tableName);
+    }
+  }
+  for (std::string_view tableName : coldTableNames)
+  {
+    AppendFormat(dbHeaderString, "  std::vector<{0}Cold> {0}ColdValues;\n", tableName);
+  }
+
+  if (options.m_deltaApply)
+  {
+    dbHeaderString += "\nprivate:\n";
+    dbHeaderString += "  template<typename T> static bool ReadID(DeltaReader& reader, IDType<T>& out) { uint32_t index = 0; if (!reader.Read(index)) { return false; } out = IDType<T>(index); return true; }\n";
+    dbHeaderString += dbDeltaHeaderString;
+  }
+
+  dbHeaderString += "};\n";
+
+  for (const auto& [_, tableName] : tableOrdering)
+  {
+    if (!IsGlobalTable(tableName))
+    {
+      AppendFormat(dbHeaderString, "template<> inline const std::vector<{0}>& DB::GetTable() const {{ return {0}Values; }}\n", tableName);
+    }
+  }
+  for (std::string_view tableName : coldTableNames)
+  {
+    AppendFormat(dbHeaderString, "template<> inline const std::vector<{0}Cold>& DB::GetColdTable<{0}>() const {{ return {0}ColdValues; }}\n", tableName);
+  }
+
+  // The includes of the compact layout, the delta apply and the stats are written after the common includes, and the delta reader and
+  // apply of the table rows and the stats types after the common types
+  std::string commonHeaderStart = s_commonHeaderStart;
+  if (options.m_compactLayout)
+  {
+    commonHeaderStart += s_compactIncludes;
+  }
+  if (options.m_deltaApply)
+  {
+    commonHeaderStart += s_deltaIncludes;
+  }
+  if (options.m_stats)
+  {
+    commonHeaderStart += s_statsIncludes;
+  }
+  commonHeaderStart += s_commonHeaderTypes;
+  if (options.m_deltaApply)
+  {
+    commonHeaderStart += s_deltaTypes;
+  }
+  if (options.m_stats)
+  {
+    commonHeaderStart += s_statsTypes;
+  }
+
+  // Get the file name and contents of each file to write
+  std::vector<std::tuple<std::string, std::string>> outFiles;
+  if (!options.m_splitFiles)
+  {
+    // Size the files first so that each is allocated once
+    size_t headerSize = commonHeaderStart.size() + dbHeaderString.size() + std::string_view(s_commonHeaderEnd).size();
+    size_t bodySize = std::string_view(s_commonBodyStart).size() + dbBodyString.size() + std::string_view(s_commonBodyEnd).size();
+    for (size_t i = 0; i < enumNames.size(); i++)
+    {
+      headerSize += enumHeaderStrings[i].size();
+      bodySize += enumBodyStrings[i].size();
+    }
+    for (const TableCode& tableCode : tableCodes)
+    {
+      headerSize += tableCode.m_header.size();
+      bodySize += tableCode.m_body.size();
+    }
+
+    std::string outHeaderString;
+    outHeaderString.reserve(headerSize);
+    outHeaderString += commonHeaderStart;
+    for (const std::string& enumHeaderString : enumHeaderStrings)
+    {
+      outHeaderString += enumHeaderString;
+    }
+    for (const TableCode& tableCode : tableCodes)
+    {
+      outHeaderString += tableCode.m_header;
+    }
+    outHeaderString += dbHeaderString;
+    outHeaderString += s_commonHeaderEnd;
+
+    std::string outBodyString;
+    outBodyString.reserve(bodySize);
+    outBodyString += s_commonBodyStart;
+    for (const std::string& enumBodyString : enumBodyStrings)
+    {
+      outBodyString += enumBodyString;
+    }
+    for (const TableCode& tableCode : tableCodes)
+    {
+      outBodyString += tableCode.m_body;
+    }
+    outBodyString += dbBodyString;
+    outBodyString += s_commonBodyEnd;
+
+    outFiles.emplace_back("DB.h", std::move(outHeaderString));
+    outFiles.emplace_back("DB.cpp", std::move(outBodyString));
+  }
+  else
+  {
+    // Core header with the common types and forward declarations of all the enums and tables
+    std::string coreHeaderString = commonHeaderStart;
+    for (size_t i = 0; i < enumNames.size(); i++)
+    {
+      AppendFormat(coreHeaderString, "enum class {} : {};\n", std::string_view(enumNames[i]).substr(4), CPPTypeString(tablesEnumRaw.find(enumNames[i])->second.m_headerData[1].m_type));
+    }
+    for (const auto& [_, tableName] : tableOrdering)
+    {
+      AppendFormat(coreHeaderString, "class {};\n", tableName);
+    }
+    coreHeaderString += s_commonHeaderEnd;
+    outFiles.emplace_back("DBCore.h", std::move(coreHeaderString));
+
+    // A header and a .cpp per enum
+    for (size_t i = 0; i < enumNames.size(); i++)
+    {
+      outFiles.emplace_back(std::format("DB{}.h", enumNames[i]), std::format("{}{}{}", s_splitHeaderStart, enumHeaderStrings[i], s_commonHeaderEnd));
+      outFiles.emplace_back(std::format("DB{}.cpp", enumNames[i]), std::format("{}#include \"DB{}.h\"\n\n#include <algorithm>\n\n{}", s_splitBodyStart, enumNames[i], enumBodyStrings[i]));
+    }
+
+    // A header and a .cpp per table, the header only includes the enums that the table uses
+    std::string dbFileHeaderString = R"header(// Generated Database file - do not edit manually
+#pragma once
+
+#include "DBCore.h"
+)header";
+    for (size_t i = 0; i < tableOrdering.size(); i++)
+    {
+      const std::string& tableName = std::get<1>(tableOrdering[i]);
+      const CSVTable& table = *orderedTables[i];
+      AppendFormat(dbFileHeaderString, "#include \"DB{}.h\"\n", tableName);
+
+      std::vector<std::string> includes;
+      for (const CSVHeader& header : table.m_headerData)
+      {
+        if (IsEnumTable(header.m_foreignTable) &&
+            std::find(includes.begin(), includes.end(), header.m_foreignTable) == includes.end())
+        {
+          includes.push_back(header.m_foreignTable);
+        }
+      }
+      std::sort(includes.begin(), includes.end());
+
+      std::string tableHeaderString = s_splitHeaderStart;
+      for (const std::string& include : includes)
+      {
+        tableHeaderString.insert(tableHeaderString.find("\nnamespace DB"), std::format("#include \"DB{}.h\"\n", include));
+      }
+      tableHeaderString += std::string_view(tableCodes[i].m_header).substr(1); // Skip the leading newline
+      tableHeaderString += s_commonHeaderEnd;
+      outFiles.emplace_back(std::format("DB{}.h", tableName), std::move(tableHeaderString));
+
+      if (tableCodes[i].m_body.size() > 0)
+      {
+        outFiles.emplace_back(std::format("DB{}.cpp", tableName), std::format("{}{}", s_commonBodyStart, std::string_view(tableCodes[i].m_body).substr(1)));
+      }
+    }
+
+    dbFileHeaderString += "\nnamespace DB\n{\n";
+    dbFileHeaderString += dbHeaderString;
+    dbFileHeaderString += s_commonHeaderEnd;
+    outFiles.emplace_back("DB.h", std::move(dbFileHeaderString));
+
+    if (dbBodyString.size() > 0)
+    {
+      outFiles.emplace_back("DB.cpp", std::format("{}{}", s_commonBodyStart, std::string_view(dbBodyString).substr(1)));
+    }
+  }
+
+  // Check for table names that clash with the generated file names
+  for (size_t i = 0; i < outFiles.size(); i++)
+  {
+    for (size_t j = i + 1; j < outFiles.size(); j++)
+    {
+      if (std::get<0>(outFiles[i]) == std::get<0>(outFiles[j]))
+      {
+        OutputMessage("Error: Generated file name {} is used twice - rename the table", std::get<0>(outFiles[i]));
+        return false;
+      }
+    }
+  }
+
+  // Only write files that have changed so that only the affected files are rebuilt
+  std::string workingBuffer;
+  for (const auto& [fileName, contents] : outFiles)
+  {
+    ProfileScope fileScope("CodeGenWriteFile", fileName);
+    fileScope.SetBytes(contents.size());
+    if (!OverrideIfDifferent(contents, workingBuffer, outputPath / fileName))
+    {
+      return false;
+    }
+  }
+
+  // Remove generated files from a previous run that are no longer used (eg. a table was removed)
+  if (options.m_splitFiles)
+  {
+    for (const auto& entry : std::filesystem::directory_iterator(outputPath, error))
+    {
+      std::string fileName = entry.path().filename().string();
+      if (!entry.is_regular_file() ||
+          !fileName.starts_with("DB") ||
+          !(fileName.ends_with(".h") || fileName.ends_with(".cpp")) ||
+          std::find_if(outFiles.begin(), outFiles.end(), [&fileName](const auto& outFile) { return std::get<0>(outFile) == fileName; }) != outFiles.end())
+      {
+        continue;
+      }
+
+      // Only remove files that were generated
+      if (ReadToString(entry.path(), workingBuffer) &&
+          workingBuffer.starts_with(s_generatedFileComment))
+      {
+        OutputMessage("Removing unused generated file {}", entry.path().string());
+        std::filesystem::remove(entry.path(), error);
+      }
+    }
+  }
 
-   // Handle Global tables
   return true;
 }
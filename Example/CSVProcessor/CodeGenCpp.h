@@ -1,4 +1,30 @@
 #pragma once
 #include "CSVProcessor.h"
+#include "TaskGraph.h"
 
-bool CodeGenCpp(const char* outputPathStr, const std::unordered_map<std::string, CSVTable>& tables, const std::unordered_map<std::string, CSVTable>& tablesEnumRaw);
+#include <span>
+
+struct CodeGenOptions
+{
+  bool m_splitFiles = false;    // Write a core header, a header + .cpp per enum and table and a DB.h that includes them, instead of a single DB.h / DB.cpp
+  bool m_compactLayout = false; // Bit pack bool, enum and small range integer columns into words with accessor methods.
+                                // Ranges come from the column min/max, or the current column values if not declared.
+  bool m_reorderMembers = false; // Order the members of the generated types by alignment to minimize padding, instead of column order
+  uint32_t m_dictionaryMaxValues = 0; // Store non-key string columns with at most this many distinct values (up to 65536) as a uint8/uint16 code
+                                      // into a sorted dictionary of the values, with an accessor returning std::string_view. 0 to disable.
+  bool m_deltaApply = false;    // Write DB::ApplyDelta to apply a delta written by "CSVProcessor diff" to a loaded DB.
+                                // Compact ranges and dictionaries come from the current values, so diff checks the new values fit (CheckCodeGenValues).
+  bool m_stats = false;         // Write DB::GetStats() with the row count, row size and heap bytes of each table. Building the generated code with
+                                // DB_ENABLE_ACCESS_STATS also counts the Find(), Get() and Iter() calls of each table and times the Find() calls.
+};
+
+bool CodeGenCpp(const char* outputPathStr, const std::unordered_map<std::string, CSVTable>& tables, const std::unordered_map<std::string, CSVTable>& tablesEnumRaw, const CodeGenOptions& options = CodeGenOptions());
+
+// Check that the values of a table can be stored in the types generated from another version of the table (codeTable).
+// The compact ranges without a declared min/max and the dictionaries come from the values at code gen, so other values may not fit.
+bool CheckCodeGenValues(const std::string& tableName, const CSVTable& codeTable, const CSVTable& table, const std::unordered_map<std::string, CSVTable>& tablesEnumRaw, const CodeGenOptions& options);
+
+// Add the code gen to a graph, so that it shares the worker threads of the other steps of the graph. The code gen starts once
+// the dependencies have finished, and the tables must not change until the graph has run. Returns the task writing the files.
+TaskGraph::TaskID CodeGenCppAddTasks(TaskGraph& graph, std::span<const TaskGraph::TaskID> dependencies, const char* outputPathStr,
+                                     const std::unordered_map<std::string, CSVTable>& tables, const std::unordered_map<std::string, CSVTable>& tablesEnumRaw, const CodeGenOptions& options);
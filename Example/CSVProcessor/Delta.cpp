@@ -0,0 +1,362 @@
+#include "Delta.h"
+#include "Profile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <tuple>
+#include <unordered_map>
+
+// Format values matching the generated DeltaReader
+static constexpr uint32_t c_deltaMagic = 0x44565343; // "CSVD"
+static constexpr uint32_t c_deltaVersion = 2;
+
+enum class DeltaOp : uint8_t
+{
+  Keep = 0,
+  Delete = 1,
+  Insert = 2,
+  Change = 3,
+};
+
+// Values are written in the byte order of the host (little endian on the supported targets)
+template<typename T>
+static void AppendValue(T value, std::string& outDelta)
+{
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  outDelta.append(bytes, sizeof(T));
+}
+
+static void AppendString(std::string_view value, std::string& outDelta)
+{
+  AppendValue(static_cast<uint32_t>(value.size()), outDelta);
+  outDelta += value;
+}
+
+static void AppendField(const FieldType& field, std::string& outDelta)
+{
+  std::visit([&outDelta]<typename T>(const T& value)
+  {
+    if constexpr (std::is_same_v<T, FieldString>) { AppendString(value, outDelta); }
+    else if constexpr (std::is_same_v<T, bool>) { AppendValue(static_cast<uint8_t>(value ? 1 : 0), outDelta); }
+    else { AppendValue(value, outDelta); }
+  }, field);
+}
+
+// Get the columns that are members of the generated row type. A link to a table is one member at the first column of the link.
+static bool GetDeltaColumns(const std::string& tableName, const CSVTable& table, std::vector<uint32_t>& outColumns)
+{
+  std::vector<std::string> links;
+  for (uint32_t h = 0; h < table.m_headerData.size(); h++)
+  {
+    const CSVHeader& header = table.m_headerData[h];
+    if (header.m_foreignTable.size() > 0 && !IsEnumTable(header.m_foreignTable))
+    {
+      std::string linkName = header.m_name.substr(0, header.m_name.find_first_of(':'));
+      if (std::find(links.begin(), links.end(), linkName) != links.end())
+      {
+        continue;
+      }
+      links.push_back(linkName);
+
+      // The links are written from the rows found on validation
+      if (h >= table.m_linkRows.size() || table.m_linkRows[h].size() != table.m_rowData.size())
+      {
+        OutputMessage("Error: Table {} link {} has not been validated", tableName, linkName);
+        return false;
+      }
+    }
+    outColumns.push_back(h);
+  }
+  return true;
+}
+
+static int CompareKeys(const CSVTable& table, const CSVRow& rowA, const CSVRow& rowB)
+{
+  for (uint32_t column : table.m_keyColumns)
+  {
+    if (rowA[column] < rowB[column])
+    {
+      return -1;
+    }
+    if (rowB[column] < rowA[column])
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Writes the row ops of a table, consecutive rows with the same op are a single run
+struct DeltaOpWriter
+{
+  std::string m_ops;          // The written ops
+  uint32_t m_opCount = 0;     // Number of runs
+  DeltaOp m_op = DeltaOp::Keep;
+  size_t m_countPos = 0;      // Position of the row count of the current run
+  uint32_t m_count = 0;       // Row count of the current run
+
+  // Add a row to the run of the op. The cells of an insert or change row are appended to m_ops after.
+  void AddRow(DeltaOp op)
+  {
+    if (m_opCount == 0 || op != m_op)
+    {
+      m_op = op;
+      m_opCount++;
+      m_count = 0;
+      AppendValue(static_cast<uint8_t>(op), m_ops);
+      m_countPos = m_ops.size();
+      AppendValue(m_count, m_ops);
+    }
+    m_count++;
+    std::memcpy(m_ops.data() + m_countPos, &m_count, sizeof(m_count));
+  }
+};
+
+// Write the ops of a table to the delta, if it has changed.
+// tableOrder is the position of each table in the delta, the order the tables are applied in.
+static bool WriteTableDelta(const std::string& tableName, const CSVTable& oldTable, const CSVTable& newTable, const std::unordered_map<std::string, uint32_t>& tableOrder, std::string& outDelta)
+{
+  std::vector<uint32_t> columns;
+  std::vector<uint32_t> oldColumns;
+  if (!GetDeltaColumns(tableName, newTable, columns) ||
+      !GetDeltaColumns(tableName, oldTable, oldColumns))
+  {
+    return false;
+  }
+
+  // The links to the tables applied before this table are remapped to the new rows of the linked table before this table is
+  // applied, so they only change if the key values of the link change. Links to the tables applied after (weak links) are
+  // not remapped, so they change if the linked row index changes.
+  std::vector<std::vector<uint32_t>> remappedLinkColumns(newTable.m_headerData.size());
+  for (uint32_t column : columns)
+  {
+    const std::string& foreignTable = newTable.m_headerData[column].m_foreignTable;
+    if (foreignTable.size() > 0 && !IsEnumTable(foreignTable) &&
+        tableOrder.at(foreignTable) < tableOrder.at(tableName) &&
+        !GetLinkColumns(tableName, newTable, column, remappedLinkColumns[column]))
+    {
+      return false;
+    }
+  }
+  if (newTable.m_headerData.size() > std::numeric_limits<uint16_t>::max())
+  {
+    OutputMessage("Error: Table {} has too many columns for a delta", tableName);
+    return false;
+  }
+
+  // Write the cell count and cells of a new row, all columns or only the columns changed from the old row
+  uint16_t cellCount = 0;
+  std::string cells;
+  auto writeCells = [&](const size_t* oldRow, size_t newRow)
+  {
+    cellCount = 0;
+    cells.assign(sizeof(cellCount), '\0');
+    for (uint32_t column : columns)
+    {
+      // Links to tables are written as the linked row index, enums as the value
+      const std::string& foreignTable = newTable.m_headerData[column].m_foreignTable;
+      if (foreignTable.size() > 0 && !IsEnumTable(foreignTable))
+      {
+        const std::vector<uint32_t>& newLinkRows = newTable.m_linkRows[column];
+        const std::vector<uint32_t>& linkColumns = remappedLinkColumns[column];
+        if (oldRow &&
+            (linkColumns.size() > 0 ?
+              std::all_of(linkColumns.begin(), linkColumns.end(), [&](uint32_t linkColumn) { return oldTable.m_rowData[*oldRow][linkColumn] == newTable.m_rowData[newRow][linkColumn]; }) :
+              oldTable.m_linkRows[column][*oldRow] == newLinkRows[newRow]))
+        {
+          continue;
+        }
+        AppendValue(static_cast<uint16_t>(column), cells);
+        AppendValue(newLinkRows[newRow], cells);
+      }
+      else
+      {
+        if (oldRow && oldTable.m_rowData[*oldRow][column] == newTable.m_rowData[newRow][column])
+        {
+          continue;
+        }
+        AppendValue(static_cast<uint16_t>(column), cells);
+        AppendField(newTable.m_rowData[newRow][column], cells);
+      }
+      cellCount++;
+    }
+    std::memcpy(cells.data(), &cellCount, sizeof(cellCount));
+  };
+
+  // Join the rows of the versions by key. Tables without keys (global tables) are joined by row order.
+  DeltaOpWriter writer;
+  size_t insertCount = 0;
+  size_t deleteCount = 0;
+  size_t changeCount = 0;
+  size_t oldIndex = 0;
+  size_t newIndex = 0;
+  while (oldIndex < oldTable.m_rowData.size() || newIndex < newTable.m_rowData.size())
+  {
+    int compare = 0;
+    if (oldIndex == oldTable.m_rowData.size())
+    {
+      compare = 1;
+    }
+    else if (newIndex == newTable.m_rowData.size())
+    {
+      compare = -1;
+    }
+    else
+    {
+      compare = CompareKeys(newTable, oldTable.m_rowData[oldIndex], newTable.m_rowData[newIndex]);
+    }
+
+    if (compare < 0)
+    {
+      writer.AddRow(DeltaOp::Delete);
+      deleteCount++;
+      oldIndex++;
+    }
+    else if (compare > 0)
+    {
+      writeCells(nullptr, newIndex);
+      writer.AddRow(DeltaOp::Insert);
+      writer.m_ops += cells;
+      insertCount++;
+      newIndex++;
+    }
+    else
+    {
+      writeCells(&oldIndex, newIndex);
+      if (cellCount == 0)
+      {
+        writer.AddRow(DeltaOp::Keep);
+      }
+      else
+      {
+        writer.AddRow(DeltaOp::Change);
+        writer.m_ops += cells;
+        changeCount++;
+      }
+      oldIndex++;
+      newIndex++;
+    }
+  }
+
+  if (insertCount + deleteCount + changeCount == 0)
+  {
+    return true;
+  }
+
+  OutputMessage("{}: {} inserted, {} deleted, {} changed rows", tableName, insertCount, deleteCount, changeCount);
+  AppendString(tableName, outDelta);
+  AppendValue(static_cast<uint32_t>(oldTable.m_rowData.size()), outDelta);
+  AppendValue(static_cast<uint32_t>(newTable.m_rowData.size()), outDelta);
+  AppendValue(writer.m_opCount, outDelta);
+  outDelta += writer.m_ops;
+  return true;
+}
+
+// Check that the versions have the same tables, columns and enums, so the delta can be read by the generated code
+static bool IsSameSchema(const DBTables& oldDB, const DBTables& newDB)
+{
+  if (oldDB.m_tables.size() != newDB.m_tables.size() ||
+      oldDB.m_tablesEnumRaw.size() != newDB.m_tablesEnumRaw.size())
+  {
+    OutputMessage("Error: The tables of the versions are different");
+    return false;
+  }
+  for (const auto& [tableName, oldTable] : oldDB.m_tables)
+  {
+    auto findTable = newDB.m_tables.find(tableName);
+    if (findTable == newDB.m_tables.end())
+    {
+      OutputMessage("Error: Table {} is not in the new version", tableName);
+      return false;
+    }
+    const CSVTable& newTable = findTable->second;
+    bool isSame = oldTable.m_headerData.size() == newTable.m_headerData.size();
+    for (size_t h = 0; isSame && h < oldTable.m_headerData.size(); h++)
+    {
+      isSame = oldTable.m_headerData[h].m_rawField == newTable.m_headerData[h].m_rawField;
+    }
+    if (!isSame)
+    {
+      OutputMessage("Error: Table {} has different columns in the new version", tableName);
+      return false;
+    }
+  }
+  for (const auto& [tableName, oldTable] : oldDB.m_tablesEnumRaw)
+  {
+    auto findTable = newDB.m_tablesEnumRaw.find(tableName);
+    if (findTable == newDB.m_tablesEnumRaw.end() ||
+        oldTable.m_rowData != findTable->second.m_rowData)
+    {
+      OutputMessage("Error: Enum {} is different in the new version", tableName);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool WriteDelta(const DBTables& oldDB, const DBTables& newDB, const CodeGenOptions& options, std::string& outDelta)
+{
+  if (!IsSameSchema(oldDB, newDB))
+  {
+    OutputMessage("Error: A delta needs the same schema, regenerate the code and distribute the full DB");
+    return false;
+  }
+
+  // The generated code of the old version can only store new values in the compact ranges and dictionaries of the old values
+  for (const auto& [tableName, newTable] : newDB.m_tables)
+  {
+    if (!CheckCodeGenValues(tableName, oldDB.m_tables.at(tableName), newTable, newDB.m_tablesEnumRaw, options))
+    {
+      OutputMessage("Error: The new values do not fit the code generated from the old version, regenerate the code and distribute the full DB");
+      return false;
+    }
+  }
+
+  // Tables in the order of the generated code, by reference order then by name, so the linked tables are applied before the
+  // tables that link to them. Enum tables are the same in both versions.
+  std::unordered_map<std::string, uint32_t> tableDepths;
+  for (const auto& [tableName, table] : newDB.m_tables)
+  {
+    uint32_t depth = 0;
+    if (!CalculateTableDepth(tableName, newDB.m_tables, tableDepths, depth))
+    {
+      return false;
+    }
+  }
+  std::vector<std::tuple<uint32_t, std::string>> tableOrdering;
+  for (const auto& [tableName, depth] : tableDepths)
+  {
+    tableOrdering.emplace_back(depth, tableName);
+  }
+  std::sort(tableOrdering.begin(), tableOrdering.end());
+  std::unordered_map<std::string, uint32_t> tableOrder;
+  for (uint32_t i = 0; i < tableOrdering.size(); i++)
+  {
+    tableOrder[std::get<1>(tableOrdering[i])] = i;
+  }
+
+  std::string tablesDelta;
+  uint32_t tableCount = 0;
+  for (const auto& [_, tableName] : tableOrdering)
+  {
+    const CSVTable& newTable = newDB.m_tables.at(tableName);
+    ProfileScope scope("WriteTableDelta", tableName);
+    scope.SetRows(newTable.m_rowData.size());
+
+    const size_t deltaSize = tablesDelta.size();
+    if (!WriteTableDelta(tableName, oldDB.m_tables.at(tableName), newTable, tableOrder, tablesDelta))
+    {
+      return false;
+    }
+    tableCount += tablesDelta.size() != deltaSize ? 1 : 0;
+  }
+
+  outDelta.clear();
+  AppendValue(c_deltaMagic, outDelta);
+  AppendValue(c_deltaVersion, outDelta);
+  AppendValue(tableCount, outDelta);
+  outDelta += tablesDelta;
+  return true;
+}
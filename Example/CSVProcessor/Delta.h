@@ -0,0 +1,16 @@
+#pragma once
+#include "CSVProcessor.h"
+#include "CodeGenCpp.h"
+
+// Binary delta between two versions of a DB, applied to the loaded DB by the generated DB::ApplyDelta.
+// The tables are sorted by key, then joined in a single pass over both versions. Each changed table is written as:
+//  name, old row count, new row count, op count, then runs of ops in key order - keep (count), delete (count),
+//  insert (rows with every column value) and change (rows with the values of the changed columns only).
+// The tables are written in the order of the generated code, so the linked tables are applied before the tables that link
+// to them. Links are written as the ID (row index) of the linked row in the new version. ApplyDelta remaps the links to the
+// rows of the tables applied before, so those are only changed cells if the key values of the link change.
+// The tables, columns and enums of both versions need to be the same, as the generated code reads the values by column.
+// Both versions need to be validated (ValidateTables), as the links are written from the link rows found on validation.
+// options are the code gen options of the code generated from the old version, the compact and dictionary columns of that code
+// can only hold the values of the old version (or the declared range), so the delta fails if a new value does not fit.
+bool WriteDelta(const DBTables& oldDB, const DBTables& newDB, const CodeGenOptions& options, std::string& outDelta);
@@ -0,0 +1,501 @@
+#include "FileIO.h"
+#include "CSVProcessor.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define CSVPROCESSOR_IO_URING
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef CSVPROCESSOR_IO_URING
+
+// A minimal io_uring using the system calls directly, so there is no dependency on liburing.
+// Requests are queued, then submitted together and all waited on.
+class IOUring
+{
+public:
+  IOUring() = default;
+  IOUring(const IOUring&) = delete;
+  IOUring& operator=(const IOUring&) = delete;
+  ~IOUring();
+
+  bool Init(uint32_t entries);
+
+  // Queue a request. At most the number of entries can be queued before each Submit.
+  io_uring_sqe& Queue(uint8_t opcode, uint64_t userData);
+
+  // Submit the queued requests and wait for all of them, calling onComplete(userData, result) for each
+  template <typename Func>
+  bool Submit(Func&& onComplete);
+
+private:
+  int m_fd = -1;
+  void* m_sqRing = nullptr;
+  void* m_cqRing = nullptr;
+  size_t m_sqRingSize = 0;
+  size_t m_cqRingSize = 0;
+  io_uring_sqe* m_sqes = nullptr;
+  size_t m_sqesSize = 0;
+
+  unsigned* m_sqTail = nullptr;
+  unsigned* m_sqArray = nullptr;
+  unsigned m_sqMask = 0;
+  unsigned* m_cqHead = nullptr;
+  unsigned* m_cqTail = nullptr;
+  io_uring_cqe* m_cqes = nullptr;
+  unsigned m_cqMask = 0;
+
+  unsigned m_tail = 0;         // Tail of the queued requests, given to the kernel on Submit
+  uint32_t m_queuedCount = 0;
+};
+
+IOUring::~IOUring()
+{
+  if (m_sqes)
+  {
+    munmap(m_sqes, m_sqesSize);
+  }
+  if (m_cqRing && m_cqRing != m_sqRing)
+  {
+    munmap(m_cqRing, m_cqRingSize);
+  }
+  if (m_sqRing)
+  {
+    munmap(m_sqRing, m_sqRingSize);
+  }
+  if (m_fd >= 0)
+  {
+    close(m_fd);
+  }
+}
+
+bool IOUring::Init(uint32_t entries)
+{
+  io_uring_params params = {};
+  m_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+  if (m_fd < 0)
+  {
+    return false;
+  }
+
+  // Newer kernels map both rings together
+  m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (singleMap)
+  {
+    m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+  }
+
+  void* sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+  if (sqRing == MAP_FAILED)
+  {
+    return false;
+  }
+  m_sqRing = sqRing;
+
+  if (singleMap)
+  {
+    m_cqRing = m_sqRing;
+  }
+  else
+  {
+    void* cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED)
+    {
+      return false;
+    }
+    m_cqRing = cqRing;
+  }
+
+  m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED)
+  {
+    return false;
+  }
+  m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+  char* sq = static_cast<char*>(m_sqRing);
+  m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  m_tail = *m_sqTail;
+
+  char* cq = static_cast<char*>(m_cqRing);
+  m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  return true;
+}
+
+io_uring_sqe& IOUring::Queue(uint8_t opcode, uint64_t userData)
+{
+  unsigned index = m_tail & m_sqMask;
+  io_uring_sqe& sqe = m_sqes[index];
+  std::memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = opcode;
+  sqe.user_data = userData;
+  m_sqArray[index] = index;
+  m_tail++;
+  m_queuedCount++;
+  return sqe;
+}
+
+template <typename Func>
+bool IOUring::Submit(Func&& onComplete)
+{
+  std::atomic_ref<unsigned>(*m_sqTail).store(m_tail, std::memory_order_release);
+  uint32_t submitCount = m_queuedCount;
+  uint32_t waitCount = m_queuedCount;
+  m_queuedCount = 0;
+
+  while (waitCount > 0)
+  {
+    int submitted = static_cast<int>(syscall(__NR_io_uring_enter, m_fd, submitCount, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+    if (submitted < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+      {
+        continue;
+      }
+      return false;
+    }
+    submitCount -= static_cast<uint32_t>(submitted);
+
+    unsigned head = *m_cqHead;
+    unsigned tail = std::atomic_ref<unsigned>(*m_cqTail).load(std::memory_order_acquire);
+    for (; head != tail; head++)
+    {
+      const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+      onComplete(cqe.user_data, cqe.res);
+      waitCount--;
+    }
+    std::atomic_ref<unsigned>(*m_cqHead).store(head, std::memory_order_release);
+  }
+  return true;
+}
+
+// Set when io_uring can not be set up (old kernel, or blocked by a container), so it is not tried for every batch
+static std::atomic<bool> s_ioUringUnavailable = false;
+
+static bool InitRing(IOUring& ring)
+{
+  if (s_ioUringUnavailable)
+  {
+    return false;
+  }
+  if (!ring.Init(c_fileBatchSize * 2))
+  {
+    s_ioUringUnavailable = true;
+    return false;
+  }
+  return true;
+}
+
+// The buffers a request gives to the kernel are held here, so they stay alive until the ring is torn down
+struct FileRequest
+{
+  int m_fd = -1;
+  bool m_failed = false;
+  size_t m_size = 0;        // Bytes to read or write
+  size_t m_done = 0;        // Bytes read or written
+  struct statx m_stat = {}; // Size of a file to read
+  std::string m_tempPath;   // Temporary file written before it is renamed over the file
+};
+
+// Close the open files directly, when the ring can not be used to close them
+static void CloseOpenFiles(std::vector<FileRequest>& requests)
+{
+  for (FileRequest& request : requests)
+  {
+    if (request.m_fd >= 0)
+    {
+      close(request.m_fd);
+      request.m_fd = -1;
+    }
+  }
+}
+
+// Read or write the buffers of the open files, submitting again for the rest of any short transfers
+template <typename GetBuffer>
+static bool TransferFiles(IOUring& ring, std::vector<FileRequest>& requests, uint8_t opcode, GetBuffer&& getBuffer)
+{
+  while (true)
+  {
+    bool pending = false;
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+      FileRequest& request = requests[i];
+      if (request.m_fd >= 0 && !request.m_failed && request.m_done < request.m_size)
+      {
+        io_uring_sqe& sqe = ring.Queue(opcode, i);
+        sqe.fd = request.m_fd;
+        sqe.addr = reinterpret_cast<uint64_t>(getBuffer(i) + request.m_done);
+        sqe.len = static_cast<uint32_t>(std::min<size_t>(request.m_size - request.m_done, 1u << 30));
+        sqe.off = request.m_done;
+        pending = true;
+      }
+    }
+    if (!pending)
+    {
+      break;
+    }
+
+    bool submitted = ring.Submit([&requests](uint64_t i, int result)
+    {
+      // No bytes transferred before the end is an error (the file was truncated while reading)
+      if (result <= 0)
+      {
+        requests[i].m_failed = true;
+      }
+      else
+      {
+        requests[i].m_done += result;
+      }
+    });
+    if (!submitted)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Close the open files together. A file that fails to close is marked failed (its writes may not be stored).
+static bool CloseFiles(IOUring& ring, std::vector<FileRequest>& requests)
+{
+  bool queued = false;
+  for (size_t i = 0; i < requests.size(); i++)
+  {
+    if (requests[i].m_fd >= 0)
+    {
+      io_uring_sqe& sqe = ring.Queue(IORING_OP_CLOSE, i);
+      sqe.fd = requests[i].m_fd;
+      queued = true;
+    }
+  }
+  if (!queued)
+  {
+    return true;
+  }
+
+  bool submitted = ring.Submit([&requests](uint64_t i, int result)
+  {
+    if (result < 0)
+    {
+      requests[i].m_failed = true;
+    }
+    requests[i].m_fd = -1;
+  });
+  if (!submitted)
+  {
+    CloseOpenFiles(requests);
+  }
+  return submitted;
+}
+
+// Read a batch of files: open and get the size of every file, then read every file, then close them.
+// The files that fail are marked in outRequests, to be read again on their own to report the error.
+static bool ReadBatchIOUring(IOUring& ring, std::span<const std::filesystem::path> paths, std::span<std::string> outContents, std::vector<FileRequest>& outRequests)
+{
+  outRequests.assign(paths.size(), FileRequest());
+  for (size_t i = 0; i < paths.size(); i++)
+  {
+    io_uring_sqe& openSqe = ring.Queue(IORING_OP_OPENAT, i * 2);
+    openSqe.fd = AT_FDCWD;
+    openSqe.addr = reinterpret_cast<uint64_t>(paths[i].c_str());
+    openSqe.open_flags = O_RDONLY | O_CLOEXEC;
+
+    io_uring_sqe& statSqe = ring.Queue(IORING_OP_STATX, i * 2 + 1);
+    statSqe.fd = AT_FDCWD;
+    statSqe.addr = reinterpret_cast<uint64_t>(paths[i].c_str());
+    statSqe.len = STATX_SIZE;
+    statSqe.off = reinterpret_cast<uint64_t>(&outRequests[i].m_stat);
+  }
+  bool opened = ring.Submit([&outRequests](uint64_t userData, int result)
+  {
+    FileRequest& request = outRequests[userData / 2];
+    if (result < 0)
+    {
+      request.m_failed = true;
+    }
+    else if (userData % 2 == 0)
+    {
+      request.m_fd = result;
+    }
+  });
+  if (!opened)
+  {
+    CloseOpenFiles(outRequests);
+    return false;
+  }
+
+  for (size_t i = 0; i < paths.size(); i++)
+  {
+    if (!outRequests[i].m_failed)
+    {
+      outRequests[i].m_size = outRequests[i].m_stat.stx_size;
+      outContents[i].resize(outRequests[i].m_stat.stx_size);
+    }
+  }
+  bool transferred = TransferFiles(ring, outRequests, IORING_OP_READ, [&outContents](size_t i) { return outContents[i].data(); });
+  return CloseFiles(ring, outRequests) && transferred;
+}
+
+// Write a batch of files: open every temporary file, then write, close and rename them over the files.
+// The files that fail are marked in outRequests, to be written again on their own to report the error.
+static bool WriteBatchIOUring(IOUring& ring, std::span<const std::filesystem::path> paths, std::span<const std::string_view> contents, std::vector<FileRequest>& outRequests)
+{
+  outRequests.assign(paths.size(), FileRequest());
+  for (size_t i = 0; i < paths.size(); i++)
+  {
+    outRequests[i].m_tempPath = paths[i].string() + ".tmp";
+    outRequests[i].m_size = contents[i].size();
+
+    io_uring_sqe& sqe = ring.Queue(IORING_OP_OPENAT, i);
+    sqe.fd = AT_FDCWD;
+    sqe.addr = reinterpret_cast<uint64_t>(outRequests[i].m_tempPath.c_str());
+    sqe.open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    sqe.len = 0666;
+  }
+  bool opened = ring.Submit([&outRequests](uint64_t i, int result)
+  {
+    if (result < 0)
+    {
+      outRequests[i].m_failed = true;
+    }
+    else
+    {
+      outRequests[i].m_fd = result;
+    }
+  });
+  if (!opened)
+  {
+    CloseOpenFiles(outRequests);
+    return false;
+  }
+
+  bool transferred = TransferFiles(ring, outRequests, IORING_OP_WRITE, [&contents](size_t i) { return contents[i].data(); });
+  if (!CloseFiles(ring, outRequests) || !transferred)
+  {
+    return false;
+  }
+
+  // Only replace the files that were completely written
+  bool queued = false;
+  for (size_t i = 0; i < paths.size(); i++)
+  {
+    if (!outRequests[i].m_failed)
+    {
+      io_uring_sqe& sqe = ring.Queue(IORING_OP_RENAMEAT, i);
+      sqe.fd = AT_FDCWD;
+      sqe.addr = reinterpret_cast<uint64_t>(outRequests[i].m_tempPath.c_str());
+      sqe.len = static_cast<uint32_t>(AT_FDCWD);
+      sqe.addr2 = reinterpret_cast<uint64_t>(paths[i].c_str());
+      queued = true;
+    }
+  }
+  return !queued || ring.Submit([&outRequests](uint64_t i, int result)
+  {
+    if (result < 0)
+    {
+      outRequests[i].m_failed = true;
+    }
+  });
+}
+
+#endif
+
+bool ReadFiles(std::span<const std::filesystem::path> paths, std::span<std::string> outContents)
+{
+  bool result = true;
+  for (size_t batchStart = 0; batchStart < paths.size(); batchStart += c_fileBatchSize)
+  {
+    std::span<const std::filesystem::path> batchPaths = paths.subspan(batchStart, std::min(c_fileBatchSize, paths.size() - batchStart));
+    std::span<std::string> batchContents = outContents.subspan(batchStart, batchPaths.size());
+
+#ifdef CSVPROCESSOR_IO_URING
+    // Only the files that failed in the batch are read again (with the error reported).
+    // The ring is torn down before the requests and before any fallback, as reads may still be in flight after a failure.
+    std::vector<FileRequest> requests;
+    bool batchRead = false;
+    {
+      IOUring ring;
+      batchRead = InitRing(ring) && ReadBatchIOUring(ring, batchPaths, batchContents, requests);
+    }
+    if (batchRead)
+    {
+      for (size_t i = 0; i < batchPaths.size(); i++)
+      {
+        if (requests[i].m_failed && !ReadToString(batchPaths[i], batchContents[i]))
+        {
+          result = false;
+        }
+      }
+      continue;
+    }
+#endif
+
+    for (size_t i = 0; i < batchPaths.size(); i++)
+    {
+      if (!ReadToString(batchPaths[i], batchContents[i]))
+      {
+        result = false;
+      }
+    }
+  }
+  return result;
+}
+
+bool WriteFilesAtomic(std::span<const std::filesystem::path> paths, std::span<const std::string_view> contents)
+{
+  bool result = true;
+  for (size_t batchStart = 0; batchStart < paths.size(); batchStart += c_fileBatchSize)
+  {
+    std::span<const std::filesystem::path> batchPaths = paths.subspan(batchStart, std::min(c_fileBatchSize, paths.size() - batchStart));
+    std::span<const std::string_view> batchContents = contents.subspan(batchStart, batchPaths.size());
+
+#ifdef CSVPROCESSOR_IO_URING
+    // Only the files that failed in the batch are written again (with the error reported).
+    // The ring is torn down before the requests and before any fallback, as writes may still be in flight after a failure.
+    std::vector<FileRequest> requests;
+    bool batchWritten = false;
+    {
+      IOUring ring;
+      batchWritten = InitRing(ring) && WriteBatchIOUring(ring, batchPaths, batchContents, requests);
+    }
+    if (batchWritten)
+    {
+      for (size_t i = 0; i < batchPaths.size(); i++)
+      {
+        if (requests[i].m_failed && !WriteFileAtomic(batchPaths[i], batchContents[i]))
+        {
+          result = false;
+        }
+      }
+      continue;
+    }
+#endif
+
+    for (size_t i = 0; i < batchPaths.size(); i++)
+    {
+      if (!WriteFileAtomic(batchPaths[i], batchContents[i]))
+      {
+        result = false;
+      }
+    }
+  }
+  return result;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+
+// Batched file reads and writes, for DBs with many small tables.
+// On Linux the opens, reads, writes and closes of a batch are each submitted together with io_uring, so a batch of
+// files costs a few system calls and the requests are in flight at the same time (slow and network disks).
+// Without io_uring (other platforms, or not allowed at runtime) the files are read / written one after another,
+// so batches are run in parallel on the task graph instead. A file that fails in a batch is retried on its own.
+
+// Number of files to submit in a batch
+constexpr size_t c_fileBatchSize = 64;
+
+// Read the files into outContents (the same size as paths). Returns false if any file can not be read.
+bool ReadFiles(std::span<const std::filesystem::path> paths, std::span<std::string> outContents);
+
+// Write the files like WriteFileAtomic, to a temporary file next to each file that is renamed over it.
+// Returns false if any file can not be written.
+bool WriteFilesAtomic(std::span<const std::filesystem::path> paths, std::span<const std::string_view> contents);
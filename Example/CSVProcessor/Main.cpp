@@ -1,93 +1,547 @@
 #include "CSVProcessor.h"
 #include "CodeGenCpp.h"
+#include "Merge.h"
+#include "Delta.h"
+#include "Query.h"
+#include "Server.h"
+#include "Profile.h"
+#include "TaskGraph.h"
+#include "FileIO.h"
 
-#include <fstream>
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
 
-int main(int argc, char* argv[])
+enum ResaveResult : uint8_t
 {
-  // Check if directory path is provided
-  if (argc < 2)
+  ResaveUnchanged,
+  ResaveChanged,
+};
+
+// Add a task per batch of files that reads them into contents, and a parse task for each file after its batch.
+// The later batches are read while the files of the earlier batches are parsed.
+static void AddReadTasks(TaskGraph& graph, std::span<const std::filesystem::path> paths, std::span<std::string> contents,
+                         std::function<bool(size_t)> parse, std::vector<TaskGraph::TaskID>& outParseTasks)
+{
+  for (size_t batchStart = 0; batchStart < paths.size(); batchStart += c_fileBatchSize)
   {
-    OutputMessage("Usage: CSVProcessor <directory_path> <optional_output_path>");
-    return 1;
+    std::span<const std::filesystem::path> batchPaths = paths.subspan(batchStart, std::min(c_fileBatchSize, paths.size() - batchStart));
+    std::span<std::string> batchContents = contents.subspan(batchStart, batchPaths.size());
+    TaskGraph::TaskID readTask = graph.AddTask([batchPaths, batchContents]()
+    {
+      ProfileScope scope("ReadFiles");
+      if (!ReadFiles(batchPaths, batchContents))
+      {
+        return false;
+      }
+      size_t bytes = 0;
+      for (const std::string& content : batchContents)
+      {
+        bytes += content.size();
+      }
+      scope.SetBytes(bytes);
+      return true;
+    });
+
+    for (size_t fileIndex = batchStart; fileIndex < batchStart + batchPaths.size(); fileIndex++)
+    {
+      TaskGraph::TaskID parseTask = graph.AddTask([parse, fileIndex]() { return parse(fileIndex); });
+      graph.AddDependency(parseTask, readTask);
+      outParseTasks.push_back(parseTask);
+    }
+  }
+}
+
+// Read the table files in batches and parse them in parallel, then build the schema from the headers of all the tables.
+// The shards of a sharded table are merged as soon as they are all parsed.
+static bool ReadDBFiles(const char* dirPath, DBTables& db)
+{
+  ProfileScope scope("ReadDB");
+  if (!FindDBFiles(dirPath, db))
+  {
+    return false;
   }
 
-  // Get directory path from command line
-  const char* dirPath = argv[1];
+  TaskGraph graph;
+  std::vector<TaskGraph::TaskID> enumParseTasks;
+  std::vector<TaskGraph::TaskID> parseTasks;
+  AddReadTasks(graph, db.m_csvEnumFilePaths, db.m_csvEnumFileData, [&db](size_t fileIndex) { return ParseEnumTable(fileIndex, db); }, enumParseTasks);
+  AddReadTasks(graph, db.m_csvFilePaths, db.m_csvFileData, [&db](size_t fileIndex) { return ParseDBTable(fileIndex, db); }, parseTasks);
 
-  const char* outputPathStr = nullptr;
-  if (argc >= 3)
+  std::unordered_map<std::string, TaskGraph::TaskID> mergeTasks;
+  for (const auto& [tableName, shards] : db.m_tableShards)
+  {
+    mergeTasks[tableName] = graph.AddTask([&db, &tableName]() { return MergeTableShards(tableName, db); });
+  }
+  for (size_t fileIndex = 0; fileIndex < db.m_csvFilePaths.size(); fileIndex++)
+  {
+    auto findMerge = mergeTasks.find(GetTableName(db.m_csvFilePaths[fileIndex]));
+    if (findMerge != mergeTasks.end())
+    {
+      graph.AddDependency(findMerge->second, parseTasks[fileIndex]);
+    }
+  }
+  if (!graph.Run())
   {
-    outputPathStr = argv[2];
+    return false;
   }
 
+  ProfileScope schemaScope("BuildSchema");
+  return BuildSchema(db.m_tables);
+}
+
+// Add the tasks to resolve the link types, sort and validate each table (enum tables are sorted when read).
+// A table is validated as soon as it and the tables it links to are sorted.
+static void AddTableTasks(DBTables& db, TaskGraph& graph, std::unordered_map<std::string, TaskGraph::TaskID>& outValidateTasks)
+{
+  // The first file of each table (a sharded table has several files)
+  std::vector<std::string> tableNames;
+  for (size_t fileIndex = 0; fileIndex < db.m_csvFilePaths.size(); fileIndex++)
+  {
+    if (db.m_csvFileShards[fileIndex] == 0)
+    {
+      tableNames.push_back(GetTableName(db.m_csvFilePaths[fileIndex]));
+    }
+  }
+
+  std::unordered_map<std::string, TaskGraph::TaskID> sortTasks;
+  for (const std::string& tableName : tableNames)
+  {
+    CSVTable& table = db.m_tables.at(tableName);
+
+    // Resolve column types based on foreign table links (especially enums)
+    TaskGraph::TaskID resolveTask = graph.AddTask([&db, &table, tableName]()
+    {
+      ProfileScope scope("ResolveForeignLinkTypes", tableName);
+      return ResolveTableLinkTypes(tableName, table, db);
+    });
+
+    // Sort the table data by column and check for duplicates
+    TaskGraph::TaskID sortTask = graph.AddTask([&table, tableName]()
+    {
+      ProfileScope scope("SortTable", tableName);
+      scope.SetRows(table.m_rowData.size());
+      if (!SortTable(table))
+      {
+        OutputMessage("Error: Table {} failed to sort", tableName);
+        return false;
+      }
+      return true;
+    });
+    graph.AddDependency(sortTask, resolveTask);
+    sortTasks[tableName] = sortTask;
+  }
+
+  for (const std::string& tableName : tableNames)
+  {
+    CSVTable& table = db.m_tables.at(tableName);
+    TaskGraph::TaskID validateTask = graph.AddTask([&db, &table, tableName]()
+    {
+      ProfileScope scope("ValidateTable", tableName);
+      return ValidateTable(tableName, table, db.m_tables);
+    });
+
+    graph.AddDependency(validateTask, sortTasks.at(tableName));
+    std::vector<std::string_view> linkedTables;
+    for (const CSVHeader& header : table.m_headerData)
+    {
+      auto findSort = sortTasks.find(header.m_foreignTable);
+      if (findSort != sortTasks.end() && header.m_foreignTable != tableName &&
+          std::find(linkedTables.begin(), linkedTables.end(), header.m_foreignTable) == linkedTables.end())
+      {
+        linkedTables.push_back(header.m_foreignTable);
+        graph.AddDependency(validateTask, findSort->second);
+      }
+    }
+    outValidateTasks[tableName] = validateTask;
+  }
+}
+
+// Load the tables, resolve the link types, sort the tables by key and validate the links
+static bool LoadDB(const char* dirPath, DBTables& db)
+{
+  if (!ReadDBFiles(dirPath, db))
+  {
+    return false;
+  }
+
+  TaskGraph graph;
+  std::unordered_map<std::string, TaskGraph::TaskID> validateTasks;
+  AddTableTasks(db, graph, validateTasks);
+  return graph.Run();
+}
+
+static int QueryDB(const char* dirPath, const char* queryString)
+{
   DBTables db;
-  if (!ReadDB(dirPath, db))
+  if (!LoadDB(dirPath, db))
   {
     return 1;
   }
 
-  // Resolve column types based on foreign table links (especially enums)
-  if (!ResolveForeignLinkTypes(db))
+  CSVTable result;
+  {
+    ProfileScope scope("Query");
+    if (!RunQuery(queryString, db, result))
+    {
+      return 1;
+    }
+    scope.SetRows(result.m_rowData.size());
+  }
+
+  // Output the result as CSV
+  std::string outFile;
+  SaveToString(result, db.m_tables, "\n", outFile);
+  std::fwrite(outFile.data(), 1, outFile.size(), stdout);
+  return 0;
+}
+
+static int DiffDB(const char* oldDirPath, const char* newDirPath, const char* deltaPath, const CodeGenOptions& options)
+{
+  DBTables oldDB;
+  DBTables newDB;
+  if (!LoadDB(oldDirPath, oldDB) || !LoadDB(newDirPath, newDB))
   {
     return 1;
   }
 
-  // Sort the table data by column and check for duplicates
-  for (auto& [tableName, table] : db.m_tables)
+  std::string delta;
   {
-    if (!SortTable(table))
+    ProfileScope scope("WriteDelta");
+    if (!WriteDelta(oldDB, newDB, options, delta))
     {
-      OutputMessage("Error: Table {} failed to sort", tableName);
       return 1;
     }
+    scope.SetBytes(delta.size());
+  }
+  OutputMessage("Delta size {} bytes", delta.size());
+  return WriteFileAtomic(deltaPath, delta) ? 0 : 1;
+}
+
+// Resave a table file (a shard of a sharded table), comparing against the file bytes kept from the load.
+// Only reads the table data (and the enum tables), so it runs in parallel with the other tables.
+// The changed file is returned in outFile, to be written with a batch of files.
+static ResaveResult ResaveTable(const DBTables& db, size_t fileIndex, bool checkOnly, std::string& outFile)
+{
+  const std::filesystem::path& path = db.m_csvFilePaths[fileIndex];
+  std::string tableName = GetTableName(path);
+  const CSVTable& table = db.m_tables.at(tableName);
+  std::string_view existingFile = db.m_csvFileData[fileIndex];
+  uint16_t shard = db.m_csvFileShards[fileIndex];
+
+  // Most runs change nothing, so first stream compare the saved form against the file and skip building it if it matches
+  {
+    ProfileScope scope("CompareSaved", tableName);
+    scope.SetBytes(existingFile.size());
+    if (IsSavedFormat(table, db.m_tables, existingFile, shard))
+    {
+      return ResaveUnchanged;
+    }
+  }
+
+  {
+    ProfileScope scope("SaveToString", tableName);
+    SaveToString(table, db.m_tables, existingFile, outFile, shard);
+    scope.SetBytes(outFile.size());
+    scope.SetRows(table.m_rowData.size());
+  }
+
+  // Check if the file data has changed and re-save it if it has
+  if (existingFile == outFile)
+  {
+    outFile = std::string();
+    return ResaveUnchanged;
+  }
+  if (checkOnly)
+  {
+    OutputMessage("Would change: {}", path.string());
+    outFile = std::string();
+  }
+  return ResaveChanged;
+}
+
+// Write the changed files of a batch together
+static bool WriteChangedFiles(const DBTables& db, size_t batchStart, size_t batchEnd, const std::vector<uint8_t>& fileResults, std::vector<std::string>& outFiles)
+{
+  std::vector<std::filesystem::path> paths;
+  std::vector<std::string_view> contents;
+  size_t bytes = 0;
+  for (size_t fileIndex = batchStart; fileIndex < batchEnd; fileIndex++)
+  {
+    if (fileResults[fileIndex] == ResaveChanged)
+    {
+      paths.push_back(db.m_csvFilePaths[fileIndex]);
+      contents.push_back(outFiles[fileIndex]);
+      bytes += outFiles[fileIndex].size();
+    }
+  }
+  if (paths.size() == 0)
+  {
+    return true;
   }
 
-  // Validate tables
-  if (!ValidateTables(db.m_tables))
+  ProfileScope scope("WriteCSV");
+  scope.SetBytes(bytes);
+  bool result = WriteFilesAtomic(paths, contents);
+  for (size_t fileIndex = batchStart; fileIndex < batchEnd; fileIndex++)
+  {
+    outFiles[fileIndex] = std::string();
+  }
+  return result;
+}
+
+static int ProcessDB(const char* dirPath, const char* outputPathStr, const CodeGenOptions& codeGenOptions, bool checkOnly)
+{
+  DBTables db;
+  if (!ReadDBFiles(dirPath, db))
+  {
+    return 1;
+  }
+
+  // Each table is resaved as soon as it is validated, while the other tables are still sorting or validating.
+  // The changed files are written in batches, each once the files of the batch are resaved.
+  TaskGraph graph;
+  std::unordered_map<std::string, TaskGraph::TaskID> validateTasks;
+  AddTableTasks(db, graph, validateTasks);
+
+  std::vector<uint8_t> fileResults(db.m_csvFilePaths.size(), ResaveUnchanged);
+  std::vector<std::string> outFiles(db.m_csvFilePaths.size());
+  for (size_t batchStart = 0; batchStart < db.m_csvFilePaths.size(); batchStart += c_fileBatchSize)
+  {
+    size_t batchEnd = std::min(batchStart + c_fileBatchSize, db.m_csvFilePaths.size());
+    std::vector<TaskGraph::TaskID> resaveTasks;
+    for (size_t fileIndex = batchStart; fileIndex < batchEnd; fileIndex++)
+    {
+      TaskGraph::TaskID resaveTask = graph.AddTask([&db, &fileResults, &outFiles, fileIndex, checkOnly]()
+      {
+        fileResults[fileIndex] = ResaveTable(db, fileIndex, checkOnly, outFiles[fileIndex]);
+        return true;
+      });
+      graph.AddDependency(resaveTask, validateTasks.at(GetTableName(db.m_csvFilePaths[fileIndex])));
+      resaveTasks.push_back(resaveTask);
+    }
+
+    // In check mode nothing is written
+    if (!checkOnly)
+    {
+      TaskGraph::TaskID writeTask = graph.AddTask([&db, &fileResults, &outFiles, batchStart, batchEnd]()
+      {
+        return WriteChangedFiles(db, batchStart, batchEnd, fileResults, outFiles);
+      });
+      for (TaskGraph::TaskID resaveTask : resaveTasks)
+      {
+        graph.AddDependency(writeTask, resaveTask);
+      }
+    }
+  }
+
+  // Save out code gen files once all tables are validated. The code gen tasks run on the same workers as the resaves
+  // and the writes of the resaved tables. In check mode nothing is written.
+  if (outputPathStr && !checkOnly)
+  {
+    std::vector<TaskGraph::TaskID> codeGenDependencies;
+    for (const auto& [tableName, validateTask] : validateTasks)
+    {
+      codeGenDependencies.push_back(validateTask);
+    }
+    CodeGenCppAddTasks(graph, codeGenDependencies, outputPathStr, db.m_tables, db.m_tablesEnumRaw, codeGenOptions);
+  }
+
+  if (!graph.Run())
   {
     return 1;
   }
 
-  // DT_TODO: Add command line for resave of all tables
-  std::string csvFileData;
-  for (const auto& path : db.m_csvFilePaths)
+  // In check mode, report if any table is not in the saved format
+  bool hasChanges = std::find(fileResults.begin(), fileResults.end(), ResaveChanged) != fileResults.end();
+  return (checkOnly && hasChanges) ? 1 : 0;
+}
+
+// Parse the code gen option at argv[i], moving i past the option value. Returns false if the argument is not a code gen option.
+static bool ParseCodeGenOption(int argc, char* argv[], int& i, CodeGenOptions& options, bool& outError)
+{
+  std::string_view arg = argv[i];
+  if (arg == "--split")
+  {
+    options.m_splitFiles = true;
+  }
+  else if (arg == "--compact")
+  {
+    options.m_compactLayout = true;
+  }
+  else if (arg == "--reorder")
+  {
+    options.m_reorderMembers = true;
+  }
+  else if (arg == "--delta")
+  {
+    options.m_deltaApply = true;
+  }
+  else if (arg == "--stats")
+  {
+    options.m_stats = true;
+  }
+  else if (arg == "--dictionary" && i + 1 < argc)
+  {
+    std::string_view value = argv[++i];
+    auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), options.m_dictionaryMaxValues);
+    if (ec != std::errc() || ptr != value.data() + value.size())
+    {
+      OutputMessage("Error: Invalid dictionary max values {}", value);
+      outError = true;
+    }
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  // Three-way merge of a table, as a git merge driver
+  if (argc >= 2 && std::string_view(argv[1]) == "merge")
   {
-    std::string tableName = path.stem().string();
-    if (!ReadToString(path, csvFileData))
+    if (argc != 5)
     {
+      OutputMessage("Usage: CSVProcessor merge <base_file> <ours_file> <theirs_file>");
+      OutputMessage("  Merges the changes by table key, writing the result to the ours file");
       return 1;
     }
+    return MergeFiles(argv[2], argv[3], argv[4]);
+  }
 
-    std::string_view existingFile(csvFileData.data(), csvFileData.size() - 1);
+  // Query the tables, outputting the result as CSV
+  if (argc >= 2 && std::string_view(argv[1]) == "query")
+  {
+    if (argc != 4)
+    {
+      OutputMessage("Usage: CSVProcessor query <directory_path> \"<query>\"");
+      OutputMessage("  eg. CSVProcessor query DB \"from Weapons join Type where Damage > 10 select Name, Damage, Type.Name sort Damage desc limit 10\"");
+      return 1;
+    }
+    return QueryDB(argv[2], argv[3]);
+  }
 
-    std::string outFile;
-    SaveToString(db.m_tables[tableName], db.m_tables, existingFile, outFile);
+  // Keep the DB loaded, answering lookups over a local socket
+  if (argc >= 2 && std::string_view(argv[1]) == "serve")
+  {
+    if (argc != 4)
+    {
+      OutputMessage("Usage: CSVProcessor serve <directory_path> <socket_path>");
+      OutputMessage("  Answers lookup, range, links, query and validate requests of a line each, picking up changed files");
+      return 1;
+    }
+    return ServeDB(argv[2], argv[3], LoadDB);
+  }
 
-    // Check if the file data has changed and re-save it if it has
-    if (existingFile != outFile)
+  // Binary delta of the changed rows between two versions of the DB
+  if (argc >= 2 && std::string_view(argv[1]) == "diff")
+  {
+    // The code gen options of the code generated from the old version, to check the new values fit the compact and dictionary columns
+    CodeGenOptions codeGenOptions;
+    bool isError = argc < 5;
+    for (int i = 5; !isError && i < argc; i++)
     {
-      std::ofstream file(path, std::ios::binary);
-      if (!file.is_open())
+      if (!ParseCodeGenOption(argc, argv, i, codeGenOptions, isError))
       {
-        OutputMessage("Error: Unable to open file for writing {}", path.string());
-        return 1;
+        OutputMessage("Error: Unexpected argument {}", argv[i]);
+        isError = true;
       }
+    }
+    if (isError)
+    {
+      OutputMessage("Usage: CSVProcessor diff <old_directory_path> <new_directory_path> <delta_file> [code gen options]");
+      OutputMessage("  Writes the changed rows between the versions, to apply with the DB::ApplyDelta generated with --delta");
+      OutputMessage("  Pass the options the code was generated with, so the new values are checked to fit the --compact and --dictionary columns");
+      return 1;
+    }
+    return DiffDB(argv[2], argv[3], argv[4], codeGenOptions);
+  }
 
-      if (!file.write(outFile.data(), outFile.size()))
+  // Get the directory path, optional output path and options from the command line
+  const char* dirPath = nullptr;
+  const char* outputPathStr = nullptr;
+  const char* profilePath = nullptr;
+  bool checkOnly = false;
+  CodeGenOptions codeGenOptions;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string_view arg = argv[i];
+    bool isError = false;
+    if (ParseCodeGenOption(argc, argv, i, codeGenOptions, isError))
+    {
+      if (isError)
       {
-        OutputMessage("Error: Unable to write file contents {}", path.string());
         return 1;
       }
-      file.close();
+    }
+    else if (arg == "--check")
+    {
+      checkOnly = true;
+    }
+    else if (arg == "--profile" && i + 1 < argc)
+    {
+      profilePath = argv[++i];
+    }
+    else if (arg.starts_with("--"))
+    {
+      OutputMessage("Error: Unknown option {}", arg);
+      return 1;
+    }
+    else if (!dirPath)
+    {
+      dirPath = argv[i];
+    }
+    else if (!outputPathStr)
+    {
+      outputPathStr = argv[i];
+    }
+    else
+    {
+      OutputMessage("Error: Unexpected argument {}", arg);
+      return 1;
     }
   }
 
-  // Save out code gen files
-  if (outputPathStr && !CodeGenCpp(outputPathStr, db.m_tables, db.m_tablesEnumRaw))
+  // Check if directory path is provided
+  if (!dirPath)
   {
+    OutputMessage("Usage: CSVProcessor <directory_path> <optional_output_path> [--split] [--compact] [--reorder] [--dictionary <max_values>] [--delta] [--stats] [--check] [--profile <trace.json>]");
+    OutputMessage("       CSVProcessor merge <base_file> <ours_file> <theirs_file>");
+    OutputMessage("       CSVProcessor diff <old_directory_path> <new_directory_path> <delta_file> [code gen options]");
+    OutputMessage("       CSVProcessor query <directory_path> \"<query>\"");
+    OutputMessage("       CSVProcessor serve <directory_path> <socket_path>");
+    OutputMessage("  --split    Generate a header and .cpp per table instead of a single DB.h / DB.cpp");
+    OutputMessage("  --compact  Bit pack bool, enum and small range integer columns in the generated types");
+    OutputMessage("  --reorder  Order the members of the generated types by alignment to minimize padding");
+    OutputMessage("  --dictionary  Store string columns with at most max_values distinct values (up to 65536) as uint8 / uint16 codes into a dictionary");
+    OutputMessage("  --delta    Generate DB::ApplyDelta to apply a delta written by CSVProcessor diff");
+    OutputMessage("  --stats    Generate DB::GetStats() with the memory use of each table, and access counts when built with DB_ENABLE_ACCESS_STATS");
+    OutputMessage("  --check    Report the tables that would be changed by a resave without writing any files (exit code 1 if any)");
+    OutputMessage("  --profile  Write a Chrome / Perfetto trace of the processing phases and output a summary of the slowest tables");
     return 1;
   }
 
-  return 0;
+  if (profilePath)
+  {
+    ProfileEnable();
+  }
+
+  int result = 0;
+  {
+    ProfileScope totalScope("Total");
+    result = ProcessDB(dirPath, outputPathStr, codeGenOptions, checkOnly);
+  }
+
+  if (profilePath)
+  {
+    ProfileWriteSummary();
+    if (!ProfileWriteTrace(profilePath))
+    {
+      return 1;
+    }
+  }
+  return result;
 }
@@ -0,0 +1,675 @@
+#include "Merge.h"
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+static constexpr size_t c_noRow = std::numeric_limits<size_t>::max(); // The version does not have a row with the key
+
+// A version of the table being merged, with the columns mapped to the merged header
+struct MergeSource
+{
+  const char* m_name = nullptr;       // Version name for messages
+  const CSVTable* m_header = nullptr; // Table with the header of the version
+  std::vector<int32_t> m_columnMap;   // Column in the version of each merged column (-1 if the version does not have the column)
+  std::vector<uint32_t> m_keyMap;     // Column in the version of each merged key column
+  size_t m_rowIndex = 0;              // Current row in the merge
+  mutable bool m_hasBadField = false; // If a field of the version failed to parse, that stops the merge
+
+  bool HasCell(size_t row, size_t column) const
+  {
+    return row != c_noRow && m_columnMap[column] >= 0;
+  }
+};
+
+// A version merged from the rows of a table
+struct TableMergeSource : MergeSource
+{
+  CSVTable* m_table = nullptr;
+
+  size_t GetRowCount() const { return m_table->m_rowData.size(); }
+
+  const FieldType* GetCell(size_t row, size_t column) const
+  {
+    return HasCell(row, column) ? &m_table->m_rowData[row][m_columnMap[column]] : nullptr;
+  }
+
+  int CompareKeys(size_t row, const TableMergeSource& other, size_t otherRow) const
+  {
+    for (size_t k = 0; k < m_keyMap.size(); k++)
+    {
+      const FieldType& field = m_table->m_rowData[row][m_keyMap[k]];
+      const FieldType& otherField = other.m_table->m_rowData[otherRow][other.m_keyMap[k]];
+      if (field < otherField)
+      {
+        return -1;
+      }
+      if (otherField < field)
+      {
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  static bool IsSameCell(const TableMergeSource& a, size_t rowA, const TableMergeSource& b, size_t rowB, size_t column)
+  {
+    const FieldType* cellA = a.GetCell(rowA, column);
+    const FieldType* cellB = b.GetCell(rowB, column);
+    if (!cellA || !cellB)
+    {
+      return cellA == cellB;
+    }
+    return *cellA == *cellB;
+  }
+
+  std::string GetCellString(size_t row, size_t column) const
+  {
+    const FieldType* cell = GetCell(row, column);
+    return cell ? to_string(*cell) : std::string();
+  }
+
+  std::string GetKeyString(size_t row) const
+  {
+    std::string ret;
+    for (uint32_t column : m_keyMap)
+    {
+      if (ret.size() > 0)
+      {
+        ret += ",";
+      }
+      AppendToString(m_table->m_rowData[row][column], ret);
+    }
+    return ret;
+  }
+};
+
+// A version merged from the text fields of the file. Only the keys, the fields that differ between versions and the merged fields are parsed,
+// so the rows are not all converted to table cells.
+struct TextMergeSource : MergeSource
+{
+  std::string m_fileData;                                           // The loaded file
+  std::unique_ptr<std::pmr::monotonic_buffer_resource> m_parseArena; // Arena of the text fields
+  std::pmr::vector<std::pmr::vector<std::string_view>> m_csvData;  // Text fields of the header and rows
+  CSVTable m_headerTable;                                           // Header of the version, without rows
+  std::vector<FieldType> m_minValues;                               // Range of each column of the version
+  std::vector<FieldType> m_maxValues;
+  std::vector<FieldType> m_keys;                                    // Key values of each row
+  bool m_isSorted = false;                                          // If the rows are in key order, without duplicate keys
+
+  size_t GetRowCount() const { return m_csvData.size() - 1; }
+
+  const FieldType& GetKey(size_t row, size_t key) const { return m_keys[row * m_headerTable.m_keyColumns.size() + key]; }
+
+  bool Read(const char* path)
+  {
+    if (!ReadToString(path, m_fileData))
+    {
+      return false;
+    }
+    m_parseArena = std::make_unique<std::pmr::monotonic_buffer_resource>(std::max<size_t>(m_fileData.size() * 4, 4096));
+    m_csvData = ReadCSV(m_fileData.c_str(), m_parseArena.get());
+    if (!ReadTableHeader(m_csvData, m_headerTable))
+    {
+      return false;
+    }
+
+    const std::vector<CSVHeader>& headers = m_headerTable.m_headerData;
+    m_minValues.resize(headers.size());
+    m_maxValues.resize(headers.size());
+    for (size_t h = 0; h < headers.size(); h++)
+    {
+      if (!ReadColumnRange(headers[h], m_minValues[h], m_maxValues[h]))
+      {
+        return false;
+      }
+    }
+
+    // Parse the keys, and check the rows are in key order so they can be merge joined without sorting
+    const std::vector<uint32_t>& keyColumns = m_headerTable.m_keyColumns;
+    m_keys.resize(GetRowCount() * keyColumns.size());
+    m_isSorted = true;
+    for (size_t r = 0; r < GetRowCount(); r++)
+    {
+      for (size_t k = 0; k < keyColumns.size(); k++)
+      {
+        uint32_t column = keyColumns[k];
+        if (!ParseColumnField(headers[column], m_minValues[column], m_maxValues[column], m_csvData[r + 1][column], m_keys[r * keyColumns.size() + k]))
+        {
+          return false;
+        }
+      }
+      if (r > 0 && m_isSorted)
+      {
+        m_isSorted = CompareKeys(r - 1, *this, r) < 0;
+      }
+    }
+    return true;
+  }
+
+  const std::string_view* GetField(size_t row, size_t column) const
+  {
+    return HasCell(row, column) ? &m_csvData[row + 1][m_columnMap[column]] : nullptr;
+  }
+
+  const FieldType& GetType(size_t column) const
+  {
+    return m_headerTable.m_headerData[m_columnMap[column]].m_type;
+  }
+
+  int CompareKeys(size_t row, const TextMergeSource& other, size_t otherRow) const
+  {
+    for (size_t k = 0; k < m_headerTable.m_keyColumns.size(); k++)
+    {
+      const FieldType& field = GetKey(row, k);
+      const FieldType& otherField = other.GetKey(otherRow, k);
+      if (field < otherField)
+      {
+        return -1;
+      }
+      if (otherField < field)
+      {
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  static bool IsSameCell(const TextMergeSource& a, size_t rowA, const TextMergeSource& b, size_t rowB, size_t column)
+  {
+    const std::string_view* fieldA = a.GetField(rowA, column);
+    const std::string_view* fieldB = b.GetField(rowB, column);
+    if (!fieldA || !fieldB)
+    {
+      return fieldA == fieldB;
+    }
+    if (a.m_hasBadField || b.m_hasBadField)
+    {
+      return false;
+    }
+
+    // The same text is the same value if the column types match, other fields are compared by value (eg. 1.50 and 1.5)
+    const FieldType& typeA = a.GetType(column);
+    const FieldType& typeB = b.GetType(column);
+    if (*fieldA == *fieldB &&
+        typeA.index() == typeB.index())
+    {
+      return true;
+    }
+    FieldType cellA;
+    FieldType cellB;
+    if (!a.ParseCell(rowA, column, cellA) ||
+        !b.ParseCell(rowB, column, cellB))
+    {
+      return false;
+    }
+    return cellA == cellB;
+  }
+
+  bool ParseCell(size_t row, size_t column, FieldType& retField) const
+  {
+    uint32_t sourceColumn = m_columnMap[column];
+    if (!ParseColumnField(m_headerTable.m_headerData[sourceColumn], m_minValues[sourceColumn], m_maxValues[sourceColumn], m_csvData[row + 1][sourceColumn], retField))
+    {
+      m_hasBadField = true;
+      return false;
+    }
+    return true;
+  }
+
+  std::string GetCellString(size_t row, size_t column) const
+  {
+    const std::string_view* field = GetField(row, column);
+    if (!field)
+    {
+      return std::string();
+    }
+    FieldType cell;
+    return ParseCell(row, column, cell) ? to_string(cell) : std::string(*field);
+  }
+
+  std::string GetKeyString(size_t row) const
+  {
+    std::string ret;
+    for (size_t k = 0; k < m_headerTable.m_keyColumns.size(); k++)
+    {
+      if (ret.size() > 0)
+      {
+        ret += ",";
+      }
+      AppendToString(GetKey(row, k), ret);
+    }
+    return ret;
+  }
+
+  // Append the field in the saved form, checking it is valid for the column
+  bool AppendField(size_t row, size_t column, std::string& appendStr) const
+  {
+    if (std::holds_alternative<FieldString>(GetType(column)))
+    {
+      AppendSavedString(*GetField(row, column), appendStr);
+      return true;
+    }
+
+    FieldType cell;
+    if (!ParseCell(row, column, cell))
+    {
+      return false;
+    }
+    AppendToString(cell, appendStr);
+    return true;
+  }
+};
+
+static bool IsSameHeader(const CSVTable& a, const CSVTable& b)
+{
+  if (a.m_headerData.size() != b.m_headerData.size())
+  {
+    return false;
+  }
+  for (size_t i = 0; i < a.m_headerData.size(); i++)
+  {
+    if (a.m_headerData[i].m_rawField != b.m_headerData[i].m_rawField)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool MapColumns(const CSVTable& mergeTable, const CSVTable& table, const char* name, MergeSource& out)
+{
+  out.m_name = name;
+  out.m_header = &table;
+
+  // Columns are matched by name, so added, removed and moved columns merge
+  out.m_columnMap.resize(mergeTable.m_headerData.size(), -1);
+  for (size_t c = 0; c < mergeTable.m_headerData.size(); c++)
+  {
+    for (size_t i = 0; i < table.m_headerData.size(); i++)
+    {
+      if (table.m_headerData[i].m_name == mergeTable.m_headerData[c].m_name)
+      {
+        out.m_columnMap[c] = (int32_t)i;
+        break;
+      }
+    }
+  }
+
+  // The keys need to be the same in all versions to join the rows
+  if (table.m_keyColumns.size() != mergeTable.m_keyColumns.size())
+  {
+    OutputMessage("Error: Key columns of the {} table do not match the merged table", name);
+    return false;
+  }
+  for (size_t k = 0; k < mergeTable.m_keyColumns.size(); k++)
+  {
+    uint32_t mergeColumn = mergeTable.m_keyColumns[k];
+    int32_t column = out.m_columnMap[mergeColumn];
+    if (column != (int32_t)table.m_keyColumns[k] ||
+        table.m_headerData[column].m_type.index() != mergeTable.m_headerData[mergeColumn].m_type.index())
+    {
+      OutputMessage("Error: Key columns of the {} table do not match the merged table", name);
+      return false;
+    }
+    out.m_keyMap.push_back(column);
+  }
+  return true;
+}
+
+// Set the merged header from the versions, and map the columns of each version to it
+static bool MergeHeaders(const CSVTable& base, const CSVTable& ours, const CSVTable& theirs, CSVTable& outTable, MergeSource& baseSource, MergeSource& oursSource, MergeSource& theirsSource)
+{
+  // Take the header from the side that changed it
+  const CSVTable* headerTable = &ours;
+  if (!IsSameHeader(ours, theirs))
+  {
+    if (IsSameHeader(ours, base))
+    {
+      headerTable = &theirs;
+    }
+    else if (!IsSameHeader(theirs, base))
+    {
+      OutputMessage("Error: Table header was changed in both ours and theirs");
+      return false;
+    }
+  }
+  outTable.m_headerData = headerTable->m_headerData;
+  outTable.m_keyColumns = headerTable->m_keyColumns;
+  if (outTable.m_keyColumns.size() == 0)
+  {
+    OutputMessage("Error: Table has no key columns to merge the rows by");
+    return false;
+  }
+
+  // Links to other tables are not resolved in a merge, linked columns are kept as the written text
+  for (CSVHeader& header : outTable.m_headerData)
+  {
+    header.m_foreignTable.clear();
+  }
+
+  return MapColumns(outTable, base, "base", baseSource) &&
+         MapColumns(outTable, ours, "ours", oursSource) &&
+         MapColumns(outTable, theirs, "theirs", theirsSource);
+}
+
+template<typename Source>
+static bool IsSameRow(const Source& a, size_t rowA, const Source& b, size_t rowB)
+{
+  for (size_t c = 0; c < a.m_columnMap.size(); c++)
+  {
+    if (!Source::IsSameCell(a, rowA, b, rowB, c))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Merge join the rows of the versions (base, ours, theirs) in key order. Each merged row is passed to addRow with the row of each version
+// (c_noRow if the version does not have it) and the version each cell is taken from (-1 for the default value of a column the version does not have).
+template<typename Source, typename AddRow>
+static bool MergeRows(Source* const (&sources)[3], const std::vector<CSVHeader>& headers, uint32_t& outConflictCount, AddRow&& addRow)
+{
+  const Source& baseSource = *sources[0];
+  const Source& oursSource = *sources[1];
+  const Source& theirsSource = *sources[2];
+  const size_t columnCount = headers.size();
+  std::vector<int32_t> cellSources(columnCount);
+  auto hasBadField = [&]() { return baseSource.m_hasBadField || oursSource.m_hasBadField || theirsSource.m_hasBadField; };
+  for (;;)
+  {
+    // Find the lowest key of the current rows
+    const Source* keySource = nullptr;
+    for (const Source* source : sources)
+    {
+      if (source->m_rowIndex < source->GetRowCount() &&
+          (!keySource || source->CompareKeys(source->m_rowIndex, *keySource, keySource->m_rowIndex) < 0))
+      {
+        keySource = source;
+      }
+    }
+    if (!keySource)
+    {
+      break;
+    }
+    const size_t keyRow = keySource->m_rowIndex;
+
+    // Get the rows of each version with the key
+    size_t rows[3] = { c_noRow, c_noRow, c_noRow };
+    for (uint32_t s = 0; s < 3; s++)
+    {
+      Source* source = sources[s];
+      if (source->m_rowIndex < source->GetRowCount() &&
+          source->CompareKeys(source->m_rowIndex, *keySource, keyRow) == 0)
+      {
+        rows[s] = source->m_rowIndex++;
+      }
+    }
+    size_t& baseRow = rows[0];
+    const size_t oursRow = rows[1];
+    const size_t theirsRow = rows[2];
+
+    // Check rows removed on a side
+    if (baseRow != c_noRow && (oursRow == c_noRow || theirsRow == c_noRow))
+    {
+      // Removed on both sides, or removed on one side and not changed on the other
+      const Source& keptSource = oursRow != c_noRow ? oursSource : theirsSource;
+      size_t keptRow = oursRow != c_noRow ? oursRow : theirsRow;
+      bool isSameRow = keptRow == c_noRow || IsSameRow(baseSource, baseRow, keptSource, keptRow);
+      if (hasBadField())
+      {
+        return false;
+      }
+      if (isSameRow)
+      {
+        continue;
+      }
+
+      outConflictCount++;
+      OutputMessage("Conflict: Row {} removed in {} and changed in {}", keySource->GetKeyString(keyRow), oursRow != c_noRow ? "theirs" : "ours", keptSource.m_name);
+
+      // Keep the ours version of the row
+      if (oursRow == c_noRow)
+      {
+        continue;
+      }
+      baseRow = c_noRow;
+    }
+
+    // Merge each cell, taking the side that changed it
+    for (size_t c = 0; c < columnCount; c++)
+    {
+      int32_t mergeSource = 1;
+      bool isTheirsChanged = !Source::IsSameCell(oursSource, oursRow, theirsSource, theirsRow, c) &&
+                             !Source::IsSameCell(baseSource, baseRow, theirsSource, theirsRow, c);
+      bool isOursSame = isTheirsChanged && Source::IsSameCell(baseSource, baseRow, oursSource, oursRow, c);
+      if (hasBadField())
+      {
+        return false;
+      }
+      if (isTheirsChanged)
+      {
+        if (isOursSame)
+        {
+          mergeSource = 2;
+        }
+        else
+        {
+          outConflictCount++;
+          OutputMessage("Conflict: Row {} column {} changed to \"{}\" in ours and \"{}\" in theirs", keySource->GetKeyString(keyRow), headers[c].m_name,
+            oursSource.GetCellString(oursRow, c), theirsSource.GetCellString(theirsRow, c));
+        }
+      }
+
+      // A column that the merged side does not have gets the default value
+      cellSources[c] = sources[mergeSource]->HasCell(rows[mergeSource], c) ? mergeSource : -1;
+    }
+
+    if (!addRow(rows, cellSources))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MergeTables(CSVTable& base, CSVTable& ours, CSVTable& theirs, CSVTable& outTable, uint32_t& outConflictCount)
+{
+  outConflictCount = 0;
+
+  TableMergeSource baseSource;
+  TableMergeSource oursSource;
+  TableMergeSource theirsSource;
+  if (!MergeHeaders(base, ours, theirs, outTable, baseSource, oursSource, theirsSource))
+  {
+    return false;
+  }
+  baseSource.m_table = &base;
+  oursSource.m_table = &ours;
+  theirsSource.m_table = &theirs;
+
+  // Sort the versions by key (usually already sorted, so only a check)
+  bool sorted[3] = {};
+  {
+    std::thread baseThread([&]() { sorted[0] = SortTable(base); });
+    std::thread theirsThread([&]() { sorted[2] = SortTable(theirs); });
+    sorted[1] = SortTable(ours);
+    baseThread.join();
+    theirsThread.join();
+  }
+  if (!sorted[0] || !sorted[1] || !sorted[2])
+  {
+    OutputMessage("Error: Table failed to sort");
+    return false;
+  }
+
+  // The merged table shares the arena of ours, so when the columns match the rows of ours are moved in instead of copied
+  bool moveOursRows = IsSameHeader(outTable, ours);
+  outTable.m_rowData = CSVRows(ours.GetArena());
+  outTable.m_arena = ours.m_arena;
+
+  // Merge join the rows of the versions in key order
+  const size_t columnCount = outTable.m_headerData.size();
+  outTable.m_rowData.reserve(std::max(ours.m_rowData.size(), theirs.m_rowData.size()));
+  TableMergeSource* const sources[] = { &baseSource, &oursSource, &theirsSource };
+  return MergeRows(sources, outTable.m_headerData, outConflictCount,
+    [&](const size_t (&rows)[3], const std::vector<int32_t>& cellSources)
+    {
+      bool isMovedRow = moveOursRows && rows[1] != c_noRow;
+      CSVRow& newRow = isMovedRow ? outTable.m_rowData.emplace_back(std::move(ours.m_rowData[rows[1]])) : outTable.m_rowData.emplace_back(columnCount);
+      for (size_t c = 0; c < columnCount; c++)
+      {
+        if (isMovedRow && cellSources[c] == 1)
+        {
+          continue;
+        }
+        const FieldType* mergeCell = cellSources[c] >= 0 ? sources[cellSources[c]]->GetCell(rows[cellSources[c]], c) : nullptr;
+        CopyField(mergeCell ? *mergeCell : outTable.m_headerData[c].m_type, newRow[c], outTable.GetArena());
+      }
+      return true;
+    });
+}
+
+// Merge the text of the versions into the saved merged table, in the format (eg. newlines) of the ours file
+static bool MergeText(TextMergeSource& base, TextMergeSource& ours, TextMergeSource& theirs, std::string& outFile, uint32_t& outConflictCount)
+{
+  outConflictCount = 0;
+
+  CSVTable headerTable;
+  if (!MergeHeaders(base.m_headerTable, ours.m_headerTable, theirs.m_headerTable, headerTable, base, ours, theirs))
+  {
+    return false;
+  }
+
+  const std::string newLine = GetNewLine(ours.m_fileData);
+  outFile.reserve(ours.m_fileData.size());
+  for (size_t c = 0; c < headerTable.m_headerData.size(); c++)
+  {
+    if (c > 0)
+    {
+      outFile += ",";
+    }
+    outFile += headerTable.m_headerData[c].m_rawField;
+  }
+
+  TextMergeSource* const sources[] = { &base, &ours, &theirs };
+  const bool merged = MergeRows(sources, headerTable.m_headerData, outConflictCount,
+    [&](const size_t (&rows)[3], const std::vector<int32_t>& cellSources)
+    {
+      outFile += newLine;
+      for (size_t c = 0; c < cellSources.size(); c++)
+      {
+        if (c > 0)
+        {
+          outFile += ",";
+        }
+        if (cellSources[c] < 0)
+        {
+          AppendSavedField(headerTable.m_headerData[c].m_type, outFile);
+        }
+        else if (!sources[cellSources[c]]->AppendField(rows[cellSources[c]], c, outFile))
+        {
+          return false;
+        }
+      }
+      return true;
+    });
+
+  // Only end with a newline if the ours file does
+  if (ours.m_fileData.ends_with(newLine))
+  {
+    outFile += newLine;
+  }
+  return merged;
+}
+
+int MergeFiles(const char* basePath, const char* oursPath, const char* theirsPath)
+{
+  // Load the text of the versions in parallel
+  const char* paths[3] = { basePath, oursPath, theirsPath };
+  TextMergeSource texts[3];
+  bool loaded[3] = {};
+  {
+    auto loadText = [&](uint32_t i) { loaded[i] = texts[i].Read(paths[i]); };
+    std::thread baseThread(loadText, 0);
+    std::thread theirsThread(loadText, 2);
+    loadText(1);
+    baseThread.join();
+    theirsThread.join();
+  }
+  for (uint32_t i = 0; i < 3; i++)
+  {
+    if (!loaded[i])
+    {
+      OutputMessage("Error: Reading table {}", paths[i]);
+      return 1;
+    }
+  }
+
+  // Versions in key order (the saved order) are merged from the text, only parsing the fields that are needed.
+  // Otherwise the versions are read as tables to be sorted.
+  std::string outFile;
+  uint32_t conflictCount = 0;
+  if (texts[0].m_isSorted && texts[1].m_isSorted && texts[2].m_isSorted)
+  {
+    if (!MergeText(texts[0], texts[1], texts[2], outFile, conflictCount))
+    {
+      for (uint32_t i = 0; i < 3; i++)
+      {
+        if (texts[i].m_hasBadField)
+        {
+          OutputMessage("Error: Reading table {}", paths[i]);
+        }
+      }
+      return 1;
+    }
+  }
+  else
+  {
+    CSVTable tables[3];
+    {
+      auto loadTable = [&](uint32_t i)
+        {
+          tables[i] = CSVTable(texts[i].m_fileData.size() * 2);
+          loaded[i] = ReadTable(texts[i].m_fileData.c_str(), tables[i]);
+        };
+      std::thread baseThread(loadTable, 0);
+      std::thread theirsThread(loadTable, 2);
+      loadTable(1);
+      baseThread.join();
+      theirsThread.join();
+    }
+    for (uint32_t i = 0; i < 3; i++)
+    {
+      if (!loaded[i])
+      {
+        OutputMessage("Error: Reading table {}", paths[i]);
+        return 1;
+      }
+    }
+
+    CSVTable mergedTable;
+    if (!MergeTables(tables[0], tables[1], tables[2], mergedTable, conflictCount))
+    {
+      return 1;
+    }
+
+    // Save in the format (eg. newlines) of the ours file, that is also the output
+    const std::unordered_map<std::string, CSVTable> noTables;
+    SaveToString(mergedTable, noTables, texts[1].m_fileData, outFile);
+  }
+
+  if (outFile != texts[1].m_fileData &&
+      !WriteFileAtomic(oursPath, outFile))
+  {
+    return 1;
+  }
+
+  if (conflictCount > 0)
+  {
+    OutputMessage("Merge has {} conflicts, the ours values were kept", conflictCount);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "CSVProcessor.h"
+
+// Three-way merge of the versions of a table by the key columns.
+// The tables are sorted by key, then merged in a single pass joining the rows with the same key.
+// Each cell takes the changed side, only cells changed differently on both sides are a conflict (the ours value is kept).
+// outConflictCount is the number of conflicts, each is reported with OutputMessage.
+// The merged table shares the arena of ours and the rows of ours are moved into it.
+bool MergeTables(CSVTable& base, CSVTable& ours, CSVTable& theirs, CSVTable& outTable, uint32_t& outConflictCount);
+
+// Merge the files of a table and write the result to the ours file. Usable as a git merge driver (%O %A %B).
+// Versions in key order are merged from the CSV text, only parsing the keys and the fields that are compared or merged (so a bad field
+// is only reported if it is used). Otherwise the versions are read as tables and merged with MergeTables.
+// Returns 0 on a clean merge, 1 on conflicts or errors.
+int MergeFiles(const char* basePath, const char* oursPath, const char* theirsPath);
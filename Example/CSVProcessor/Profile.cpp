@@ -0,0 +1,294 @@
+#include "Profile.h"
+#include "CSVProcessor.h"
+
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <map>
+#include <new>
+#include <cstdlib>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#include <malloc.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+bool g_profileEnabled = false;
+
+static std::mutex s_profileMutex;
+static std::vector<ProfileEvent> s_profileEvents;
+static std::chrono::steady_clock::time_point s_profileStart;
+static std::atomic<uint32_t> s_profileThreadCount = 0;
+
+static thread_local uint64_t t_allocationCount = 0;
+
+// Count the allocations of each thread by replacing the global new / delete.
+// The hook is opt-in, define CSVPROCESSOR_ALLOCATION_HOOK to get the allocation counts in the profile.
+// It is left out by default so it does not add to the timings, or clash with a program that has its own.
+#ifdef CSVPROCESSOR_ALLOCATION_HOOK
+static constexpr bool c_countAllocations = true;
+
+static void* AllocateCounted(size_t size, size_t alignment)
+{
+  t_allocationCount++;
+  if (size == 0)
+  {
+    size = 1;
+  }
+  while (true)
+  {
+    void* ptr = nullptr;
+    if (alignment == 0)
+    {
+      ptr = std::malloc(size);
+    }
+    else
+    {
+#ifdef _WIN32
+      ptr = _aligned_malloc(size, alignment);
+#else
+      // aligned_alloc wants the size to be a multiple of the alignment
+      ptr = std::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+#endif
+    }
+    if (ptr)
+    {
+      return ptr;
+    }
+    std::new_handler handler = std::get_new_handler();
+    if (!handler)
+    {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+}
+
+static void FreeAligned(void* ptr)
+{
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  std::free(ptr);
+#endif
+}
+
+void* operator new(size_t size) { return AllocateCounted(size, 0); }
+void* operator new[](size_t size) { return AllocateCounted(size, 0); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+
+// Over-aligned types go through the align_val_t forms, they have to be freed with the matching function
+void* operator new(size_t size, std::align_val_t alignment) { return AllocateCounted(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return AllocateCounted(size, static_cast<size_t>(alignment)); }
+void operator delete(void* ptr, std::align_val_t) noexcept { FreeAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { FreeAligned(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { FreeAligned(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { FreeAligned(ptr); }
+#else
+static constexpr bool c_countAllocations = false; // The allocation counts are left out of the output, rather than written as 0
+#endif
+
+uint64_t ProfileThreadAllocations()
+{
+  return t_allocationCount;
+}
+
+// Get the peak resident memory of the process in bytes
+static uint64_t GetPeakRSS()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters = {};
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+  {
+    return counters.PeakWorkingSetSize;
+  }
+  return 0;
+#else
+  rusage usage = {};
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+  {
+    return 0;
+  }
+#ifdef __APPLE__
+  return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+static uint64_t GetProfileTimeNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_profileStart).count();
+}
+
+void ProfileEnable()
+{
+  s_profileStart = std::chrono::steady_clock::now();
+  g_profileEnabled = true;
+}
+
+void ProfileScope::Begin(const char* name, std::string_view table, std::string_view item)
+{
+  static thread_local uint32_t t_threadIndex = s_profileThreadCount++;
+
+  m_isActive = true;
+  m_event.m_name = name;
+  m_event.m_table = table;
+  m_event.m_item = item;
+  m_event.m_threadIndex = t_threadIndex;
+  m_event.m_allocations = t_allocationCount;
+  m_event.m_startNs = GetProfileTimeNs();
+}
+
+void ProfileScope::End()
+{
+  m_event.m_durationNs = GetProfileTimeNs() - m_event.m_startNs;
+  m_event.m_allocations = t_allocationCount - m_event.m_allocations;
+  m_event.m_peakRSS = GetPeakRSS();
+
+  std::lock_guard<std::mutex> lock(s_profileMutex);
+  s_profileEvents.push_back(std::move(m_event));
+}
+
+static void AppendJsonString(std::string_view str, std::string& out)
+{
+  out += '"';
+  for (char c : str)
+  {
+    if (c == '"' || c == '\\')
+    {
+      out += '\\';
+    }
+    out += c;
+  }
+  out += '"';
+}
+
+bool ProfileWriteTrace(const char* path)
+{
+  std::lock_guard<std::mutex> lock(s_profileMutex);
+
+  // Complete events ("ph":"X") with microsecond times
+  std::string json = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  for (size_t i = 0; i < s_profileEvents.size(); i++)
+  {
+    const ProfileEvent& event = s_profileEvents[i];
+
+    std::string name = event.m_name;
+    if (event.m_table.size() > 0)
+    {
+      name += " " + event.m_table;
+    }
+    if (event.m_item.size() > 0)
+    {
+      name += "." + event.m_item;
+    }
+
+    json += "{\"name\": ";
+    AppendJsonString(name, json);
+    json += ", \"cat\": ";
+    AppendJsonString(event.m_name, json);
+    json += std::format(", \"ph\": \"X\", \"pid\": 1, \"tid\": {}, \"ts\": {:.3f}, \"dur\": {:.3f}, \"args\": {{\"table\": ",
+      event.m_threadIndex, event.m_startNs / 1000.0, event.m_durationNs / 1000.0);
+    AppendJsonString(event.m_table, json);
+    json += std::format(", \"bytes\": {}, \"rows\": {}", event.m_bytes, event.m_rows);
+    if (c_countAllocations)
+    {
+      json += std::format(", \"allocations\": {}", event.m_allocations);
+    }
+    json += std::format(", \"peakRSS\": {}}}}}{}\n", event.m_peakRSS, (i + 1 < s_profileEvents.size()) ? "," : "");
+  }
+  json += "]}\n";
+
+  std::ofstream file(path, std::ios::binary);
+  if (!file.is_open() ||
+      !file.write(json.data(), json.size()))
+  {
+    OutputMessage("Error: Unable to write profile trace {}", path);
+    return false;
+  }
+  return true;
+}
+
+void ProfileWriteSummary(uint32_t maxTableCount)
+{
+  struct Total
+  {
+    uint64_t m_count = 0;
+    uint64_t m_durationNs = 0;
+    uint64_t m_bytes = 0;
+    uint64_t m_rows = 0;
+    uint64_t m_allocations = 0;
+  };
+
+  std::lock_guard<std::mutex> lock(s_profileMutex);
+
+  // Get the totals of each phase and of each phase of each table
+  std::map<std::string, Total> phaseTotals;
+  std::map<std::pair<std::string, std::string>, Total> tableTotals;
+  uint64_t peakRSS = 0;
+  for (const ProfileEvent& event : s_profileEvents)
+  {
+    auto addEvent = [&event](Total& total)
+    {
+      total.m_count++;
+      total.m_durationNs += event.m_durationNs;
+      total.m_bytes += event.m_bytes;
+      total.m_rows += event.m_rows;
+      total.m_allocations += event.m_allocations;
+    };
+    addEvent(phaseTotals[event.m_name]);
+    if (event.m_table.size() > 0)
+    {
+      addEvent(tableTotals[{ event.m_name, event.m_table }]);
+    }
+    peakRSS = std::max(peakRSS, event.m_peakRSS);
+  }
+
+  auto writeTotal = [](std::string_view name, const Total& total)
+  {
+    if (c_countAllocations)
+    {
+      OutputMessage("  {:.3f}ms  {}  (calls {}, rows {}, bytes {}, allocations {})", total.m_durationNs / 1000000.0, name, total.m_count, total.m_rows, total.m_bytes, total.m_allocations);
+    }
+    else
+    {
+      OutputMessage("  {:.3f}ms  {}  (calls {}, rows {}, bytes {})", total.m_durationNs / 1000000.0, name, total.m_count, total.m_rows, total.m_bytes);
+    }
+  };
+
+  std::vector<std::pair<std::string, Total>> sorted(phaseTotals.begin(), phaseTotals.end());
+  std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second.m_durationNs > b.second.m_durationNs; });
+  OutputMessage("Profile phases:");
+  for (const auto& [name, total] : sorted)
+  {
+    writeTotal(name, total);
+  }
+
+  sorted.clear();
+  for (const auto& [names, total] : tableTotals)
+  {
+    sorted.emplace_back(names.first + " " + names.second, total);
+  }
+  std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second.m_durationNs > b.second.m_durationNs; });
+  OutputMessage("Slowest table phases:");
+  for (size_t i = 0; i < sorted.size() && i < maxTableCount; i++)
+  {
+    writeTotal(sorted[i].first, sorted[i].second);
+  }
+
+  OutputMessage("Peak memory: {:.1f} MB", peakRSS / (1024.0 * 1024.0));
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Scoped profile timers of the processing phases.
+// Disabled by default, a disabled scope is only a check of a global flag.
+
+struct ProfileEvent
+{
+  const char* m_name = nullptr; // Phase name
+  std::string m_table;          // Table the phase is run on (if any)
+  std::string m_item;           // Item in the table (eg. column name) (if any)
+  uint64_t m_startNs = 0;       // Start time since profiling was enabled
+  uint64_t m_durationNs = 0;    // Wall time of the scope
+  uint64_t m_bytes = 0;         // Bytes processed (if set)
+  uint64_t m_rows = 0;          // Rows processed (if set)
+  uint64_t m_allocations = 0;   // Allocations made on the thread during the scope (with CSVPROCESSOR_ALLOCATION_HOOK)
+  uint64_t m_peakRSS = 0;       // Peak resident memory of the process at the scope end
+  uint32_t m_threadIndex = 0;   // Index of the thread the scope ran on
+};
+
+extern bool g_profileEnabled;
+
+void ProfileEnable();
+uint64_t ProfileThreadAllocations();
+
+class ProfileScope
+{
+public:
+  explicit ProfileScope(const char* name, std::string_view table = std::string_view(), std::string_view item = std::string_view())
+  {
+    if (g_profileEnabled)
+    {
+      Begin(name, table, item);
+    }
+  }
+
+  ~ProfileScope()
+  {
+    if (m_isActive)
+    {
+      End();
+    }
+  }
+
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+  void SetBytes(uint64_t bytes) { m_event.m_bytes = bytes; }
+  void SetRows(uint64_t rows) { m_event.m_rows = rows; }
+
+private:
+  void Begin(const char* name, std::string_view table, std::string_view item);
+  void End();
+
+  bool m_isActive = false;
+  ProfileEvent m_event;
+};
+
+// Write all the recorded events as a Chrome / Perfetto trace JSON file
+bool ProfileWriteTrace(const char* path);
+
+// Output a summary of the total time of each phase and the slowest table phases
+void ProfileWriteSummary(uint32_t maxTableCount = 20);
@@ -0,0 +1,979 @@
+#include "Query.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <map>
+#include <numeric>
+
+// Rows are scanned in batches. Each filter term runs over the whole batch with the comparison type resolved once per batch.
+static constexpr uint32_t s_queryBatchSize = 1024;
+
+// Row index of a source with no row (eg. a missing weak link)
+static constexpr uint32_t s_noRow = UINT32_MAX;
+
+enum class QueryOp
+{
+  Equal,
+  NotEqual,
+  Less,
+  LessEqual,
+  Greater,
+  GreaterEqual,
+  Contains,
+};
+
+enum class QueryAggregate
+{
+  None,
+  Count,
+  Sum,
+  Min,
+  Max,
+  Avg,
+};
+
+struct QueryColumn
+{
+  uint32_t m_source = 0; // Source of the column (0 is the from table, then the joins)
+  uint32_t m_column = 0; // Column in the source table
+
+  bool operator == (const QueryColumn& other) const = default;
+};
+
+// A table in the query, the from table or a table joined along a foreign link
+struct QuerySource
+{
+  std::string m_name;                  // Name the columns are prefixed with (empty for the from table)
+  std::string m_tableName;             // Name of the table
+  const CSVTable* m_table = nullptr;
+  uint32_t m_linkSource = 0;           // Source that holds the link (joins only)
+  uint32_t m_linkColumn = 0;           // First column of the link in the link source (joins only)
+  std::vector<uint32_t> m_linkColumns; // Columns of the link source with the keys of the table (joins only)
+};
+
+struct QueryTerm
+{
+  QueryColumn m_column;
+  QueryOp m_op = QueryOp::Equal;
+  FieldType m_value;                   // Value of the column type to compare with
+};
+
+struct QuerySelect
+{
+  std::string m_name;                  // Name in the result
+  QueryColumn m_column;
+  QueryAggregate m_aggregate = QueryAggregate::None;
+  bool m_hasColumn = true;             // If the column is set (count() has none)
+};
+
+struct QuerySort
+{
+  uint32_t m_select = 0;               // Selected column to sort by
+  bool m_descending = false;
+};
+
+struct Query
+{
+  std::vector<QuerySource> m_sources;
+  std::vector<std::vector<QueryTerm>> m_where; // Or'd groups of and'd terms
+  std::vector<QueryColumn> m_group;
+  std::vector<QuerySelect> m_select;
+  std::vector<QuerySort> m_sort;
+  size_t m_limit = SIZE_MAX;
+  bool m_isAggregate = false;          // If the result is grouped rows
+};
+
+static bool TokenizeQuery(std::string_view query, std::vector<std::string>& outTokens)
+{
+  size_t i = 0;
+  while (i < query.size())
+  {
+    char c = query[i];
+    if (std::isspace((unsigned char)c))
+    {
+      i++;
+    }
+    else if (c == '"' || c == '\'')
+    {
+      // Quoted values keep the quotes so they are never taken as a keyword
+      size_t end = query.find(c, i + 1);
+      if (end == std::string::npos)
+      {
+        OutputMessage("Error: Query has an unterminated string");
+        return false;
+      }
+      outTokens.emplace_back(query.substr(i, end + 1 - i));
+      i = end + 1;
+    }
+    else if (c == ',' || c == '(' || c == ')')
+    {
+      outTokens.emplace_back(1, c);
+      i++;
+    }
+    else if (c == '=' || c == '!' || c == '<' || c == '>')
+    {
+      size_t length = (i + 1 < query.size() && query[i + 1] == '=') ? 2 : 1;
+      outTokens.emplace_back(query.substr(i, length));
+      i += length;
+    }
+    else
+    {
+      size_t start = i;
+      while (i < query.size() &&
+             !std::isspace((unsigned char)query[i]) &&
+             std::string_view(",()=!<>\"'").find(query[i]) == std::string::npos)
+      {
+        i++;
+      }
+      outTokens.emplace_back(query.substr(start, i - start));
+    }
+  }
+  return true;
+}
+
+class QueryParser
+{
+public:
+  QueryParser(const DBTables& db, std::vector<std::string>&& tokens) : m_db(db), m_tokens(std::move(tokens)) {}
+
+  bool Parse(Query& outQuery);
+
+private:
+  bool IsEnd() const { return m_pos >= m_tokens.size(); }
+  std::string_view Peek() const { return IsEnd() ? std::string_view() : std::string_view(m_tokens[m_pos]); }
+  std::string_view Next() { return IsEnd() ? std::string_view() : std::string_view(m_tokens[m_pos++]); }
+  bool Accept(std::string_view token)
+  {
+    if (Peek() == token)
+    {
+      m_pos++;
+      return true;
+    }
+    return false;
+  }
+
+  bool ParseJoin(Query& query);
+  bool ParseTerm(const Query& query, QueryTerm& outTerm);
+  bool ParseSelect(const Query& query, QuerySelect& outSelect);
+  bool ResolveColumn(const Query& query, std::string_view name, QueryColumn& outColumn) const;
+  bool ParseValue(const Query& query, const QueryColumn& column, std::string_view text, FieldType& outValue) const;
+
+  const DBTables& m_db;
+  std::vector<std::string> m_tokens;
+  size_t m_pos = 0;
+};
+
+bool QueryParser::ResolveColumn(const Query& query, std::string_view name, QueryColumn& outColumn) const
+{
+  // Columns of joined tables are prefixed with the join name
+  std::string_view sourceName;
+  std::string_view columnName = name;
+  size_t splitIndex = name.rfind('.');
+  if (splitIndex != std::string_view::npos)
+  {
+    sourceName = name.substr(0, splitIndex);
+    columnName = name.substr(splitIndex + 1);
+  }
+
+  for (uint32_t s = 0; s < query.m_sources.size(); s++)
+  {
+    const QuerySource& source = query.m_sources[s];
+    if (source.m_name != sourceName)
+    {
+      continue;
+    }
+    const std::unordered_map<std::string, uint32_t>& columnIndices = source.m_table->m_schema.m_columnIndices;
+    auto findColumn = columnIndices.find(std::string(columnName));
+    if (findColumn != columnIndices.end())
+    {
+      outColumn.m_source = s;
+      outColumn.m_column = findColumn->second;
+      return true;
+    }
+  }
+
+  OutputMessage("Error: Query has unknown column {}", name);
+  return false;
+}
+
+bool QueryParser::ParseValue(const Query& query, const QueryColumn& column, std::string_view text, FieldType& outValue) const
+{
+  if (text.size() >= 2 && (text[0] == '"' || text[0] == '\''))
+  {
+    text = text.substr(1, text.size() - 2);
+  }
+
+  // Enum columns hold the enum values, so look up the value of an enum name
+  const CSVTable& table = *query.m_sources[column.m_source].m_table;
+  const CSVHeader& header = table.m_headerData[column.m_column];
+  const std::string& lookupTable = table.m_schema.m_columnLinks[column.m_column].m_sourceTable;
+  if (IsEnumTable(lookupTable))
+  {
+    auto findTable = m_db.m_tablesEnumNameSort.find(lookupTable);
+    if (findTable != m_db.m_tablesEnumNameSort.end())
+    {
+      for (const CSVRow& row : findTable->second.m_rowData)
+      {
+        const FieldString* name = std::get_if<FieldString>(&row[0]);
+        if (name && *name == text)
+        {
+          outValue = row[1];
+          return true;
+        }
+      }
+    }
+  }
+
+  if (!ParseField(header.m_type, text, outValue))
+  {
+    OutputMessage("Error: Query value {} is not valid for column {}", text, header.m_name);
+    return false;
+  }
+  return true;
+}
+
+bool QueryParser::ParseJoin(Query& query)
+{
+  // A join of a joined table link is <join>.<link>
+  std::string_view name = Next();
+  std::string_view sourceName;
+  std::string_view linkName = name;
+  size_t splitIndex = name.rfind('.');
+  if (splitIndex != std::string_view::npos)
+  {
+    sourceName = name.substr(0, splitIndex);
+    linkName = name.substr(splitIndex + 1);
+  }
+
+  for (const QuerySource& source : query.m_sources)
+  {
+    if (source.m_name == name)
+    {
+      OutputMessage("Error: Query has duplicate join {}", name);
+      return false;
+    }
+  }
+
+  auto findSource = std::find_if(query.m_sources.begin(), query.m_sources.end(), [sourceName](const QuerySource& source) { return source.m_name == sourceName; });
+  if (findSource == query.m_sources.end())
+  {
+    OutputMessage("Error: Query join {} is not from a joined table", name);
+    return false;
+  }
+  uint32_t linkSource = (uint32_t)(findSource - query.m_sources.begin());
+  const CSVTable& linkTable = *findSource->m_table;
+  std::string linkTableName = findSource->m_tableName;
+
+  // Find the link column, multi key links are found by the base name
+  for (uint32_t c = 0; c < linkTable.m_headerData.size(); c++)
+  {
+    const CSVHeader& header = linkTable.m_headerData[c];
+    if (header.m_foreignTable.size() == 0 ||
+        std::string_view(header.m_name).substr(0, header.m_name.find_first_of(':')) != linkName)
+    {
+      continue;
+    }
+
+    auto findTable = m_db.m_tables.find(header.m_foreignTable);
+    if (findTable == m_db.m_tables.end())
+    {
+      OutputMessage("Error: Table {} has link to unknown table {}", linkTableName, header.m_foreignTable);
+      return false;
+    }
+
+    QuerySource newSource;
+    newSource.m_name = name;
+    newSource.m_tableName = findTable->first;
+    newSource.m_table = &findTable->second;
+    newSource.m_linkSource = linkSource;
+    newSource.m_linkColumn = c;
+    if (!GetLinkColumns(linkTableName, linkTable, c, newSource.m_linkColumns))
+    {
+      return false;
+    }
+    query.m_sources.push_back(std::move(newSource));
+    return true;
+  }
+
+  OutputMessage("Error: Query join {} is not a link column of table {}", name, linkTableName);
+  return false;
+}
+
+bool QueryParser::ParseTerm(const Query& query, QueryTerm& outTerm)
+{
+  if (!ResolveColumn(query, Next(), outTerm.m_column))
+  {
+    return false;
+  }
+
+  std::string_view op = Next();
+  if      (op == "=")        { outTerm.m_op = QueryOp::Equal; }
+  else if (op == "!=")       { outTerm.m_op = QueryOp::NotEqual; }
+  else if (op == "<")        { outTerm.m_op = QueryOp::Less; }
+  else if (op == "<=")       { outTerm.m_op = QueryOp::LessEqual; }
+  else if (op == ">")        { outTerm.m_op = QueryOp::Greater; }
+  else if (op == ">=")       { outTerm.m_op = QueryOp::GreaterEqual; }
+  else if (op == "contains") { outTerm.m_op = QueryOp::Contains; }
+  else
+  {
+    OutputMessage("Error: Query has unknown operator {}", op);
+    return false;
+  }
+
+  if (IsEnd())
+  {
+    OutputMessage("Error: Query term is missing a value");
+    return false;
+  }
+  if (!ParseValue(query, outTerm.m_column, Next(), outTerm.m_value))
+  {
+    return false;
+  }
+
+  if (outTerm.m_op == QueryOp::Contains &&
+      !std::holds_alternative<FieldString>(outTerm.m_value))
+  {
+    OutputMessage("Error: Query contains is only for string columns");
+    return false;
+  }
+  return true;
+}
+
+bool QueryParser::ParseSelect(const Query& query, QuerySelect& outSelect)
+{
+  std::string_view name = Next();
+  if (!Accept("("))
+  {
+    outSelect.m_name = name;
+    return ResolveColumn(query, name, outSelect.m_column);
+  }
+
+  if      (name == "count") { outSelect.m_aggregate = QueryAggregate::Count; }
+  else if (name == "sum")   { outSelect.m_aggregate = QueryAggregate::Sum; }
+  else if (name == "min")   { outSelect.m_aggregate = QueryAggregate::Min; }
+  else if (name == "max")   { outSelect.m_aggregate = QueryAggregate::Max; }
+  else if (name == "avg")   { outSelect.m_aggregate = QueryAggregate::Avg; }
+  else
+  {
+    OutputMessage("Error: Query has unknown aggregate {}", name);
+    return false;
+  }
+
+  // Only count() has no column
+  outSelect.m_name = name;
+  outSelect.m_name += "(";
+  outSelect.m_hasColumn = !Accept(")");
+  if (outSelect.m_hasColumn)
+  {
+    std::string_view columnName = Next();
+    if (!ResolveColumn(query, columnName, outSelect.m_column))
+    {
+      return false;
+    }
+    if (!Accept(")"))
+    {
+      OutputMessage("Error: Query aggregate {} is missing )", name);
+      return false;
+    }
+    outSelect.m_name += columnName;
+  }
+  else if (outSelect.m_aggregate != QueryAggregate::Count)
+  {
+    OutputMessage("Error: Query aggregate {} needs a column", name);
+    return false;
+  }
+  outSelect.m_name += ")";
+
+  // Sum and average are of number columns
+  if (outSelect.m_aggregate == QueryAggregate::Sum ||
+      outSelect.m_aggregate == QueryAggregate::Avg)
+  {
+    const CSVHeader& header = query.m_sources[outSelect.m_column.m_source].m_table->m_headerData[outSelect.m_column.m_column];
+    if (std::holds_alternative<FieldString>(header.m_type))
+    {
+      OutputMessage("Error: Query aggregate {} is not of a number column", outSelect.m_name);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool QueryParser::Parse(Query& outQuery)
+{
+  if (!Accept("from") || IsEnd())
+  {
+    OutputMessage("Error: Query needs to start with from <table>");
+    return false;
+  }
+
+  std::string_view tableName = Next();
+  auto findTable = m_db.m_tables.find(std::string(tableName));
+  if (findTable == m_db.m_tables.end())
+  {
+    OutputMessage("Error: Query has unknown table {}", tableName);
+    return false;
+  }
+  QuerySource& fromSource = outQuery.m_sources.emplace_back();
+  fromSource.m_tableName = tableName;
+  fromSource.m_table = &findTable->second;
+
+  if (Accept("join"))
+  {
+    do
+    {
+      if (!ParseJoin(outQuery))
+      {
+        return false;
+      }
+    } while (Accept(","));
+  }
+
+  if (Accept("where"))
+  {
+    outQuery.m_where.emplace_back();
+    for (;;)
+    {
+      QueryTerm& term = outQuery.m_where.back().emplace_back();
+      if (!ParseTerm(outQuery, term))
+      {
+        return false;
+      }
+      if (Accept("or"))
+      {
+        outQuery.m_where.emplace_back();
+      }
+      else if (!Accept("and"))
+      {
+        break;
+      }
+    }
+  }
+
+  if (Accept("group"))
+  {
+    outQuery.m_isAggregate = true;
+    do
+    {
+      if (!ResolveColumn(outQuery, Next(), outQuery.m_group.emplace_back()))
+      {
+        return false;
+      }
+    } while (Accept(","));
+  }
+
+  if (Accept("select") && !Accept("*"))
+  {
+    do
+    {
+      QuerySelect& select = outQuery.m_select.emplace_back();
+      if (!ParseSelect(outQuery, select))
+      {
+        return false;
+      }
+      outQuery.m_isAggregate |= (select.m_aggregate != QueryAggregate::None);
+    } while (Accept(","));
+  }
+
+  // Default to all the columns of the from table
+  if (outQuery.m_select.empty())
+  {
+    for (uint32_t c = 0; c < fromSource.m_table->m_headerData.size(); c++)
+    {
+      QuerySelect& select = outQuery.m_select.emplace_back();
+      select.m_name = fromSource.m_table->m_headerData[c].m_name;
+      select.m_column.m_column = c;
+    }
+  }
+
+  // When grouped, the other selected columns need to be group columns
+  if (outQuery.m_isAggregate)
+  {
+    for (const QuerySelect& select : outQuery.m_select)
+    {
+      if (select.m_aggregate == QueryAggregate::None &&
+          std::find(outQuery.m_group.begin(), outQuery.m_group.end(), select.m_column) == outQuery.m_group.end())
+      {
+        OutputMessage("Error: Query column {} needs to be grouped or in an aggregate", select.m_name);
+        return false;
+      }
+    }
+  }
+
+  if (Accept("sort"))
+  {
+    do
+    {
+      // Sort columns are the selected columns
+      QuerySelect sortSelect;
+      if (!ParseSelect(outQuery, sortSelect))
+      {
+        return false;
+      }
+      auto findSelect = std::find_if(outQuery.m_select.begin(), outQuery.m_select.end(), [&sortSelect](const QuerySelect& select) { return select.m_name == sortSelect.m_name; });
+      if (findSelect == outQuery.m_select.end())
+      {
+        OutputMessage("Error: Query sort column {} is not selected", sortSelect.m_name);
+        return false;
+      }
+
+      QuerySort& sort = outQuery.m_sort.emplace_back();
+      sort.m_select = (uint32_t)(findSelect - outQuery.m_select.begin());
+      sort.m_descending = Accept("desc");
+      if (!sort.m_descending)
+      {
+        Accept("asc");
+      }
+    } while (Accept(","));
+  }
+
+  if (Accept("limit"))
+  {
+    std::string_view limit = Next();
+    if (std::from_chars(limit.data(), limit.data() + limit.size(), outQuery.m_limit).ec != std::errc())
+    {
+      OutputMessage("Error: Query has bad limit {}", limit);
+      return false;
+    }
+  }
+
+  if (!IsEnd())
+  {
+    OutputMessage("Error: Query has unexpected {}", Peek());
+    return false;
+  }
+  return true;
+}
+
+static int CompareLinkKeys(const CSVRow& a, const CSVRow& b, const std::vector<uint32_t>& linkColumns)
+{
+  for (uint32_t column : linkColumns)
+  {
+    if (a[column] < b[column])
+    {
+      return -1;
+    }
+    if (a[column] != b[column])
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Get the rows of each joined table for a batch of rows of the from table
+static void JoinBatch(const Query& query, size_t start, uint32_t count, std::vector<std::vector<uint32_t>>& sourceRows)
+{
+  std::iota(sourceRows[0].begin(), sourceRows[0].begin() + count, (uint32_t)start);
+
+  for (uint32_t s = 1; s < query.m_sources.size(); s++)
+  {
+    const QuerySource& source = query.m_sources[s];
+    const CSVTable& table = *source.m_table;
+    const CSVTable& linkTable = *query.m_sources[source.m_linkSource].m_table;
+    const std::vector<uint32_t>& linkRows = sourceRows[source.m_linkSource];
+    std::vector<uint32_t>& rows = sourceRows[s];
+
+    // Validated tables have the linked row of each row
+    if (source.m_linkColumn < linkTable.m_linkRows.size() &&
+        linkTable.m_linkRows[source.m_linkColumn].size() == linkTable.m_rowData.size())
+    {
+      const std::vector<uint32_t>& linkedRows = linkTable.m_linkRows[source.m_linkColumn];
+      for (uint32_t k = 0; k < count; k++)
+      {
+        rows[k] = linkRows[k] == s_noRow ? s_noRow : linkedRows[linkRows[k]];
+      }
+      continue;
+    }
+
+    auto KeyLess = [&table, &source](const CSVRow& a, const CSVRow& b)
+      {
+        for (uint32_t i = 0; i < table.m_keyColumns.size(); i++)
+        {
+          const FieldType& aVal = a[table.m_keyColumns[i]];
+          const FieldType& bVal = b[source.m_linkColumns[i]];
+          if (aVal < bVal)
+          {
+            return true;
+          }
+          if (aVal != bVal)
+          {
+            break;
+          }
+        }
+        return false;
+      };
+
+    // The linked table is sorted by key, so each row is found with a binary search.
+    // When the link values are in order (eg. the link is the first key of the from table) each search starts from the previous row found.
+    size_t searchStart = 0;
+    const CSVRow* prevRow = nullptr;
+    for (uint32_t k = 0; k < count; k++)
+    {
+      if (linkRows[k] == s_noRow)
+      {
+        rows[k] = s_noRow;
+        continue;
+      }
+
+      const CSVRow& row = linkTable.m_rowData[linkRows[k]];
+      if (!prevRow || CompareLinkKeys(row, *prevRow, source.m_linkColumns) < 0)
+      {
+        searchStart = 0;
+      }
+      prevRow = &row;
+
+      auto findRow = std::lower_bound(table.m_rowData.begin() + searchStart, table.m_rowData.end(), row, KeyLess);
+      searchStart = findRow - table.m_rowData.begin();
+      if (findRow == table.m_rowData.end())
+      {
+        rows[k] = s_noRow;
+        continue;
+      }
+
+      // Check the keys are equal (not less is already known)
+      bool isEqual = true;
+      for (uint32_t i = 0; i < table.m_keyColumns.size(); i++)
+      {
+        if ((*findRow)[table.m_keyColumns[i]] != row[source.m_linkColumns[i]])
+        {
+          isEqual = false;
+          break;
+        }
+      }
+      rows[k] = isEqual ? (uint32_t)searchStart : s_noRow;
+    }
+  }
+}
+
+// Remove the batch rows in the selection that do not pass the term
+static void FilterBatch(const Query& query, const QueryTerm& term, const std::vector<std::vector<uint32_t>>& sourceRows, std::vector<uint32_t>& selection)
+{
+  const CSVTable& table = *query.m_sources[term.m_column.m_source].m_table;
+  const std::vector<uint32_t>& rows = sourceRows[term.m_column.m_source];
+  const uint32_t column = term.m_column.m_column;
+
+  std::visit([&]<typename T>(const T& value)
+  {
+    auto Filter = [&](auto compare)
+      {
+        size_t outCount = 0;
+        for (uint32_t k : selection)
+        {
+          uint32_t row = rows[k];
+          if (row == s_noRow)
+          {
+            continue;
+          }
+          const T* field = std::get_if<T>(&table.m_rowData[row][column]);
+          if (field && compare(*field, value))
+          {
+            selection[outCount++] = k;
+          }
+        }
+        selection.resize(outCount);
+      };
+
+    switch (term.m_op)
+    {
+    case QueryOp::Equal:        Filter(std::equal_to<T>()); break;
+    case QueryOp::NotEqual:     Filter(std::not_equal_to<T>()); break;
+    case QueryOp::Less:         Filter(std::less<T>()); break;
+    case QueryOp::LessEqual:    Filter(std::less_equal<T>()); break;
+    case QueryOp::Greater:      Filter(std::greater<T>()); break;
+    case QueryOp::GreaterEqual: Filter(std::greater_equal<T>()); break;
+    case QueryOp::Contains:
+      if constexpr (std::is_same_v<T, FieldString>)
+      {
+        Filter([](const T& a, const T& b) { return a.find(b) != std::string::npos; });
+      }
+      break;
+    }
+  }, term.m_value);
+}
+
+static double GetNumberValue(const FieldType& field)
+{
+  return std::visit([]<typename T>(const T& e)
+  {
+    if constexpr (std::is_same_v<T, FieldString>)
+    {
+      return 0.0;
+    }
+    else
+    {
+      return (double)e;
+    }
+  }, field);
+}
+
+// Accumulated values of an aggregate for a group
+struct QueryAccumulator
+{
+  uint64_t m_count = 0;
+  double m_sum = 0.0;
+  const FieldType* m_min = nullptr;
+  const FieldType* m_max = nullptr;
+};
+
+bool RunQuery(std::string_view queryString, const DBTables& db, CSVTable& outTable)
+{
+  std::vector<std::string> tokens;
+  if (!TokenizeQuery(queryString, tokens))
+  {
+    return false;
+  }
+
+  Query query;
+  QueryParser parser(db, std::move(tokens));
+  if (!parser.Parse(query))
+  {
+    return false;
+  }
+
+  // Without sorting or grouping the scan can stop at the limit
+  const size_t sourceCount = query.m_sources.size();
+  const size_t scanLimit = (query.m_sort.empty() && !query.m_isAggregate) ? query.m_limit : SIZE_MAX;
+
+  // Scan the from table in batches, storing the row of each source for each matching row
+  const CSVTable& fromTable = *query.m_sources[0].m_table;
+  std::vector<std::vector<uint32_t>> sourceRows(sourceCount, std::vector<uint32_t>(s_queryBatchSize));
+  std::vector<uint32_t> selection;
+  std::vector<uint32_t> termSelection;
+  std::vector<uint8_t> isSelected(s_queryBatchSize);
+  std::vector<uint32_t> resultRows;
+  size_t resultCount = 0;
+  for (size_t start = 0; start < fromTable.m_rowData.size() && resultCount < scanLimit; start += s_queryBatchSize)
+  {
+    uint32_t count = (uint32_t)std::min<size_t>(s_queryBatchSize, fromTable.m_rowData.size() - start);
+    JoinBatch(query, start, count, sourceRows);
+
+    selection.resize(count);
+    std::iota(selection.begin(), selection.end(), 0);
+    if (query.m_where.size() == 1)
+    {
+      for (const QueryTerm& term : query.m_where[0])
+      {
+        FilterBatch(query, term, sourceRows, selection);
+      }
+    }
+    else if (query.m_where.size() > 1)
+    {
+      // Or the selections of each group of terms
+      std::fill(isSelected.begin(), isSelected.end(), 0);
+      for (const std::vector<QueryTerm>& terms : query.m_where)
+      {
+        termSelection = selection;
+        for (const QueryTerm& term : terms)
+        {
+          FilterBatch(query, term, sourceRows, termSelection);
+        }
+        for (uint32_t k : termSelection)
+        {
+          isSelected[k] = 1;
+        }
+      }
+      selection.resize(0);
+      for (uint32_t k = 0; k < count; k++)
+      {
+        if (isSelected[k])
+        {
+          selection.push_back(k);
+        }
+      }
+    }
+
+    for (uint32_t k : selection)
+    {
+      if (resultCount >= scanLimit)
+      {
+        break;
+      }
+      for (size_t s = 0; s < sourceCount; s++)
+      {
+        resultRows.push_back(sourceRows[s][k]);
+      }
+      resultCount++;
+    }
+  }
+
+  auto GetField = [&](size_t resultRow, const QueryColumn& column) -> const FieldType*
+    {
+      uint32_t row = resultRows[resultRow * sourceCount + column.m_source];
+      return (row == s_noRow) ? nullptr : &query.m_sources[column.m_source].m_table->m_rowData[row][column.m_column];
+    };
+
+  // Result header, enum columns keep the link so they are saved as the enum names
+  std::vector<bool> hasNull(query.m_select.size());
+  outTable.m_headerData.resize(query.m_select.size());
+  for (size_t i = 0; i < query.m_select.size(); i++)
+  {
+    const QuerySelect& select = query.m_select[i];
+    CSVHeader& header = outTable.m_headerData[i];
+    header.m_rawField = select.m_name;
+    header.m_name = select.m_name;
+    switch (select.m_aggregate)
+    {
+    case QueryAggregate::Count: header.m_type = FieldType(uint64_t(0)); break;
+    case QueryAggregate::Sum:
+    case QueryAggregate::Avg:   header.m_type = FieldType(0.0); break;
+    default:
+      {
+        const CSVTable& sourceTable = *query.m_sources[select.m_column.m_source].m_table;
+        const CSVHeader& sourceHeader = sourceTable.m_headerData[select.m_column.m_column];
+        header.m_type = sourceHeader.m_type;
+        if (IsEnumTable(sourceTable.m_schema.m_columnLinks[select.m_column.m_column].m_sourceTable))
+        {
+          header.m_name = sourceHeader.m_name;
+          header.m_foreignTable = sourceHeader.m_foreignTable;
+        }
+      }
+      break;
+    }
+  }
+
+  auto SetField = [&](const FieldType* field, size_t column, FieldType& outField)
+    {
+      if (field)
+      {
+        CopyField(*field, outField, outTable.GetArena());
+      }
+      else
+      {
+        hasNull[column] = true;
+        outField.emplace<FieldString>(outTable.GetArena());
+      }
+    };
+
+  if (!query.m_isAggregate)
+  {
+    outTable.m_rowData.resize(resultCount);
+    for (size_t r = 0; r < resultCount; r++)
+    {
+      CSVRow& row = outTable.m_rowData[r];
+      row.resize(query.m_select.size());
+      for (size_t i = 0; i < query.m_select.size(); i++)
+      {
+        SetField(GetField(r, query.m_select[i].m_column), i, row[i]);
+      }
+    }
+  }
+  else
+  {
+    // Find the group of each row, groups are in the order of the group column values
+    std::map<std::vector<FieldType>, uint32_t> groupIndices;
+    std::vector<size_t> groupFirstRows;
+    std::vector<QueryAccumulator> accumulators;
+    std::vector<FieldType> groupKey(query.m_group.size());
+    static const FieldType s_nullField;
+    for (size_t r = 0; r < resultCount; r++)
+    {
+      for (size_t g = 0; g < query.m_group.size(); g++)
+      {
+        const FieldType* field = GetField(r, query.m_group[g]);
+        groupKey[g] = field ? *field : s_nullField;
+      }
+      auto [findGroup, isNew] = groupIndices.try_emplace(groupKey, (uint32_t)groupFirstRows.size());
+      if (isNew)
+      {
+        groupFirstRows.push_back(r);
+        accumulators.resize(accumulators.size() + query.m_select.size());
+      }
+
+      QueryAccumulator* groupAccumulators = &accumulators[findGroup->second * query.m_select.size()];
+      for (size_t i = 0; i < query.m_select.size(); i++)
+      {
+        const QuerySelect& select = query.m_select[i];
+        if (select.m_aggregate == QueryAggregate::None)
+        {
+          continue;
+        }
+
+        QueryAccumulator& accumulator = groupAccumulators[i];
+        const FieldType* field = select.m_hasColumn ? GetField(r, select.m_column) : nullptr;
+        if (!select.m_hasColumn)
+        {
+          accumulator.m_count++;
+        }
+        else if (field)
+        {
+          accumulator.m_count++;
+          accumulator.m_sum += GetNumberValue(*field);
+          if (!accumulator.m_min || *field < *accumulator.m_min)
+          {
+            accumulator.m_min = field;
+          }
+          if (!accumulator.m_max || *accumulator.m_max < *field)
+          {
+            accumulator.m_max = field;
+          }
+        }
+      }
+    }
+
+    outTable.m_rowData.resize(groupIndices.size());
+    size_t outRow = 0;
+    for (const auto& [key, groupIndex] : groupIndices)
+    {
+      CSVRow& row = outTable.m_rowData[outRow++];
+      row.resize(query.m_select.size());
+      const QueryAccumulator* groupAccumulators = &accumulators[groupIndex * query.m_select.size()];
+      for (size_t i = 0; i < query.m_select.size(); i++)
+      {
+        const QueryAccumulator& accumulator = groupAccumulators[i];
+        switch (query.m_select[i].m_aggregate)
+        {
+        case QueryAggregate::None:  SetField(GetField(groupFirstRows[groupIndex], query.m_select[i].m_column), i, row[i]); break;
+        case QueryAggregate::Count: row[i] = accumulator.m_count; break;
+        case QueryAggregate::Sum:   row[i] = accumulator.m_sum; break;
+        case QueryAggregate::Min:   SetField(accumulator.m_min, i, row[i]); break;
+        case QueryAggregate::Max:   SetField(accumulator.m_max, i, row[i]); break;
+        case QueryAggregate::Avg:
+          if (accumulator.m_count > 0)
+          {
+            row[i] = accumulator.m_sum / (double)accumulator.m_count;
+          }
+          else
+          {
+            SetField(nullptr, i, row[i]);
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  // Columns with missing values are saved as the raw values
+  for (size_t i = 0; i < hasNull.size(); i++)
+  {
+    if (hasNull[i])
+    {
+      outTable.m_headerData[i].m_name = outTable.m_headerData[i].m_rawField;
+      outTable.m_headerData[i].m_foreignTable.clear();
+    }
+  }
+
+  if (query.m_sort.size() > 0)
+  {
+    std::stable_sort(outTable.m_rowData.begin(), outTable.m_rowData.end(),
+      [&query](const CSVRow& a, const CSVRow& b)
+      {
+        for (const QuerySort& sort : query.m_sort)
+        {
+          const FieldType& aVal = a[sort.m_select];
+          const FieldType& bVal = b[sort.m_select];
+          if (aVal != bVal)
+          {
+            return sort.m_descending ? (bVal < aVal) : (aVal < bVal);
+          }
+        }
+        return false;
+      });
+  }
+
+  if (outTable.m_rowData.size() > query.m_limit)
+  {
+    outTable.m_rowData.resize(query.m_limit);
+  }
+  return true;
+}
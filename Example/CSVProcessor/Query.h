@@ -0,0 +1,20 @@
+#pragma once
+#include "CSVProcessor.h"
+
+// Query over the loaded and sorted DB tables, eg.
+//   from Weapons join Type where Damage >= 10 and Type.Name != Dagger select Name, Damage, Type.Name sort Damage desc limit 10
+//   from Weapons group Type select Type, count(), avg(Damage) sort count() desc
+//
+// Clauses (in this order, all but from are optional):
+//   from <table>                 Table to scan
+//   join <link>, ...             Follow a foreign link column of the table, or of a joined table (eg. Weapon.Type).
+//                                The columns of the linked table are then <link>.<column>
+//   where <column> <op> <value>  Filter with = != < <= > >= contains, combined with and / or (and binds tighter).
+//                                Enum columns can be compared with the enum names. Values with spaces go in quotes.
+//   group <column>, ...          Group the rows, the select then holds the group columns and aggregates
+//   select <column>, ...         Columns and the aggregates count() count(<column>) sum() min() max() avg() (default all columns of the table)
+//   sort <column> [desc], ...    Sort by the selected columns
+//   limit <count>                Maximum number of rows
+//
+// The result is returned as a table that can be saved with SaveToString.
+bool RunQuery(std::string_view query, const DBTables& db, CSVTable& outTable);
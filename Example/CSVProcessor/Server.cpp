@@ -0,0 +1,860 @@
+#include "Server.h"
+#include "Query.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <span>
+#include <tuple>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// How often the DB files are checked for changes
+static constexpr std::chrono::milliseconds s_refreshInterval(250);
+// Longest request line, a client sending more is disconnected
+static constexpr size_t s_maxRequestSize = 1 << 20;
+
+// Collect the output messages into a string while in scope (from the worker threads of a load too)
+class MessageCapture
+{
+public:
+  explicit MessageCapture(std::string& outMessages) : m_prevFunc(OutputMessageFunc)
+  {
+    OutputMessageFunc = [this, &outMessages](const char* msg)
+    {
+      std::lock_guard lock(m_mutex);
+      outMessages += msg;
+      outMessages += '\n';
+    };
+  }
+  MessageCapture(const MessageCapture&) = delete;
+  MessageCapture& operator=(const MessageCapture&) = delete;
+  ~MessageCapture() { OutputMessageFunc = m_prevFunc; }
+
+private:
+  std::function<void(const char*)> m_prevFunc;
+  std::mutex m_mutex;
+};
+
+struct FileState
+{
+  std::filesystem::file_time_type m_writeTime;
+  uintmax_t m_size = 0;
+
+  bool operator==(const FileState& other) const = default;
+};
+
+// Split a request into its values on spaces, keeping the spaces in quoted values.
+// outCommandEnd is set to the offset in the line after the first value.
+static bool SplitRequest(std::string_view line, std::vector<std::string>& outValues, size_t& outCommandEnd)
+{
+  outCommandEnd = 0;
+  size_t i = 0;
+  while (i < line.size())
+  {
+    if (std::isspace((unsigned char)line[i]))
+    {
+      i++;
+    }
+    else if (line[i] == '"')
+    {
+      size_t end = line.find('"', i + 1);
+      if (end == std::string::npos)
+      {
+        OutputMessage("Error: Request has an unterminated string");
+        return false;
+      }
+      outValues.emplace_back(line.substr(i + 1, end - i - 1));
+      i = end + 1;
+    }
+    else
+    {
+      size_t start = i;
+      while (i < line.size() && !std::isspace((unsigned char)line[i]))
+      {
+        i++;
+      }
+      outValues.emplace_back(line.substr(start, i - start));
+    }
+
+    // A value always ends after the start of the line, so the offset is only set once
+    if (outValues.size() == 1 && outCommandEnd == 0)
+    {
+      outCommandEnd = i;
+    }
+  }
+  return true;
+}
+
+// Compare the first key columns of a row against key values
+static int CompareKeys(const CSVTable& table, const CSVRow& row, const std::vector<FieldType>& keys)
+{
+  for (size_t i = 0; i < keys.size(); i++)
+  {
+    const FieldType& value = row[table.m_keyColumns[i]];
+    if (value < keys[i])
+    {
+      return -1;
+    }
+    if (value != keys[i])
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+class DBServer
+{
+public:
+  DBServer(const char* dirPath, const std::function<bool(const char*, DBTables&)>& loadDB) : m_dirPath(dirPath), m_loadDB(loadDB) {}
+
+  // Read the tables of the changed files again, or load the whole DB. Returns true if anything was read.
+  bool Refresh(bool forceLoad);
+
+  // Output the result of the last refresh
+  void OutputStatus() const;
+
+  // Run a request line, returning the response
+  std::string HandleRequest(std::string_view line);
+
+private:
+  void ScanFiles(std::map<std::string, FileState>& outFiles) const;
+  bool ReloadTables(const std::unordered_set<std::string>& tableNames, bool& outNeedsLoad);
+  void BuildLinkIndex();
+
+  bool RunRequest(std::string_view line, std::string& outBody);
+  const CSVTable* FindTable(const std::string& tableName) const;
+  bool ParseKeys(const std::string& tableName, const CSVTable& table, std::span<const std::string> values, std::vector<FieldType>& outKeys) const;
+  bool FindRow(const std::string& tableName, const CSVTable& table, std::span<const std::string> values, size_t& outRow) const;
+  void AppendKeyText(const CSVTable& table, size_t row, std::string& outText) const;
+  void SaveRows(const CSVTable& table, size_t start, size_t end, std::string& outBody) const;
+
+  std::string m_dirPath;
+  std::function<bool(const char*, DBTables&)> m_loadDB;
+
+  DBTables m_db;
+  bool m_isValid = false;
+  std::string m_status;                      // What the last refresh read
+  std::string m_loadMessages;                // Errors of the last refresh, returned to the requests while the DB is not valid
+  std::map<std::string, FileState> m_files;  // State of each CSV file when it was last read
+
+  // A link from a row of a table to a row of the linked table
+  struct LinkSource
+  {
+    uint32_t m_row = 0;                        // Row of the linked table
+    const std::string* m_tableName = nullptr;  // Table with the link
+    uint32_t m_column = 0;                     // Column of the link
+    uint32_t m_sourceRow = 0;                  // Row with the link
+  };
+
+  // The links to each table, sorted by the linked row then by the table name, column and row of the link
+  std::unordered_map<std::string, std::vector<LinkSource>> m_linkIndex;
+};
+
+void DBServer::ScanFiles(std::map<std::string, FileState>& outFiles) const
+{
+  std::error_code error;
+  for (std::filesystem::directory_iterator iter(m_dirPath, error), end; !error && iter != end; iter.increment(error))
+  {
+    const std::filesystem::directory_entry& entry = *iter;
+    std::string extension = entry.path().extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    if (extension != ".csv" || !entry.is_regular_file(error))
+    {
+      continue;
+    }
+
+    FileState& state = outFiles[entry.path().string()];
+    state.m_writeTime = entry.last_write_time(error);
+    state.m_size = entry.file_size(error);
+  }
+}
+
+bool DBServer::Refresh(bool forceLoad)
+{
+  std::map<std::string, FileState> files;
+  ScanFiles(files);
+  if (!forceLoad && files == m_files)
+  {
+    return false;
+  }
+
+  // Added or removed files change the tables, and a changed enum table changes the values of the tables that link to it
+  bool needsLoad = forceLoad || !m_isValid || files.size() != m_files.size();
+  std::unordered_set<std::string> changedTables;
+  for (const auto& [path, state] : files)
+  {
+    auto findFile = m_files.find(path);
+    if (findFile == m_files.end())
+    {
+      needsLoad = true;
+    }
+    else if (findFile->second != state)
+    {
+      std::string tableName = GetTableName(path);
+      needsLoad |= IsEnumTable(tableName);
+      changedTables.insert(tableName);
+    }
+  }
+  m_files = std::move(files);
+
+  // The file states are from before the read, so a file changed while reading is read again on the next refresh
+  m_loadMessages.clear();
+  MessageCapture capture(m_loadMessages);
+  if (!needsLoad)
+  {
+    m_isValid = ReloadTables(changedTables, needsLoad);
+    m_status = std::format("Reloaded {} tables", changedTables.size());
+  }
+  if (needsLoad)
+  {
+    m_db = DBTables();
+    m_isValid = m_loadDB(m_dirPath.c_str(), m_db);
+    m_status = std::format("Loaded {} tables", m_db.m_tables.size());
+  }
+  BuildLinkIndex();
+  return true;
+}
+
+bool DBServer::ReloadTables(const std::unordered_set<std::string>& tableNames, bool& outNeedsLoad)
+{
+  // The headers of the tables are kept, as the types of the tables that link to them were resolved from them
+  std::unordered_map<std::string, std::vector<std::string>> oldHeaders;
+  for (const std::string& tableName : tableNames)
+  {
+    for (const CSVHeader& header : m_db.m_tables.at(tableName).m_headerData)
+    {
+      oldHeaders[tableName].push_back(header.m_rawField);
+    }
+    auto findShards = m_db.m_tableShards.find(tableName);
+    if (findShards != m_db.m_tableShards.end())
+    {
+      findShards->second.resize(std::count_if(m_db.m_csvFilePaths.begin(), m_db.m_csvFilePaths.end(),
+        [&tableName](const std::filesystem::path& path) { return GetTableName(path) == tableName; }));
+    }
+  }
+
+  for (size_t fileIndex = 0; fileIndex < m_db.m_csvFilePaths.size(); fileIndex++)
+  {
+    const std::filesystem::path& path = m_db.m_csvFilePaths[fileIndex];
+    if (tableNames.contains(GetTableName(path)) &&
+        (!ReadToString(path, m_db.m_csvFileData[fileIndex]) || !ParseDBTable(fileIndex, m_db)))
+    {
+      return false;
+    }
+  }
+
+  for (const std::string& tableName : tableNames)
+  {
+    if (m_db.m_tableShards.contains(tableName) && !MergeTableShards(tableName, m_db))
+    {
+      return false;
+    }
+
+    const std::vector<CSVHeader>& headers = m_db.m_tables.at(tableName).m_headerData;
+    const std::vector<std::string>& oldHeader = oldHeaders.at(tableName);
+    bool isSame = headers.size() == oldHeader.size();
+    for (size_t h = 0; isSame && h < headers.size(); h++)
+    {
+      isSame = headers[h].m_rawField == oldHeader[h];
+    }
+    if (!isSame)
+    {
+      outNeedsLoad = true;
+      return false;
+    }
+  }
+
+  if (!BuildSchema(m_db.m_tables))
+  {
+    return false;
+  }
+  for (const std::string& tableName : tableNames)
+  {
+    CSVTable& table = m_db.m_tables.at(tableName);
+    if (!ResolveTableLinkTypes(tableName, table, m_db))
+    {
+      return false;
+    }
+    if (!SortTable(table))
+    {
+      OutputMessage("Error: Table {} failed to sort", tableName);
+      return false;
+    }
+  }
+
+  // The link rows of the tables that link to a changed table index into its rows, so they are validated again too
+  for (auto& [tableName, table] : m_db.m_tables)
+  {
+    bool isChanged = tableNames.contains(tableName);
+    for (const CSVHeader& header : table.m_headerData)
+    {
+      isChanged |= tableNames.contains(header.m_foreignTable);
+    }
+    if (isChanged && !ValidateTable(tableName, table, m_db.m_tables))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Index the link rows of the tables by the linked table, so a links request does not scan every table
+void DBServer::BuildLinkIndex()
+{
+  m_linkIndex.clear();
+  if (!m_isValid)
+  {
+    return;
+  }
+
+  for (const auto& [tableName, table] : m_db.m_tables)
+  {
+    for (uint32_t h = 0; h < table.m_linkRows.size(); h++)
+    {
+      const std::vector<uint32_t>& linkRows = table.m_linkRows[h];
+      if (linkRows.size() == 0)
+      {
+        continue;
+      }
+      std::vector<LinkSource>& links = m_linkIndex[table.m_headerData[h].m_foreignTable];
+      for (uint32_t r = 0; r < linkRows.size(); r++)
+      {
+        links.push_back(LinkSource{ linkRows[r], &tableName, h, r });
+      }
+    }
+  }
+
+  for (auto& [tableName, links] : m_linkIndex)
+  {
+    std::sort(links.begin(), links.end(), [](const LinkSource& a, const LinkSource& b)
+    {
+      if (a.m_row != b.m_row)
+      {
+        return a.m_row < b.m_row;
+      }
+      int compare = a.m_tableName->compare(*b.m_tableName);
+      if (compare != 0)
+      {
+        return compare < 0;
+      }
+      return std::tie(a.m_column, a.m_sourceRow) < std::tie(b.m_column, b.m_sourceRow);
+    });
+  }
+}
+
+void DBServer::OutputStatus() const
+{
+  if (m_isValid)
+  {
+    OutputMessage("{}", m_status);
+    return;
+  }
+
+  OutputMessage("Error: The DB is not valid");
+  std::string_view messages = m_loadMessages;
+  while (messages.size() > 0)
+  {
+    size_t end = messages.find('\n');
+    OutputMessage("{}", messages.substr(0, end));
+    messages.remove_prefix(std::min(end + 1, messages.size()));
+  }
+}
+
+const CSVTable* DBServer::FindTable(const std::string& tableName) const
+{
+  auto findTable = m_db.m_tables.find(tableName);
+  if (findTable == m_db.m_tables.end())
+  {
+    OutputMessage("Error: Unknown table {}", tableName);
+    return nullptr;
+  }
+  return &findTable->second;
+}
+
+bool DBServer::ParseKeys(const std::string& tableName, const CSVTable& table, std::span<const std::string> values, std::vector<FieldType>& outKeys) const
+{
+  if (values.size() > table.m_keyColumns.size())
+  {
+    OutputMessage("Error: Table {} has {} key columns", tableName, table.m_keyColumns.size());
+    return false;
+  }
+
+  for (size_t i = 0; i < values.size(); i++)
+  {
+    uint32_t column = table.m_keyColumns[i];
+    const CSVHeader& header = table.m_headerData[column];
+    const std::string& sourceTable = table.m_schema.m_columnLinks[column].m_sourceTable;
+    FieldType& key = outKeys.emplace_back();
+
+    // Enum keys are stored as the values, found from the names
+    if (IsEnumTable(sourceTable))
+    {
+      const CSVTable& enumTable = m_db.m_tablesEnumNameSort.at(sourceTable);
+      FieldType name = FieldString(values[i]);
+      auto findRow = std::lower_bound(enumTable.m_rowData.begin(), enumTable.m_rowData.end(), name,
+        [](const CSVRow& a, const FieldType& b) { return a[0] < b; });
+      if (findRow == enumTable.m_rowData.end() || (*findRow)[0] != name)
+      {
+        OutputMessage("Error: Unknown {} value {} for column {}", sourceTable, values[i], header.m_name);
+        return false;
+      }
+      key = (*findRow)[1];
+    }
+    else if (!ParseField(header.m_type, values[i], key))
+    {
+      OutputMessage("Error: Invalid key {} for column {}", values[i], header.m_name);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DBServer::FindRow(const std::string& tableName, const CSVTable& table, std::span<const std::string> values, size_t& outRow) const
+{
+  if (values.size() != table.m_keyColumns.size())
+  {
+    OutputMessage("Error: Table {} has {} key columns", tableName, table.m_keyColumns.size());
+    return false;
+  }
+  std::vector<FieldType> keys;
+  if (!ParseKeys(tableName, table, values, keys))
+  {
+    return false;
+  }
+
+  auto findRow = std::lower_bound(table.m_rowData.begin(), table.m_rowData.end(), keys,
+    [&table](const CSVRow& a, const std::vector<FieldType>& b) { return CompareKeys(table, a, b) < 0; });
+  if (findRow == table.m_rowData.end() || CompareKeys(table, *findRow, keys) != 0)
+  {
+    OutputMessage("Error: Table {} has no row with the keys", tableName);
+    return false;
+  }
+  outRow = std::distance(table.m_rowData.begin(), findRow);
+  return true;
+}
+
+void DBServer::AppendKeyText(const CSVTable& table, size_t row, std::string& outText) const
+{
+  // A table without keys has the row number instead
+  if (table.m_keyColumns.size() == 0)
+  {
+    outText += std::format("#{}", row);
+    return;
+  }
+
+  for (uint32_t column : table.m_keyColumns)
+  {
+    if (column != table.m_keyColumns[0])
+    {
+      outText += ' ';
+    }
+
+    // Enum keys are output as the names, the enum tables are sorted by value
+    const FieldType* field = &table.m_rowData[row][column];
+    const std::string& sourceTable = table.m_schema.m_columnLinks[column].m_sourceTable;
+    if (IsEnumTable(sourceTable))
+    {
+      const CSVTable& enumTable = m_db.m_tables.at(sourceTable);
+      auto findRow = std::lower_bound(enumTable.m_rowData.begin(), enumTable.m_rowData.end(), *field,
+        [](const CSVRow& a, const FieldType& b) { return a[1] < b; });
+      if (findRow != enumTable.m_rowData.end() && (*findRow)[1] == *field)
+      {
+        field = &(*findRow)[0];
+      }
+    }
+    AppendToString(*field, outText);
+  }
+}
+
+void DBServer::SaveRows(const CSVTable& table, size_t start, size_t end, std::string& outBody) const
+{
+  // The rows are saved as the table would be, with the links of the table to save the enum names
+  CSVTable result;
+  result.m_headerData = table.m_headerData;
+  result.m_keyColumns = table.m_keyColumns;
+  result.m_schema = table.m_schema;
+  result.m_rowData.reserve(end - start);
+  for (size_t r = start; r < end; r++)
+  {
+    const CSVRow& srcRow = table.m_rowData[r];
+    CSVRow& row = result.m_rowData.emplace_back();
+    row.resize(srcRow.size());
+    for (size_t i = 0; i < srcRow.size(); i++)
+    {
+      CopyField(srcRow[i], row[i], result.GetArena());
+    }
+  }
+  SaveToString(result, m_db.m_tables, "\n", outBody);
+}
+
+bool DBServer::RunRequest(std::string_view line, std::string& outBody)
+{
+  std::vector<std::string> values;
+  size_t commandEnd = 0;
+  if (!SplitRequest(line, values, commandEnd))
+  {
+    return false;
+  }
+  if (values.size() == 0)
+  {
+    OutputMessage("Error: Empty request");
+    return false;
+  }
+  const std::string& command = values[0];
+
+  if (command == "validate")
+  {
+    Refresh(false);
+  }
+  if (!m_isValid)
+  {
+    OutputMessage("Error: The DB is not valid");
+    return false;
+  }
+  if (command == "validate")
+  {
+    outBody = std::format("Valid {} tables\n", m_db.m_tables.size());
+    return true;
+  }
+
+  if (command == "query")
+  {
+    // The query is the rest of the line, with its quotes
+    CSVTable result;
+    if (!RunQuery(line.substr(commandEnd), m_db, result))
+    {
+      return false;
+    }
+    SaveToString(result, m_db.m_tables, "\n", outBody);
+    return true;
+  }
+
+  if ((command == "lookup" || command == "links") && values.size() >= 2)
+  {
+    const CSVTable* table = FindTable(values[1]);
+    size_t row = 0;
+    if (!table ||
+        !FindRow(values[1], *table, std::span<const std::string>(values).subspan(2), row))
+    {
+      return false;
+    }
+
+    if (command == "lookup")
+    {
+      SaveRows(*table, row, row + 1, outBody);
+      return true;
+    }
+
+    // Rows of all the tables with a link to the table that found the row on validation, in table name order
+    CSVTable result;
+    for (const char* name : { "Table", "Column", "Keys" })
+    {
+      CSVHeader& header = result.m_headerData.emplace_back();
+      header.m_rawField = name;
+      header.m_name = name;
+      header.m_type = FieldType(FieldString());
+    }
+    auto findLinks = m_linkIndex.find(values[1]);
+    if (findLinks != m_linkIndex.end())
+    {
+      const std::vector<LinkSource>& links = findLinks->second;
+      auto start = std::partition_point(links.begin(), links.end(), [row](const LinkSource& link) { return link.m_row < row; });
+      std::string keyText;
+      for (auto link = start; link != links.end() && link->m_row == row; ++link)
+      {
+        const CSVTable& linkTable = m_db.m_tables.at(*link->m_tableName);
+        keyText.clear();
+        AppendKeyText(linkTable, link->m_sourceRow, keyText);
+        CSVRow& resultRow = result.m_rowData.emplace_back();
+        resultRow.resize(3);
+        resultRow[0].emplace<FieldString>(*link->m_tableName, result.GetArena());
+        resultRow[1].emplace<FieldString>(linkTable.m_headerData[link->m_column].m_name, result.GetArena());
+        resultRow[2].emplace<FieldString>(keyText, result.GetArena());
+      }
+    }
+    SaveToString(result, m_db.m_tables, "\n", outBody);
+    return true;
+  }
+
+  if (command == "range" && values.size() == 4)
+  {
+    const CSVTable* table = FindTable(values[1]);
+    std::vector<FieldType> fromKey;
+    std::vector<FieldType> toKey;
+    if (!table ||
+        !ParseKeys(values[1], *table, std::span<const std::string>(values).subspan(2, 1), fromKey) ||
+        !ParseKeys(values[1], *table, std::span<const std::string>(values).subspan(3, 1), toKey))
+    {
+      return false;
+    }
+
+    // The rows are sorted by the first key
+    auto start = std::partition_point(table->m_rowData.begin(), table->m_rowData.end(),
+      [table, &fromKey](const CSVRow& row) { return CompareKeys(*table, row, fromKey) < 0; });
+    auto end = std::partition_point(start, table->m_rowData.end(),
+      [table, &toKey](const CSVRow& row) { return CompareKeys(*table, row, toKey) <= 0; });
+    SaveRows(*table, start - table->m_rowData.begin(), end - table->m_rowData.begin(), outBody);
+    return true;
+  }
+
+  OutputMessage("Error: Unknown request {} (lookup <table> <key> ..., range <table> <from> <to>, links <table> <key> ..., query <query>, validate)", command);
+  return false;
+}
+
+std::string DBServer::HandleRequest(std::string_view line)
+{
+  // Errors of the request are returned instead of the rows, with the errors of the load if the DB is not valid
+  std::string body;
+  std::string messages;
+  bool result = false;
+  {
+    MessageCapture capture(messages);
+    result = RunRequest(line, body);
+  }
+  if (!result)
+  {
+    body = std::move(messages);
+    if (!m_isValid)
+    {
+      body += m_loadMessages;
+    }
+  }
+
+  std::string response = std::format("{} {}\n", result ? "OK" : "ERROR", body.size());
+  response += body;
+  return response;
+}
+
+#ifndef _WIN32
+
+static volatile std::sig_atomic_t s_stopServer = 0;
+
+static void StopServer(int)
+{
+  s_stopServer = 1;
+}
+
+struct ServerClient
+{
+  int m_fd = -1;
+  std::string m_input;       // Received bytes up to the end of the last complete request
+  std::string m_output;      // Responses to send
+  size_t m_outputOffset = 0; // Bytes of the responses sent
+  bool m_isClosing = false;  // Closed by the client, or failed. Removed once the responses are sent.
+};
+
+// Receive the requests of a client and add the responses. Returns false if the client is closed or failed.
+static bool ReadClient(DBServer& server, ServerClient& client)
+{
+  char buffer[65536];
+  while (true)
+  {
+    ssize_t count = recv(client.m_fd, buffer, sizeof(buffer), 0);
+    if (count == 0)
+    {
+      return false;
+    }
+    if (count < 0)
+    {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    client.m_input.append(buffer, count);
+
+    size_t lineStart = 0;
+    size_t lineEnd = 0;
+    while ((lineEnd = client.m_input.find('\n', lineStart)) != std::string::npos)
+    {
+      std::string_view line = std::string_view(client.m_input).substr(lineStart, lineEnd - lineStart);
+      if (line.ends_with('\r'))
+      {
+        line.remove_suffix(1);
+      }
+      if (line.size() > 0)
+      {
+        client.m_output += server.HandleRequest(line);
+      }
+      lineStart = lineEnd + 1;
+    }
+    client.m_input.erase(0, lineStart);
+    if (client.m_input.size() > s_maxRequestSize)
+    {
+      return false;
+    }
+  }
+}
+
+// Send the pending responses of a client. Returns false if the client failed.
+static bool WriteClient(ServerClient& client)
+{
+  while (client.m_outputOffset < client.m_output.size())
+  {
+    ssize_t count = send(client.m_fd, client.m_output.data() + client.m_outputOffset, client.m_output.size() - client.m_outputOffset, 0);
+    if (count < 0)
+    {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    client.m_outputOffset += count;
+  }
+  client.m_output.clear();
+  client.m_outputOffset = 0;
+  return true;
+}
+
+static bool SetNonBlocking(int fd)
+{
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+int ServeDB(const char* dirPath, const char* socketPath, const std::function<bool(const char*, DBTables&)>& loadDB)
+{
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (std::strlen(socketPath) >= sizeof(address.sun_path))
+  {
+    OutputMessage("Error: Socket path is too long {}", socketPath);
+    return 1;
+  }
+  std::strcpy(address.sun_path, socketPath);
+
+  // Replace the socket of a server that was not shut down, but never another file
+  std::error_code error;
+  if (std::filesystem::exists(socketPath, error))
+  {
+    if (!std::filesystem::is_socket(socketPath, error))
+    {
+      OutputMessage("Error: {} exists and is not a socket", socketPath);
+      return 1;
+    }
+    std::filesystem::remove(socketPath, error);
+  }
+
+  DBServer server(dirPath, loadDB);
+  server.Refresh(true);
+  server.OutputStatus();
+
+  int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenFd < 0 ||
+      bind(listenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(listenFd, SOMAXCONN) != 0 ||
+      !SetNonBlocking(listenFd))
+  {
+    OutputMessage("Error: Unable to listen on {} ({})", socketPath, std::strerror(errno));
+    if (listenFd >= 0)
+    {
+      close(listenFd);
+    }
+    return 1;
+  }
+
+  // Stop on Ctrl+C or a terminate, removing the socket. A client that disconnects while sent to is only an error.
+  struct sigaction stopAction = {};
+  stopAction.sa_handler = StopServer;
+  sigaction(SIGINT, &stopAction, nullptr);
+  sigaction(SIGTERM, &stopAction, nullptr);
+  std::signal(SIGPIPE, SIG_IGN);
+  OutputMessage("Serving {} on {}", dirPath, socketPath);
+
+  // All the clients are served by this thread, each request takes the tables as they are
+  std::vector<ServerClient> clients;
+  std::vector<pollfd> pollFds;
+  std::chrono::steady_clock::time_point lastRefresh = std::chrono::steady_clock::now();
+  while (!s_stopServer)
+  {
+    pollFds.clear();
+    pollFds.push_back({ listenFd, POLLIN, 0 });
+    for (const ServerClient& client : clients)
+    {
+      short events = client.m_output.size() > 0 ? (POLLIN | POLLOUT) : POLLIN;
+      pollFds.push_back({ client.m_fd, events, 0 });
+    }
+    if (poll(pollFds.data(), pollFds.size(), static_cast<int>(s_refreshInterval.count())) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      OutputMessage("Error: Server poll failed ({})", std::strerror(errno));
+      break;
+    }
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - lastRefresh >= s_refreshInterval)
+    {
+      if (server.Refresh(false))
+      {
+        server.OutputStatus();
+      }
+      lastRefresh = now;
+    }
+
+    for (size_t c = 0; c < clients.size(); c++)
+    {
+      ServerClient& client = clients[c];
+      short events = pollFds[c + 1].revents;
+      if ((events & (POLLIN | POLLHUP | POLLERR)) && !ReadClient(server, client))
+      {
+        client.m_isClosing = true;
+      }
+      if (!WriteClient(client))
+      {
+        client.m_output.clear();
+        client.m_isClosing = true;
+      }
+    }
+    std::erase_if(clients, [](const ServerClient& client)
+    {
+      if (client.m_isClosing && client.m_output.size() == 0)
+      {
+        close(client.m_fd);
+        return true;
+      }
+      return false;
+    });
+
+    if (pollFds[0].revents & POLLIN)
+    {
+      int clientFd = -1;
+      while ((clientFd = accept(listenFd, nullptr, nullptr)) >= 0)
+      {
+        if (!SetNonBlocking(clientFd))
+        {
+          close(clientFd);
+          continue;
+        }
+        clients.emplace_back().m_fd = clientFd;
+      }
+    }
+  }
+
+  for (const ServerClient& client : clients)
+  {
+    close(client.m_fd);
+  }
+  close(listenFd);
+  std::filesystem::remove(socketPath, error);
+  return 0;
+}
+
+#else
+
+int ServeDB(const char* dirPath, const char* socketPath, const std::function<bool(const char*, DBTables&)>& loadDB)
+{
+  OutputMessage("Error: The server is only supported on Linux and macOS");
+  return 1;
+}
+
+#endif
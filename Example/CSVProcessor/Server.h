@@ -0,0 +1,15 @@
+#pragma once
+#include "CSVProcessor.h"
+
+// Resident server of the validated DB, so tools can look up a few rows without loading the tables each time.
+// Listens on a Unix domain socket for requests of a line each (values with spaces go in quotes):
+//   lookup <table> <key> ...      The row with the keys, in key column order (keys linking to an enum table by the enum name)
+//   range <table> <from> <to>     The rows with the first key from <from> to <to> inclusive
+//   links <table> <key> ...       The rows of other tables that link to the row, as Table,Column,Keys
+//   query <query>                 A query, as run by CSVProcessor query
+//   validate                      Pick up the changed files now and report if the tables are valid
+// Each response is a line "OK <size>" or "ERROR <size>", then <size> bytes of the rows as CSV or the error messages.
+//
+// Changed files are picked up between requests. Only the changed tables are read, sorted and validated again (and the
+// tables that link to them). Added or removed files, a changed enum table or a changed header loads the DB with loadDB.
+int ServeDB(const char* dirPath, const char* socketPath, const std::function<bool(const char*, DBTables&)>& loadDB);
@@ -0,0 +1,154 @@
+#include "TaskGraph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+TaskGraph::TaskID TaskGraph::AddTask(std::function<bool()> func)
+{
+  Task& task = m_tasks.emplace_back();
+  task.m_func = std::move(func);
+  return static_cast<TaskID>(m_tasks.size() - 1);
+}
+
+void TaskGraph::AddDependency(TaskID task, TaskID dependency)
+{
+  m_tasks[dependency].m_dependents.push_back(task);
+  m_tasks[task].m_dependencyCount++;
+}
+
+// The tasks ready to run on a worker. The owner takes from the back, other workers steal from the front.
+struct WorkerQueue
+{
+  std::mutex m_mutex;
+  std::deque<TaskGraph::TaskID> m_tasks;
+};
+
+bool TaskGraph::Run(uint32_t threadCount)
+{
+  if (m_tasks.size() == 0)
+  {
+    return true;
+  }
+  if (threadCount == 0)
+  {
+    threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  threadCount = static_cast<uint32_t>(std::min<size_t>(threadCount, m_tasks.size()));
+
+  std::unique_ptr<std::atomic<uint32_t>[]> waitCounts = std::make_unique<std::atomic<uint32_t>[]>(m_tasks.size());
+  std::unique_ptr<WorkerQueue[]> queues = std::make_unique<WorkerQueue[]>(threadCount);
+  std::atomic<size_t> queuedCount = 0;   // Tasks in the queues
+  std::atomic<size_t> finishedCount = 0; // Tasks run or skipped after a failure
+  std::atomic<bool> failed = false;
+
+  // Idle workers sleep until a task is queued or all tasks are finished
+  std::mutex wakeMutex;
+  std::condition_variable wake;
+
+  // Start with the tasks without dependencies spread over the workers
+  uint32_t startWorker = 0;
+  for (TaskID t = 0; t < m_tasks.size(); t++)
+  {
+    waitCounts[t] = m_tasks[t].m_dependencyCount;
+    if (m_tasks[t].m_dependencyCount == 0)
+    {
+      queues[startWorker].m_tasks.push_back(t);
+      startWorker = (startWorker + 1) % threadCount;
+      queuedCount++;
+    }
+  }
+
+  auto popTask = [&](uint32_t worker, TaskID& outTask)
+  {
+    {
+      WorkerQueue& queue = queues[worker];
+      std::lock_guard lock(queue.m_mutex);
+      if (queue.m_tasks.size() > 0)
+      {
+        outTask = queue.m_tasks.back();
+        queue.m_tasks.pop_back();
+        return true;
+      }
+    }
+    for (uint32_t i = 1; i < threadCount; i++)
+    {
+      WorkerQueue& queue = queues[(worker + i) % threadCount];
+      std::lock_guard lock(queue.m_mutex);
+      if (queue.m_tasks.size() > 0)
+      {
+        outTask = queue.m_tasks.front();
+        queue.m_tasks.pop_front();
+        return true;
+      }
+    }
+    return false;
+  };
+
+  auto worker = [&](uint32_t workerIndex)
+  {
+    WorkerQueue& ownQueue = queues[workerIndex];
+    while (finishedCount < m_tasks.size())
+    {
+      TaskID taskID = 0;
+      if (!popTask(workerIndex, taskID))
+      {
+        std::unique_lock lock(wakeMutex);
+        wake.wait(lock, [&]() { return queuedCount > 0 || finishedCount == m_tasks.size(); });
+        continue;
+      }
+      queuedCount--;
+
+      // After a failure the remaining tasks are skipped, but still release their dependents so every task finishes
+      Task& task = m_tasks[taskID];
+      if (!failed && !task.m_func())
+      {
+        failed = true;
+      }
+
+      size_t readyCount = 0;
+      for (TaskID dependent : task.m_dependents)
+      {
+        if (--waitCounts[dependent] == 0)
+        {
+          queuedCount++;
+          std::lock_guard lock(ownQueue.m_mutex);
+          ownQueue.m_tasks.push_back(dependent);
+          readyCount++;
+        }
+      }
+      bool isLast = ++finishedCount == m_tasks.size();
+
+      // Taking the lock before notifying means a worker can not miss the wake between its check and its wait
+      if (readyCount > 0 || isLast)
+      {
+        std::lock_guard lock(wakeMutex);
+        if (isLast || readyCount > 1)
+        {
+          wake.notify_all();
+        }
+        else
+        {
+          wake.notify_one();
+        }
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(threadCount - 1);
+  for (uint32_t t = 1; t < threadCount; t++)
+  {
+    threads.emplace_back(worker, t);
+  }
+  worker(0);
+  for (std::thread& thread : threads)
+  {
+    thread.join();
+  }
+  return !failed;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// A graph of tasks run on a pool of worker threads. Each task runs as soon as the tasks it depends on have finished,
+// so the steps of different tables overlap instead of each step waiting for every table.
+// A worker runs the newest task it made ready first (the data it just used is still in cache), and steals the
+// oldest task of another worker when it has none.
+class TaskGraph
+{
+public:
+  using TaskID = uint32_t;
+
+  // Add a task. Returning false stops the tasks that have not started, and Run returns false.
+  TaskID AddTask(std::function<bool()> func);
+
+  // The task only runs after the dependency has finished
+  void AddDependency(TaskID task, TaskID dependency);
+
+  // Run all the tasks, on the hardware threads if threadCount is 0. The calling thread is one of the workers.
+  bool Run(uint32_t threadCount = 0);
+
+private:
+  struct Task
+  {
+    std::function<bool()> m_func;
+    std::vector<TaskID> m_dependents; // Tasks that wait on this task
+    uint32_t m_dependencyCount = 0;   // Number of tasks this task waits on
+  };
+  std::vector<Task> m_tasks;
+};
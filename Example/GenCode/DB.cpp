@@ -1,6 +1,8 @@
 // Generated Database file - do not edit manually
 #include "DB.h"
 
+#include <algorithm>
+
 const char* DB::to_string(WeaponTypes value)
 {
   switch (value)
@@ -52,6 +54,72 @@ bool DB::DB::Find(std::string_view name, WeaponTypes type, SpecialWeapons::ID& _
   return true;
 }
 
+bool DB::DB::LowerBound(std::string_view name, WeaponTypes type, SpecialWeapons::ID& _ret) const
+{
+  auto _searchLowerBound = std::lower_bound(SpecialWeaponsValues.begin(), SpecialWeaponsValues.end(), 0, [&](const SpecialWeapons& left, int)
+  {
+    return (left.Name < name) ||
+           (left.Name == name && left.Type < type);
+  });
+  _ret = SpecialWeapons::ID((uint32_t)std::distance(SpecialWeaponsValues.begin(), _searchLowerBound));
+  return _searchLowerBound != SpecialWeaponsValues.end();
+}
+
+uint32_t DB::DB::FindBatch(std::span<const SpecialWeapons::Key> keys, std::span<SpecialWeapons::ID> _ret) const
+{
+  uint32_t _found = 0;
+  BatchLowerBound(SpecialWeaponsValues, std::min(keys.size(), _ret.size()), [&](const SpecialWeapons& left, size_t _keyIndex)
+  {
+    const SpecialWeapons::Key& key = keys[_keyIndex];
+    return (left.Name < key.Name) ||
+           (left.Name == key.Name && left.Type < key.Type);
+  },
+  [&](size_t _keyIndex, uint32_t _index)
+  {
+    const SpecialWeapons::Key& key = keys[_keyIndex];
+    if (_index == SpecialWeaponsValues.size() ||
+        SpecialWeaponsValues[_index].Name != key.Name ||
+        SpecialWeaponsValues[_index].Type != key.Type)
+    {
+      _ret[_keyIndex] = SpecialWeapons::ID(0);
+      return;
+    }
+    _ret[_keyIndex] = SpecialWeapons::ID(_index);
+    _found++;
+  });
+  return _found;
+}
+
+bool DB::DB::EqualRange(std::string_view name, WeaponTypes type, IDRange<SpecialWeapons>& _ret) const
+{
+  auto _searchLowerBound = std::lower_bound(SpecialWeaponsValues.begin(), SpecialWeaponsValues.end(), 0, [&](const SpecialWeapons& left, int)
+  {
+    return (left.Name < name) ||
+           (left.Name == name && left.Type < type);
+  });
+  auto _searchUpperBound = std::upper_bound(_searchLowerBound, SpecialWeaponsValues.end(), 0, [&](int, const SpecialWeapons& right)
+  {
+    return (name < right.Name) ||
+           (name == right.Name && type < right.Type);
+  });
+  _ret = IDRange<SpecialWeapons>((uint32_t)std::distance(SpecialWeaponsValues.begin(), _searchLowerBound), (uint32_t)std::distance(SpecialWeaponsValues.begin(), _searchUpperBound));
+  return _searchLowerBound != _searchUpperBound;
+}
+
+bool DB::DB::PrefixRange(std::string_view name, IDRange<SpecialWeapons>& _ret) const
+{
+  auto _searchLowerBound = std::lower_bound(SpecialWeaponsValues.begin(), SpecialWeaponsValues.end(), 0, [&](const SpecialWeapons& left, int)
+  {
+    return (left.Name < name);
+  });
+  auto _searchUpperBound = std::upper_bound(_searchLowerBound, SpecialWeaponsValues.end(), 0, [&](int, const SpecialWeapons& right)
+  {
+    return (name < right.Name);
+  });
+  _ret = IDRange<SpecialWeapons>((uint32_t)std::distance(SpecialWeaponsValues.begin(), _searchLowerBound), (uint32_t)std::distance(SpecialWeaponsValues.begin(), _searchUpperBound));
+  return _searchLowerBound != _searchUpperBound;
+}
+
 bool DB::DB::Find(std::string_view name, Weapons::ID& _ret) const
 {
   auto _searchLowerBound = std::lower_bound(WeaponsValues.begin(), WeaponsValues.end(), 0, [&](const Weapons& left, int)
@@ -68,6 +136,53 @@ bool DB::DB::Find(std::string_view name, Weapons::ID& _ret) const
   return true;
 }
 
+bool DB::DB::LowerBound(std::string_view name, Weapons::ID& _ret) const
+{
+  auto _searchLowerBound = std::lower_bound(WeaponsValues.begin(), WeaponsValues.end(), 0, [&](const Weapons& left, int)
+  {
+    return (left.Name < name);
+  });
+  _ret = Weapons::ID((uint32_t)std::distance(WeaponsValues.begin(), _searchLowerBound));
+  return _searchLowerBound != WeaponsValues.end();
+}
+
+uint32_t DB::DB::FindBatch(std::span<const Weapons::Key> keys, std::span<Weapons::ID> _ret) const
+{
+  uint32_t _found = 0;
+  BatchLowerBound(WeaponsValues, std::min(keys.size(), _ret.size()), [&](const Weapons& left, size_t _keyIndex)
+  {
+    const Weapons::Key& key = keys[_keyIndex];
+    return (left.Name < key.Name);
+  },
+  [&](size_t _keyIndex, uint32_t _index)
+  {
+    const Weapons::Key& key = keys[_keyIndex];
+    if (_index == WeaponsValues.size() ||
+        WeaponsValues[_index].Name != key.Name)
+    {
+      _ret[_keyIndex] = Weapons::ID(0);
+      return;
+    }
+    _ret[_keyIndex] = Weapons::ID(_index);
+    _found++;
+  });
+  return _found;
+}
+
+bool DB::DB::EqualRange(std::string_view name, IDRange<Weapons>& _ret) const
+{
+  auto _searchLowerBound = std::lower_bound(WeaponsValues.begin(), WeaponsValues.end(), 0, [&](const Weapons& left, int)
+  {
+    return (left.Name < name);
+  });
+  auto _searchUpperBound = std::upper_bound(_searchLowerBound, WeaponsValues.end(), 0, [&](int, const Weapons& right)
+  {
+    return (name < right.Name);
+  });
+  _ret = IDRange<Weapons>((uint32_t)std::distance(WeaponsValues.begin(), _searchLowerBound), (uint32_t)std::distance(WeaponsValues.begin(), _searchUpperBound));
+  return _searchLowerBound != _searchUpperBound;
+}
+
 bool DB::DB::Find(std::string_view name, Characters::ID& _ret) const
 {
   auto _searchLowerBound = std::lower_bound(CharactersValues.begin(), CharactersValues.end(), 0, [&](const Characters& left, int)
@@ -83,3 +198,50 @@ bool DB::DB::Find(std::string_view name, Characters::ID& _ret) const
   _ret = Characters::ID((uint32_t)std::distance(CharactersValues.begin(), _searchLowerBound));
   return true;
 }
+
+bool DB::DB::LowerBound(std::string_view name, Characters::ID& _ret) const
+{
+  auto _searchLowerBound = std::lower_bound(CharactersValues.begin(), CharactersValues.end(), 0, [&](const Characters& left, int)
+  {
+    return (left.Name < name);
+  });
+  _ret = Characters::ID((uint32_t)std::distance(CharactersValues.begin(), _searchLowerBound));
+  return _searchLowerBound != CharactersValues.end();
+}
+
+uint32_t DB::DB::FindBatch(std::span<const Characters::Key> keys, std::span<Characters::ID> _ret) const
+{
+  uint32_t _found = 0;
+  BatchLowerBound(CharactersValues, std::min(keys.size(), _ret.size()), [&](const Characters& left, size_t _keyIndex)
+  {
+    const Characters::Key& key = keys[_keyIndex];
+    return (left.Name < key.Name);
+  },
+  [&](size_t _keyIndex, uint32_t _index)
+  {
+    const Characters::Key& key = keys[_keyIndex];
+    if (_index == CharactersValues.size() ||
+        CharactersValues[_index].Name != key.Name)
+    {
+      _ret[_keyIndex] = Characters::ID(0);
+      return;
+    }
+    _ret[_keyIndex] = Characters::ID(_index);
+    _found++;
+  });
+  return _found;
+}
+
+bool DB::DB::EqualRange(std::string_view name, IDRange<Characters>& _ret) const
+{
+  auto _searchLowerBound = std::lower_bound(CharactersValues.begin(), CharactersValues.end(), 0, [&](const Characters& left, int)
+  {
+    return (left.Name < name);
+  });
+  auto _searchUpperBound = std::upper_bound(_searchLowerBound, CharactersValues.end(), 0, [&](int, const Characters& right)
+  {
+    return (name < right.Name);
+  });
+  _ret = IDRange<Characters>((uint32_t)std::distance(CharactersValues.begin(), _searchLowerBound), (uint32_t)std::distance(CharactersValues.begin(), _searchUpperBound));
+  return _searchLowerBound != _searchUpperBound;
+}
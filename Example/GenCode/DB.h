@@ -6,10 +6,71 @@
 #include <vector>
 #include <string>
 #include <string_view>
+#include <span>
+#include <algorithm>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
 
 namespace DB
 {
 
+// Hint to the CPU that the memory at the address will be read soon
+inline void Prefetch(const void* address)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#elif defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(address);
+#else
+  (void)address;
+#endif
+}
+
+// Lower bound search of many keys over a sorted table.
+// Keys are searched in groups that step through the table together, with the next probe rows of each search
+// prefetched a step ahead so the cache misses of the group overlap instead of being waited on one at a time.
+//  isLess(row, keyIndex) - returns true if the row is ordered before the key
+//  onResult(keyIndex, rowIndex) - called with the lower bound row index of each key
+template<typename T, typename IsLess, typename OnResult>
+void BatchLowerBound(const std::vector<T>& values, size_t keyCount, IsLess isLess, OnResult onResult)
+{
+  constexpr size_t c_groupSize = 16;
+  uint32_t base[c_groupSize];
+
+  const T* data = values.data();
+  for (size_t groupStart = 0; groupStart < keyCount; groupStart += c_groupSize)
+  {
+    const size_t groupCount = std::min(c_groupSize, keyCount - groupStart);
+    std::fill_n(base, groupCount, 0);
+
+    // Branchless binary search, all searches in the group have the same step sizes
+    size_t count = values.size();
+    while (count > 1)
+    {
+      const size_t half = count / 2;
+      const size_t nextHalf = (count - half) / 2;
+      for (size_t i = 0; i < groupCount; i++)
+      {
+        base[i] += isLess(data[base[i] + half], groupStart + i) ? static_cast<uint32_t>(half) : 0;
+        Prefetch(&data[base[i] + nextHalf]);
+      }
+      count -= half;
+    }
+
+    for (size_t i = 0; i < groupCount; i++)
+    {
+      uint32_t index = base[i];
+      if (count > 0 && isLess(data[index], groupStart + i))
+      {
+        index++;
+      }
+      onResult(groupStart + i, index);
+    }
+  }
+}
+
 // Protected DB identifier type. The ID can only be created by the database and helper database methods.
 template<typename T>
 class IDType
@@ -23,7 +84,8 @@ public:
 
 private:
   friend class DB;
-  template<typename T> friend class IterType;
+  template<typename U> friend class IterType;
+  template<typename U> friend class IDRange;
 
   uint32_t m_dbIndex = 0;
 
@@ -74,6 +136,44 @@ private:
   const std::vector<T>& m_dbArray;
 };
 
+// Contiguous range of IDs in a table, returned from the range queries. IDs are in table key order.
+// Usage example for a "SpecialWeapons" table with the keys "Name" and "Type":
+//  DB::IDRange<DB::SpecialWeapons> range;
+//  Database.PrefixRange("Name", range);
+//  for (DB::SpecialWeapons::ID id : range)
+//  {
+//    const DB::SpecialWeapons& Item = Database.Get(id);
+//  }
+template <typename T>
+class IDRange
+{
+public:
+  struct Iterator
+  {
+    constexpr IDType<T> operator *() const { return IDType<T>(m_pos); }
+    constexpr Iterator& operator++() { m_pos++; return *this; }
+    constexpr bool operator!=(const Iterator& val) const { return m_pos != val.m_pos; }
+
+    uint32_t m_pos;
+  };
+
+  constexpr IDRange() = default;
+  constexpr uint32_t size() const { return m_end - m_begin; }
+  constexpr bool empty() const { return m_begin == m_end; }
+  constexpr IDType<T> operator[](uint32_t index) const { return IDType<T>(m_begin + index); }
+
+  constexpr Iterator begin() const { return Iterator{ m_begin }; }
+  constexpr Iterator end() const { return Iterator{ m_end }; }
+
+private:
+  friend class DB;
+
+  uint32_t m_begin = 0;
+  uint32_t m_end = 0;
+
+  constexpr IDRange(uint32_t begin, uint32_t end) : m_begin(begin), m_end(end) {}
+};
+
 enum class WeaponTypes : uint8_t
 {
   None = 0, // A none type of weapon
@@ -89,6 +189,12 @@ public:
   using ID = IDType<SpecialWeapons>;
   using Iter = const IterType<SpecialWeapons>::Data;
 
+  struct Key
+  {
+    std::string_view Name;
+    WeaponTypes Type;
+  };
+
   std::string Name;
   WeaponTypes Type = WeaponTypes::None;
   SpecialWeapons::ID Default;
@@ -100,6 +206,11 @@ public:
   using ID = IDType<Weapons>;
   using Iter = const IterType<Weapons>::Data;
 
+  struct Key
+  {
+    std::string_view Name;
+  };
+
   std::string Name;
   WeaponTypes Type = WeaponTypes::None;
 };
@@ -110,6 +221,11 @@ public:
   using ID = IDType<Characters>;
   using Iter = const IterType<Characters>::Data;
 
+  struct Key
+  {
+    std::string_view Name;
+  };
+
   std::string Name;
   Weapons::ID LeftWeapon;
   Weapons::ID RightWeapon;
@@ -133,9 +249,38 @@ public:
   template<typename T> const T& Get(IDType<T> id) const { return GetTable<T>()[id.m_dbIndex]; }
   template<typename T> bool ToID(uint32_t index, IDType<T>& id) const { if (index < GetTable<T>().size()) { id = IDType<T>(index); return true; } return false; }
 
+  // Read a member from the rows of many IDs. Rows are prefetched ahead of use so the cache misses overlap.
+  // Usage example following links from "Characters" to "Weapons" to the weapon type:
+  //  Database.Gather(characterIds, &DB::Characters::LeftWeapon, weaponIds);
+  //  Database.Gather(weaponIds, &DB::Weapons::Type, weaponTypes);
+  template<typename T, typename M> void Gather(std::span<const std::type_identity_t<IDType<T>>> ids, M T::* member, std::span<std::type_identity_t<M>> out) const
+  {
+    constexpr size_t c_prefetchDistance = 8;
+    const std::vector<T>& table = GetTable<T>();
+    const size_t count = std::min(ids.size(), out.size());
+    for (size_t i = 0; i < count; i++)
+    {
+      if (i + c_prefetchDistance < count)
+      {
+        Prefetch(&table[ids[i + c_prefetchDistance].m_dbIndex]);
+      }
+      out[i] = table[ids[i].m_dbIndex].*member;
+    }
+  }
+
   bool Find(std::string_view name, WeaponTypes type, SpecialWeapons::ID& _ret) const;
+  bool LowerBound(std::string_view name, WeaponTypes type, SpecialWeapons::ID& _ret) const;
+  uint32_t FindBatch(std::span<const SpecialWeapons::Key> keys, std::span<SpecialWeapons::ID> _ret) const;
+  bool EqualRange(std::string_view name, WeaponTypes type, IDRange<SpecialWeapons>& _ret) const;
+  bool PrefixRange(std::string_view name, IDRange<SpecialWeapons>& _ret) const;
   bool Find(std::string_view name, Weapons::ID& _ret) const;
+  bool LowerBound(std::string_view name, Weapons::ID& _ret) const;
+  uint32_t FindBatch(std::span<const Weapons::Key> keys, std::span<Weapons::ID> _ret) const;
+  bool EqualRange(std::string_view name, IDRange<Weapons>& _ret) const;
   bool Find(std::string_view name, Characters::ID& _ret) const;
+  bool LowerBound(std::string_view name, Characters::ID& _ret) const;
+  uint32_t FindBatch(std::span<const Characters::Key> keys, std::span<Characters::ID> _ret) const;
+  bool EqualRange(std::string_view name, IDRange<Characters>& _ret) const;
 
   std::vector<SpecialWeapons> SpecialWeaponsValues;
   std::vector<Weapons> WeaponsValues;